@@ -12,6 +12,13 @@
 #include <argp.h>
 #include <stdbool.h>
 
+/* code generated from intermediate code */
+enum backend {
+	BACKEND_C,
+	BACKEND_X86,
+	BACKEND_LLVM
+};
+
 struct arguments {
 	bool debug;
 	bool tree;
@@ -19,6 +26,16 @@ struct arguments {
 	bool checks;
 	bool assemble;
 	bool compile;
+	bool run;
+	bool interpret;
+	bool time_passes;
+	bool reorder_members;
+	bool register_stats;
+	bool profile_generate;
+	bool profile_use;
+	bool profile;
+	int level;
+	enum backend backend;
 	char *output;
 	char *include;
 	char **input_files;
@@ -0,0 +1,61 @@
+#include <iostream>
+using namespace std;
+
+/* testing naturally aligned locals, globals, and class members */
+class Mixed {
+public:
+	Mixed();
+	char a;
+	int b;
+	bool c;
+	double d;
+	char e;
+	int sum();
+};
+
+char g1;
+int g2;
+bool g3;
+double g4;
+
+int take(char cx, int y, bool z, double w)
+{
+	if (z)
+		if (cx == 'A')
+			return y + 1;
+	return y;
+}
+
+int main(int argc, char *argv[])
+{
+	char c = 'A';
+	bool f = true;
+	int i = 3;
+	Mixed m;
+	Mixed *p = new Mixed();
+	g1 = 'B';
+	g2 = 5;
+	g3 = true;
+	g4 = 2.5;
+	m.b = 7;
+	p->b = 9;
+	cout << take(c, i, f, g4) << ' ' << m.sum() << ' ' << p->sum() << ' ' << g2 << '\n';
+	delete p;
+	return 0;
+}
+
+Mixed::Mixed()
+{
+	a = 'x';
+	b = 1;
+	c = true;
+	d = 0.5;
+	e = 'y';
+}
+
+int Mixed::sum()
+{
+	if (e == 'y')
+		return b + 1;
+	return b;
+}
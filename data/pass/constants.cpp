@@ -0,0 +1,18 @@
+#include <iostream>
+using namespace std;
+
+/* testing merged string literals and immediate float constants */
+double area(double r)
+{
+	return 3.25 * r * r;
+}
+
+int main(int argc, char *argv[])
+{
+	cout << "Hello, world\n";
+	cout << "world\n";
+	cout << "ld\n";
+	cout << "Hello, world\n";
+	cout << area(2.0) << ' ' << 0.5 + 0.25 << '\n';
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include <iostream>
+using namespace std;
+
+/* testing inlining of small procedures */
+int counter;
+
+int square(int x)
+{
+	return x * x;
+}
+
+int larger(int a, int b)
+{
+	if (a > b)
+		return a;
+	return b;
+}
+
+void tick()
+{
+	counter = counter + 1;
+}
+
+int hypot2(int a, int b)
+{
+	tick();
+	return square(a) + square(b);
+}
+
+char grade(int score)
+{
+	switch (score / 10) {
+	case 10:
+	case 9:
+		return 'A';
+	case 8:
+		return 'B';
+	default:
+		return 'C';
+	}
+}
+
+int factorial(int n)
+{
+	if (n < 2)
+		return 1;
+	return n * factorial(n - 1);
+}
+
+int main()
+{
+	counter = 0;
+	int sum = 0;
+	for (int i = 0; i < 5; ++i) {
+		sum = sum + larger(square(i), hypot2(i, 2));
+		tick();
+	}
+	cout << sum << ' ' << counter << '\n';
+	cout << grade(95) << grade(81) << grade(42) << '\n';
+	cout << factorial(6) << ' ' << larger(factorial(3), square(3)) << '\n';
+	return 0;
+}
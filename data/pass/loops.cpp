@@ -0,0 +1,50 @@
+#include <iostream>
+using namespace std;
+
+/* testing loop-invariant code motion out of nested loops */
+int scale;
+
+int bump()
+{
+	scale = scale + 1;
+	return scale;
+}
+
+int main()
+{
+	int grid[16];
+	int width = 4;
+	int height = 4;
+	scale = 3;
+
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			grid[y * width + x] = (width * height) / 2 + x * scale;
+		}
+	}
+
+	int sum = 0;
+	int i = 0;
+	while (i < width * height) {
+		sum = sum + grid[width * 2] + grid[i] % 8;
+		++i;
+	}
+	cout << "sum " << sum << '\n';
+
+	/* scale changes in the loop through a call */
+	int total = 0;
+	for (int j = 0; j < 3; ++j) {
+		total = total + scale * 2;
+		bump();
+	}
+	cout << "total " << total << '\n';
+
+	int k = 0;
+	do {
+		grid[k] = -width;
+		++k;
+	} while (k < 16);
+	cout << "last " << grid[15] << '\n';
+
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include <math.h>
+double pow(double, double);
+
+#include <iostream>
+using namespace std;
+
+/* testing parameters and return values passed as C arguments */
+int square(int x)
+{
+	return x * x;
+}
+
+int sub(int a, int b)
+{
+	return a - b;
+}
+
+double scale(char c, bool half, double x)
+{
+	double y = x;
+	if (c == 'n')
+		y = 0.0 - y;
+	if (half)
+		return y / 2.0;
+	return y;
+}
+
+int ackermann(int m, int n)
+{
+	if (m == 0)
+		return n + 1;
+	if (n == 0)
+		return ackermann(m - 1, 1);
+	return ackermann(m - 1, ackermann(m, n - 1));
+}
+
+int sum(int a[4])
+{
+	int s = 0;
+	for (int i = 0; i < 4; ++i) {
+		s = s + a[i];
+		a[i] = 0;
+	}
+	return s;
+}
+
+int main()
+{
+	cout << sub(square(5), sub(10, square(2))) << ' ' << pow(2.0, 3.0) << '\n';
+	cout << scale('p', false, 1.5) << ' ' << scale('n', true, 0.25) << '\n';
+	cout << ackermann(2, 3) << '\n';
+	int a[4];
+	for (int i = 0; i < 4; ++i)
+		a[i] = i + 1;
+	/* an array is passed as its address, so sum zeroes a: 10 0 */
+	cout << sum(a) << ' ' << a[3] << '\n';
+	return 0;
+}
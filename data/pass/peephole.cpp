@@ -0,0 +1,39 @@
+#include <iostream>
+using namespace std;
+
+/* testing peephole patterns: fused branches, folded copies, increments */
+int count(int n)
+{
+	int c = 0;
+	int i = 0;
+	while (i < n) {
+		if (i % 3 == 0)
+			c = c + 1;
+		if (!(i != 4))
+			c = c - 1;
+		i = i + 1;
+	}
+	return c;
+}
+
+int clamp(double x)
+{
+	if (x < 0.5)
+		return 0;
+	if (!(x == 1.5))
+		return 1;
+	return 2;
+}
+
+int main()
+{
+	cout << count(10) << ' ' << count(0) << '\n';
+	cout << clamp(0.25) << clamp(1.0) << clamp(1.5) << '\n';
+	bool b = 3 >= 2;
+	int k = 7;
+	k = k + 1;
+	k = k - 1;
+	k = k - 1;
+	cout << b << ' ' << k << '\n';
+	return 0;
+}
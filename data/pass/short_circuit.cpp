@@ -0,0 +1,36 @@
+/* test short-circuit evaluation of && and || with side effects */
+#include <iostream>
+using namespace std;
+
+int calls;
+
+bool check(bool b)
+{
+	calls = calls + 1;
+	return b;
+}
+
+int main(int argc, char *argv[])
+{
+	calls = 0;
+	if (check(false) && check(true))
+		cout << "wrong\n";
+	cout << "and calls: " << calls << '\n';
+	calls = 0;
+	if (check(true) || check(false))
+		cout << "or taken, calls: " << calls << '\n';
+	int i = 0;
+	while (i < 10 && !(i == 5 || i == 7))
+		i++;
+	cout << "i stopped at " << i << '\n';
+	calls = 0;
+	bool b = check(false) || (check(true) && !check(false));
+	cout << "b is " << b << " calls " << calls << '\n';
+	bool c = !(4 > 2 || (5 < 6 && 8 > 7) || !false);
+	cout << "c is " << c << '\n';
+	do {
+		i--;
+	} while (i > 0 && i != 2);
+	cout << "do stopped at " << i << '\n';
+	return 0;
+}
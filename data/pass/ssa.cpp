@@ -0,0 +1,56 @@
+#include <iostream>
+using namespace std;
+
+/* testing SSA form: phis, parallel copies, and copy propagation */
+int fib(int n)
+{
+	int a = 0;
+	int b = 1;
+	for (int i = 0; i < n; ++i) {
+		int t = a;
+		a = b;
+		b = t + b;
+	}
+	return a;
+}
+
+int rot(int n)
+{
+	int x = 1;
+	int y = 2;
+	int z = 3;
+	while (n > 0) {
+		int t = x;
+		x = y;
+		y = z;
+		z = t;
+		n = n - 1;
+	}
+	return x * 100 + y * 10 + z;
+}
+
+int pick(int n)
+{
+	int r = 5;
+	if (n > 3)
+		r = 7;
+	else if (n < 0)
+		r = -1;
+	int s = r;
+	for (int i = 0; i < n; ++i) {
+		if (i % 2 == 0)
+			s = s - 1;
+		s = s + i;
+		if (s > 40)
+			break;
+	}
+	return s;
+}
+
+int main()
+{
+	cout << fib(10) << ' ' << fib(20) << '\n';
+	cout << rot(0) << ' ' << rot(1) << ' ' << rot(2) << ' ' << rot(4) << '\n';
+	cout << pick(-5) << ' ' << pick(2) << ' ' << pick(10) << ' ' << pick(30) << '\n';
+	return 0;
+}
@@ -0,0 +1,33 @@
+#include <iostream>
+using namespace std;
+
+/* testing strength reduction of arithmetic by constants */
+int main()
+{
+	int sum = 0;
+	int mix = 0;
+	for (int x = -100; x < 100; ++x) {
+		sum = sum + x / 2 + x / 3 + x / 7 + x / 8 + x / -5 + x / -16;
+		sum = sum + x % 6 + x % 8 + x % -4 + x % 10;
+		mix = mix + x * 5 + x * 7 + x * 8 - x * 10 + x * -1;
+	}
+	cout << sum << ' ' << mix << '\n';
+
+	int big = 2147483647;
+	int small = -2147483647;
+	cout << big / 7 << ' ' << small / 9 << ' ' << big % 1000 << ' ' << small % 3 << '\n';
+	cout << 100 / 7 << ' ' << 6 * 7 << ' ' << -9 % 4 << '\n';
+
+	int a[10];
+	int n = 0;
+	while (n < 10) {
+		a[n] = n * n;
+		n = n + 1;
+	}
+	int total = 0;
+	for (int i = 9; i >= 0; --i)
+		total = total + a[i] / 3;
+	cout << total << '\n';
+
+	return 0;
+}
@@ -0,0 +1,48 @@
+/* test switch lowering: jump tables, binary search, and linear tests */
+#include <iostream>
+using namespace std;
+
+int classify(int x)
+{
+	int r = 0;
+	switch (x) {
+	case 0: r = 100; break;
+	case 1: r = 101; break;
+	case 2: r = 102; break;
+	case 3: r = 103; break;
+	case 4: r = 104; break;
+	case 5: r = 105; break;
+	case 7: r = 107; break;
+	case 8:
+	case 9: r = 109; break;
+	case 500: r = 500; break;
+	case 1000: r = 1000; break;
+	case 2000: r = 2000; break;
+	case -40: r = -40; break;
+	case 70000: r = 7; break;
+	default: r = -1; break;
+	}
+	return r;
+}
+
+int small(char c)
+{
+	switch (c) {
+	case 'a': return 1;
+	case 'z': {
+		if (c == 'z')
+			return 26;
+	}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int sum = 0;
+	for (int i = -50; i < 2100; ++i)
+		sum = sum + classify(i) * (i % 7 + 1);
+	cout << sum << ' ' << classify(70000) << ' ' << classify(6) << '\n';
+	cout << small('a') << small('z') << small('q') << '\n';
+	return 0;
+}
@@ -0,0 +1,51 @@
+#include <iostream>
+using namespace std;
+
+/* testing tail call elimination */
+int gcd(int a, int b)
+{
+	if (b == 0)
+		return a;
+	return gcd(b, a % b);
+}
+
+int sum_to(int n, int acc)
+{
+	if (n == 0)
+		return acc;
+	return sum_to(n - 1, acc + n % 7);
+}
+
+void countdown(int n)
+{
+	if (n < 0)
+		return;
+	cout << n << ' ';
+	countdown(n - 2);
+}
+
+int is_odd(int n);
+
+int is_even(int n)
+{
+	if (n == 0)
+		return 1;
+	return is_odd(n - 1);
+}
+
+int is_odd(int n)
+{
+	if (n == 0)
+		return 0;
+	return is_even(n - 1);
+}
+
+int main()
+{
+	cout << gcd(1071, 462) << ' ' << gcd(17, 5) << '\n';
+	cout << sum_to(1000000, 0) << '\n';
+	countdown(9);
+	cout << '\n';
+	cout << is_even(1000) << is_odd(1000) << is_even(777) << '\n';
+	return 0;
+}
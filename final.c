@@ -6,13 +6,18 @@
  * This file released under the AGPLv3 license.
  */
 
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "intermediate.h"
 #include "type.h"
 #include "args.h"
+#include "regalloc.h"
+#include "profile.h"
 
+#include "logger.h"
 #include "list.h"
 #include "hasht.h"
 
@@ -20,12 +25,151 @@
 
 extern struct list *yyscopes;
 
+/* the locals of the procedure being printed */
+static struct {
+	int frame;
+	struct typeinfo **types; /* by offset, of the variable starting there */
+	bool *taken;             /* by byte, kept in the local region */
+	struct typeinfo *class;  /* of a member function, else NULL */
+	struct typeinfo self;    /* pointer to class, as in local region */
+	struct typeinfo **reg_types; /* C type of each register class */
+	int reg_type_count;
+	struct regalloc *regs;
+	int index;               /* of the procedure, in code order */
+} locals;
+
+/* string literals as laid out in the generated constant region */
+static struct {
+	struct typeinfo **strings; /* by new offset, then host string */
+	size_t *offsets;           /* new offset of each string */
+	size_t count;
+	size_t size;
+} constants;
+
 static void map_instruction(FILE *stream, struct list_node *iter);
 static char *map_op(enum opcode code);
 static char *map_print(enum opcode code);
 static char *map_region(enum region r);
 static void map_address(FILE *stream, struct address a);
+static void map_array(FILE *stream, struct address a);
 static void print_prototypes(FILE *stream, struct hasht *table, char *class);
+static void print_param_t(FILE *stream, struct typeinfo *t);
+static void print_params(FILE *stream, struct typeinfo *function,
+                         char *class);
+static void store_params(FILE *stream, struct typeinfo *function);
+static int declare_args(FILE *stream, struct list_node *iter);
+static void map_args(FILE *stream, int *pending, int *top, int n);
+static void set_class(char *name);
+static bool find_locals(struct list_node *iter);
+static void add_local(struct address a, bool taken, int *owner);
+static bool is_variable(struct address a);
+static void declare_locals(FILE *stream);
+static int register_class(struct address a);
+static void print_struct(FILE *stream, char *name, struct typeinfo *class);
+static char *find_field(struct typeinfo *class, struct address a);
+static size_t c_size(struct typeinfo *t);
+static void map_field(FILE *stream, struct address a, struct address pointer,
+                      struct address offset, bool value);
+static int compare_suffixes(const void *a, const void *b);
+static bool is_suffix(struct typeinfo *s, struct typeinfo *t);
+static size_t string_offset(struct address a);
+static char *float_literal(struct address a);
+static void print_bytes(FILE *stream, char *bytes, size_t size);
+static void print_source_name(FILE *stream, char *name);
+static void print_line(FILE *stream, struct op *op);
+
+/*
+ * The profiler of --profile: each procedure enters its frame on entry
+ * and leaves it on return, or before a tail call replaces it. Frames
+ * still open at exit are left then, before the report.
+ */
+static const char *const profiler[] = {
+	"#if defined(__x86_64__) || defined(__i386__)",
+	"#define profiler_clock() __builtin_ia32_rdtsc()",
+	"#define PROFILER_UNIT \"cycles\"",
+	"#else",
+	"#define PROFILER_UNIT \"ns\"",
+	"static unsigned long long profiler_clock(void)",
+	"{",
+	"\tstruct timespec t;",
+	"\tclock_gettime(CLOCK_MONOTONIC, &t);",
+	"\treturn t.tv_sec * 1000000000ULL + t.tv_nsec;",
+	"}",
+	"#endif",
+	"",
+	"static struct profiler_frame {",
+	"\tstruct profiler_function *function;",
+	"\tunsigned long long start;",
+	"\tunsigned long long children;",
+	"} *profiler_stack;",
+	"static int profiler_top;",
+	"static int profiler_size;",
+	"",
+	"static void profiler_enter(int f)",
+	"{",
+	"\tif (profiler_top == profiler_size) {",
+	"\t\tprofiler_size = profiler_size ? 2 * profiler_size : 64;",
+	"\t\tprofiler_stack = realloc(profiler_stack,",
+	"\t\t                         profiler_size * sizeof(*profiler_stack));",
+	"\t\tif (profiler_stack == NULL)",
+	"\t\t\tabort();",
+	"\t}",
+	"\tstruct profiler_frame *frame = &profiler_stack[profiler_top++];",
+	"\tframe->function = &profiler_functions[f];",
+	"\t++frame->function->calls;",
+	"\t++frame->function->active;",
+	"\tframe->children = 0;",
+	"\tframe->start = profiler_clock();",
+	"}",
+	"",
+	"static void profiler_exit(void)",
+	"{",
+	"\tunsigned long long now = profiler_clock();",
+	"\tstruct profiler_frame *frame = &profiler_stack[--profiler_top];",
+	"\tunsigned long long elapsed = now - frame->start;",
+	"\t/* recursive calls are inside the outermost */",
+	"\tif (--frame->function->active == 0)",
+	"\t\tframe->function->inclusive += elapsed;",
+	"\tframe->function->exclusive += elapsed - frame->children;",
+	"\tif (profiler_top > 0)",
+	"\t\tprofiler_stack[profiler_top - 1].children += elapsed;",
+	"}",
+	"",
+	"static int profiler_compare(const void *a, const void *b)",
+	"{",
+	"\tconst struct profiler_function *f = a;",
+	"\tconst struct profiler_function *g = b;",
+	"\treturn (f->exclusive < g->exclusive) - (f->exclusive > g->exclusive);",
+	"}",
+	"",
+	"static void profiler_report(void) __attribute__((destructor));",
+	"static void profiler_report(void)",
+	"{",
+	"\tint count = sizeof(profiler_functions) / sizeof(*profiler_functions);",
+	"\twhile (profiler_top > 0)",
+	"\t\tprofiler_exit();",
+	"\tunsigned long long total = 0;",
+	"\tfor (int i = 0; i < count; ++i)",
+	"\t\ttotal += profiler_functions[i].exclusive;",
+	"\tif (total == 0)",
+	"\t\ttotal = 1;",
+	"\tqsort(profiler_functions, count, sizeof(*profiler_functions),",
+	"\t      profiler_compare);",
+	"",
+	"\tfprintf(stderr, \"%-32s %10s %16s %7s %16s %7s\\n\", \"function\",",
+	"\t        \"calls\", \"inclusive \" PROFILER_UNIT, \"%\",",
+	"\t        \"exclusive \" PROFILER_UNIT, \"%\");",
+	"\tfor (int i = 0; i < count; ++i) {",
+	"\t\tstruct profiler_function *f = &profiler_functions[i];",
+	"\t\tif (f->calls == 0)",
+	"\t\t\tcontinue;",
+	"\t\tfprintf(stderr, \"%-32s %10lu %16llu %6.2f%% %16llu %6.2f%%\\n\",",
+	"\t\t        f->name, f->calls, f->inclusive,",
+	"\t\t        100.0 * f->inclusive / total, f->exclusive,",
+	"\t\t        100.0 * f->exclusive / total);",
+	"\t}",
+	"}",
+};
 
 void final_code(FILE *stream, struct list *code)
 {
@@ -39,7 +183,18 @@ void final_code(FILE *stream, struct list *code)
 			struct typeinfo *value = slot->value;
 			char *key = slot->key;
 			if (value->base == CLASS_T)
-				p("typedef char *%s;\n", key);
+				p("typedef struct %s %s;\n", key, key);
+		}
+	}
+	p("\n");
+
+	/* print class layouts */
+	for (size_t i = 0; i < global->size; ++i) {
+		struct hasht_node *slot = global->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *value = slot->value;
+			if (value->base == CLASS_T)
+				print_struct(stream, slot->key, value);
 		}
 	}
 
@@ -60,31 +215,18 @@ void final_code(FILE *stream, struct list *code)
 		}
 	}
 
-	p("void _initialize_constants()\n{\n");
-	p("\t/* initializing constant region */\n");
-	struct hasht *constant = list_front(yyscopes);
-	for (size_t i = 0; i < constant->size; ++i) {
-		struct hasht_node *slot = constant->table[i];
-		if (slot && !hasht_node_deleted(slot)) {
-			struct typeinfo *v = slot->value;
-			if (v->base == FLOAT_T) {
-				p("\t");
-				map_address(stream, v->place);
-				p(" = %s;\n", v->token->text);
-			} else if (v->base == CHAR_T && v->pointer) {
-				p("\tmemcpy(constant + %d, %s, %zu);\n",
-				  v->place.offset, v->token->text, v->token->ssize);
-			}
-		}
-	}
-	p("}\n\n");
+	if (arguments.register_stats)
+		regalloc_print(stderr, NULL, NULL);
 
 	/* generate C instructions for list of TAC ops */
+	locals.index = -1;
 	struct list_node *iter = list_head(code);
 	while (!list_end(iter)) {
 		map_instruction(stream, iter);
 		iter = iter->next;
 	}
+	regalloc_free(locals.regs);
+	locals.regs = NULL;
 }
 
 static void print_t(FILE *stream, struct address a)
@@ -101,87 +243,90 @@ static void map_instruction(FILE *stream, struct list_node *iter)
 		print_op(stream, op);
 		p("*/\n");
 	}
-	static int param_offset = 0;
+	if (op->code != END_O && op->code != CASE_O)
+		print_line(stream, op);
+	/* arguments saved by PARAM_O for calls yet to be made; a nested
+	   call's arguments are pushed and popped before the next outer one */
+	static int *pending = NULL;
+	static int top = 0;
+	static int next_arg = 0;
 	struct address a = op->address[0];
 	struct address b = op->address[1];
 	struct address c = op->address[2];
 	switch (op->code) {
 	case PROC_O:
+		set_class(op->name);
 		print_typeinfo(stream, "", typeinfo_return(c.type));
-		p("%s()\n{\n", op->name);
-		p("\tchar local[%d];\n", b.offset);
-		if (strcmp(op->name, "main") == 0)
-			p("\t_initialize_constants();\n");
-		/* copy parameters from faux stack into front of local region */
-		p("\tmemcpy(local, stack, %d); /* copy parameters */\n", a.offset);
-		if (strstr(op->name, "__")) /* probably a class */
-			p("\tclass *instance = (class *)local;\n");
+		p("%s", op->name);
+		print_params(stream, c.type,
+		             locals.class ? locals.self.class.type : NULL);
+		p("\n{\n");
+		bool used = find_locals(iter);
+		regalloc_free(locals.regs);
+		locals.regs = regalloc_new(iter, REGALLOC_REGISTERS, &register_class);
+		if (arguments.register_stats)
+			regalloc_print(stderr, op->name, locals.regs);
+		if (used)
+			p("\tchar local[%d] __attribute__((aligned(8)));\n",
+			  b.offset);
+		declare_locals(stream);
+		int args = declare_args(stream, iter);
+		pending = realloc(pending, (args + 1) * sizeof(*pending));
+		log_assert(pending);
+		top = 0;
+		next_arg = 0;
+		/* the prologue is the function's line too */
+		print_line(stream, op);
+		/* copy parameters into front of local region */
+		store_params(stream, c.type);
+		if (arguments.profile)
+			p("\tprofiler_enter(%d);\n", ++locals.index);
 		break;
 	case END_O:
+		if (arguments.profile)
+			p("\tprofiler_exit();\n");
 		p("}\n\n");
 		break;
 	case PARAM_O:
-		/* save parameters into faux stack */
-		p("\t(*(");
-		print_t(stream, a);
-		p("*)(stack + %d))", param_offset);
-		p(" = ");
-		map_address(stream, a);
+		/* evaluate argument now, as its operand may be reused */
+		p("\targ_%d = ", next_arg);
+		if (typeinfo_by_reference(a.type))
+			p("(void *)(%s + %d)", map_region(a.region), a.offset);
+		else
+			map_address(stream, a);
 		p(";\n");
-		param_offset += typeinfo_size(a.type);
+		pending[top++] = next_arg++;
 		break;
 	case CALL_O:
-		/* reset parameter offset and call function, saving return */
-		param_offset = 0;
-		p("\t");
-		if (a.region != UNKNOWN_R) {
-			map_address(stream, a);
-			p(" = ");
-		}
-		p("%s();\n", op->name);
-		break;
 	case CALLC_O:
-		param_offset = 0;
+		/* call function with its arguments, saving return */
 		p("\t");
 		if (a.region != UNKNOWN_R) {
 			map_address(stream, a);
 			p(" = ");
 		}
 		p("%s(", op->name);
-		/* add parameters */
-		iter = iter->prev;
-		for (int i = 0; i < b.offset; ++i) {
-			struct op *param = iter->data;
-			map_address(stream, param->address[0]);
-			/* append separator */
-			if (i != b.offset - 1)
-				p(", ");
-			iter = iter->prev;
-		}
+		map_args(stream, pending, &top, b.offset);
+		p(");\n");
+		break;
+	case TCALL_O:
+		/* a call in tail position, which GCC can compile to a jump */
+		if (arguments.profile)
+			p("\tprofiler_exit();\n");
+		p("\t%s%s(", (a.region != UNKNOWN_R) ? "return " : "", op->name);
+		map_args(stream, pending, &top, b.offset);
 		p(");\n");
+		if (a.region == UNKNOWN_R)
+			p("\treturn;\n");
 		break;
 	case RET_O:
+		if (arguments.profile)
+			p("\tprofiler_exit();\n");
 		p("\treturn");
-		/* if an immediate, use it */
-		if (a.region == UNKNOWN_R) {
-		} else if (a.region == CONST_R && !a.type->pointer
-		    && (a.type->base == INT_T
-		        || a.type->base == CHAR_T
-		        || a.type->base == BOOL_T)) {
-			p(" %d", a.offset);
-		} else if (!(a.type->base == VOID_T && !a.type->pointer)) {
-			if (a.type->base == CHAR_T && a.type->pointer) {
-				/* TODO: no idea why this is a special
-				   case and other primitives are not */
-				p(" ((");
-				print_t(stream, a);
-				p(")(%s + %d))", map_region(a.region), a.offset);
-			}
-			else {
-				p(" (*(");
-				print_t(stream, a);
-				p("*)(%s + %d))", map_region(a.region), a.offset);
-			}
+		if (a.region != UNKNOWN_R
+		    && !(a.type->base == VOID_T && !a.type->pointer)) {
+			p(" ");
+			map_address(stream, a);
 		}
 		p(";\n");
 		break;
@@ -191,10 +336,33 @@ static void map_instruction(FILE *stream, struct list_node *iter)
 	case GOTO_O:
 		p("\tgoto L_%d;\n", a.offset);
 		break;
+	case TABLE_O:
+		/* dense C switch, which GCC compiles to a jump table */
+		p("\tswitch (");
+		map_address(stream, a);
+		p(") {\n");
+		for (int i = 0; i < b.offset; ++i) {
+			iter = iter->next;
+			struct op *entry = iter->data;
+			p("\tcase %d: goto L_%d;\n", entry->address[0].offset,
+			  entry->address[1].offset);
+		}
+		p("\tdefault: goto L_%d;\n", c.offset);
+		p("\t}\n");
+		break;
+	case CASE_O:
+		/* printed by preceding TABLE_O */
+		break;
+	case COUNT_O:
+		p("\t++profile_counts[%d];\n", a.offset);
+		break;
 	case NEW_O:
 		p("\t");
 		map_address(stream, a);
-		p(" = calloc(%d, sizeof(char));\n", b.offset);
+		if (op->name)
+			p(" = calloc(1, sizeof(struct %s));\n", op->name);
+		else
+			p(" = calloc(%d, sizeof(char));\n", b.offset);
 		break;
 	case DEL_O:
 		p("\tfree(");
@@ -233,6 +401,7 @@ static void map_instruction(FILE *stream, struct list_node *iter)
 	case FNE_O:
 	case OR_O:
 	case AND_O:
+	case SHR_O:
 		p("\t");
 		map_address(stream, a);
 		p(" = ");
@@ -241,6 +410,32 @@ static void map_instruction(FILE *stream, struct list_node *iter)
 		map_address(stream, c);
 		p(";\n");
 		break;
+	case SHL_O:
+	case USHR_O:
+		/* shift unsigned so overflow is defined */
+		p("\t");
+		map_address(stream, a);
+		p(" = (int)((unsigned)");
+		map_address(stream, b);
+		p(" %s ", map_op(op->code));
+		map_address(stream, c);
+		p(");\n");
+		break;
+	case INC_O:
+	case DEC_O:
+		p("\t%s", (op->code == INC_O) ? "++" : "--");
+		map_address(stream, a);
+		p(";\n");
+		break;
+	case MULH_O:
+		p("\t");
+		map_address(stream, a);
+		p(" = (int)(((long long)");
+		map_address(stream, b);
+		p(" * ");
+		map_address(stream, c);
+		p(") >> 32);\n");
+		break;
 	case NEG_O:
 	case FNEG_O:
 	case NOT_O:
@@ -254,11 +449,9 @@ static void map_instruction(FILE *stream, struct list_node *iter)
 		p(";\n");
 		break;
 	case LSTAR_O:
-		p("\t");
-		p("(**(");
-		print_t(stream, a);
-		p("*)(%s + %d))", map_region(a.region), a.offset);
-		p(" = ");
+		p("\t(*");
+		map_address(stream, a);
+		p(") = ");
 		map_address(stream, b);
 		p(";\n");
 		break;
@@ -275,9 +468,9 @@ static void map_instruction(FILE *stream, struct list_node *iter)
 		p("\t");
 		map_address(stream, a);
 		p(" = ");
-		p("(*(");
-		print_t(stream, b);
-		p("*)(%s + %d + ", map_region(b.region), b.offset);
+		p("(*(%s *)(", print_basetype(b.type));
+		map_array(stream, b);
+		p(" + ");
 		map_address(stream, c);
 		p("));\n");
 		break;
@@ -285,35 +478,19 @@ static void map_instruction(FILE *stream, struct list_node *iter)
 		p("\t");
 		map_address(stream, a);
 		p(" = ");
-		p("(");
-		print_t(stream, b);
-		p("*)(%s + %d + ", map_region(b.region), b.offset);
+		p("(%s *)(", print_basetype(b.type));
+		map_array(stream, b);
+		p(" + ");
 		map_address(stream, c);
 		p(");\n");
 		break;
 	case LFIELD_O:
-		p("\t");
-		map_address(stream, a);
-		p(" = ");
-		p("(");
-		print_t(stream, a);
-		p(")(*(");
-		print_t(stream, b);
-		p("**)(%s + %d) + ", map_region(b.region), b.offset);
-		map_address(stream, c);
-		p(");\n");
-		break;
 	case RFIELD_O:
 		p("\t");
 		map_address(stream, a);
 		p(" = ");
-		p("(");
-		print_t(stream, a);
-		p(")(*(*(");
-		print_t(stream, b);
-		p("**)(%s + %d) + ", map_region(b.region), b.offset);
-		map_address(stream, c);
-		p("));\n");
+		map_field(stream, a, b, c, op->code == RFIELD_O);
+		p(";\n");
 		break;
 	case IF_O:
 		p("\tif (");
@@ -321,6 +498,25 @@ static void map_instruction(FILE *stream, struct list_node *iter)
 		p(")\n");
 		p("\t\tgoto L_%d;\n", b.offset);
 		break;
+	case IFN_O:
+		p("\tif (!");
+		map_address(stream, a);
+		p(")\n");
+		p("\t\tgoto L_%d;\n", b.offset);
+		break;
+	case IFLT_O:
+	case IFLE_O:
+	case IFGT_O:
+	case IFGE_O:
+	case IFEQ_O:
+	case IFNE_O:
+		p("\tif (");
+		map_address(stream, a);
+		p(" %s ", map_op(op->code));
+		map_address(stream, b);
+		p(")\n");
+		p("\t\tgoto L_%d;\n", c.offset);
+		break;
 	case ERRC_O:
 		p("\texit(-1); /* operation error */");
 		break;
@@ -338,9 +534,19 @@ static void map_address(FILE *stream, struct address a)
 	        || a.type->base == BOOL_T)) {
 		/* use an immediate directly */
 		p("%d", a.offset);
+	} else if (a.region == CONST_R && a.type->base == FLOAT_T
+	           && !a.type->pointer) {
+		/* use the literal as an immediate */
+		p("%s", float_literal(a));
 	} else if (a.region == CONST_R && a.type->base == CHAR_T && a.type->pointer) {
 		/* use constant string directly */
-		p("(char *)(%s + %d)", map_region(a.region), a.offset);
+		p("(char *)(%s + %zu)", map_region(a.region), string_offset(a));
+	} else if (is_variable(a) && regalloc_register(locals.regs, a) >= 0) {
+		p("r_%d", regalloc_register(locals.regs, a));
+	} else if (is_variable(a)) {
+		p("l_%d", a.offset);
+	} else if (a.region == CLASS_R && find_field(locals.class, a)) {
+		p("this->%s", find_field(locals.class, a));
 	} else {
 		/* grab value from region */
 		p("(*(");
@@ -349,6 +555,17 @@ static void map_address(FILE *stream, struct address a)
 	}
 }
 
+/* returns code to get address of array a, an array parameter's value */
+static void map_array(FILE *stream, struct address a)
+{
+	if (a.type->pointer) {
+		p("(char *)");
+		map_address(stream, a);
+	} else {
+		p("%s + %d", map_region(a.region), a.offset);
+	}
+}
+
 /* returns string representation of binary operator */
 static char *map_op(enum opcode code)
 {
@@ -367,23 +584,34 @@ static char *map_op(enum opcode code)
 		return "/";
 	case MOD_O:
 		return "%";
+	case SHL_O:
+		return "<<";
+	case SHR_O:
+	case USHR_O:
+		return ">>";
 	case LT_O:
 	case FLT_O:
+	case IFLT_O:
 		return "<";
 	case LE_O:
 	case FLE_O:
+	case IFLE_O:
 		return "<=";
 	case GT_O:
 	case FGT_O:
+	case IFGT_O:
 		return ">";
 	case GE_O:
 	case FGE_O:
+	case IFGE_O:
 		return ">=";
 	case EQ_O:
 	case FEQ_O:
+	case IFEQ_O:
 		return "==";
 	case NE_O:
 	case FNE_O:
+	case IFNE_O:
 		return "!=";
 	case OR_O:
 		return "||";
@@ -435,12 +663,617 @@ static char *map_region(enum region r)
 	case PARAM_R:
 		return "local";
 	case CLASS_R:
-		return "*instance";
+		return "(char *)this";
 	default:
 		return "unimplemented";
 	}
 }
 
+/* print C type of a parameter or argument of type t */
+static void print_param_t(FILE *stream, struct typeinfo *t)
+{
+	if (t->base == ARRAY_T)
+		p("%s%s*", print_basetype(t), t->array.type->pointer ? " *" : " ");
+	else if (typeinfo_by_reference(t))
+		p("void *");
+	else
+		p("%s%s", print_basetype(t), t->pointer ? " *" : " ");
+}
+
+/* print parameter list of function, naming each by position */
+static void print_params(FILE *stream, struct typeinfo *function,
+                         char *class)
+{
+	p("(");
+	int i = 0;
+	if (class) {
+		/* pointer to class instance */
+		p("%s *this", class);
+		++i;
+	}
+	struct list_node *iter = list_head(function->function.parameters);
+	while (!list_end(iter)) {
+		struct typeinfo *t = iter->data;
+		if (i > 0)
+			p(", ");
+		print_param_t(stream, t);
+		p("p%d", i++);
+		iter = iter->next;
+	}
+	if (i == 0)
+		p("void");
+	p(")");
+}
+
+/* copy parameters of function into the front of local region */
+static void store_params(FILE *stream, struct typeinfo *function)
+{
+	int i = 0;
+	int offset = 0;
+	if (locals.class) {
+		struct address a = { PARAM_R, offset, &locals.self };
+		p("\t");
+		map_address(stream, a);
+		p(" = this;\n");
+		++i;
+		offset += typeinfo_size(&locals.self);
+	}
+	struct list_node *iter = list_head(function->function.parameters);
+	while (!list_end(iter)) {
+		struct typeinfo *t = iter->data;
+		offset = typeinfo_aligned(offset, t);
+		struct address a = { PARAM_R, offset, t };
+		size_t size = typeinfo_size(t);
+		if (typeinfo_by_reference(t)) {
+			if (size > 0) /* else nothing in local region to copy into */
+				p("\tmemcpy(local + %d, p%d, %zu);\n", offset, i, size);
+			++i;
+		} else {
+			p("\t");
+			map_address(stream, a);
+			p(" = p%d;\n", i++);
+		}
+		offset += size;
+		iter = iter->next;
+	}
+}
+
+/* declare a variable for each argument passed in procedure at iter */
+static int declare_args(FILE *stream, struct list_node *iter)
+{
+	int count = 0;
+	for (; ((struct op *)iter->data)->code != END_O; iter = iter->next) {
+		struct op *op = iter->data;
+		if (op->code != PARAM_O)
+			continue;
+		p("\t");
+		print_param_t(stream, op->address[0].type);
+		p("arg_%d;\n", count++);
+	}
+	return count;
+}
+
+/* print and pop the last n pending arguments, in order */
+static void map_args(FILE *stream, int *pending, int *top, int n)
+{
+	log_assert(*top >= n);
+	*top -= n;
+	for (int i = 0; i < n; ++i) {
+		if (i > 0)
+			p(", ");
+		p("arg_%d", pending[*top + i]);
+	}
+}
+
+/*
+ * Sets the class whose member function is printed next from its name,
+ * Class__method, or none if it is not a member.
+ */
+static void set_class(char *name)
+{
+	locals.class = NULL;
+	char *split = strstr(name, "__");
+	if (split == NULL)
+		return;
+
+	struct hasht *global = list_index(yyscopes, 1)->data;
+	free(locals.self.class.type);
+	char *class = strndup(name, split - name);
+	log_assert(class);
+	locals.class = hasht_search(global, class);
+	log_assert(locals.class && locals.class->base == CLASS_T);
+	locals.self = *locals.class;
+	locals.self.pointer = true;
+	locals.self.class.type = class;
+}
+
+/*
+ * Finds the locals of the procedure at iter which can be typed C
+ * variables: each is always accessed at one offset with one scalar
+ * type, never overlaps another, and never has its address taken.
+ * Returns true if anything is left in the local region.
+ */
+static bool find_locals(struct list_node *iter)
+{
+	struct op *proc = iter->data;
+	int frame = proc->address[1].offset;
+	locals.frame = frame;
+	free(locals.types);
+	free(locals.taken);
+	locals.reg_type_count = 0;
+	locals.types = calloc(frame + 1, sizeof(*locals.types));
+	locals.taken = calloc(frame + 1, sizeof(*locals.taken));
+	int *owner = calloc(frame + 1, sizeof(*owner));
+	log_assert(locals.types && locals.taken && owner);
+
+	/* parameters as stored by the prologue, instance pointer first */
+	int offset = 0;
+	if (locals.class) {
+		struct address a = { PARAM_R, offset, &locals.self };
+		add_local(a, false, owner);
+		offset += typeinfo_size(&locals.self);
+	}
+	struct typeinfo *function = proc->address[2].type;
+	struct list_node *param = list_head(function->function.parameters);
+	while (!list_end(param)) {
+		struct typeinfo *t = param->data;
+		offset = typeinfo_aligned(offset, t);
+		struct address a = { PARAM_R, offset, t };
+		add_local(a, false, owner);
+		offset += typeinfo_size(t);
+		param = param->next;
+	}
+
+	for (iter = iter->next; ((struct op *)iter->data)->code != END_O;
+	     iter = iter->next) {
+		struct op *op = iter->data;
+		struct address *a = op->address;
+		switch (op->code) {
+		case ADDR_O:
+		case LARR_O:
+		case RARR_O:
+			/* printed as the address of the second operand,
+			   unless an array parameter holding it */
+			add_local(a[0], false, owner);
+			add_local(a[1], op->code == ADDR_O || !a[1].type->pointer,
+			          owner);
+			add_local(a[2], false, owner);
+			break;
+		case PARAM_O:
+			add_local(a[0], typeinfo_by_reference(a[0].type),
+			          owner);
+			break;
+		default:
+			for (int i = 0; i < 3; ++i)
+				add_local(a[i], false, owner);
+		}
+	}
+
+	bool used = false;
+	for (int i = 0; i < frame; ++i) {
+		if (locals.types[i] == NULL)
+			continue;
+		int size = typeinfo_size(locals.types[i]);
+		for (int j = 0; j < size; ++j)
+			if (locals.taken[i + j])
+				locals.types[i] = NULL;
+	}
+	for (int i = 0; i < frame; ++i)
+		if (locals.taken[i] || (owner[i] && !locals.types[owner[i] - 1]))
+			used = true;
+
+	free(owner);
+	return used;
+}
+
+/* record an access of local a, which may take its address */
+static void add_local(struct address a, bool taken, int *owner)
+{
+	if (a.region != LOCAL_R && a.region != PARAM_R)
+		return;
+	int size = typeinfo_size(a.type);
+	if (a.offset < 0 || a.offset + size > locals.frame)
+		return;
+	struct typeinfo *t = locals.types[a.offset];
+
+	if (size == 0 || typeinfo_by_reference(a.type)
+	    || (a.type->base == ARRAY_T && !a.type->pointer))
+		taken = true;
+	else if (t && (t->pointer != a.type->pointer
+	               || strcmp(print_basetype(t), print_basetype(a.type))))
+		taken = true;
+	else
+		locals.types[a.offset] = a.type;
+
+	for (int i = a.offset; i < a.offset + size; ++i) {
+		if (taken || (owner[i] && owner[i] != a.offset + 1))
+			locals.taken[i] = true;
+		owner[i] = a.offset + 1;
+	}
+}
+
+/* true if local a is printed as a typed C variable */
+static bool is_variable(struct address a)
+{
+	return (a.region == LOCAL_R || a.region == PARAM_R)
+		&& a.offset >= 0 && a.offset < locals.frame
+		&& locals.types[a.offset] != NULL;
+}
+
+/*
+ * Declare the typed C variables of the procedure being printed, and
+ * a register variable for each register allocated to any of them.
+ */
+static void declare_locals(FILE *stream)
+{
+	struct regalloc *r = locals.regs;
+	bool *used = calloc(r->classes * r->registers + 1, sizeof(*used));
+	log_assert(used);
+	for (size_t i = 0; i < r->count; ++i)
+		if (r->intervals[i].reg >= 0)
+			used[r->intervals[i].reg] = true;
+	for (int i = 0; i < r->classes * r->registers; ++i) {
+		struct typeinfo *t = locals.reg_types[i / r->registers];
+		if (used[i])
+			p("\tregister %s%sr_%d;\n", print_basetype(t),
+			  t->pointer ? " *" : " ", i);
+	}
+	free(used);
+
+	for (int i = 0; i < locals.frame; ++i) {
+		struct typeinfo *t = locals.types[i];
+		struct address a = { LOCAL_R, i, t };
+		if (t && regalloc_register(r, a) < 0)
+			p("\t%s%sl_%d;\n", print_basetype(t),
+			  t->pointer ? " *" : " ", i);
+	}
+}
+
+/*
+ * Returns the register class of local a, one for each C type of the
+ * typed C variables, else -1 if it is not one.
+ */
+static int register_class(struct address a)
+{
+	if (!is_variable(a))
+		return -1;
+	struct typeinfo *t = locals.types[a.offset];
+	for (int i = 0; i < locals.reg_type_count; ++i) {
+		struct typeinfo *u = locals.reg_types[i];
+		if (u->pointer == t->pointer
+		    && strcmp(print_basetype(u), print_basetype(t)) == 0)
+			return i;
+	}
+	locals.reg_types = realloc(locals.reg_types, (locals.reg_type_count + 1)
+	                           * sizeof(*locals.reg_types));
+	log_assert(locals.reg_types);
+	locals.reg_types[locals.reg_type_count] = t;
+	return locals.reg_type_count++;
+}
+
+/*
+ * Prints a class as a struct with each field at its offset, padding
+ * between fields, and packing if a field would otherwise be moved.
+ */
+static void print_struct(FILE *stream, char *name, struct typeinfo *class)
+{
+	size_t count;
+	struct hasht_node **fields = typeinfo_fields(class, &count);
+
+	p("struct %s {\n", name);
+	int end = 0;
+	bool packed = false;
+	for (size_t i = 0; i < count; ++i) {
+		struct typeinfo *t = fields[i]->value;
+		int offset = t->place.offset;
+		if (offset > end)
+			p("\tchar pad_%d[%d];\n", end, offset - end);
+		if (typeinfo_by_reference(t)) {
+			p("\tchar %s[%zu];\n", (char *)fields[i]->key,
+			  typeinfo_size(t));
+		} else {
+			p("\t%s%s%s;\n", print_basetype(t), t->pointer ? " *" : " ",
+			  (char *)fields[i]->key);
+			packed |= offset % c_size(t) != 0;
+		}
+		end = offset + c_size(t);
+	}
+	int size = typeinfo_size(class);
+	if (end < size)
+		p("\tchar pad_%d[%d];\n", end, size - end);
+	p("}%s;\n\n", packed ? " __attribute__((packed))" : "");
+
+	free(fields);
+}
+
+/* returns name of scalar field of class at a with its type, else NULL */
+static char *find_field(struct typeinfo *class, struct address a)
+{
+	if (class == NULL || class->base != CLASS_T)
+		return NULL;
+	struct hasht *tables[] = { class->class.public, class->class.private };
+	for (int i = 0; i < 2; ++i) {
+		for (size_t j = 0; tables[i] && j < tables[i]->size; ++j) {
+			struct hasht_node *slot = tables[i]->table[j];
+			if (slot == NULL || hasht_node_deleted(slot))
+				continue;
+			struct typeinfo *t = slot->value;
+			if (t->base != FUNCTION_T && !typeinfo_by_reference(t)
+			    && t->place.offset == a.offset
+			    && t->pointer == a.type->pointer
+			    && strcmp(print_basetype(t), print_basetype(a.type)) == 0)
+				return slot->key;
+		}
+	}
+	return NULL;
+}
+
+/* returns bytes taken by a value of type t in C */
+static size_t c_size(struct typeinfo *t)
+{
+	if (t->pointer)
+		return sizeof(void *);
+	switch (t->base) {
+	case INT_T:
+		return sizeof(int);
+	case FLOAT_T:
+		return sizeof(double);
+	case CHAR_T:
+	case BOOL_T:
+		return 1;
+	default:
+		return typeinfo_size(t);
+	}
+}
+
+/*
+ * Prints field access into a, its value if value (RFIELD_O) else its
+ * address (LFIELD_O), of the instance at pointer: by member where the
+ * field is known, else by byte offset.
+ */
+static void map_field(FILE *stream, struct address a, struct address pointer,
+                      struct address offset, bool value)
+{
+	struct typeinfo *class = NULL;
+	if (pointer.type->base == CLASS_T && pointer.type->class.type) {
+		struct hasht *global = list_index(yyscopes, 1)->data;
+		class = hasht_search(global, pointer.type->class.type);
+	}
+	struct typeinfo type = *a.type;
+	type.pointer = value ? a.type->pointer : false;
+	struct address f = { CLASS_R, offset.offset, &type };
+	char *field = find_field(class, f);
+
+	if (field) {
+		p("(");
+		print_t(stream, a);
+		p(")%s((%s *)", value ? "" : "&", pointer.type->class.type);
+		map_address(stream, pointer);
+		p(")->%s", field);
+	} else {
+		p(value ? "(*(" : "((");
+		print_t(stream, a);
+		p(value ? " *)((char *)" : ")((char *)");
+		map_address(stream, pointer);
+		p(" + %d))", offset.offset);
+	}
+}
+
+/*
+ * Prints the constant region, initialized with each string literal.
+ * Identical strings, and strings ending another, share its bytes.
+ * Floats are immediates and take no room.
+ */
+void final_constants(FILE *stream)
+{
+	struct hasht *constant = list_front(yyscopes);
+	free(constants.strings);
+	free(constants.offsets);
+	constants.strings = calloc(constant->size + 1, sizeof(*constants.strings));
+	constants.offsets = calloc(constant->size + 1, sizeof(*constants.offsets));
+	log_assert(constants.strings && constants.offsets);
+	constants.count = 0;
+	constants.size = 0;
+	for (size_t i = 0; i < constant->size; ++i) {
+		struct hasht_node *slot = constant->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *v = slot->value;
+			if (v->base == CHAR_T && v->pointer)
+				constants.strings[constants.count++] = v;
+		}
+	}
+	if (constants.count == 0)
+		return;
+
+	/* a string sorts just before those it is a suffix of */
+	qsort(constants.strings, constants.count, sizeof(*constants.strings),
+	      compare_suffixes);
+
+	size_t *hosts = calloc(constants.count, sizeof(*hosts));
+	log_assert(hosts);
+	for (size_t i = constants.count; i-- > 0;) {
+		struct typeinfo *s = constants.strings[i];
+		if (i + 1 < constants.count
+		    && is_suffix(s, constants.strings[hosts[i + 1]])) {
+			hosts[i] = hosts[i + 1];
+			struct typeinfo *host = constants.strings[hosts[i]];
+			constants.offsets[i] = constants.offsets[hosts[i]]
+				+ host->token->ssize - s->token->ssize;
+		} else {
+			hosts[i] = i;
+			constants.offsets[i] = constants.size;
+			constants.size += s->token->ssize;
+		}
+	}
+
+	/* exactly filled, so no implicit terminating null is stored */
+	p("static const char constant[%zu] =", constants.size);
+	for (size_t i = constants.count; i-- > 0;) {
+		if (hosts[i] != i)
+			continue;
+		struct token *token = constants.strings[i]->token;
+		p("\n\t");
+		print_bytes(stream, token->sval, token->ssize);
+	}
+	p(";\n");
+	free(hosts);
+}
+
+/*
+ * Prints the counters of instrumented code, and a destructor writing
+ * them to the profile at filename when the program exits.
+ */
+void final_profile(FILE *stream, const char *filename)
+{
+	size_t count;
+	struct profile_site *sites = profile_sites(&count);
+	if (count == 0)
+		return;
+
+	p("static unsigned long profile_counts[%zu];\n", count);
+	p("static const char *const profile_sites[%zu] = {", count);
+	for (size_t i = 0; i < count; ++i) {
+		if (sites[i].callee)
+			p("\n\t\"call %s %zu %%lu %s\\n\",", sites[i].proc,
+			  sites[i].index, sites[i].callee);
+		else
+			p("\n\t\"block %s %zu %%lu\\n\",", sites[i].proc,
+			  sites[i].index);
+	}
+	p("\n};\n\n");
+
+	p("static void profile_write(void) __attribute__((destructor));\n");
+	p("static void profile_write(void)\n{\n");
+	p("\tFILE *file = fopen(");
+	print_bytes(stream, (char *)filename, strlen(filename));
+	p(", \"w\");\n");
+	p("\tif (file == NULL)\n\t\treturn;\n");
+	p("\tfor (int i = 0; i < %zu; ++i)\n", count);
+	p("\t\tfprintf(file, profile_sites[i], profile_counts[i]);\n");
+	p("\tfclose(file);\n}\n");
+}
+
+/*
+ * Prints the profiler, with a count and times for each procedure of
+ * code under its name in the source.
+ */
+void final_profiler(FILE *stream, struct list *code)
+{
+	p("static struct profiler_function {\n");
+	p("\tconst char *name;\n");
+	p("\tunsigned long calls;\n");
+	p("\tunsigned long active;\n");
+	p("\tunsigned long long inclusive;\n");
+	p("\tunsigned long long exclusive;\n");
+	p("} profiler_functions[] = {\n");
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		if (op->code == PROC_O) {
+			p("\t{ \"");
+			print_source_name(stream, op->name);
+			p("\" },\n");
+		}
+		iter = iter->next;
+	}
+	p("};\n\n");
+
+	for (size_t i = 0; i < sizeof(profiler) / sizeof(*profiler); ++i)
+		p("%s\n", profiler[i]);
+}
+
+/* orders strings by their bytes from last to first */
+static int compare_suffixes(const void *a, const void *b)
+{
+	struct token *s = (*(struct typeinfo **)a)->token;
+	struct token *t = (*(struct typeinfo **)b)->token;
+	for (size_t i = 1; i <= s->ssize && i <= t->ssize; ++i) {
+		unsigned char x = s->sval[s->ssize - i];
+		unsigned char y = t->sval[t->ssize - i];
+		if (x != y)
+			return (x > y) - (x < y);
+	}
+	return (s->ssize > t->ssize) - (s->ssize < t->ssize);
+}
+
+/* true if the bytes of string s end those of t */
+static bool is_suffix(struct typeinfo *s, struct typeinfo *t)
+{
+	size_t size = s->token->ssize;
+	return size <= t->token->ssize
+		&& memcmp(s->token->sval, t->token->sval + t->token->ssize - size,
+		          size) == 0;
+}
+
+/* returns offset of string constant a in the generated constant region */
+static size_t string_offset(struct address a)
+{
+	for (size_t i = 0; i < constants.count; ++i)
+		if (constants.strings[i]->place.offset == a.offset)
+			return constants.offsets[i];
+	log_error("string constant at %d not found", a.offset);
+	return 0;
+}
+
+/* returns source text of float constant a, which may be a copy's type */
+static char *float_literal(struct address a)
+{
+	struct hasht *constant = list_front(yyscopes);
+	for (size_t i = 0; i < constant->size; ++i) {
+		struct hasht_node *slot = constant->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *v = slot->value;
+			if (v->base == FLOAT_T && v->place.offset == a.offset)
+				return v->token->text;
+		}
+	}
+	log_error("float constant at %d not found", a.offset);
+	return NULL;
+}
+
+/* prints bytes as a C string literal */
+static void print_bytes(FILE *stream, char *bytes, size_t size)
+{
+	p("\"");
+	for (size_t i = 0; i < size; ++i) {
+		unsigned char c = bytes[i];
+		if (c == '\n')
+			p("\\n");
+		else if (c == '\t')
+			p("\\t");
+		else if (c == '"' || c == '\\')
+			p("\\%c", c);
+		else if (c >= ' ' && c <= '~' && c != '?') /* no trigraphs */
+			p("%c", c);
+		else
+			p("\\%03o", c);
+	}
+	p("\"");
+}
+
+/*
+ * Prints a #line directive giving the source line of op as that of
+ * the next line, so compiler and debugger messages refer to it.
+ */
+static void print_line(FILE *stream, struct op *op)
+{
+	if (op->filename == NULL)
+		return;
+	p("#line %d ", op->lineno);
+	print_bytes(stream, op->filename, strlen(op->filename));
+	p("\n");
+}
+
+/* prints the name of procedure Class__method as Class::method */
+static void print_source_name(FILE *stream, char *name)
+{
+	char *split = strstr(name, "__");
+	if (split)
+		p("%.*s::%s", (int)(split - name), name, split + 2);
+	else
+		p("%s", name);
+}
+
 /* print prototypes of functions in symbol table */
 static void print_prototypes(FILE *stream, struct hasht *table, char *class)
 {
@@ -454,12 +1287,16 @@ static void print_prototypes(FILE *stream, struct hasht *table, char *class)
 					continue;
 				print_typeinfo(stream, "", typeinfo_return(value));
 				if (class)
-					p(" %s__%s();\n", class, key);
+					p(" %s__%s", class, key);
 				else
-					p(" %s();\n", key);
+					p(" %s", key);
+				print_params(stream, value, class);
+				p(";\n");
 			} else if (value->base == FUNCTION_T && class) {
 				print_typeinfo(stream, NULL, typeinfo_return(value));
-				p(" %s__%s() { } /* noop function */\n", class, key);
+				p(" %s__%s", class, key);
+				print_params(stream, value, class);
+				p(" { } /* noop function */\n");
 			}
 		}
 	}
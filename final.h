@@ -14,6 +14,9 @@
 
 struct list;
 
+void final_constants(FILE *stream);
+void final_profile(FILE *stream, const char *filename);
+void final_profiler(FILE *stream, struct list *code);
 void final_code(FILE *stream, struct list *code);
 
 #endif /* FINAL_H */
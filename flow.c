@@ -0,0 +1,603 @@
+/*
+ * flow.c - Implementation of control flow graphs.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flow.h"
+#include "intermediate.h"
+#include "type.h"
+
+#include "logger.h"
+#include "list.h"
+
+extern size_t yylabels;
+
+#define op_at(node) ((struct op *)(node)->data)
+
+static size_t find_blocks(struct flow *f);
+static void add_edge(struct flow *f, size_t from, size_t to);
+static void find_edges(struct flow *f);
+static void find_dominators(struct flow *f);
+static void find_body(struct flow *f, struct loop *loop, size_t latch);
+static int compare_loops(const void *a, const void *b);
+static int first_access(struct block *block, struct list_node *iter,
+                        struct address a);
+
+/*
+ * Builds the control flow graph of the procedure starting at proc,
+ * with dominators for every reachable block.
+ */
+struct flow *flow_new(struct list_node *proc)
+{
+	log_assert(op_at(proc)->code == PROC_O);
+
+	struct flow *f = calloc(1, sizeof(*f));
+	log_assert(f);
+	f->proc = proc;
+
+	f->count = find_blocks(f);
+	f->blocks = calloc(f->count, sizeof(*f->blocks));
+	log_assert(f->count == 0 || f->blocks);
+	find_blocks(f);
+
+	find_edges(f);
+	find_dominators(f);
+
+	return f;
+}
+
+void flow_free(struct flow *f)
+{
+	for (size_t i = 0; i < f->count; ++i) {
+		free(f->blocks[i].succs);
+		free(f->blocks[i].preds);
+	}
+	free(f->blocks);
+	free(f->dom);
+	free(f);
+}
+
+/*
+ * Returns true if every path from entry to block b passes through d.
+ */
+bool flow_dominates(struct flow *f, size_t d, size_t b)
+{
+	return f->dom[b * f->count + d];
+}
+
+/*
+ * Returns true if a may be read directly, before it is overwritten,
+ * after node in block b.
+ */
+bool flow_live_after(struct flow *f, size_t b, struct list_node *node,
+                     struct address a)
+{
+	struct block *block = &f->blocks[b];
+	int access = first_access(block, block_next(block, node), a);
+	if (access != 0)
+		return access > 0;
+
+	bool *seen = calloc(f->count, sizeof(*seen));
+	size_t *stack = malloc(f->count * sizeof(*stack));
+	log_assert(seen && stack);
+	size_t top = 0;
+	for (size_t i = 0; i < block->succ_count; ++i) {
+		seen[block->succs[i]] = true;
+		stack[top++] = block->succs[i];
+	}
+
+	bool live = false;
+	while (top > 0 && !live) {
+		block = &f->blocks[stack[--top]];
+		access = first_access(block, block->first, a);
+		live = access > 0;
+		if (access != 0)
+			continue;
+		for (size_t i = 0; i < block->succ_count; ++i)
+			if (!seen[block->succs[i]]) {
+				seen[block->succs[i]] = true;
+				stack[top++] = block->succs[i];
+			}
+	}
+
+	free(stack);
+	free(seen);
+	return live;
+}
+
+/*
+ * Returns the natural loops of f, one per header (merging back edges
+ * to the same header), sorted smallest first so inner loops precede
+ * the loops enclosing them.
+ */
+struct loop *flow_loops(struct flow *f, size_t *count)
+{
+	struct loop *loops = NULL;
+	*count = 0;
+
+	for (size_t b = 0; b < f->count; ++b) {
+		struct block *block = &f->blocks[b];
+		if (!block->reachable)
+			continue;
+		for (size_t i = 0; i < block->succ_count; ++i) {
+			size_t h = block->succs[i];
+			if (!flow_dominates(f, h, b))
+				continue;
+
+			/* back edge b -> h */
+			struct loop *loop = NULL;
+			for (size_t j = 0; j < *count; ++j)
+				if (loops[j].header == h)
+					loop = &loops[j];
+			if (loop == NULL) {
+				loops = realloc(loops, (*count + 1) * sizeof(*loops));
+				log_assert(loops);
+				loop = &loops[(*count)++];
+				loop->header = h;
+				loop->body = calloc(f->count, sizeof(*loop->body));
+				log_assert(loop->body);
+				loop->body[h] = true;
+				loop->size = 1;
+			}
+			find_body(f, loop, b);
+		}
+	}
+
+	if (*count > 1)
+		qsort(loops, *count, sizeof(*loops), compare_loops);
+	return loops;
+}
+
+void flow_loops_free(struct loop *loops, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		free(loops[i].body);
+	free(loops);
+}
+
+/*
+ * Returns the op after iter in block, else NULL at its end.
+ */
+struct list_node *block_next(struct block *block, struct list_node *iter)
+{
+	return (iter == block->last) ? NULL : iter->next;
+}
+
+/*
+ * Returns the label address of a jump, else NULL.
+ */
+struct address *op_target(struct op *op)
+{
+	switch (op->code) {
+	case GOTO_O:
+		return &op->address[0];
+	case IF_O:
+	case IFN_O:
+	case CASE_O:
+		return &op->address[1];
+	case TABLE_O:
+	case IFLT_O:
+	case IFLE_O:
+	case IFGT_O:
+	case IFGE_O:
+	case IFEQ_O:
+	case IFNE_O:
+		return &op->address[2];
+	default:
+		return NULL;
+	}
+}
+
+/*
+ * Returns the address an op stores its result to, else NULL.
+ */
+struct address *op_def(struct op *op)
+{
+	switch (op->code) {
+	case CALL_O:
+	case CALLC_O:
+		if (op->address[0].region == UNKNOWN_R)
+			return NULL;
+		return &op->address[0];
+	case NEW_O:
+	case ADD_O:
+	case FADD_O:
+	case SUB_O:
+	case FSUB_O:
+	case MUL_O:
+	case FMUL_O:
+	case DIV_O:
+	case FDIV_O:
+	case MOD_O:
+	case SHL_O:
+	case SHR_O:
+	case USHR_O:
+	case MULH_O:
+	case INC_O:
+	case DEC_O:
+	case LT_O:
+	case FLT_O:
+	case LE_O:
+	case FLE_O:
+	case GT_O:
+	case FGT_O:
+	case GE_O:
+	case FGE_O:
+	case EQ_O:
+	case FEQ_O:
+	case NE_O:
+	case FNE_O:
+	case OR_O:
+	case AND_O:
+	case NEG_O:
+	case FNEG_O:
+	case NOT_O:
+	case RSTAR_O:
+	case ADDR_O:
+	case ASN_O:
+	case LARR_O:
+	case RARR_O:
+	case LFIELD_O:
+	case RFIELD_O:
+		return &op->address[0];
+	default:
+		return NULL;
+	}
+}
+
+/*
+ * Returns true if op directly reads the value at its address i.
+ */
+bool op_uses(struct op *op, int i)
+{
+	switch (op->code) {
+	case PARAM_O:
+	case RET_O:
+	case TABLE_O:
+	case DEL_O:
+	case PINT_O:
+	case PCHAR_O:
+	case PBOOL_O:
+	case PFLOAT_O:
+	case PSTR_O:
+	case IF_O:
+	case IFN_O:
+	case INC_O:
+	case DEC_O:
+		return i == 0;
+	case LSTAR_O:
+	case IFLT_O:
+	case IFLE_O:
+	case IFGT_O:
+	case IFGE_O:
+	case IFEQ_O:
+	case IFNE_O:
+		return i == 0 || i == 1;
+	case NEG_O:
+	case FNEG_O:
+	case NOT_O:
+	case ASN_O:
+	case RSTAR_O:
+		return i == 1;
+	case LARR_O:
+		/* the array operand is only an address, unless a pointer */
+		return i == 2 || (i == 1 && op->address[1].type->pointer);
+	case ADD_O:
+	case FADD_O:
+	case SUB_O:
+	case FSUB_O:
+	case MUL_O:
+	case FMUL_O:
+	case DIV_O:
+	case FDIV_O:
+	case MOD_O:
+	case SHL_O:
+	case SHR_O:
+	case USHR_O:
+	case MULH_O:
+	case LT_O:
+	case FLT_O:
+	case LE_O:
+	case FLE_O:
+	case GT_O:
+	case FGT_O:
+	case GE_O:
+	case FGE_O:
+	case EQ_O:
+	case FEQ_O:
+	case NE_O:
+	case FNE_O:
+	case OR_O:
+	case AND_O:
+	case RARR_O:
+	case LFIELD_O:
+	case RFIELD_O:
+		return i == 1 || i == 2;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Returns true if op directly reads memory overlapping a. Reads
+ * through pointers and by called procedures are not included.
+ */
+bool op_reads(struct op *op, struct address a)
+{
+	for (int i = 0; i < 3; ++i)
+		if (op_uses(op, i) && address_overlaps(op->address[i], a))
+			return true;
+	return false;
+}
+
+/*
+ * Returns true if op jumps or falls through depending on a condition.
+ */
+bool op_branches(struct op *op)
+{
+	struct address *target = op_target(op);
+	return target && op->code != GOTO_O && op->code != TABLE_O
+		&& op->code != CASE_O;
+}
+
+/*
+ * Returns true if control never falls through op to the next op.
+ */
+bool op_jumps(struct op *op)
+{
+	return op->code == GOTO_O || op->code == RET_O || op->code == TABLE_O
+		|| op->code == TCALL_O;
+}
+
+/*
+ * Returns true if addresses a and b share any bytes of memory. The
+ * parameter and local regions are the same memory in final code.
+ */
+bool address_overlaps(struct address a, struct address b)
+{
+	enum region r = (a.region == PARAM_R) ? LOCAL_R : a.region;
+	enum region s = (b.region == PARAM_R) ? LOCAL_R : b.region;
+	if (r != s || r == CONST_R || r == LABEL_R || r == UNKNOWN_R)
+		return false;
+
+	size_t a_size = typeinfo_size(a.type);
+	size_t b_size = typeinfo_size(b.type);
+	if (a_size == 0)
+		a_size = 1;
+	if (b_size == 0)
+		b_size = 1;
+
+	return a.offset < b.offset + (int)b_size
+		&& b.offset < a.offset + (int)a_size;
+}
+
+/*
+ * Partitions the procedure into blocks, recording their bounds if
+ * f->blocks is allocated, and returns the number of blocks.
+ */
+static size_t find_blocks(struct flow *f)
+{
+	size_t count = 0;
+	bool leader = true;
+	struct list_node *iter = f->proc->next;
+	while (!list_end(iter) && op_at(iter)->code != END_O) {
+		struct op *op = iter->data;
+		if (op->code == LABEL_O && !leader
+		    && op_at(iter->prev)->code != LABEL_O)
+			leader = true;
+		if (leader) {
+			if (f->blocks)
+				f->blocks[count].first = iter;
+			++count;
+			leader = false;
+		}
+		if (f->blocks)
+			f->blocks[count - 1].last = iter;
+
+		if (op->code == TABLE_O) {
+			/* entries belong to their table */
+			for (int i = 0; i < op->address[1].offset; ++i) {
+				iter = iter->next;
+				if (f->blocks)
+					f->blocks[count - 1].last = iter;
+			}
+		}
+		if (op_jumps(op) || op_branches(op))
+			leader = true;
+		iter = iter->next;
+	}
+	log_assert(!list_end(iter));
+	f->end = iter;
+	return count;
+}
+
+static void add_edge(struct flow *f, size_t from, size_t to)
+{
+	struct block *a = &f->blocks[from];
+	struct block *b = &f->blocks[to];
+	for (size_t i = 0; i < a->succ_count; ++i)
+		if (a->succs[i] == to)
+			return;
+
+	a->succs = realloc(a->succs, (a->succ_count + 1) * sizeof(*a->succs));
+	b->preds = realloc(b->preds, (b->pred_count + 1) * sizeof(*b->preds));
+	log_assert(a->succs && b->preds);
+	a->succs[a->succ_count++] = to;
+	b->preds[b->pred_count++] = from;
+}
+
+/*
+ * Links each block to the blocks its jumps target and the block it
+ * falls through to.
+ */
+static void find_edges(struct flow *f)
+{
+	size_t *labels = malloc(yylabels * sizeof(*labels));
+	log_assert(yylabels == 0 || labels);
+	for (size_t i = 0; i < yylabels; ++i)
+		labels[i] = f->count;
+
+	for (size_t b = 0; b < f->count; ++b) {
+		struct list_node *iter = f->blocks[b].first;
+		while (op_at(iter)->code == LABEL_O) {
+			labels[op_at(iter)->address[0].offset] = b;
+			if (iter == f->blocks[b].last)
+				break;
+			iter = iter->next;
+		}
+	}
+
+	for (size_t b = 0; b < f->count; ++b) {
+		struct block *block = &f->blocks[b];
+		struct list_node *iter = block->first;
+		while (true) {
+			struct address *target = op_target(iter->data);
+			if (target && labels[target->offset] < f->count)
+				add_edge(f, b, labels[target->offset]);
+			if (iter == block->last)
+				break;
+			iter = iter->next;
+		}
+
+		/* a jump table ends its block before its entries */
+		iter = block->last;
+		while (op_at(iter)->code == CASE_O)
+			iter = iter->prev;
+		if (!op_jumps(iter->data) && b + 1 < f->count)
+			add_edge(f, b, b + 1);
+	}
+
+	free(labels);
+}
+
+/*
+ * Iteratively solves dom(b) = {b} + intersection of dom(p) over the
+ * predecessors p of b. Unreachable blocks dominate nothing but
+ * themselves.
+ */
+static void find_dominators(struct flow *f)
+{
+	size_t n = f->count;
+	f->dom = calloc(n * n, sizeof(*f->dom));
+	log_assert(n == 0 || f->dom);
+	if (n == 0)
+		return;
+
+	/* mark reachable blocks */
+	size_t *stack = malloc(n * sizeof(*stack));
+	log_assert(stack);
+	size_t top = 0;
+	f->blocks[0].reachable = true;
+	stack[top++] = 0;
+	while (top > 0) {
+		struct block *block = &f->blocks[stack[--top]];
+		for (size_t i = 0; i < block->succ_count; ++i) {
+			size_t s = block->succs[i];
+			if (!f->blocks[s].reachable) {
+				f->blocks[s].reachable = true;
+				stack[top++] = s;
+			}
+		}
+	}
+	free(stack);
+
+	for (size_t b = 0; b < n; ++b) {
+		if (b == 0 || !f->blocks[b].reachable)
+			f->dom[b * n + b] = true;
+		else
+			memset(&f->dom[b * n], true, n * sizeof(*f->dom));
+	}
+
+	bool changed = true;
+	bool *row = malloc(n * sizeof(*row));
+	log_assert(row);
+	while (changed) {
+		changed = false;
+		for (size_t b = 1; b < n; ++b) {
+			struct block *block = &f->blocks[b];
+			if (!block->reachable)
+				continue;
+
+			memset(row, true, n * sizeof(*row));
+			for (size_t i = 0; i < block->pred_count; ++i) {
+				size_t p = block->preds[i];
+				if (!f->blocks[p].reachable)
+					continue;
+				for (size_t d = 0; d < n; ++d)
+					row[d] = row[d] && f->dom[p * n + d];
+			}
+			row[b] = true;
+
+			if (memcmp(row, &f->dom[b * n], n * sizeof(*row)) != 0) {
+				memcpy(&f->dom[b * n], row, n * sizeof(*row));
+				changed = true;
+			}
+		}
+	}
+	free(row);
+}
+
+/*
+ * Adds to loop every block which reaches latch without passing
+ * through the loop header.
+ */
+static void find_body(struct flow *f, struct loop *loop, size_t latch)
+{
+	size_t *stack = malloc(f->count * sizeof(*stack));
+	log_assert(stack);
+	size_t top = 0;
+	if (!loop->body[latch]) {
+		loop->body[latch] = true;
+		++loop->size;
+		stack[top++] = latch;
+	}
+	while (top > 0) {
+		struct block *block = &f->blocks[stack[--top]];
+		for (size_t i = 0; i < block->pred_count; ++i) {
+			size_t p = block->preds[i];
+			if (!loop->body[p] && f->blocks[p].reachable) {
+				loop->body[p] = true;
+				++loop->size;
+				stack[top++] = p;
+			}
+		}
+	}
+	free(stack);
+}
+
+/*
+ * Returns 1 if the ops of block from iter on read a before writing
+ * all of it, -1 if they write it first, else 0.
+ */
+static int first_access(struct block *block, struct list_node *iter,
+                        struct address a)
+{
+	size_t size = typeinfo_size(a.type);
+	for (; iter; iter = block_next(block, iter)) {
+		if (op_reads(iter->data, a))
+			return 1;
+		struct address *def = op_def(iter->data);
+		if (def && address_overlaps(*def, a) && def->offset <= a.offset
+		    && def->offset + typeinfo_size(def->type)
+		       >= a.offset + size)
+			return -1;
+	}
+	return 0;
+}
+
+static int compare_loops(const void *a, const void *b)
+{
+	const struct loop *x = a;
+	const struct loop *y = b;
+	return (x->size > y->size) - (x->size < y->size);
+}
+
+#undef op_at
@@ -0,0 +1,64 @@
+/*
+ * flow.h - Control flow graphs over intermediate code.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "type.h"
+
+struct list_node;
+struct op;
+
+/* a maximal run of ops entered only at first and left only at last */
+struct block {
+	struct list_node *first;
+	struct list_node *last;
+	size_t *succs;
+	size_t succ_count;
+	size_t *preds;
+	size_t pred_count;
+	bool reachable;
+};
+
+/* the basic blocks of one procedure, in code order; block 0 is entry */
+struct flow {
+	struct list_node *proc; /* PROC_O */
+	struct list_node *end;  /* END_O */
+	struct block *blocks;
+	size_t count;
+	bool *dom;              /* dom[b * count + d] iff d dominates b */
+};
+
+/* a natural loop: header plus every block reaching a back edge to it */
+struct loop {
+	size_t header;
+	bool *body;             /* indexed by block */
+	size_t size;
+};
+
+struct flow *flow_new(struct list_node *proc);
+void flow_free(struct flow *f);
+bool flow_dominates(struct flow *f, size_t d, size_t b);
+bool flow_live_after(struct flow *f, size_t b, struct list_node *node,
+                     struct address a);
+struct loop *flow_loops(struct flow *f, size_t *count);
+void flow_loops_free(struct loop *loops, size_t count);
+struct list_node *block_next(struct block *block, struct list_node *iter);
+
+struct address *op_target(struct op *op);
+struct address *op_def(struct op *op);
+bool op_uses(struct op *op, int i);
+bool op_reads(struct op *op, struct address a);
+bool op_jumps(struct op *op);
+bool op_branches(struct op *op);
+bool address_overlaps(struct address a, struct address b);
+
+#endif /* FLOW_H */
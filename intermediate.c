@@ -43,6 +43,7 @@ static struct address temp_new(struct typeinfo *t);
 static struct list *get_code(struct tree *t, int i);
 static struct address get_place(struct tree *t, int i);
 static struct address get_label(struct op *op);
+static struct token *first_token(struct tree *t);
 
 const struct address e = { UNKNOWN_R, 0, &unknown_type };
 const struct address one = { CONST_R, 1, &int_type };
@@ -51,6 +52,9 @@ struct op break_op;
 struct op continue_op;
 struct op default_op;
 
+/* the source location given to new ops */
+static struct token *location;
+
 /*
  * Tree traversal(s) to generate a list of three-address code
  * instructions given a parse tree. Handles scopes in pre-order,
@@ -60,12 +64,19 @@ struct op default_op;
 #define child(i) tree_index(t, i)
 #define map_c(a) map_code(n->rule, a)
 
-static struct op *handle_switch(struct list *code, struct op *next,
-                                struct address temp, struct address test,
-                                struct list *test_code);
+static void handle_switch(struct list *code, struct op *next,
+                          struct address temp, struct address test,
+                          struct list *test_code);
 
 static void backpatch(struct list *code, struct op *first, struct op *follow);
 
+static bool is_condition(struct tree *t);
+static void make_jumps(struct tree *t);
+static void patch_jumps(struct list *jumps, struct op *label);
+static void materialize(struct node *n);
+static void append_branch(struct node *n, struct tree *t, int i,
+                          struct op *truel, struct op *falsel);
+
 void code_generate(struct tree *t)
 {
 	struct node *n = t->data;
@@ -104,9 +115,9 @@ void code_generate(struct tree *t)
 		/* manage memory regions */
 		region = LOCAL_R;
 		offset = scope_size(f->function.symbols);
-		/* class functions' scope size does not account for implicit pointer */
-		if (class)
-			offset += typeinfo_size(&ptr_type);
+		/* parameters, with implicit pointer of class functions */
+		if (offset < f->function.param_size)
+			offset = f->function.param_size;
 
 		break;
 	}
@@ -131,6 +142,11 @@ void code_generate(struct tree *t)
 		return;
 	}
 
+	/* ops of this node come from where it starts */
+	struct token *token = first_token(t);
+	if (token)
+		location = token;
+
 	/** post-order **/
 	switch(n->rule) {
 	case INITIALIZER:
@@ -191,16 +207,14 @@ void code_generate(struct tree *t)
 		break;
 	}
 	case NEW_EXPR: { /* explicit constructor call */
-		append_code(2); /* parameters */
 		char *k = get_class(t);
 		struct typeinfo *class = scope_search(k);
 		if (class) {
-			struct address size = { CONST_R,
-			                        scope_size(class->class.public)
-			                        + scope_size(class->class.private),
+			struct address size = { CONST_R, typeinfo_size(class),
 			                        &int_type };
 			class = typeinfo_copy(class);
 			class->pointer = true;
+			class->class.type = k;
 			n->place = temp_new(class);
 			push_op(n, op_new(NEW_O, k, n->place, size, e));
 
@@ -208,11 +222,14 @@ void code_generate(struct tree *t)
 			asprintf(&name, "%s__%s", k, k);
 			struct typeinfo *ctor = hasht_search(class->class.public, k);
 			struct address count = { CONST_R,
-			                         list_size(ctor->function.parameters),
+			                         list_size(ctor->function.parameters) + 1,
 			                         &int_type };
+			/* instance is the first parameter */
 			push_op(n, op_new(PARAM_O, k, n->place, e, e));
+			append_code(2); /* parameters */
 			push_op(n, op_new(CALL_O, name, e, count, e));
 		} else {
+			append_code(2); /* parameters */
 			struct tree *type_spec = get_production(t, TYPE_SPEC_SEQ);
 			struct typeinfo *type = typeinfo_copy(type_check(tree_index(type_spec, 0)));
 			struct address size = { CONST_R,
@@ -323,6 +340,15 @@ void code_generate(struct tree *t)
 			n->code = list_concat(n->code, n_->code);
 			/* if child has a place, add a param */
 			struct address p = get_place(child, -1);
+			if (p.region != UNKNOWN_R && p.type->base == ARRAY_T
+			    && !p.type->pointer) {
+				/* arrays are passed as their address */
+				struct typeinfo *temp = typeinfo_copy(p.type);
+				temp->pointer = true;
+				struct address pointer = temp_new(temp);
+				push_op(n, op_new(ADDR_O, NULL, pointer, p, e));
+				p = pointer;
+			}
 			if (p.region != UNKNOWN_R)
 				push_op(n, op_new(PARAM_O, NULL, p, e, e));
 			iter = iter->next;
@@ -354,9 +380,7 @@ void code_generate(struct tree *t)
 	case IF_STATEMENT: { /* if (test) { body } */
 		struct op *first = label_new();
 		struct op *follow = label_new();
-		append_code(1); /* test */
-		push_op(n, op_new(IF_O, NULL, get_place(t, 1), get_label(first), e));
-		push_op(n, op_new(GOTO_O, NULL, get_label(follow), e, e));
+		append_branch(n, t, 1, first, follow); /* test */
 		push_op(n, first);
 		append_code(2); /* true */
 		push_op(n, follow);
@@ -364,21 +388,21 @@ void code_generate(struct tree *t)
 	}
 	case IF_ELSE_STATEMENT: { /* if (test) { true } else { false } chains */
 		struct op *first = label_new();
+		struct op *other = label_new();
 		struct op *follow = label_new();
-		append_code(1); /* test */
-		push_op(n, op_new(IF_O, NULL, get_place(t, 1), get_label(first), e));
-		push_op(n, op_new(GOTO_O, NULL, get_label(follow), e, e));
+		append_branch(n, t, 1, first, other); /* test */
 		push_op(n, first);
 		append_code(2); /* true */
-		push_op(n, follow);
+		push_op(n, op_new(GOTO_O, NULL, get_label(follow), e, e));
+		push_op(n, other);
 		append_code(4); /* false */
+		push_op(n, follow);
 		break;
 	}
 	case SWITCH_STATEMENT: { /* switch (test) { body } */
 		struct address s = get_place(t, 1);
 		struct op *test = label_new();
 		struct op *next = label_new();
-		struct op *dflt = NULL;
 
 		/* create test code list starting with test label */
 		struct list *test_code = list_new(NULL, NULL);
@@ -387,15 +411,12 @@ void code_generate(struct tree *t)
 		/* call search for labels, tests, and breaks */
 		append_code(1); /* test */
 		push_op(n, op_new(GOTO_O, NULL, get_label(test), e, e));
-		dflt = handle_switch(get_code(t, 2), next,
-		                     temp_new(&bool_type), s, test_code);
+		handle_switch(get_code(t, 2), next,
+		              temp_new(&bool_type), s, test_code);
 		append_code(2); /* body */
 
 		/* concat test code and follow label */
 		n->code = list_concat(n->code, test_code);
-		/* push GOTO default if found */
-		if (dflt)
-			push_op(n, op_new(GOTO_O, NULL, get_label(dflt), e, e));
 		push_op(n, next);
 
 		break;
@@ -405,9 +426,7 @@ void code_generate(struct tree *t)
 		struct op *body = label_new();
 		struct op *follow = label_new();
 		push_op(n, first); /* before test */
-		append_code(1); /* test */
-		push_op(n, op_new(IF_O, NULL, get_place(t, 1), get_label(body), e));
-		push_op(n, op_new(GOTO_O, NULL, get_label(follow), e, e));
+		append_branch(n, t, 1, body, follow); /* test */
 		push_op(n, body);
 		backpatch(get_code(t, 2), first, follow);
 		append_code(2); /* body */
@@ -421,8 +440,7 @@ void code_generate(struct tree *t)
 		push_op(n, first); /* before body */
 		backpatch(get_code(t, 1), first, follow);
 		append_code(1); /* body */
-		append_code(3); /* test */
-		push_op(n, op_new(IF_O, NULL, get_place(t, 3), get_label(first), e));
+		append_branch(n, t, 3, first, follow); /* test */
 		push_op(n, follow);
 		break;
 	}
@@ -432,9 +450,7 @@ void code_generate(struct tree *t)
 		struct op *body = label_new();
 		struct op *follow = label_new();
 		push_op(n, first); /* before condition */
-		append_code(2); /* test */
-		push_op(n, op_new(IF_O, NULL, get_place(t, 2), get_label(body), e));
-		push_op(n, op_new(GOTO_O, NULL, get_label(follow), e, e));
+		append_branch(n, t, 2, body, follow); /* test */
 		push_op(n, body);
 		backpatch(get_code(t, 4), first, follow);
 		append_code(4); /* body */
@@ -454,7 +470,9 @@ void code_generate(struct tree *t)
 			struct address count = { CONST_R,
 			                         1,
 			                         &int_type };
-			push_op(n, op_new(PARAM_O, NULL, p, e, e));
+			struct address pointer = temp_new(&ptr_type);
+			push_op(n, op_new(ADDR_O, NULL, pointer, p, e));
+			push_op(n, op_new(PARAM_O, NULL, pointer, e, e));
 			push_op(n, op_new(CALL_O, "string__c_str", temp, count, e));
 			p = temp;
 		}
@@ -466,10 +484,7 @@ void code_generate(struct tree *t)
 	case REL_LTEQ:
 	case REL_GTEQ:
 	case NOTEQUAL_EXPR:
-	case EQUAL_EXPR:
-	case LOGICAL_OR_EXPR:
-	case LOGICAL_AND_EXPR: { /* int and float comparisons */
-		/* TODO: handle short circuiting */
+	case EQUAL_EXPR: { /* int and float comparisons */
 		n->place = temp_new(&bool_type);
 		struct address l = get_place(t, 0);
 		append_code(0); /* left */
@@ -478,6 +493,30 @@ void code_generate(struct tree *t)
 		push_op(n, op_new(map_c(l.type), NULL, n->place, l, r));
 		break;
 	}
+	case LOGICAL_AND_EXPR:
+	case LOGICAL_OR_EXPR: { /* short-circuit with backpatched jumps */
+		struct node *l = get_node(t, 0);
+		struct node *r = get_node(t, 2);
+		make_jumps(child(0));
+		make_jumps(child(2));
+		/* right operand is only reached when left does not decide */
+		struct op *right = label_new();
+		append_code(0); /* left */
+		push_op(n, right);
+		append_code(2); /* right */
+		if (n->rule == LOGICAL_AND_EXPR) {
+			patch_jumps(l->truelist, right);
+			n->truelist = r->truelist;
+			n->falselist = list_concat(l->falselist, r->falselist);
+		} else {
+			patch_jumps(l->falselist, right);
+			n->truelist = list_concat(l->truelist, r->truelist);
+			n->falselist = r->falselist;
+		}
+		if (!is_condition(t))
+			materialize(n);
+		break;
+	}
 	case ADD_EXPR:
 	case SUB_EXPR:
 	case MULT_EXPR:
@@ -518,6 +557,17 @@ void code_generate(struct tree *t)
 		break;
 	}
 	case UNARY_NOT: { /* logical not */
+		struct node *c = get_node(t, 1);
+		if (c->truelist || is_condition(t)) {
+			/* jumping code just swaps true and false */
+			make_jumps(child(1));
+			append_code(1);
+			n->truelist = c->falselist;
+			n->falselist = c->truelist;
+			if (!is_condition(t))
+				materialize(n);
+			break;
+		}
 		n->place = temp_new(&bool_type);
 		append_code(1);
 		push_op(n, op_new(NOT_O, NULL, n->place, get_place(t, 1), e));
@@ -525,6 +575,13 @@ void code_generate(struct tree *t)
 	}
 	case UNARY_MINUS: { /* negative int or float */
 		struct address p = get_place(t, 1);
+		if (p.region == CONST_R && !p.type->pointer
+		    && p.type->base == INT_T) {
+			/* negative integer literal, e.g. for case labels */
+			n->place = p;
+			n->place.offset = -p.offset;
+			break;
+		}
 		n->place = temp_new(p.type);
 		append_code(1);
 		push_op(n, op_new(map_c(p.type), NULL, n->place, p, e));
@@ -578,6 +635,7 @@ void code_generate(struct tree *t)
 		struct address index = get_place(t, 2);
 		char *name;
 		asprintf(&name, "%s[%d]", k, index.offset);
+		append_code(2); /* index */
 		/* calculate real offset */
 		struct address offset = temp_new(&int_type);
 		struct address size = { CONST_R,
@@ -708,39 +766,132 @@ void code_generate(struct tree *t)
 	}
 }
 
+/*
+ * Switch dispatch strategy: up to SWITCH_LINEAR cases are tested one
+ * at a time, case values filling at least 1 in SWITCH_DENSITY slots
+ * of their range (up to SWITCH_TABLE_MAX slots) become a jump table,
+ * and anything else is split into a balanced binary decision tree.
+ */
+#define SWITCH_LINEAR 4
+#define SWITCH_DENSITY 2
+#define SWITCH_TABLE_MAX 1024
+
+struct switch_case {
+	struct address value;
+	struct op *label;
+};
+
+static int compare_cases(const void *a, const void *b)
+{
+	const struct switch_case *x = a;
+	const struct switch_case *y = b;
+	return (x->value.offset > y->value.offset)
+		- (x->value.offset < y->value.offset);
+}
+
+/*
+ * Appends dispatch code for the sorted cases [lo, hi) to code,
+ * jumping to miss if none match.
+ */
+static void lower_switch(struct switch_case *cases, size_t lo, size_t hi,
+                         struct address temp, struct address test,
+                         struct op *miss, struct list *code)
+{
+	size_t count = hi - lo;
+
+	if (count <= SWITCH_LINEAR) {
+		for (size_t i = lo; i < hi; ++i) {
+			struct address value = cases[i].value;
+			list_push_back(code, op_new(EQ_O, NULL, temp, test, value));
+			list_push_back(code, op_new(IF_O, NULL, temp,
+			                            get_label(cases[i].label), e));
+		}
+		list_push_back(code, op_new(GOTO_O, NULL, get_label(miss), e, e));
+		return;
+	}
+
+	long range = (long)cases[hi - 1].value.offset - cases[lo].value.offset + 1;
+	if (range <= SWITCH_TABLE_MAX && (long)count * SWITCH_DENSITY >= range) {
+		/* table is followed by its entries */
+		struct address size = { CONST_R, count, &int_type };
+		list_push_back(code, op_new(TABLE_O, NULL, test, size, get_label(miss)));
+		for (size_t i = lo; i < hi; ++i) {
+			struct address value = cases[i].value;
+			list_push_back(code, op_new(CASE_O, NULL, value,
+			                            get_label(cases[i].label), e));
+		}
+		return;
+	}
+
+	/* binary search: lower half jumps away, upper half falls through */
+	size_t mid = lo + count / 2;
+	struct op *lower = label_new();
+	struct address pivot = cases[mid].value;
+	list_push_back(code, op_new(LT_O, NULL, temp, test, pivot));
+	list_push_back(code, op_new(IF_O, NULL, temp, get_label(lower), e));
+	lower_switch(cases, mid, hi, temp, test, miss, code);
+	list_push_back(code, lower);
+	lower_switch(cases, lo, mid, temp, test, miss, code);
+}
+
 /*
  * Creates test code given a the body's code list with marked nodes
  * for labels and breaks.
  *
- * Returns the default label with GOTO dflt appended after this
- * function returns.
+ * Case labels are marked by their value in address[1]. Constant cases
+ * are sorted and dispatched by lower_switch(), otherwise they are
+ * tested in order. Unmatched tests jump to the default label if
+ * found, else to next.
  */
-static struct op *handle_switch(struct list *code, struct op *next,
-                                struct address temp, struct address test,
-                                struct list *test_code)
+static void handle_switch(struct list *code, struct op *next,
+                          struct address temp, struct address test,
+                          struct list *test_code)
 {
 	struct op *dflt = NULL;
+	struct switch_case *cases = calloc(list_size(code) + 1, sizeof(*cases));
+	log_assert(cases);
+	size_t count = 0;
+	bool constant = true;
+
 	struct list_node *iter = list_head(code);
 	while (!list_end(iter)) {
 		struct op *op = iter->data;
-		if (op->code == LABEL_O) {
-			/* append IF(EQ(s, case), label), clear label */
-			list_push_back(test_code, op_new(EQ_O, NULL, temp,
-			                                 test, op->address[1]));
-			list_push_back(test_code, op_new(IF_O, NULL, temp,
-			                                 get_label(op), e));
+		if (op->code == LABEL_O && op->address[1].region != UNKNOWN_R) {
+			/* record case, clear label */
+			struct address value = op->address[1];
+			if (value.region != CONST_R || value.type->pointer
+			    || value.type->base == FLOAT_T)
+				constant = false;
+			cases[count].value = value;
+			cases[count].label = op;
+			++count;
 			op->address[1] = e;
 		} else if (op == &break_op) {
 			/* replace marker with GOTO next for break statements */
 			iter->data = op_new(GOTO_O, NULL, get_label(next), e, e);
 		} else if (op == &default_op) {
-			/* replace marker with default label and pass back */
+			/* replace marker with default label */
 			dflt = label_new();
 			iter->data = dflt;
 		}
 		iter = iter->next;
 	}
-	return dflt;
+
+	struct op *miss = dflt ? dflt : next;
+	if (constant) {
+		qsort(cases, count, sizeof(*cases), &compare_cases);
+		lower_switch(cases, 0, count, temp, test, miss, test_code);
+	} else {
+		/* append IF(EQ(s, case), label) for each case in order */
+		for (size_t i = 0; i < count; ++i) {
+			list_push_back(test_code, op_new(EQ_O, NULL, temp,
+			                                 test, cases[i].value));
+			list_push_back(test_code, op_new(IF_O, NULL, temp,
+			                                 get_label(cases[i].label), e));
+		}
+		list_push_back(test_code, op_new(GOTO_O, NULL, get_label(miss), e, e));
+	}
+	free(cases);
 }
 
 static void backpatch(struct list *code, struct op *first, struct op *follow)
@@ -755,6 +906,127 @@ static void backpatch(struct list *code, struct op *first, struct op *follow)
 		iter = iter->next;
 	}
 }
+
+/*
+ * Returns true if the value of t is only used to decide a jump, in
+ * which case boolean operators leave jumping code with true and false
+ * lists for the parent to backpatch instead of materializing a value.
+ */
+static bool is_condition(struct tree *t)
+{
+	struct tree *p = t->parent;
+	if (p == NULL)
+		return false;
+
+	switch (get_rule(p)) {
+	case LOGICAL_AND_EXPR:
+	case LOGICAL_OR_EXPR:
+	case UNARY_NOT:
+		return true;
+	case IF_STATEMENT:
+	case IF_ELSE_STATEMENT:
+	case WHILE_LOOP:
+		return t == tree_index(p, 1);
+	case DO_WHILE_LOOP:
+		return t == tree_index(p, 3);
+	case FOR_LOOP:
+		return t == tree_index(p, 2);
+	default:
+		return false;
+	}
+}
+
+/*
+ * Converts a node with a value into jumping code with dangling true
+ * and false jumps. Constant tests jump unconditionally.
+ */
+static void make_jumps(struct tree *t)
+{
+	struct node *n = t->data;
+	if (n->truelist || n->falselist)
+		return;
+
+	n->truelist = list_new(NULL, NULL);
+	n->falselist = list_new(NULL, NULL);
+	log_assert(n->truelist && n->falselist);
+
+	struct address p = get_place(t, -1);
+	if (p.region == CONST_R && !p.type->pointer
+	    && (p.type->base == INT_T || p.type->base == BOOL_T)) {
+		/* result is known, so only one jump is needed */
+		struct op *jump = op_new(GOTO_O, NULL, e, e, e);
+		push_op(n, jump);
+		list_push_back(p.offset ? n->truelist : n->falselist, jump);
+		return;
+	}
+
+	struct op *test = op_new(IF_O, NULL, p, e, e);
+	struct op *skip = op_new(GOTO_O, NULL, e, e, e);
+	push_op(n, test);
+	push_op(n, skip);
+	list_push_back(n->truelist, test);
+	list_push_back(n->falselist, skip);
+}
+
+/*
+ * Fills in the target of each dangling jump with the given label and
+ * frees the list of jumps.
+ */
+static void patch_jumps(struct list *jumps, struct op *label)
+{
+	struct list_node *iter = list_head(jumps);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		if (op->code == IF_O)
+			op->address[1] = get_label(label);
+		else
+			op->address[0] = get_label(label);
+		iter = iter->next;
+	}
+	list_free(jumps);
+}
+
+/*
+ * Turns jumping code back into a bool value for expressions used
+ * outside of a condition, e.g. 'bool b = x && y;'.
+ */
+static void materialize(struct node *n)
+{
+	struct address yes = { CONST_R, 1, &bool_type };
+	struct address no = { CONST_R, 0, &bool_type };
+	struct op *truel = label_new();
+	struct op *falsel = label_new();
+	struct op *follow = label_new();
+
+	n->place = temp_new(&bool_type);
+	patch_jumps(n->truelist, truel);
+	patch_jumps(n->falselist, falsel);
+	n->truelist = NULL;
+	n->falselist = NULL;
+
+	push_op(n, truel);
+	push_op(n, op_new(ASN_O, NULL, n->place, yes, e));
+	push_op(n, op_new(GOTO_O, NULL, get_label(follow), e, e));
+	push_op(n, falsel);
+	push_op(n, op_new(ASN_O, NULL, n->place, no, e));
+	push_op(n, follow);
+}
+
+/*
+ * Appends the code of child i as a test jumping to truel if true and
+ * to falsel otherwise.
+ */
+static void append_branch(struct node *n, struct tree *t, int i,
+                          struct op *truel, struct op *falsel)
+{
+	struct node *c = get_node(t, i);
+	make_jumps(child(i));
+	append_code(i);
+	patch_jumps(c->truelist, truel);
+	patch_jumps(c->falselist, falsel);
+	c->truelist = NULL;
+	c->falselist = NULL;
+}
 #undef append_code
 #undef child
 #undef map_c
@@ -835,6 +1107,9 @@ static struct op *op_new(enum opcode code, char *name,
 	op->address[0] = a;
 	op->address[1] = b;
 	op->address[2] = c;
+	op->count = 0;
+	op->filename = location ? location->filename : NULL;
+	op->lineno = location ? location->lineno : 0;
 
 	return op;
 }
@@ -870,11 +1145,30 @@ static struct op *label_new()
  */
 static struct address temp_new(struct typeinfo *t)
 {
+	offset = typeinfo_aligned(offset, t);
 	struct address p = { region, offset, t };
 	offset += typeinfo_size(t);
 	return p;
 }
 
+/*
+ * Returns the leftmost token of t, else NULL if it has none.
+ */
+static struct token *first_token(struct tree *t)
+{
+	struct node *n = t->data;
+	if (n->rule == TOKEN)
+		return n->token;
+	struct list_node *iter = list_head(t->children);
+	while (!list_end(iter)) {
+		struct token *token = first_token(iter->data);
+		if (token)
+			return token;
+		iter = iter->next;
+	}
+	return NULL;
+}
+
 /*
  * Returns code list given a child index on a tree if available.
  */
@@ -933,11 +1227,15 @@ static char *print_opcode(enum opcode code)
 		R(PARAM_O);
 		R(CALL_O);
 		R(CALLC_O);
+		R(TCALL_O);
 		R(RET_O);
 		R(LABEL_O);
 		R(GOTO_O);
+		R(TABLE_O);
+		R(CASE_O);
 		R(NEW_O);
 		R(DEL_O);
+		R(COUNT_O);
 		R(PINT_O);
 		R(PCHAR_O);
 		R(PBOOL_O);
@@ -952,6 +1250,12 @@ static char *print_opcode(enum opcode code)
 		R(DIV_O);
 		R(FDIV_O);
 		R(MOD_O);
+		R(SHL_O);
+		R(SHR_O);
+		R(USHR_O);
+		R(MULH_O);
+		R(INC_O);
+		R(DEC_O);
 		R(LT_O);
 		R(FLT_O);
 		R(LE_O);
@@ -978,6 +1282,13 @@ static char *print_opcode(enum opcode code)
 		R(LFIELD_O);
 		R(RFIELD_O);
 		R(IF_O);
+		R(IFN_O);
+		R(IFLT_O);
+		R(IFLE_O);
+		R(IFGT_O);
+		R(IFGE_O);
+		R(IFEQ_O);
+		R(IFNE_O);
 		R(ERRC_O);
 	}
 	return NULL;
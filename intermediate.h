@@ -21,11 +21,15 @@ enum opcode {
 	PARAM_O,  /* param x          store x as a parameter */
 	CALL_O,   /* call p, x, n     call procedure p with n parameters, store result in x */
 	CALLC_O,  /* call built-in (or otherwise linked) C function */
+	TCALL_O,  /* tcall p, x, n    call procedure p with n parameters, return result x */
 	RET_O,    /* return x         return from procedure, use x as the result */
 	LABEL_O,  /* name (optional), in LABEL_R */
 	GOTO_O,   /* goto L           unconditional jump to L */
+	TABLE_O,  /* table x, n, L    jump to case of x in the n following entries, else L */
+	CASE_O,   /* case v, L        jump table entry: goto L if x == v */
 	NEW_O,    /* x := new Foo, n  create a new instance of class Foo of size n */
 	DEL_O,    /* delete object    free memory allocated for object */
+	COUNT_O,  /* count n          increment profile counter n */
 	/* psudeo opcodes for printing types with cout << thing */
 	PINT_O,
 	PCHAR_O,
@@ -42,6 +46,12 @@ enum opcode {
 	DIV_O,
 	FDIV_O,
 	MOD_O,
+	SHL_O,    /* x := y << z  shift left */
+	SHR_O,    /* x := y >> z  arithmetic shift right */
+	USHR_O,   /* x := y >>> z logical shift right */
+	MULH_O,   /* x := y *h z  high word of signed product y * z */
+	INC_O,    /* x := x + 1   increment in place */
+	DEC_O,    /* x := x - 1   decrement in place */
 	LT_O,    /* x < y */
 	FLT_O,
 	LE_O,    /* x <= y */
@@ -68,6 +78,13 @@ enum opcode {
 	LFIELD_O, /* class.field = x */
 	RFIELD_O, /* x = class.field */
 	IF_O,     /* if x then goto L  unary conditional jump to L */
+	IFN_O,    /* ifn x then goto L  jump to L if x is false */
+	IFLT_O,   /* iflt x, y, L  jump to L if x < y */
+	IFLE_O,
+	IFGT_O,
+	IFGE_O,
+	IFEQ_O,
+	IFNE_O,
 	ERRC_O,
 };
 
@@ -75,6 +92,9 @@ struct op {
 	enum opcode code;
 	char *name;
 	struct address address[3];
+	unsigned long count; /* times run in the profile read, else 0 */
+	char *filename;      /* of the source the op came from, else NULL */
+	int lineno;
 };
 
 void code_generate(struct tree *t);
@@ -0,0 +1,1373 @@
+/*
+ * interpret.c - Implementation of a threaded bytecode interpreter.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interpret.h"
+#include "intermediate.h"
+#include "jit.h"
+#include "type.h"
+#include "token.h"
+#include "scope.h"
+
+#include "logger.h"
+#include "list.h"
+#include "hasht.h"
+
+extern struct list *yyscopes;
+extern size_t yylabels;
+
+/* bytes of the stack of frames and their local regions */
+#define STACK_SIZE (64 << 20)
+
+/* System V registers for integer and double arguments */
+#define INT_ARGS 6
+#define FLOAT_ARGS 8
+
+/* where an operand is: nowhere, an immediate, or in a region */
+enum kind {
+	K_NONE,
+	K_IMM,
+	K_LOCAL,
+	K_GLOBAL,
+	K_CONST,
+	K_CLASS,   /* of the instance pointed to at local 0 */
+};
+
+/* how a value is kept in memory, as by the native backend */
+enum tag {
+	T_VOID,
+	T_INT,     /* 4 bytes, signed */
+	T_CHAR,    /* 1 byte, signed */
+	T_BOOL,    /* 1 byte, 0 or 1 */
+	T_PTR,     /* 8 bytes */
+	T_FLOAT,   /* a double */
+	T_AGG,     /* an array or instance, its value its address */
+};
+
+/*
+ * Bytecode, one for each op, except that comparisons and negation
+ * are chosen by the types of their operands.
+ */
+enum code {
+	B_END,
+	B_PARAM,
+	B_CALL,
+	B_CALLC,
+	B_TCALL,
+	B_TCALLC,
+	B_RET,
+	B_GOTO,
+	B_TABLE,
+	B_NEW,
+	B_DEL,
+	B_PINT,
+	B_PCHAR,
+	B_PFLOAT,
+	B_PSTR,
+	B_ADD,
+	B_SUB,
+	B_MUL,
+	B_DIV,
+	B_MOD,
+	B_SHL,
+	B_SHR,
+	B_USHR,
+	B_MULH,
+	B_INC,
+	B_DEC,
+	B_FADD,
+	B_FSUB,
+	B_FMUL,
+	B_FDIV,
+	B_LT,
+	B_LE,
+	B_GT,
+	B_GE,
+	B_EQ,
+	B_NE,
+	B_FLT,
+	B_FLE,
+	B_FGT,
+	B_FGE,
+	B_FEQ,
+	B_FNE,
+	B_OR,
+	B_AND,
+	B_NEG,
+	B_FNEG,
+	B_NOT,
+	B_ASN,
+	B_COPY,
+	B_RSTAR,
+	B_LSTAR,
+	B_ADDR,
+	B_LARR,
+	B_RARR,
+	B_LFIELD,
+	B_RFIELD,
+	B_IF,
+	B_IFN,
+	B_IFLT,
+	B_IFLE,
+	B_IFGT,
+	B_IFGE,
+	B_IFEQ,
+	B_IFNE,
+	B_FIFLT,
+	B_FIFLE,
+	B_FIFGT,
+	B_FIFGE,
+	B_FIFEQ,
+	B_FIFNE,
+	B_ERR,
+	B_COUNT
+};
+
+/* an address resolved to its region and how its value is kept */
+struct operand {
+	uint8_t kind;
+	uint8_t tag;
+	int32_t offset;    /* into its region, else the immediate */
+};
+
+/*
+ * An op encoded in 40 bytes, its jump targets as instruction indices
+ * in n, which otherwise holds a callee, size, step or offset.
+ */
+struct insn {
+	const void *handler;  /* label of its code, once threaded */
+	uint8_t code;
+	int32_t n;
+	struct operand x[3];
+};
+
+/* a parameter as stored into the local region by a call */
+struct param {
+	int offset;
+	uint8_t tag;
+	int size;          /* copied in whole if passed by reference */
+};
+
+struct proc {
+	char *name;
+	size_t entry;      /* index of its first instruction */
+	int frame;         /* bytes of its local region */
+	uint8_t tag;       /* returned */
+	bool member;       /* passed the instance pointer first */
+	struct param *params;
+	int count;
+};
+
+/* a C function, or a method only declared which does nothing */
+struct cfunc {
+	char *name;
+	void *address;
+	uint8_t tag;       /* returned */
+	uint8_t *params;
+	int count;
+};
+
+union value {
+	int64_t i;
+	double f;
+};
+
+/* an argument evaluated by PARAM_O, waiting for its call */
+struct arg {
+	union value v;
+	uint8_t tag;
+};
+
+/* saved by a call below the local region of the procedure called */
+struct frame {
+	const struct insn *call;  /* in the caller, NULL for main */
+	char *local;              /* of the caller */
+};
+
+/* the program being interpreted */
+static struct {
+	struct insn *code;
+	size_t count;
+	size_t capacity;
+	struct proc *procs;
+	size_t proc_count;
+	struct cfunc *cfuncs;
+	size_t cfunc_count;
+	int *tables;       /* low, size, default, then each target */
+	size_t table_size;
+	size_t *labels;    /* index of the instruction at each label */
+	char *constant;
+	char *global;
+} program;
+
+/* arguments of calls yet to be made */
+static struct {
+	struct arg *args;
+	size_t top;
+	size_t capacity;
+} pending;
+
+static void translate(struct list *code);
+static void find_procs(struct list *code);
+static void translate_op(struct list_node *iter, struct proc *proc);
+static struct insn *add(enum code code, struct op *op);
+static struct operand operand(struct address a);
+static int find_proc(char *name);
+static size_t find_cfunc(struct op *op);
+static void add_table(struct insn *insn, struct list_node *iter);
+static void resolve_labels();
+static void make_regions();
+static void free_program();
+static int execute(struct proc *main);
+static union value external(const struct cfunc *c, struct arg *args,
+                            int count);
+static enum tag tag(struct typeinfo *t);
+static enum tag pointee(struct typeinfo *t);
+static int step(struct op *op);
+
+/*
+ * Interprets the program: its code is translated to bytecode, then
+ * main is run with a direct threaded dispatch. Returns the status
+ * main returns.
+ */
+int interpret(struct list *code)
+{
+	translate(code);
+	make_regions();
+	struct proc *main = NULL;
+	for (size_t i = 0; i < program.proc_count; ++i)
+		if (strcmp(program.procs[i].name, "main") == 0)
+			main = &program.procs[i];
+	if (main == NULL)
+		log_error("program has no main procedure");
+
+	fflush(stdout);
+	int status = execute(main);
+	fflush(stdout);
+
+	free_program();
+	return status;
+}
+
+/* translates each op of code to bytecode, but labels and cases */
+static void translate(struct list *code)
+{
+	memset(&program, 0, sizeof(program));
+	program.labels = calloc(yylabels + 1, sizeof(*program.labels));
+	log_assert(program.labels);
+	find_procs(code);
+
+	struct proc *proc = NULL;
+	for (struct list_node *iter = list_head(code); !list_end(iter);
+	     iter = iter->next) {
+		struct op *op = iter->data;
+		if (op->code == PROC_O) {
+			proc = &program.procs[find_proc(op->name)];
+			proc->entry = program.count;
+		} else {
+			log_assert(proc);
+			translate_op(iter, proc);
+		}
+	}
+	resolve_labels();
+}
+
+/*
+ * Finds each procedure and where its parameters are stored in its
+ * local region: the instance pointer first, then each at its aligned
+ * offset, as the native prologue does.
+ */
+static void find_procs(struct list *code)
+{
+	for (struct list_node *iter = list_head(code); !list_end(iter);
+	     iter = iter->next)
+		if (((struct op *)iter->data)->code == PROC_O)
+			++program.proc_count;
+	program.procs = calloc(program.proc_count + 1, sizeof(*program.procs));
+	log_assert(program.procs);
+
+	struct proc *proc = program.procs;
+	for (struct list_node *iter = list_head(code); !list_end(iter);
+	     iter = iter->next) {
+		struct op *op = iter->data;
+		if (op->code != PROC_O)
+			continue;
+		struct typeinfo *function = op->address[2].type;
+		struct list *params = function->function.parameters;
+		proc->name = op->name;
+		proc->frame = (op->address[1].offset + 7) / 8 * 8;
+		proc->tag = tag(typeinfo_return(function));
+		proc->member = strstr(op->name, "__") != NULL;
+		proc->params = calloc(list_size(params) + 1, sizeof(*proc->params));
+		log_assert(proc->params);
+
+		int offset = proc->member ? 8 : 0;
+		for (struct list_node *p = list_head(params); !list_end(p);
+		     p = p->next) {
+			struct typeinfo *t = p->data;
+			offset = typeinfo_aligned(offset, t);
+			struct param *param = &proc->params[proc->count++];
+			param->offset = offset;
+			param->tag = tag(t);
+			param->size = typeinfo_size(t);
+			offset += typeinfo_size(t);
+		}
+		++proc;
+	}
+}
+
+/* appends the bytecode of the op at iter, in proc */
+static void translate_op(struct list_node *iter, struct proc *proc)
+{
+	struct op *op = iter->data;
+	struct address a = op->address[0];
+	struct address b = op->address[1];
+	struct address c = op->address[2];
+	bool floating = typeinfo_double(a.type) || typeinfo_double(b.type);
+	struct insn *insn;
+
+	switch (op->code) {
+	case PROC_O:
+		break;
+	case END_O:
+		/* falling off the end returns 0 */
+		add(B_END, op)->n = proc->tag;
+		break;
+	case PARAM_O:
+		add(B_PARAM, op);
+		break;
+	case CALL_O:
+	case CALLC_O:
+	case TCALL_O: {
+		/* procedures not in the program are C functions */
+		int p = find_proc(op->name);
+		bool tail = op->code == TCALL_O;
+		if (p >= 0) {
+			insn = add(tail ? B_TCALL : B_CALL, op);
+			insn->n = p;
+		} else {
+			insn = add(tail ? B_TCALLC : B_CALLC, op);
+			insn->n = find_cfunc(op);
+		}
+		/* the caller's return type, converted to on return */
+		if (tail)
+			insn->x[2].tag = proc->tag;
+		break;
+	}
+	case RET_O:
+		insn = add(B_RET, op);
+		insn->n = proc->tag;
+		if (proc->tag == T_VOID)
+			insn->x[0].kind = K_NONE;
+		break;
+	case LABEL_O:
+		program.labels[a.offset] = program.count;
+		break;
+	case GOTO_O:
+		add(B_GOTO, op)->n = a.offset;
+		break;
+	case TABLE_O:
+		add_table(add(B_TABLE, op), iter);
+		break;
+	case CASE_O:
+		/* in the table of the preceding TABLE_O */
+		break;
+	case COUNT_O:
+		/* only the C backend is instrumented */
+		break;
+	case NEW_O:
+		add(B_NEW, op)->n = b.offset;
+		break;
+	case DEL_O:
+		add(B_DEL, op);
+		break;
+	case PINT_O:
+	case PBOOL_O:
+		add(B_PINT, op);
+		break;
+	case PCHAR_O:
+		add(B_PCHAR, op);
+		break;
+	case PFLOAT_O:
+		add(B_PFLOAT, op);
+		break;
+	case PSTR_O:
+		add(B_PSTR, op);
+		break;
+	case ADD_O:
+	case SUB_O:
+		add(op->code == ADD_O ? B_ADD : B_SUB, op)->n = step(op);
+		break;
+	case MUL_O:
+		add(B_MUL, op);
+		break;
+	case DIV_O:
+		add(B_DIV, op);
+		break;
+	case MOD_O:
+		add(B_MOD, op);
+		break;
+	case SHL_O:
+		add(B_SHL, op);
+		break;
+	case SHR_O:
+		add(B_SHR, op);
+		break;
+	case USHR_O:
+		add(B_USHR, op);
+		break;
+	case MULH_O:
+		add(B_MULH, op);
+		break;
+	case INC_O:
+		add(B_INC, op);
+		break;
+	case DEC_O:
+		add(B_DEC, op);
+		break;
+	case FADD_O:
+		add(B_FADD, op);
+		break;
+	case FSUB_O:
+		add(B_FSUB, op);
+		break;
+	case FMUL_O:
+		add(B_FMUL, op);
+		break;
+	case FDIV_O:
+		add(B_FDIV, op);
+		break;
+	case LT_O:
+	case FLT_O:
+	case LE_O:
+	case FLE_O:
+	case GT_O:
+	case FGT_O:
+	case GE_O:
+	case FGE_O:
+	case EQ_O:
+	case FEQ_O:
+	case NE_O:
+	case FNE_O: {
+		/* opcodes pair integer and floating relations, in order */
+		int relation = (op->code - LT_O) / 2;
+		floating = typeinfo_double(b.type) || typeinfo_double(c.type);
+		add((floating ? B_FLT : B_LT) + relation, op);
+		break;
+	}
+	case OR_O:
+		add(B_OR, op);
+		break;
+	case AND_O:
+		add(B_AND, op);
+		break;
+	case NEG_O:
+	case FNEG_O:
+		add(typeinfo_double(b.type) ? B_FNEG : B_NEG, op);
+		break;
+	case NOT_O:
+		add(B_NOT, op);
+		break;
+	case ASN_O:
+		if (typeinfo_by_reference(a.type))
+			add(B_COPY, op)->n = typeinfo_size(a.type);
+		else
+			add(B_ASN, op);
+		break;
+	case RSTAR_O:
+		add(B_RSTAR, op)->n = pointee(b.type);
+		break;
+	case LSTAR_O:
+		add(B_LSTAR, op)->n = pointee(a.type);
+		break;
+	case ADDR_O:
+		add(B_ADDR, op);
+		break;
+	case LARR_O:
+		add(B_LARR, op);
+		break;
+	case RARR_O:
+		add(B_RARR, op);
+		break;
+	case LFIELD_O:
+		add(B_LFIELD, op)->n = c.offset;
+		break;
+	case RFIELD_O:
+		add(B_RFIELD, op)->n = c.offset;
+		break;
+	case IF_O:
+		add(B_IF, op)->n = b.offset;
+		break;
+	case IFN_O:
+		add(B_IFN, op)->n = b.offset;
+		break;
+	case IFLT_O:
+	case IFLE_O:
+	case IFGT_O:
+	case IFGE_O:
+	case IFEQ_O:
+	case IFNE_O:
+		add((floating ? B_FIFLT : B_IFLT) + (op->code - IFLT_O), op)->n
+			= c.offset;
+		break;
+	case ERRC_O:
+		add(B_ERR, op);
+		break;
+	}
+}
+
+/* appends an instruction of code with the operands of op */
+static struct insn *add(enum code code, struct op *op)
+{
+	if (program.count == program.capacity) {
+		program.capacity = program.capacity ? 2 * program.capacity : 256;
+		program.code = realloc(program.code,
+		                       program.capacity * sizeof(*program.code));
+		log_assert(program.code);
+	}
+	struct insn *insn = &program.code[program.count++];
+	memset(insn, 0, sizeof(*insn));
+	insn->code = code;
+	for (int i = 0; i < 3; ++i)
+		insn->x[i] = operand(op->address[i]);
+	return insn;
+}
+
+/*
+ * Returns operand for a: integer constants are immediates, while
+ * string constants are kept as their address, like aggregates.
+ */
+static struct operand operand(struct address a)
+{
+	struct operand o = { K_NONE, T_VOID, a.offset };
+	if (a.type == NULL)
+		return o;
+	o.tag = tag(a.type);
+	switch (a.region) {
+	case CONST_R:
+		if (!a.type->pointer && (a.type->base == INT_T
+		                         || a.type->base == CHAR_T
+		                         || a.type->base == BOOL_T)) {
+			o.kind = K_IMM;
+		} else {
+			o.kind = K_CONST;
+			if (a.type->base == CHAR_T)
+				o.tag = T_AGG;
+		}
+		break;
+	case LOCAL_R:
+	case PARAM_R:
+		o.kind = K_LOCAL;
+		break;
+	case GLOBE_R:
+		o.kind = K_GLOBAL;
+		break;
+	case CLASS_R:
+		o.kind = K_CLASS;
+		break;
+	default:
+		o.kind = K_NONE;
+	}
+	return o;
+}
+
+/* returns index of the procedure named name, else -1 */
+static int find_proc(char *name)
+{
+	for (size_t i = 0; i < program.proc_count; ++i)
+		if (strcmp(program.procs[i].name, name) == 0)
+			return i;
+	return -1;
+}
+
+/*
+ * Returns index of the C function called by op, adding it if new:
+ * looked up in this process as when linked, else a method only
+ * declared, which does nothing.
+ */
+static size_t find_cfunc(struct op *op)
+{
+	for (size_t i = 0; i < program.cfunc_count; ++i)
+		if (strcmp(program.cfuncs[i].name, op->name) == 0)
+			return i;
+
+	program.cfuncs = realloc(program.cfuncs, (program.cfunc_count + 1)
+	                         * sizeof(*program.cfuncs));
+	log_assert(program.cfuncs);
+	struct cfunc *c = &program.cfuncs[program.cfunc_count];
+	memset(c, 0, sizeof(*c));
+	c->name = op->name;
+
+	struct typeinfo *f = scope_procedure(op->name);
+	c->tag = tag(f ? typeinfo_return(f) : op->address[0].type);
+	if (!strstr(op->name, "__")) {
+		c->address = jit_lookup(op->name);
+		if (c->address == NULL)
+			log_error("undefined function: %s", op->name);
+	}
+
+	/* as passed in registers by the System V ABI */
+	int ints = 0;
+	int floats = 0;
+	struct list *params = f ? f->function.parameters : NULL;
+	c->params = calloc(list_size(params) + 1, sizeof(*c->params));
+	log_assert(c->params);
+	for (struct list_node *p = list_head(params); !list_end(p);
+	     p = p->next) {
+		c->params[c->count] = typeinfo_by_reference(p->data)
+			? T_PTR : tag(p->data);
+		if (c->params[c->count++] == T_FLOAT)
+			++floats;
+		else
+			++ints;
+	}
+	if (ints > INT_ARGS || floats > FLOAT_ARGS)
+		log_error("too many arguments to %s", op->name);
+
+	return program.cfunc_count++;
+}
+
+/*
+ * Adds the jump table of TABLE_O at iter from its CASE_O entries,
+ * dense from the lowest value to the highest, with those missing
+ * going to the default.
+ */
+static void add_table(struct insn *insn, struct list_node *iter)
+{
+	struct op *op = iter->data;
+	int n = op->address[1].offset;
+	int low = 0;
+	int high = -1;
+	struct list_node *entry = iter->next;
+	for (int i = 0; i < n; ++i, entry = entry->next) {
+		int v = ((struct op *)entry->data)->address[0].offset;
+		if (i == 0 || v < low)
+			low = v;
+		if (i == 0 || v > high)
+			high = v;
+	}
+
+	size_t size = (n > 0) ? (size_t)high - low + 1 : 0;
+	program.tables = realloc(program.tables, (program.table_size + 3 + size)
+	                         * sizeof(*program.tables));
+	log_assert(program.tables);
+	int *table = program.tables + program.table_size;
+	insn->n = program.table_size;
+	program.table_size += 3 + size;
+
+	table[0] = low;
+	table[1] = size;
+	table[2] = op->address[2].offset;
+	for (size_t i = 0; i < size; ++i)
+		table[3 + i] = table[2];
+	entry = iter->next;
+	for (int i = 0; i < n; ++i, entry = entry->next) {
+		struct op *e = entry->data;
+		table[3 + e->address[0].offset - low] = e->address[1].offset;
+	}
+}
+
+/* replaces the labels jumped to by the index of their instruction */
+static void resolve_labels()
+{
+	for (size_t i = 0; i < program.count; ++i) {
+		struct insn *insn = &program.code[i];
+		switch (insn->code) {
+		case B_GOTO:
+		case B_IF:
+		case B_IFN:
+		case B_IFLT:
+		case B_IFLE:
+		case B_IFGT:
+		case B_IFGE:
+		case B_IFEQ:
+		case B_IFNE:
+		case B_FIFLT:
+		case B_FIFLE:
+		case B_FIFGT:
+		case B_FIFGE:
+		case B_FIFEQ:
+		case B_FIFNE:
+			insn->n = program.labels[insn->n];
+			break;
+		case B_TABLE: {
+			int *table = program.tables + insn->n;
+			for (int j = 0; j < 1 + table[1]; ++j)
+				table[2 + j] = program.labels[table[2 + j]];
+			break;
+		}
+		default:
+			break;
+		}
+	}
+}
+
+/*
+ * Makes the constant region, each float and string at its offset as
+ * laid out for the native backend, and the zeroed global region.
+ */
+static void make_regions()
+{
+	struct hasht *constant = list_front(yyscopes);
+	size_t size = 0;
+	for (size_t i = 0; i < constant->size; ++i) {
+		struct hasht_node *slot = constant->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *v = slot->value;
+			size_t end;
+			if (v->base == FLOAT_T && !v->pointer)
+				end = v->place.offset + sizeof(double);
+			else if (v->base == CHAR_T && v->pointer)
+				end = v->place.offset + v->token->ssize;
+			else
+				continue;
+			if (end > size)
+				size = end;
+		}
+	}
+	program.constant = calloc(size + 1, 1);
+	log_assert(program.constant);
+	for (size_t i = 0; i < constant->size; ++i) {
+		struct hasht_node *slot = constant->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *v = slot->value;
+			char *at = program.constant + v->place.offset;
+			if (v->base == FLOAT_T && !v->pointer)
+				memcpy(at, &v->token->fval, sizeof(double));
+			else if (v->base == CHAR_T && v->pointer)
+				memcpy(at, v->token->sval, v->token->ssize);
+		}
+	}
+
+	program.global = calloc(scope_size(list_index(yyscopes, 1)->data) + 1, 1);
+	log_assert(program.global);
+}
+
+static void free_program()
+{
+	for (size_t i = 0; i < program.proc_count; ++i)
+		free(program.procs[i].params);
+	for (size_t i = 0; i < program.cfunc_count; ++i)
+		free(program.cfuncs[i].params);
+	free(program.procs);
+	free(program.cfuncs);
+	free(program.code);
+	free(program.tables);
+	free(program.labels);
+	free(program.constant);
+	free(program.global);
+	free(pending.args);
+	memset(&pending, 0, sizeof(pending));
+}
+
+/* returns address of o, which is in a region */
+static inline char *address(struct operand o, char *local)
+{
+	switch (o.kind) {
+	case K_LOCAL:
+		return local + o.offset;
+	case K_GLOBAL:
+		return program.global + o.offset;
+	case K_CONST:
+		return program.constant + o.offset;
+	case K_CLASS: {
+		char *instance;
+		memcpy(&instance, local, sizeof(instance));
+		return instance + o.offset;
+	}
+	default:
+		log_error("operand has no address");
+		return NULL;
+	}
+}
+
+/* loads value kept as tag at p, integers extended to 64 bits */
+static inline union value load(const char *p, enum tag tag)
+{
+	union value v;
+	switch (tag) {
+	case T_INT: {
+		int32_t i;
+		memcpy(&i, p, sizeof(i));
+		v.i = i;
+		break;
+	}
+	case T_CHAR:
+		v.i = (signed char)*p;
+		break;
+	case T_BOOL:
+		v.i = (unsigned char)*p;
+		break;
+	default:
+		memcpy(&v, p, sizeof(v));
+	}
+	return v;
+}
+
+/* stores value to p as tag, integers truncated */
+static inline void save(char *p, enum tag tag, union value v)
+{
+	switch (tag) {
+	case T_INT: {
+		int32_t i = v.i;
+		memcpy(p, &i, sizeof(i));
+		break;
+	}
+	case T_CHAR:
+	case T_BOOL:
+		*p = v.i;
+		break;
+	default:
+		memcpy(p, &v, sizeof(v));
+	}
+}
+
+/* converts value between integers and doubles, and to a bool */
+static inline union value convert(union value v, enum tag from, enum tag to)
+{
+	if (from == T_FLOAT && to == T_BOOL)
+		v.i = v.f != 0;
+	else if (from == T_FLOAT && to != T_FLOAT)
+		v.i = v.f;
+	else if (from != T_FLOAT && to == T_FLOAT)
+		v.f = v.i;
+	else if (to == T_BOOL && from != T_BOOL)
+		v.i = v.i != 0;
+	return v;
+}
+
+/* returns value of o, the address of aggregates */
+static inline union value get(struct operand o, char *local)
+{
+	union value v;
+	if (o.kind == K_IMM || o.kind == K_NONE) {
+		v.i = o.offset;
+		return v;
+	}
+	char *p = address(o, local);
+	if (o.tag == T_AGG) {
+		v.i = (intptr_t)p;
+		return v;
+	}
+	return load(p, o.tag);
+}
+
+/* stores value of type from to o, converted to its type */
+static inline void put(struct operand o, enum tag from, union value v,
+                       char *local)
+{
+	if (o.kind != K_NONE)
+		save(address(o, local), o.tag, convert(v, from, o.tag));
+}
+
+static inline double get_float(struct operand o, char *local)
+{
+	return convert(get(o, local), o.tag, T_FLOAT).f;
+}
+
+static inline bool truth(struct operand o, char *local)
+{
+	return convert(get(o, local), o.tag, T_BOOL).i;
+}
+
+#define A ip->x[0]
+#define B ip->x[1]
+#define C ip->x[2]
+#define NEXT goto *(++ip)->handler
+#define JUMP(i) do { ip = program.code + (i); goto *ip->handler; } while (0)
+#define INT(o) get(o, local).i
+#define FLOAT(o) get_float(o, local)
+#define SET_INT(o, x) do { v.i = (x); put(o, T_INT, v, local); } while (0)
+#define SET_BOOL(o, x) do { v.i = (x); put(o, T_BOOL, v, local); } while (0)
+#define SET_FLOAT(o, x) do { v.f = (x); put(o, T_FLOAT, v, local); } while (0)
+
+/*
+ * Runs the program from main until it returns, with direct threaded
+ * dispatch: each instruction jumps to the label of the next one's
+ * code. Frames are kept on a stack of their own, each local region
+ * below its saved caller.
+ */
+static int execute(struct proc *main)
+{
+	static const void *labels[B_COUNT] = {
+		[B_END] = &&end, [B_PARAM] = &&param, [B_CALL] = &&call,
+		[B_CALLC] = &&callc, [B_TCALL] = &&call, [B_TCALLC] = &&callc,
+		[B_RET] = &&ret, [B_GOTO] = &&jump, [B_TABLE] = &&table,
+		[B_NEW] = &&new, [B_DEL] = &&del, [B_PINT] = &&pint,
+		[B_PCHAR] = &&pchar, [B_PFLOAT] = &&pfloat, [B_PSTR] = &&pstr,
+		[B_ADD] = &&add, [B_SUB] = &&sub, [B_MUL] = &&mul, [B_DIV] = &&div,
+		[B_MOD] = &&mod, [B_SHL] = &&shl, [B_SHR] = &&shr,
+		[B_USHR] = &&ushr, [B_MULH] = &&mulh, [B_INC] = &&inc,
+		[B_DEC] = &&dec, [B_FADD] = &&fadd, [B_FSUB] = &&fsub,
+		[B_FMUL] = &&fmul, [B_FDIV] = &&fdiv,
+		[B_LT] = &&lt, [B_LE] = &&le, [B_GT] = &&gt, [B_GE] = &&ge,
+		[B_EQ] = &&eq, [B_NE] = &&ne, [B_FLT] = &&flt, [B_FLE] = &&fle,
+		[B_FGT] = &&fgt, [B_FGE] = &&fge, [B_FEQ] = &&feq, [B_FNE] = &&fne,
+		[B_OR] = &&or, [B_AND] = &&and, [B_NEG] = &&neg, [B_FNEG] = &&fneg,
+		[B_NOT] = &&not, [B_ASN] = &&asn, [B_COPY] = &&copy,
+		[B_RSTAR] = &&rstar, [B_LSTAR] = &&lstar, [B_ADDR] = &&addr,
+		[B_LARR] = &&larr, [B_RARR] = &&rarr, [B_LFIELD] = &&lfield,
+		[B_RFIELD] = &&rfield, [B_IF] = &&if_, [B_IFN] = &&ifn,
+		[B_IFLT] = &&iflt, [B_IFLE] = &&ifle, [B_IFGT] = &&ifgt,
+		[B_IFGE] = &&ifge, [B_IFEQ] = &&ifeq, [B_IFNE] = &&ifne,
+		[B_FIFLT] = &&fiflt, [B_FIFLE] = &&fifle, [B_FIFGT] = &&fifgt,
+		[B_FIFGE] = &&fifge, [B_FIFEQ] = &&fifeq, [B_FIFNE] = &&fifne,
+		[B_ERR] = &&err,
+	};
+	for (size_t i = 0; i < program.count; ++i)
+		program.code[i].handler = labels[program.code[i].code];
+
+	char *stack = malloc(STACK_SIZE);
+	log_assert(stack);
+	char *limit = stack + STACK_SIZE;
+	struct frame *f = (struct frame *)stack;
+	f->call = NULL;
+	f->local = NULL;
+	char *local = (char *)(f + 1);
+	char *sp = local + main->frame;
+	const struct insn *ip = program.code + main->entry;
+	union value v;
+	enum tag type;
+	goto *ip->handler;
+
+end:
+	v.i = 0;
+	type = ip->n;
+	goto leave;
+ret:
+	v = convert(get(A, local), A.tag, ip->n);
+	type = ip->n;
+leave:
+	/* back to the caller, storing the result of its call */
+	f = (struct frame *)local - 1;
+	sp = (char *)f;
+	local = f->local;
+	ip = f->call;
+	if (ip == NULL) {
+		free(stack);
+		return v.i;
+	}
+	if (ip->code == B_TCALL) {
+		/* which returns it in turn */
+		v = convert(v, type, C.tag);
+		type = C.tag;
+		goto leave;
+	}
+	put(A, type, v, local);
+	NEXT;
+
+param:
+	if (pending.top == pending.capacity) {
+		pending.capacity = pending.capacity ? 2 * pending.capacity : 64;
+		pending.args = realloc(pending.args,
+		                       pending.capacity * sizeof(*pending.args));
+		log_assert(pending.args);
+	}
+	pending.args[pending.top].v = get(A, local);
+	pending.args[pending.top++].tag = A.tag;
+	NEXT;
+call: {
+	/* the prologue: instance pointer, then parameters by value */
+	const struct proc *p = &program.procs[ip->n];
+	int count = B.offset;
+	struct arg *args = pending.args + (pending.top -= count);
+	f = (struct frame *)sp;
+	char *callee = (char *)(f + 1);
+	sp = callee + p->frame;
+	if (sp > limit)
+		log_error("stack overflow in %s", p->name);
+	f->call = ip;
+	f->local = local;
+	int k = 0;
+	if (p->member && count > 0)
+		memcpy(callee, &args[k++].v, sizeof(void *));
+	for (int j = 0; j < p->count && k < count; ++j, ++k) {
+		const struct param *q = &p->params[j];
+		if (q->tag == T_AGG)
+			memcpy(callee + q->offset, (char *)(intptr_t)args[k].v.i,
+			       q->size);
+		else
+			save(callee + q->offset, q->tag,
+			     convert(args[k].v, args[k].tag, q->tag));
+	}
+	local = callee;
+	JUMP(p->entry);
+}
+callc: {
+	const struct cfunc *c = &program.cfuncs[ip->n];
+	int count = B.offset;
+	pending.top -= count;
+	v = external(c, pending.args + pending.top, count);
+	type = c->tag;
+	if (ip->code == B_TCALLC) {
+		v = convert(v, type, C.tag);
+		type = C.tag;
+		goto leave;
+	}
+	put(A, type, v, local);
+	NEXT;
+}
+
+jump:
+	JUMP(ip->n);
+table: {
+	const int *t = program.tables + ip->n;
+	uint64_t i = INT(A) - t[0];
+	JUMP(i < (uint64_t)t[1] ? t[3 + i] : t[2]);
+}
+
+new:
+	v.i = (intptr_t)calloc(1, ip->n);
+	put(A, T_PTR, v, local);
+	NEXT;
+del:
+	free((void *)(intptr_t)INT(A));
+	NEXT;
+
+pint:
+	printf("%d", (int)INT(A));
+	NEXT;
+pchar:
+	printf("%c", (int)INT(A));
+	NEXT;
+pfloat:
+	printf("%f", FLOAT(A));
+	NEXT;
+pstr:
+	printf("%s", (char *)(intptr_t)INT(A));
+	NEXT;
+
+	/* in 64 bits, as wrapping unsigned, pointers stepping */
+add:
+	SET_INT(A, (uint64_t)INT(B) + (uint64_t)INT(C) * ip->n);
+	NEXT;
+sub:
+	SET_INT(A, (uint64_t)INT(B) - (uint64_t)INT(C) * ip->n);
+	NEXT;
+mul:
+	SET_INT(A, (uint64_t)INT(B) * (uint64_t)INT(C));
+	NEXT;
+div:
+	SET_INT(A, INT(B) / INT(C));
+	NEXT;
+mod:
+	SET_INT(A, INT(B) % INT(C));
+	NEXT;
+	/* in 32 bits, as the ints they shift */
+shl:
+	SET_INT(A, (int32_t)((uint32_t)INT(B) << (INT(C) & 31)));
+	NEXT;
+shr:
+	SET_INT(A, (int32_t)INT(B) >> (INT(C) & 31));
+	NEXT;
+ushr:
+	SET_INT(A, (int32_t)((uint32_t)INT(B) >> (INT(C) & 31)));
+	NEXT;
+mulh:
+	SET_INT(A, (INT(B) * INT(C)) >> 32);
+	NEXT;
+inc:
+	if (A.tag == T_FLOAT)
+		SET_FLOAT(A, get(A, local).f + 1);
+	else
+		SET_INT(A, (uint64_t)INT(A) + 1);
+	NEXT;
+dec:
+	if (A.tag == T_FLOAT)
+		SET_FLOAT(A, get(A, local).f - 1);
+	else
+		SET_INT(A, (uint64_t)INT(A) - 1);
+	NEXT;
+fadd:
+	SET_FLOAT(A, FLOAT(B) + FLOAT(C));
+	NEXT;
+fsub:
+	SET_FLOAT(A, FLOAT(B) - FLOAT(C));
+	NEXT;
+fmul:
+	SET_FLOAT(A, FLOAT(B) * FLOAT(C));
+	NEXT;
+fdiv:
+	SET_FLOAT(A, FLOAT(B) / FLOAT(C));
+	NEXT;
+
+lt:
+	SET_BOOL(A, INT(B) < INT(C));
+	NEXT;
+le:
+	SET_BOOL(A, INT(B) <= INT(C));
+	NEXT;
+gt:
+	SET_BOOL(A, INT(B) > INT(C));
+	NEXT;
+ge:
+	SET_BOOL(A, INT(B) >= INT(C));
+	NEXT;
+eq:
+	SET_BOOL(A, INT(B) == INT(C));
+	NEXT;
+ne:
+	SET_BOOL(A, INT(B) != INT(C));
+	NEXT;
+	/* false if unordered, but for not equal */
+flt:
+	SET_BOOL(A, FLOAT(B) < FLOAT(C));
+	NEXT;
+fle:
+	SET_BOOL(A, FLOAT(B) <= FLOAT(C));
+	NEXT;
+fgt:
+	SET_BOOL(A, FLOAT(B) > FLOAT(C));
+	NEXT;
+fge:
+	SET_BOOL(A, FLOAT(B) >= FLOAT(C));
+	NEXT;
+feq:
+	SET_BOOL(A, FLOAT(B) == FLOAT(C));
+	NEXT;
+fne:
+	SET_BOOL(A, FLOAT(B) != FLOAT(C));
+	NEXT;
+or:
+	SET_BOOL(A, truth(B, local) | truth(C, local));
+	NEXT;
+and:
+	SET_BOOL(A, truth(B, local) & truth(C, local));
+	NEXT;
+
+neg:
+	v.i = -(uint64_t)INT(B);
+	put(A, B.tag, v, local);
+	NEXT;
+fneg:
+	/* multiplying by -1 flips the sign of zeros too */
+	v.f = get(B, local).f * -1;
+	put(A, T_FLOAT, v, local);
+	NEXT;
+not:
+	SET_BOOL(A, !truth(B, local));
+	NEXT;
+asn:
+	put(A, B.tag, get(B, local), local);
+	NEXT;
+copy:
+	memmove(address(A, local), address(B, local), ip->n);
+	NEXT;
+
+rstar:
+	v = load((char *)(intptr_t)INT(B), ip->n);
+	put(A, ip->n, v, local);
+	NEXT;
+lstar:
+	v = convert(get(B, local), B.tag, ip->n);
+	save((char *)(intptr_t)INT(A), ip->n, v);
+	NEXT;
+addr:
+	v.i = (intptr_t)address(B, local);
+	put(A, T_PTR, v, local);
+	NEXT;
+	/* index is already in bytes, and an array's value is its address */
+larr:
+	v.i = INT(B) + INT(C);
+	put(A, T_PTR, v, local);
+	NEXT;
+rarr:
+	v = load((char *)(intptr_t)INT(B) + INT(C), A.tag);
+	put(A, A.tag, v, local);
+	NEXT;
+lfield:
+	v.i = INT(B) + ip->n;
+	put(A, A.tag, v, local);
+	NEXT;
+rfield:
+	v = load((char *)(intptr_t)INT(B) + ip->n, A.tag);
+	put(A, A.tag, v, local);
+	NEXT;
+
+if_:
+	if (truth(A, local))
+		JUMP(ip->n);
+	NEXT;
+ifn:
+	if (!truth(A, local))
+		JUMP(ip->n);
+	NEXT;
+iflt:
+	if (INT(A) < INT(B))
+		JUMP(ip->n);
+	NEXT;
+ifle:
+	if (INT(A) <= INT(B))
+		JUMP(ip->n);
+	NEXT;
+ifgt:
+	if (INT(A) > INT(B))
+		JUMP(ip->n);
+	NEXT;
+ifge:
+	if (INT(A) >= INT(B))
+		JUMP(ip->n);
+	NEXT;
+ifeq:
+	if (INT(A) == INT(B))
+		JUMP(ip->n);
+	NEXT;
+ifne:
+	if (INT(A) != INT(B))
+		JUMP(ip->n);
+	NEXT;
+fiflt:
+	if (FLOAT(A) < FLOAT(B))
+		JUMP(ip->n);
+	NEXT;
+fifle:
+	if (FLOAT(A) <= FLOAT(B))
+		JUMP(ip->n);
+	NEXT;
+fifgt:
+	if (FLOAT(A) > FLOAT(B))
+		JUMP(ip->n);
+	NEXT;
+fifge:
+	if (FLOAT(A) >= FLOAT(B))
+		JUMP(ip->n);
+	NEXT;
+fifeq:
+	if (FLOAT(A) == FLOAT(B))
+		JUMP(ip->n);
+	NEXT;
+fifne:
+	if (FLOAT(A) != FLOAT(B))
+		JUMP(ip->n);
+	NEXT;
+
+err:
+	exit(-1); /* operation error */
+}
+
+#undef A
+#undef B
+#undef C
+#undef NEXT
+#undef JUMP
+#undef INT
+#undef FLOAT
+#undef SET_INT
+#undef SET_BOOL
+#undef SET_FLOAT
+
+/*
+ * Calls C function c with args converted to its parameter types. As
+ * the System V ABI passes integers and doubles each in their own
+ * registers, in order, a call through a prototype taking as many of
+ * each as are passed in registers passes any arguments that fit.
+ */
+static union value external(const struct cfunc *c, struct arg *args,
+                            int count)
+{
+	typedef int64_t (*int_f)(int64_t, int64_t, int64_t, int64_t, int64_t,
+	                         int64_t, double, double, double, double, double,
+	                         double, double, double);
+	typedef double (*float_f)(int64_t, int64_t, int64_t, int64_t, int64_t,
+	                          int64_t, double, double, double, double, double,
+	                          double, double, double);
+	union value v = { 0 };
+	if (c->address == NULL)
+		return v;
+
+	int64_t i[INT_ARGS] = { 0 };
+	double d[FLOAT_ARGS] = { 0 };
+	int ints = 0;
+	int floats = 0;
+	for (int k = 0; k < count; ++k) {
+		enum tag t = (k < c->count) ? c->params[k] : args[k].tag;
+		union value a = convert(args[k].v, args[k].tag, t);
+		if (t == T_FLOAT && floats < FLOAT_ARGS)
+			d[floats++] = a.f;
+		else if (t != T_FLOAT && ints < INT_ARGS)
+			i[ints++] = a.i;
+		else
+			log_error("too many arguments to %s", c->name);
+	}
+
+	if (c->tag == T_FLOAT) {
+		v.f = ((float_f)c->address)(i[0], i[1], i[2], i[3], i[4], i[5],
+		                            d[0], d[1], d[2], d[3], d[4], d[5],
+		                            d[6], d[7]);
+		return v;
+	}
+	v.i = ((int_f)c->address)(i[0], i[1], i[2], i[3], i[4], i[5],
+	                          d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7]);
+	/* only the bytes of the type returned are set */
+	switch (c->tag) {
+	case T_INT:
+		v.i = (int32_t)v.i;
+		break;
+	case T_CHAR:
+		v.i = (signed char)v.i;
+		break;
+	case T_BOOL:
+		v.i = (unsigned char)v.i;
+		break;
+	default:
+		break;
+	}
+	return v;
+}
+
+/* returns how a value of type t is kept */
+static enum tag tag(struct typeinfo *t)
+{
+	if (t == NULL)
+		return T_VOID;
+	if (t->pointer)
+		return T_PTR;
+	switch (t->base) {
+	case INT_T:
+		return T_INT;
+	case CHAR_T:
+		return T_CHAR;
+	case BOOL_T:
+		return T_BOOL;
+	case FLOAT_T:
+		return T_FLOAT;
+	case ARRAY_T:
+	case CLASS_T:
+		return T_AGG;
+	case VOID_T:
+		return T_VOID;
+	default:
+		return T_PTR;
+	}
+}
+
+/* returns how what pointer type t points to is kept, loaded in whole */
+static enum tag pointee(struct typeinfo *t)
+{
+	struct typeinfo u = *t;
+	u.pointer = false;
+	enum tag k = tag(&u);
+	return (k == T_AGG || k == T_VOID) ? T_PTR : k;
+}
+
+/* bytes pointer arithmetic of op steps by, the size pointed to */
+static int step(struct op *op)
+{
+	struct typeinfo *b = op->address[1].type;
+	if (!b->pointer || op->address[2].type->pointer)
+		return 1;
+	struct typeinfo t = *b;
+	t.pointer = false;
+	int size = typeinfo_size(&t);
+	return (size > 1) ? size : 1;
+}
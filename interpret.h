@@ -0,0 +1,16 @@
+/*
+ * interpret.h - Bytecode interpretation of intermediate code.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef INTERPRET_H
+#define INTERPRET_H
+
+struct list;
+
+int interpret(struct list *code);
+
+#endif /* INTERPRET_H */
@@ -0,0 +1,170 @@
+/*
+ * jit.c - Implementation of loading native code into memory.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "jit.h"
+#include "object.h"
+
+#include "logger.h"
+#include "list.h"
+
+/* an indirect jump through the address stored after it */
+#define STUB_SIZE 16
+
+/* libraries searched for symbols this process lacks, as when linked */
+static const char *libraries[] = { "libm.so.6" };
+#define LIBRARIES (sizeof(libraries) / sizeof(*libraries))
+
+/* their handles, opened once a symbol is missing */
+static void *handles[LIBRARIES];
+
+static unsigned char *resolve(struct jit *j, const char *name, bool call);
+static unsigned char *stub(struct jit *j, void *address);
+static size_t section_offset(struct jit *j, enum object_section section);
+static size_t round_up(size_t n, size_t align);
+
+/*
+ * Maps the sections of o into memory, text and a stub per procedure
+ * called in libc first, then read-only data, then zeroed data, each
+ * on their own pages. Its relocations are applied as the linker
+ * would, with symbols not defined by o looked up in this process.
+ * Then the text is made executable and the read-only data read-only.
+ */
+struct jit *jit_load(struct object *o)
+{
+	struct jit *j = calloc(1, sizeof(*j));
+	log_assert(j);
+	j->object = o;
+
+	size_t page = sysconf(_SC_PAGESIZE);
+	j->stubs = round_up(o->text_size, STUB_SIZE);
+	j->rodata = round_up(j->stubs + STUB_SIZE * list_size(o->relocs), page);
+	j->bss = round_up(j->rodata + o->rodata_size, page);
+	j->size = round_up(j->bss + o->bss_size, page);
+
+	j->memory = mmap(NULL, j->size, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (j->memory == MAP_FAILED)
+		log_error("could not map memory for native code");
+	memcpy(j->memory, o->text, o->text_size);
+	memcpy(j->memory + j->rodata, o->rodata, o->rodata_size);
+
+	struct list_node *iter = list_head(o->relocs);
+	for (; !list_end(iter); iter = iter->next) {
+		struct object_reloc *r = iter->data;
+		unsigned char *place = j->memory + r->offset;
+		unsigned char *target = resolve(j, r->symbol,
+		                                r->type == R_X86_64_PLT32);
+		int64_t value = (intptr_t)target - (intptr_t)place + r->addend;
+		if (value != (int32_t)value)
+			log_error("relocation out of range: %s", r->symbol);
+		int32_t field = value;
+		memcpy(place, &field, sizeof(field));
+	}
+
+	if (mprotect(j->memory, j->rodata, PROT_READ | PROT_EXEC) != 0
+	    || mprotect(j->memory + j->rodata, j->bss - j->rodata,
+	                PROT_READ) != 0)
+		log_error("could not protect native code");
+
+	return j;
+}
+
+/* returns the address of the symbol defined as name, else NULL */
+void *jit_symbol(struct jit *j, const char *name)
+{
+	struct object_symbol *s = object_find(j->object, name);
+	if (s == NULL || s->section == SECTION_UNDEF)
+		return NULL;
+	return j->memory + section_offset(j, s->section) + s->value;
+}
+
+void jit_free(struct jit *j)
+{
+	if (j == NULL)
+		return;
+	munmap(j->memory, j->size);
+	free(j);
+}
+
+/*
+ * Returns the address of name in this process, else in the libraries
+ * programs are linked with, else NULL.
+ */
+void *jit_lookup(const char *name)
+{
+	void *address = dlsym(RTLD_DEFAULT, name);
+	for (size_t i = 0; address == NULL && i < LIBRARIES; ++i) {
+		if (handles[i] == NULL)
+			handles[i] = dlopen(libraries[i], RTLD_NOW);
+		if (handles[i])
+			address = dlsym(handles[i], name);
+	}
+	return address;
+}
+
+/*
+ * Returns the address of name, defined by the object or else looked
+ * up. Calls go through a stub, as libc is likely mapped farther than
+ * a 32 bit displacement reaches.
+ */
+static unsigned char *resolve(struct jit *j, const char *name, bool call)
+{
+	unsigned char *address = jit_symbol(j, name);
+	if (address)
+		return address;
+	address = jit_lookup(name);
+	if (address == NULL)
+		log_error("undefined symbol: %s", name);
+	return call ? stub(j, address) : address;
+}
+
+/* returns the stub jumping to address, adding it if new */
+static unsigned char *stub(struct jit *j, void *address)
+{
+	/* jmp *0(%rip) */
+	static const unsigned char jump[] = { 0xff, 0x25, 0, 0, 0, 0 };
+
+	for (size_t i = 0; i < j->stub_count; ++i) {
+		unsigned char *s = j->memory + j->stubs + STUB_SIZE * i;
+		if (memcmp(s + sizeof(jump), &address, sizeof(address)) == 0)
+			return s;
+	}
+	unsigned char *s = j->memory + j->stubs + STUB_SIZE * j->stub_count++;
+	memcpy(s, jump, sizeof(jump));
+	memcpy(s + sizeof(jump), &address, sizeof(address));
+	return s;
+}
+
+static size_t section_offset(struct jit *j, enum object_section section)
+{
+	switch (section) {
+	case SECTION_TEXT:
+		return 0;
+	case SECTION_RODATA:
+		return j->rodata;
+	case SECTION_BSS:
+		return j->bss;
+	default:
+		log_assert(false);
+		return 0;
+	}
+}
+
+static size_t round_up(size_t n, size_t align)
+{
+	return (n + align - 1) / align * align;
+}
@@ -0,0 +1,32 @@
+/*
+ * jit.h - Native code loaded into memory to run in process.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+
+struct object;
+
+/* an object's sections mapped into memory, relocated as if linked */
+struct jit {
+	unsigned char *memory;
+	size_t size;
+	struct object *object;
+	size_t stubs;           /* offsets of the sections in memory */
+	size_t rodata;
+	size_t bss;
+	size_t stub_count;
+};
+
+struct jit *jit_load(struct object *o);
+void *jit_symbol(struct jit *j, const char *name);
+void jit_free(struct jit *j);
+void *jit_lookup(const char *name);
+
+#endif /* JIT_H */
@@ -0,0 +1,1465 @@
+/*
+ * llvm.c - Implementation of textual LLVM IR code generation.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "llvm.h"
+#include "intermediate.h"
+#include "type.h"
+#include "token.h"
+#include "scope.h"
+#include "args.h"
+
+#include "logger.h"
+#include "list.h"
+#include "hasht.h"
+
+#define p(...) fprintf(stream, __VA_ARGS__)
+
+extern struct list *yyscopes;
+
+/* LLVM types of values, integers extended as the native backend does */
+enum kind {
+	K_VOID,
+	K_FLAG,   /* i1, of comparisons */
+	K_BOOL,   /* i8, zero extended */
+	K_CHAR,   /* i8, sign extended */
+	K_INT,    /* i32 */
+	K_LONG,   /* i64, of addressing */
+	K_FLOAT,  /* double */
+	K_PTR,    /* i8*, as are the addresses of arrays and instances */
+};
+
+/* an operand of an instruction: a temporary, immediate or constant */
+struct value {
+	enum kind kind;
+	char name[128];
+};
+
+/* the procedure being printed */
+static struct {
+	int frame;
+	struct typeinfo **types; /* by offset, of the variable starting there */
+	bool *taken;             /* by byte, kept in the local region */
+	struct typeinfo *class;  /* of a member function, else NULL */
+	struct typeinfo self;    /* pointer to class, as in local region */
+	enum kind type;          /* returned */
+	int temps;
+	int blocks;
+	bool open;               /* last block not yet terminated */
+	enum kind *args;         /* of each argument variable */
+	int *pending;            /* argument variables of calls yet made */
+	int top;
+	int next;
+} proc;
+
+/* routines called by generated code, which programs may call too */
+static const char *library[] = {
+	"declare i32 @printf(i8*, ...)",
+	"declare i8* @calloc(i64, i64)",
+	"declare void @free(i8*)",
+	"declare void @exit(i32) noreturn",
+	"declare void @llvm.memcpy.p0i8.p0i8.i64(i8*, i8*, i64, i1)",
+	"declare void @llvm.memmove.p0i8.p0i8.i64(i8*, i8*, i64, i1)",
+};
+#define LIBRARY (sizeof(library) / sizeof(*library))
+
+/* names of the procedures defined, and lines declaring the rest */
+static struct list *defined;
+static struct list *declared;
+
+static void print_op_ir(FILE *stream, struct list_node *iter);
+static void print_struct(FILE *stream, char *name, struct typeinfo *class);
+static void print_strings(FILE *stream);
+static void print_noops(FILE *stream, struct hasht *table, char *class);
+static void print_prologue(FILE *stream, struct list_node *iter);
+static void store_params(FILE *stream, struct typeinfo *function);
+static struct value call(FILE *stream, struct op *op, bool tail);
+static void declare(char *name, enum kind type, enum kind *params, int n);
+static void compare(FILE *stream, struct value *r, enum opcode code,
+                    struct address a, struct address b);
+static void arithmetic(FILE *stream, struct op *op);
+static void begin(FILE *stream);
+static void branch(FILE *stream, struct value flag, int label, bool when);
+static void jump(FILE *stream, int label);
+static struct value temp(enum kind k);
+static struct value constant(enum kind k, const char *text);
+static struct value zero(enum kind k);
+static struct value load(FILE *stream, struct address a);
+static void store(FILE *stream, struct address a, struct value v);
+static struct value location(FILE *stream, struct address a);
+static struct value offset_of(FILE *stream, struct value base,
+                              struct value offset);
+static struct value field(FILE *stream, struct typeinfo *pointer,
+                          struct value base, int offset, enum kind k);
+static struct value load_at(FILE *stream, struct value pointer, enum kind k);
+static void store_at(FILE *stream, struct value pointer, struct value v);
+static struct value typed(FILE *stream, struct value pointer, enum kind k);
+static void copy(FILE *stream, struct value to, struct value from, int size,
+                 const char *intrinsic);
+static struct value convert(FILE *stream, struct value v, enum kind to);
+static void set_class(char *name);
+static bool find_locals(struct list_node *iter);
+static void add_local(struct address a, bool taken, int *owner);
+static bool is_variable(struct address a);
+static int find_field(struct typeinfo *class, int offset, enum kind k);
+static struct typeinfo *class_of(struct typeinfo *pointer);
+static enum kind kind(struct typeinfo *t);
+static enum kind pointee(struct typeinfo *t);
+static const char *llvm_t(enum kind k);
+static int bits(enum kind k);
+static int scalar_size(enum kind k);
+static int step(struct typeinfo *t);
+static bool has_name(struct list *names, const char *name);
+
+/*
+ * Prints the program as an LLVM module: a struct type for each class,
+ * the string constants and global region, then each procedure with a
+ * typed alloca for each of its scalar locals, which LLVM promotes to
+ * registers. Whatever else is local stays in a byte region, addressed
+ * by getelementptr as are fields and array elements.
+ */
+void llvm_code(FILE *stream, struct list *code)
+{
+	struct hasht *global = list_index(yyscopes, 1)->data;
+
+	defined = list_new(NULL, &free);
+	declared = list_new(NULL, &free);
+	log_assert(defined && declared);
+	for (size_t i = 0; i < LIBRARY; ++i)
+		list_push_back(declared, strdup(library[i]));
+
+	/* class layouts */
+	for (size_t i = 0; i < global->size; ++i) {
+		struct hasht_node *slot = global->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *value = slot->value;
+			if (value->base == CLASS_T)
+				print_struct(stream, slot->key, value);
+		}
+	}
+	p("\n");
+
+	/* regions, strings being constants of their own */
+	print_strings(stream);
+	p("@global = common global [%zu x i8] zeroinitializer, align 8\n\n",
+	  scope_size(global));
+
+	/* what library routines print */
+	p("@.print_int = private unnamed_addr constant [3 x i8] c\"%%d\\00\"\n");
+	p("@.print_char = private unnamed_addr constant [3 x i8] c\"%%c\\00\"\n");
+	p("@.print_float = private unnamed_addr constant [3 x i8] c\"%%f\\00\"\n");
+	p("@.print_str = private unnamed_addr constant [3 x i8] c\"%%s\\00\"\n\n");
+
+	for (struct list_node *iter = list_head(code); !list_end(iter);
+	     iter = iter->next) {
+		struct op *op = iter->data;
+		if (op->code == PROC_O)
+			list_push_back(defined, strdup(op->name));
+	}
+
+	/* methods declared but not defined, which do nothing */
+	for (size_t i = 0; i < global->size; ++i) {
+		struct hasht_node *slot = global->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *value = slot->value;
+			if (value->base == CLASS_T) {
+				print_noops(stream, value->class.public, slot->key);
+				print_noops(stream, value->class.private, slot->key);
+			}
+		}
+	}
+
+	for (struct list_node *iter = list_head(code); !list_end(iter);
+	     iter = iter->next)
+		print_op_ir(stream, iter);
+
+	/* functions called but not defined */
+	for (struct list_node *iter = list_head(declared); !list_end(iter);
+	     iter = iter->next)
+		p("%s\n", (char *)iter->data);
+
+	list_free(defined);
+	list_free(declared);
+	defined = NULL;
+	declared = NULL;
+	free(proc.types);
+	free(proc.taken);
+	free(proc.args);
+	free(proc.pending);
+	free(proc.self.class.type);
+	memset(&proc, 0, sizeof(proc));
+}
+
+/* prints the instructions of the op at iter */
+static void print_op_ir(FILE *stream, struct list_node *iter)
+{
+	struct op *op = iter->data;
+	struct address a = op->address[0];
+	struct address b = op->address[1];
+	struct address c = op->address[2];
+	if (arguments.debug) {
+		p("; ");
+		print_op(stream, op);
+	}
+	if (op->code != PROC_O && op->code != END_O && op->code != LABEL_O
+	    && op->code != CASE_O)
+		begin(stream);
+
+	struct value v, w, r;
+	switch (op->code) {
+	case PROC_O:
+		print_prologue(stream, iter);
+		break;
+	case END_O:
+		/* falling off the end, main returns 0 */
+		if (proc.open) {
+			if (proc.type == K_VOID)
+				p("\tret void\n");
+			else
+				p("\tret %s %s\n", llvm_t(proc.type), zero(proc.type).name);
+		}
+		p("}\n\n");
+		break;
+	case PARAM_O:
+		/* evaluate argument now, as its operand may be reused */
+		v = load(stream, a);
+		p("\tstore %s %s, %s* %%a_%d\n", llvm_t(v.kind), v.name,
+		  llvm_t(v.kind), proc.next);
+		proc.pending[proc.top++] = proc.next++;
+		break;
+	case CALL_O:
+	case CALLC_O:
+		v = call(stream, op, false);
+		if (a.region != UNKNOWN_R && v.kind != K_VOID)
+			store(stream, a, v);
+		break;
+	case TCALL_O:
+		/* marked so llc may compile it to a jump */
+		v = call(stream, op, true);
+		if (proc.type == K_VOID) {
+			p("\tret void\n");
+		} else {
+			v = (v.kind == K_VOID) ? zero(proc.type)
+				: convert(stream, v, proc.type);
+			p("\tret %s %s\n", llvm_t(proc.type), v.name);
+		}
+		proc.open = false;
+		break;
+	case RET_O:
+		if (proc.type == K_VOID) {
+			p("\tret void\n");
+		} else {
+			v = (a.region == UNKNOWN_R || kind(a.type) == K_VOID)
+				? zero(proc.type)
+				: convert(stream, load(stream, a), proc.type);
+			p("\tret %s %s\n", llvm_t(proc.type), v.name);
+		}
+		proc.open = false;
+		break;
+	case LABEL_O:
+		if (proc.open)
+			p("\tbr label %%L_%d\n", a.offset);
+		p("L_%d:\n", a.offset);
+		proc.open = true;
+		break;
+	case GOTO_O:
+		jump(stream, a.offset);
+		break;
+	case TABLE_O:
+		/* a switch, which llc lowers to a jump table when dense */
+		v = convert(stream, load(stream, a), K_INT);
+		p("\tswitch i32 %s, label %%L_%d [\n", v.name, c.offset);
+		for (int i = 0; i < b.offset; ++i) {
+			iter = iter->next;
+			struct op *entry = iter->data;
+			p("\t\ti32 %d, label %%L_%d\n", entry->address[0].offset,
+			  entry->address[1].offset);
+		}
+		p("\t]\n");
+		proc.open = false;
+		break;
+	case CASE_O:
+		/* printed by preceding TABLE_O */
+		break;
+	case COUNT_O:
+		/* only the C backend is instrumented */
+		break;
+	case NEW_O:
+		r = temp(K_PTR);
+		p("\t%s = call i8* @calloc(i64 1, i64 %d)\n", r.name, b.offset);
+		store(stream, a, r);
+		break;
+	case DEL_O:
+		v = convert(stream, load(stream, a), K_PTR);
+		p("\tcall void @free(i8* %s)\n", v.name);
+		break;
+	case PINT_O:
+	case PCHAR_O:
+	case PBOOL_O:
+	case PFLOAT_O:
+	case PSTR_O: {
+		const char *format = (op->code == PCHAR_O) ? "char"
+			: (op->code == PFLOAT_O) ? "float"
+			: (op->code == PSTR_O) ? "str"
+			: "int";
+		enum kind k = (op->code == PFLOAT_O) ? K_FLOAT
+			: (op->code == PSTR_O) ? K_PTR : K_INT;
+		v = convert(stream, load(stream, a), k);
+		r = temp(K_INT);
+		p("\t%s = call i32 (i8*, ...) @printf(i8* getelementptr inbounds "
+		  "([3 x i8], [3 x i8]* @.print_%s, i64 0, i64 0), %s %s)\n",
+		  r.name, format, llvm_t(k), v.name);
+		break;
+	}
+	case ADD_O:
+	case FADD_O:
+	case SUB_O:
+	case FSUB_O:
+	case MUL_O:
+	case FMUL_O:
+	case DIV_O:
+	case FDIV_O:
+	case MOD_O:
+		arithmetic(stream, op);
+		break;
+	case SHL_O:
+	case SHR_O:
+	case USHR_O: {
+		/* counts are masked as x86 does */
+		const char *shift = (op->code == SHL_O) ? "shl"
+			: (op->code == SHR_O) ? "ashr" : "lshr";
+		v = convert(stream, load(stream, b), K_INT);
+		w = convert(stream, load(stream, c), K_INT);
+		struct value n = temp(K_INT);
+		p("\t%s = and i32 %s, 31\n", n.name, w.name);
+		r = temp(K_INT);
+		p("\t%s = %s i32 %s, %s\n", r.name, shift, v.name, n.name);
+		store(stream, a, r);
+		break;
+	}
+	case MULH_O: {
+		v = convert(stream, load(stream, b), K_LONG);
+		w = convert(stream, load(stream, c), K_LONG);
+		struct value product = temp(K_LONG);
+		p("\t%s = mul i64 %s, %s\n", product.name, v.name, w.name);
+		r = temp(K_LONG);
+		p("\t%s = ashr i64 %s, 32\n", r.name, product.name);
+		store(stream, a, convert(stream, r, K_INT));
+		break;
+	}
+	case INC_O:
+	case DEC_O: {
+		bool inc = op->code == INC_O;
+		v = load(stream, a);
+		if (v.kind == K_FLOAT) {
+			r = temp(K_FLOAT);
+			p("\t%s = %s double %s, 1.0\n", r.name, inc ? "fadd" : "fsub",
+			  v.name);
+		} else if (v.kind == K_PTR) {
+			r = temp(K_PTR);
+			p("\t%s = getelementptr i8, i8* %s, i64 %d\n", r.name, v.name,
+			  inc ? step(a.type) : -step(a.type));
+		} else {
+			v = convert(stream, v, K_INT);
+			r = temp(K_INT);
+			p("\t%s = %s i32 %s, 1\n", r.name, inc ? "add" : "sub", v.name);
+		}
+		store(stream, a, r);
+		break;
+	}
+	case LT_O:
+	case FLT_O:
+	case LE_O:
+	case FLE_O:
+	case GT_O:
+	case FGT_O:
+	case GE_O:
+	case FGE_O:
+	case EQ_O:
+	case FEQ_O:
+	case NE_O:
+	case FNE_O:
+		compare(stream, &r, op->code, b, c);
+		store(stream, a, r);
+		break;
+	case OR_O:
+	case AND_O:
+		v = convert(stream, load(stream, b), K_FLAG);
+		w = convert(stream, load(stream, c), K_FLAG);
+		r = temp(K_FLAG);
+		p("\t%s = %s i1 %s, %s\n", r.name, (op->code == OR_O) ? "or" : "and",
+		  v.name, w.name);
+		store(stream, a, r);
+		break;
+	case NEG_O:
+	case FNEG_O:
+		v = load(stream, b);
+		if (v.kind == K_FLOAT) {
+			r = temp(K_FLOAT);
+			p("\t%s = fneg double %s\n", r.name, v.name);
+		} else {
+			v = convert(stream, v, K_INT);
+			r = temp(K_INT);
+			p("\t%s = sub i32 0, %s\n", r.name, v.name);
+		}
+		store(stream, a, r);
+		break;
+	case NOT_O:
+		v = convert(stream, load(stream, b), K_FLAG);
+		r = temp(K_FLAG);
+		p("\t%s = xor i1 %s, true\n", r.name, v.name);
+		store(stream, a, r);
+		break;
+	case ASN_O:
+		store(stream, a, load(stream, b));
+		break;
+	case RSTAR_O:
+		v = convert(stream, load(stream, b), K_PTR);
+		if (pointee(b.type) != K_VOID)
+			v = load_at(stream, v, pointee(b.type));
+		store(stream, a, v);
+		break;
+	case LSTAR_O:
+		v = convert(stream, load(stream, a), K_PTR);
+		w = load(stream, b);
+		if (pointee(a.type) == K_VOID) {
+			struct typeinfo t = *a.type;
+			t.pointer = false;
+			copy(stream, v, w, typeinfo_size(&t), "memmove");
+		} else {
+			store_at(stream, v, convert(stream, w, pointee(a.type)));
+		}
+		break;
+	case ADDR_O:
+		store(stream, a, location(stream, b));
+		break;
+	case LARR_O:
+	case RARR_O:
+		/* the index is already in bytes, an array parameter a pointer */
+		v = b.type->pointer ? convert(stream, load(stream, b), K_PTR)
+			: location(stream, b);
+		r = offset_of(stream, v, load(stream, c));
+		if (op->code == RARR_O && !typeinfo_by_reference(a.type))
+			r = load_at(stream, r, kind(a.type));
+		store(stream, a, r);
+		break;
+	case LFIELD_O:
+	case RFIELD_O: {
+		struct typeinfo t = *a.type;
+		if (op->code == LFIELD_O)
+			t.pointer = false;
+		enum kind k = typeinfo_by_reference(&t) ? K_VOID : kind(&t);
+		v = convert(stream, load(stream, b), K_PTR);
+		r = field(stream, b.type, v, c.offset, k);
+		if (op->code == RFIELD_O && k != K_VOID)
+			r = load_at(stream, r, k);
+		store(stream, a, r);
+		break;
+	}
+	case IF_O:
+	case IFN_O:
+		v = convert(stream, load(stream, a), K_FLAG);
+		branch(stream, v, b.offset, op->code == IF_O);
+		break;
+	case IFLT_O:
+	case IFLE_O:
+	case IFGT_O:
+	case IFGE_O:
+	case IFEQ_O:
+	case IFNE_O:
+		compare(stream, &r, op->code, a, b);
+		branch(stream, r, c.offset, true);
+		break;
+	case ERRC_O:
+		p("\tcall void @exit(i32 -1) ; operation error\n");
+		p("\tunreachable\n");
+		proc.open = false;
+		break;
+	}
+}
+
+/*
+ * Prints a class as a struct type with each field at its offset,
+ * padding between fields, and packed if a field would otherwise be
+ * moved, as the C backend lays out its structs.
+ */
+static void print_struct(FILE *stream, char *name, struct typeinfo *class)
+{
+	size_t count;
+	struct hasht_node **fields = typeinfo_fields(class, &count);
+
+	bool packed = false;
+	for (size_t i = 0; i < count; ++i) {
+		struct typeinfo *t = fields[i]->value;
+		if (!typeinfo_by_reference(t))
+			packed |= t->place.offset % scalar_size(kind(t)) != 0;
+	}
+
+	p("%%class.%s = type %s{", name, packed ? "<" : "");
+	int end = 0;
+	const char *separator = " ";
+	for (size_t i = 0; i < count; ++i) {
+		struct typeinfo *t = fields[i]->value;
+		int offset = t->place.offset;
+		if (offset < end)
+			continue; /* overlaps, so addressed by byte */
+		if (offset > end) {
+			p("%s[%d x i8]", separator, offset - end);
+			separator = ", ";
+		}
+		if (typeinfo_by_reference(t)) {
+			p("%s[%zu x i8]", separator, typeinfo_size(t));
+			end = offset + typeinfo_size(t);
+		} else {
+			p("%s%s", separator, llvm_t(kind(t)));
+			end = offset + scalar_size(kind(t));
+		}
+		separator = ", ";
+	}
+	int size = typeinfo_size(class);
+	if (end < size)
+		p("%s[%d x i8]", separator, size - end);
+	p(" }%s\n", packed ? ">" : "");
+
+	free(fields);
+}
+
+/* prints each string constant as a global array of its bytes */
+static void print_strings(FILE *stream)
+{
+	struct hasht *constant = list_front(yyscopes);
+	for (size_t i = 0; i < constant->size; ++i) {
+		struct hasht_node *slot = constant->table[i];
+		if (slot == NULL || hasht_node_deleted(slot))
+			continue;
+		struct typeinfo *v = slot->value;
+		if (v->base != CHAR_T || !v->pointer)
+			continue;
+		struct token *token = v->token;
+		p("@.str.%d = private unnamed_addr constant [%zu x i8] c\"",
+		  v->place.offset, token->ssize);
+		for (size_t j = 0; j < token->ssize; ++j) {
+			unsigned char c = token->sval[j];
+			if (c >= ' ' && c <= '~' && c != '"' && c != '\\')
+				p("%c", c);
+			else
+				p("\\%02X", c);
+		}
+		p("\"\n");
+	}
+}
+
+/* prints each method of class in table which has no body, as a noop */
+static void print_noops(FILE *stream, struct hasht *table, char *class)
+{
+	if (table == NULL)
+		return;
+	for (size_t i = 0; i < table->size; ++i) {
+		struct hasht_node *slot = table->table[i];
+		if (slot == NULL || hasht_node_deleted(slot))
+			continue;
+		struct typeinfo *value = slot->value;
+		if (value->base != FUNCTION_T || value->function.symbols)
+			continue;
+		char *name;
+		asprintf(&name, "%s__%s", class, (char *)slot->key);
+		enum kind type = kind(typeinfo_return(value));
+		p("define %s @%s(i8*", llvm_t(type), name);
+		struct list_node *param = list_head(value->function.parameters);
+		for (; !list_end(param); param = param->next)
+			p(", %s", llvm_t(kind(param->data)));
+		p(") {\nentry:\n");
+		if (type == K_VOID)
+			p("\tret void\n");
+		else
+			p("\tret %s %s\n", llvm_t(type), zero(type).name);
+		p("}\n\n");
+		list_push_back(defined, name);
+	}
+}
+
+/*
+ * Prints the definition of the procedure at iter: its signature, an
+ * alloca for each variable, argument, and the local region if used,
+ * then parameters stored into them.
+ */
+static void print_prologue(FILE *stream, struct list_node *iter)
+{
+	struct op *op = iter->data;
+	struct typeinfo *function = op->address[2].type;
+	set_class(op->name);
+	bool used = find_locals(iter);
+	proc.type = kind(typeinfo_return(function));
+	proc.temps = 0;
+	proc.blocks = 0;
+	proc.top = 0;
+	proc.next = 0;
+
+	p("define %s @%s(", llvm_t(proc.type), op->name);
+	int i = 0;
+	if (proc.class)
+		p("i8* %%p%d", i++);
+	struct list_node *param = list_head(function->function.parameters);
+	for (; !list_end(param); param = param->next) {
+		p("%s%s %%p%d", (i > 0) ? ", " : "", llvm_t(kind(param->data)), i);
+		++i;
+	}
+	p(") {\nentry:\n");
+	proc.open = true;
+
+	if (used)
+		p("\t%%local = alloca [%d x i8], align 8\n", proc.frame);
+	for (int j = 0; j < proc.frame; ++j)
+		if (proc.types[j])
+			p("\t%%l_%d = alloca %s\n", j, llvm_t(kind(proc.types[j])));
+
+	int args = 0;
+	for (struct list_node *i = iter->next; ((struct op *)i->data)->code != END_O;
+	     i = i->next) {
+		struct op *o = i->data;
+		if (o->code != PARAM_O)
+			continue;
+		proc.args = realloc(proc.args, (args + 1) * sizeof(*proc.args));
+		log_assert(proc.args);
+		proc.args[args] = kind(o->address[0].type);
+		p("\t%%a_%d = alloca %s\n", args, llvm_t(proc.args[args]));
+		++args;
+	}
+	proc.pending = realloc(proc.pending, (args + 1) * sizeof(*proc.pending));
+	log_assert(proc.pending);
+
+	store_params(stream, function);
+}
+
+/* stores parameters of function into the front of the local region */
+static void store_params(FILE *stream, struct typeinfo *function)
+{
+	int i = 0;
+	int offset = 0;
+	struct value v;
+	v.kind = K_PTR;
+	if (proc.class) {
+		struct address a = { PARAM_R, offset, &proc.self };
+		snprintf(v.name, sizeof(v.name), "%%p%d", i++);
+		store(stream, a, v);
+		offset += typeinfo_size(&proc.self);
+	}
+	struct list_node *iter = list_head(function->function.parameters);
+	for (; !list_end(iter); iter = iter->next) {
+		struct typeinfo *t = iter->data;
+		offset = typeinfo_aligned(offset, t);
+		struct address a = { PARAM_R, offset, t };
+		v.kind = kind(t);
+		snprintf(v.name, sizeof(v.name), "%%p%d", i++);
+		if (typeinfo_by_reference(t)) {
+			/* else nothing in local region to copy into */
+			if (typeinfo_size(t) > 0)
+				copy(stream, location(stream, a), v, typeinfo_size(t),
+				     "memcpy");
+		} else {
+			store(stream, a, v);
+		}
+		offset += typeinfo_size(t);
+	}
+}
+
+/*
+ * Calls the procedure of op with its pending arguments, converted to
+ * the types of its parameters where known, declaring it if it is not
+ * defined here. Returns the result, of the type it returns.
+ */
+static struct value call(FILE *stream, struct op *op, bool tail)
+{
+	int n = op->address[1].offset;
+	log_assert(n <= proc.top);
+	proc.top -= n;
+	int *args = proc.pending + proc.top;
+
+	struct typeinfo *f = scope_procedure(op->name);
+	struct list_node *param = f ? list_head(f->function.parameters) : NULL;
+	bool member = f && strstr(op->name, "__");
+
+	enum kind *types = calloc(n + 1, sizeof(*types));
+	struct value *values = calloc(n + 1, sizeof(*values));
+	log_assert(types && values);
+	for (int i = 0; i < n; ++i) {
+		types[i] = proc.args[args[i]];
+		if (param && !(member && i == 0) && !list_end(param)) {
+			types[i] = kind(param->data);
+			param = param->next;
+		}
+		struct value v = temp(proc.args[args[i]]);
+		p("\t%s = load %s, %s* %%a_%d\n", v.name, llvm_t(v.kind),
+		  llvm_t(v.kind), args[i]);
+		values[i] = convert(stream, v, types[i]);
+	}
+
+	enum kind type = f ? kind(typeinfo_return(f)) : kind(op->address[0].type);
+	if (!has_name(defined, op->name))
+		declare(op->name, type, types, n);
+
+	struct value r = zero(K_VOID);
+	p("\t");
+	if (type != K_VOID) {
+		r = temp(type);
+		p("%s = ", r.name);
+	}
+	p("%scall %s ", tail ? "tail " : "", llvm_t(type));
+	int count = f ? (member ? 1 : 0) + list_size(f->function.parameters) : n;
+	if (count == n) {
+		p("@%s(", op->name);
+	} else {
+		/* as to an implicit constructor, through its defined type */
+		p("bitcast (%s (", llvm_t(type));
+		param = list_head(f->function.parameters);
+		for (int i = 0; i < count; ++i) {
+			enum kind k = (member && i == 0) ? K_PTR : kind(param->data);
+			if (!(member && i == 0))
+				param = param->next;
+			p("%s%s", (i > 0) ? ", " : "", llvm_t(k));
+		}
+		p(")* @%s to %s (", op->name, llvm_t(type));
+		for (int i = 0; i < n; ++i)
+			p("%s%s", (i > 0) ? ", " : "", llvm_t(types[i]));
+		p(")*)(");
+	}
+	for (int i = 0; i < n; ++i)
+		p("%s%s %s", (i > 0) ? ", " : "", llvm_t(types[i]), values[i].name);
+	p(")\n");
+
+	free(types);
+	free(values);
+	return r;
+}
+
+/* adds a declaration of name, unless already declared */
+static void declare(char *name, enum kind type, enum kind *params, int n)
+{
+	char *symbol;
+	asprintf(&symbol, " @%s(", name);
+	for (struct list_node *iter = list_head(declared); !list_end(iter);
+	     iter = iter->next) {
+		if (strstr(iter->data, symbol)) {
+			free(symbol);
+			return;
+		}
+	}
+
+	char *line = NULL;
+	size_t size = 0;
+	FILE *stream = open_memstream(&line, &size);
+	log_assert(stream);
+	p("declare %s%s", llvm_t(type), symbol);
+	for (int i = 0; i < n; ++i)
+		p("%s%s", (i > 0) ? ", " : "", llvm_t(params[i]));
+	p(")");
+	fclose(stream);
+	list_push_back(declared, line);
+	free(symbol);
+}
+
+/*
+ * Sets r to the flag of the relation of code between a and b: of
+ * doubles if either is one, false if unordered but for not equal.
+ */
+static void compare(FILE *stream, struct value *r, enum opcode code,
+                    struct address a, struct address b)
+{
+	static const char *integer[] = { "slt", "sle", "sgt", "sge", "eq", "ne" };
+	static const char *pointer[] = { "ult", "ule", "ugt", "uge", "eq", "ne" };
+	static const char *floating[] = { "olt", "ole", "ogt", "oge", "oeq", "une" };
+	int relation;
+	switch (code) {
+	case LT_O: case FLT_O: case IFLT_O: relation = 0; break;
+	case LE_O: case FLE_O: case IFLE_O: relation = 1; break;
+	case GT_O: case FGT_O: case IFGT_O: relation = 2; break;
+	case GE_O: case FGE_O: case IFGE_O: relation = 3; break;
+	case EQ_O: case FEQ_O: case IFEQ_O: relation = 4; break;
+	default: relation = 5; break;
+	}
+
+	struct value v = load(stream, a);
+	struct value w = load(stream, b);
+	if (v.kind == K_FLOAT || w.kind == K_FLOAT) {
+		v = convert(stream, v, K_FLOAT);
+		w = convert(stream, w, K_FLOAT);
+		*r = temp(K_FLAG);
+		p("\t%s = fcmp %s double %s, %s\n", r->name, floating[relation],
+		  v.name, w.name);
+	} else if (v.kind == K_PTR || w.kind == K_PTR) {
+		v = convert(stream, v, K_LONG);
+		w = convert(stream, w, K_LONG);
+		*r = temp(K_FLAG);
+		p("\t%s = icmp %s i64 %s, %s\n", r->name, pointer[relation],
+		  v.name, w.name);
+	} else {
+		v = convert(stream, v, K_INT);
+		w = convert(stream, w, K_INT);
+		*r = temp(K_FLAG);
+		p("\t%s = icmp %s i32 %s, %s\n", r->name, integer[relation],
+		  v.name, w.name);
+	}
+}
+
+/*
+ * Prints binary arithmetic of op: on doubles if any operand is one,
+ * getelementptr stepping by the size pointed to for pointers, else on
+ * ints, wrapping.
+ */
+static void arithmetic(FILE *stream, struct op *op)
+{
+	struct address a = op->address[0];
+	struct address b = op->address[1];
+	struct address c = op->address[2];
+	struct value v = load(stream, b);
+	struct value w = load(stream, c);
+	struct value r;
+	bool sub = op->code == SUB_O || op->code == FSUB_O;
+
+	if (v.kind == K_PTR && w.kind == K_PTR && sub) {
+		/* a difference of addresses, in bytes */
+		v = convert(stream, v, K_LONG);
+		w = convert(stream, w, K_LONG);
+		r = temp(K_LONG);
+		p("\t%s = sub i64 %s, %s\n", r.name, v.name, w.name);
+	} else if (v.kind == K_PTR && (op->code == ADD_O || sub)) {
+		w = convert(stream, w, K_LONG);
+		struct value bytes = temp(K_LONG);
+		p("\t%s = mul i64 %s, %d\n", bytes.name, w.name,
+		  sub ? -step(b.type) : step(b.type));
+		r = temp(K_PTR);
+		p("\t%s = getelementptr i8, i8* %s, i64 %s\n", r.name, v.name,
+		  bytes.name);
+	} else if (v.kind == K_FLOAT || w.kind == K_FLOAT
+	           || typeinfo_double(a.type)) {
+		const char *f = (op->code == ADD_O || op->code == FADD_O) ? "fadd"
+			: sub ? "fsub"
+			: (op->code == MUL_O || op->code == FMUL_O) ? "fmul"
+			: (op->code == MOD_O) ? "frem" : "fdiv";
+		v = convert(stream, v, K_FLOAT);
+		w = convert(stream, w, K_FLOAT);
+		r = temp(K_FLOAT);
+		p("\t%s = %s double %s, %s\n", r.name, f, v.name, w.name);
+	} else {
+		const char *i = (op->code == ADD_O || op->code == FADD_O) ? "add"
+			: sub ? "sub"
+			: (op->code == MUL_O || op->code == FMUL_O) ? "mul"
+			: (op->code == MOD_O) ? "srem" : "sdiv";
+		v = convert(stream, v, K_INT);
+		w = convert(stream, w, K_INT);
+		r = temp(K_INT);
+		p("\t%s = %s i32 %s, %s\n", r.name, i, v.name, w.name);
+	}
+	store(stream, a, r);
+}
+
+/* opens a block for code after a terminator, though unreachable */
+static void begin(FILE *stream)
+{
+	if (proc.open)
+		return;
+	p("b%d:\n", proc.blocks++);
+	proc.open = true;
+}
+
+/* branches to label if flag is when, else falls through */
+static void branch(FILE *stream, struct value flag, int label, bool when)
+{
+	int next = proc.blocks++;
+	if (when)
+		p("\tbr i1 %s, label %%L_%d, label %%b%d\n", flag.name, label, next);
+	else
+		p("\tbr i1 %s, label %%b%d, label %%L_%d\n", flag.name, next, label);
+	p("b%d:\n", next);
+}
+
+static void jump(FILE *stream, int label)
+{
+	p("\tbr label %%L_%d\n", label);
+	proc.open = false;
+}
+
+/* returns the next temporary of the procedure */
+static struct value temp(enum kind k)
+{
+	struct value v;
+	v.kind = k;
+	snprintf(v.name, sizeof(v.name), "%%t%d", proc.temps++);
+	return v;
+}
+
+static struct value constant(enum kind k, const char *text)
+{
+	struct value v;
+	v.kind = k;
+	snprintf(v.name, sizeof(v.name), "%s", text);
+	return v;
+}
+
+static struct value zero(enum kind k)
+{
+	switch (k) {
+	case K_FLAG:
+		return constant(k, "false");
+	case K_FLOAT:
+		return constant(k, "0.0");
+	case K_PTR:
+		return constant(k, "null");
+	default:
+		return constant(k, "0");
+	}
+}
+
+/*
+ * Returns value of a, integer and float constants as immediates and
+ * aggregates as their address.
+ */
+static struct value load(FILE *stream, struct address a)
+{
+	if (a.region == UNKNOWN_R || a.type == NULL)
+		return zero(kind(a.type));
+	enum kind k = kind(a.type);
+	char text[128];
+
+	if (a.region == CONST_R && !a.type->pointer
+	    && (a.type->base == INT_T
+	        || a.type->base == CHAR_T
+	        || a.type->base == BOOL_T)) {
+		snprintf(text, sizeof(text), "%d", (a.type->base == CHAR_T)
+		         ? (signed char)a.offset : a.offset);
+		return constant(k, text);
+	}
+	if (a.region == CONST_R && !a.type->pointer && a.type->base == FLOAT_T) {
+		/* exactly, by its bits */
+		struct hasht *table = list_front(yyscopes);
+		for (size_t i = 0; i < table->size; ++i) {
+			struct hasht_node *slot = table->table[i];
+			if (slot == NULL || hasht_node_deleted(slot))
+				continue;
+			struct typeinfo *v = slot->value;
+			if (v->base == FLOAT_T && !v->pointer
+			    && v->place.offset == a.offset) {
+				uint64_t bits;
+				memcpy(&bits, &v->token->fval, sizeof(bits));
+				snprintf(text, sizeof(text), "0x%016" PRIX64, bits);
+				return constant(K_FLOAT, text);
+			}
+		}
+		log_error("float constant at %d not found", a.offset);
+	}
+	if (a.region == CONST_R && a.type->base != CHAR_T) {
+		/* a pointer literal */
+		snprintf(text, sizeof(text), "inttoptr (i64 %d to i8*)", a.offset);
+		return constant(K_PTR, a.offset ? text : "null");
+	}
+	if (a.region == CONST_R || typeinfo_by_reference(a.type))
+		return location(stream, a);
+
+	if (is_variable(a)) {
+		struct value v = temp(k);
+		p("\t%s = load %s, %s* %%l_%d\n", v.name, llvm_t(k), llvm_t(k),
+		  a.offset);
+		return v;
+	}
+	if (a.region == CLASS_R) {
+		struct address self = { PARAM_R, 0, &proc.self };
+		struct value f = field(stream, &proc.self, load(stream, self),
+		                       a.offset, k);
+		return load_at(stream, f, k);
+	}
+	return load_at(stream, location(stream, a), k);
+}
+
+/* stores v to a, converted to its type, copying aggregates */
+static void store(FILE *stream, struct address a, struct value v)
+{
+	if (a.region == UNKNOWN_R || a.type == NULL)
+		return;
+	if (typeinfo_by_reference(a.type)) {
+		copy(stream, location(stream, a), convert(stream, v, K_PTR),
+		     typeinfo_size(a.type), "memmove");
+		return;
+	}
+	enum kind k = kind(a.type);
+	v = convert(stream, v, k);
+	if (is_variable(a)) {
+		p("\tstore %s %s, %s* %%l_%d\n", llvm_t(k), v.name, llvm_t(k),
+		  a.offset);
+	} else if (a.region == CLASS_R) {
+		struct address self = { PARAM_R, 0, &proc.self };
+		store_at(stream, field(stream, &proc.self, load(stream, self),
+		                       a.offset, k), v);
+	} else {
+		store_at(stream, location(stream, a), v);
+	}
+}
+
+/* returns address of a, which is in a region */
+static struct value location(FILE *stream, struct address a)
+{
+	struct value r;
+	switch (a.region) {
+	case LOCAL_R:
+	case PARAM_R:
+		r = temp(K_PTR);
+		p("\t%s = getelementptr inbounds [%d x i8], [%d x i8]* %%local, "
+		  "i64 0, i64 %d\n", r.name, proc.frame, proc.frame, a.offset);
+		return r;
+	case GLOBE_R: {
+		size_t size = scope_size(list_index(yyscopes, 1)->data);
+		r = temp(K_PTR);
+		p("\t%s = getelementptr inbounds [%zu x i8], [%zu x i8]* @global, "
+		  "i64 0, i64 %d\n", r.name, size, size, a.offset);
+		return r;
+	}
+	case CONST_R: {
+		struct hasht *table = list_front(yyscopes);
+		for (size_t i = 0; i < table->size; ++i) {
+			struct hasht_node *slot = table->table[i];
+			if (slot == NULL || hasht_node_deleted(slot))
+				continue;
+			struct typeinfo *v = slot->value;
+			if (v->base == CHAR_T && v->pointer
+			    && v->place.offset == a.offset) {
+				size_t n = v->token->ssize;
+				r.kind = K_PTR;
+				snprintf(r.name, sizeof(r.name), "getelementptr inbounds "
+				         "([%zu x i8], [%zu x i8]* @.str.%d, i64 0, i64 0)",
+				         n, n, a.offset);
+				return r;
+			}
+		}
+		log_error("string constant at %d not found", a.offset);
+		return zero(K_PTR);
+	}
+	case CLASS_R: {
+		struct address self = { PARAM_R, 0, &proc.self };
+		return field(stream, &proc.self, load(stream, self), a.offset,
+		             K_VOID);
+	}
+	default:
+		log_error("no location for region %d", a.region);
+		return zero(K_PTR);
+	}
+}
+
+/* returns address offset bytes from base */
+static struct value offset_of(FILE *stream, struct value base,
+                              struct value offset)
+{
+	offset = convert(stream, offset, K_LONG);
+	struct value r = temp(K_PTR);
+	p("\t%s = getelementptr inbounds i8, i8* %s, i64 %s\n", r.name,
+	  base.name, offset.name);
+	return r;
+}
+
+/*
+ * Returns address of the field at offset of the instance at base, of
+ * the class pointed to: by its index in the struct type where it is a
+ * field of kind k, else by byte offset.
+ */
+static struct value field(FILE *stream, struct typeinfo *pointer,
+                          struct value base, int offset, enum kind k)
+{
+	struct typeinfo *class = class_of(pointer);
+	int index = (k == K_VOID) ? -1 : find_field(class, offset, k);
+	if (index < 0) {
+		char text[32];
+		snprintf(text, sizeof(text), "%d", offset);
+		return offset_of(stream, base, constant(K_LONG, text));
+	}
+	const char *name = pointer->class.type;
+	struct value instance = temp(K_PTR);
+	p("\t%s = bitcast i8* %s to %%class.%s*\n", instance.name, base.name,
+	  name);
+	struct value f = temp(k);
+	p("\t%s = getelementptr inbounds %%class.%s, %%class.%s* %s, i32 0, "
+	  "i32 %d\n", f.name, name, name, instance.name, index);
+	struct value r = temp(K_PTR);
+	p("\t%s = bitcast %s* %s to i8*\n", r.name, llvm_t(k), f.name);
+	return r;
+}
+
+/* loads value of kind k from pointer */
+static struct value load_at(FILE *stream, struct value pointer, enum kind k)
+{
+	struct value t = typed(stream, pointer, k);
+	struct value r = temp(k);
+	p("\t%s = load %s, %s* %s\n", r.name, llvm_t(k), llvm_t(k), t.name);
+	return r;
+}
+
+static void store_at(FILE *stream, struct value pointer, struct value v)
+{
+	struct value t = typed(stream, pointer, v.kind);
+	p("\tstore %s %s, %s* %s\n", llvm_t(v.kind), v.name, llvm_t(v.kind),
+	  t.name);
+}
+
+/* returns pointer cast to point to kind k */
+static struct value typed(FILE *stream, struct value pointer, enum kind k)
+{
+	if (k == K_CHAR || k == K_BOOL)
+		return pointer;
+	struct value r = temp(K_PTR);
+	p("\t%s = bitcast i8* %s to %s*\n", r.name, pointer.name, llvm_t(k));
+	return r;
+}
+
+static void copy(FILE *stream, struct value to, struct value from, int size,
+                 const char *intrinsic)
+{
+	p("\tcall void @llvm.%s.p0i8.p0i8.i64(i8* %s, i8* %s, i64 %d, i1 false)\n",
+	  intrinsic, to.name, from.name, size);
+}
+
+/*
+ * Returns v converted to kind to: doubles truncated to integers,
+ * integers extended by their signedness or truncated, and anything
+ * tested against zero for a flag or bool.
+ */
+static struct value convert(FILE *stream, struct value v, enum kind to)
+{
+	if (v.kind == to || to == K_VOID)
+		return v;
+	if (v.kind == K_VOID)
+		return zero(to);
+
+	struct value r;
+	if (to == K_FLAG) {
+		r = temp(K_FLAG);
+		if (v.kind == K_FLOAT)
+			p("\t%s = fcmp une double %s, 0.0\n", r.name, v.name);
+		else
+			p("\t%s = icmp ne %s %s, %s\n", r.name, llvm_t(v.kind), v.name,
+			  zero(v.kind).name);
+		return r;
+	}
+	if (to == K_BOOL) {
+		struct value f = convert(stream, v, K_FLAG);
+		r = temp(K_BOOL);
+		p("\t%s = zext i1 %s to i8\n", r.name, f.name);
+		return r;
+	}
+	if (to == K_FLOAT) {
+		if (v.kind == K_PTR)
+			v = convert(stream, v, K_LONG);
+		r = temp(K_FLOAT);
+		p("\t%s = %s %s %s to double\n", r.name,
+		  (v.kind == K_BOOL || v.kind == K_FLAG) ? "uitofp" : "sitofp",
+		  llvm_t(v.kind), v.name);
+		return r;
+	}
+	if (to == K_PTR) {
+		v = convert(stream, v, K_LONG);
+		r = temp(K_PTR);
+		p("\t%s = inttoptr i64 %s to i8*\n", r.name, v.name);
+		return r;
+	}
+
+	/* to an integer */
+	if (v.kind == K_FLOAT) {
+		r = temp(to);
+		p("\t%s = fptosi double %s to %s\n", r.name, v.name, llvm_t(to));
+		return r;
+	}
+	if (v.kind == K_PTR) {
+		r = temp(K_LONG);
+		p("\t%s = ptrtoint i8* %s to i64\n", r.name, v.name);
+		return convert(stream, r, to);
+	}
+	if (bits(v.kind) == bits(to)) {
+		v.kind = to;
+		return v;
+	}
+	r = temp(to);
+	if (bits(v.kind) > bits(to))
+		p("\t%s = trunc %s %s to %s\n", r.name, llvm_t(v.kind), v.name,
+		  llvm_t(to));
+	else
+		p("\t%s = %s %s %s to %s\n", r.name,
+		  (v.kind == K_BOOL || v.kind == K_FLAG) ? "zext" : "sext",
+		  llvm_t(v.kind), v.name, llvm_t(to));
+	return r;
+}
+
+/*
+ * Sets the class whose member function is printed next from its name,
+ * Class__method, or none if it is not a member.
+ */
+static void set_class(char *name)
+{
+	proc.class = NULL;
+	char *split = strstr(name, "__");
+	if (split == NULL)
+		return;
+
+	struct hasht *global = list_index(yyscopes, 1)->data;
+	free(proc.self.class.type);
+	char *class = strndup(name, split - name);
+	log_assert(class);
+	proc.class = hasht_search(global, class);
+	log_assert(proc.class && proc.class->base == CLASS_T);
+	proc.self = *proc.class;
+	proc.self.pointer = true;
+	proc.self.class.type = class;
+}
+
+/*
+ * Finds the locals of the procedure at iter which get typed allocas:
+ * each is always accessed at one offset as one scalar kind, never
+ * overlaps another, and never has its address taken. Returns true if
+ * anything is left in the local region.
+ */
+static bool find_locals(struct list_node *iter)
+{
+	struct op *op = iter->data;
+	int frame = op->address[1].offset;
+	proc.frame = frame;
+	free(proc.types);
+	free(proc.taken);
+	proc.types = calloc(frame + 1, sizeof(*proc.types));
+	proc.taken = calloc(frame + 1, sizeof(*proc.taken));
+	int *owner = calloc(frame + 1, sizeof(*owner));
+	log_assert(proc.types && proc.taken && owner);
+
+	/* parameters as stored by the prologue, instance pointer first */
+	int offset = 0;
+	if (proc.class) {
+		struct address a = { PARAM_R, offset, &proc.self };
+		add_local(a, false, owner);
+		offset += typeinfo_size(&proc.self);
+	}
+	struct typeinfo *function = op->address[2].type;
+	struct list_node *param = list_head(function->function.parameters);
+	for (; !list_end(param); param = param->next) {
+		struct typeinfo *t = param->data;
+		offset = typeinfo_aligned(offset, t);
+		struct address a = { PARAM_R, offset, t };
+		add_local(a, false, owner);
+		offset += typeinfo_size(t);
+	}
+
+	for (iter = iter->next; ((struct op *)iter->data)->code != END_O;
+	     iter = iter->next) {
+		struct op *op = iter->data;
+		struct address *a = op->address;
+		switch (op->code) {
+		case ADDR_O:
+		case LARR_O:
+		case RARR_O:
+			/* addressed by the second operand */
+			add_local(a[0], false, owner);
+			add_local(a[1], true, owner);
+			add_local(a[2], false, owner);
+			break;
+		case PARAM_O:
+			add_local(a[0], typeinfo_by_reference(a[0].type),
+			          owner);
+			break;
+		default:
+			for (int i = 0; i < 3; ++i)
+				add_local(a[i], false, owner);
+		}
+	}
+
+	bool used = false;
+	for (int i = 0; i < frame; ++i) {
+		if (proc.types[i] == NULL)
+			continue;
+		int size = typeinfo_size(proc.types[i]);
+		for (int j = 0; j < size; ++j)
+			if (proc.taken[i + j])
+				proc.types[i] = NULL;
+	}
+	for (int i = 0; i < frame; ++i)
+		if (proc.taken[i] || (owner[i] && !proc.types[owner[i] - 1]))
+			used = true;
+
+	free(owner);
+	return used;
+}
+
+/* record an access of local a, which may take its address */
+static void add_local(struct address a, bool taken, int *owner)
+{
+	if (a.region != LOCAL_R && a.region != PARAM_R)
+		return;
+	int size = typeinfo_size(a.type);
+	if (a.offset < 0 || a.offset + size > proc.frame)
+		return;
+	struct typeinfo *t = proc.types[a.offset];
+
+	if (size == 0 || typeinfo_by_reference(a.type)
+	    || kind(a.type) == K_VOID)
+		taken = true;
+	else if (t && kind(t) != kind(a.type))
+		taken = true;
+	else
+		proc.types[a.offset] = a.type;
+
+	for (int i = a.offset; i < a.offset + size; ++i) {
+		if (taken || (owner[i] && owner[i] != a.offset + 1))
+			proc.taken[i] = true;
+		owner[i] = a.offset + 1;
+	}
+}
+
+/* true if local a has a typed alloca of its own */
+static bool is_variable(struct address a)
+{
+	return (a.region == LOCAL_R || a.region == PARAM_R)
+		&& a.offset >= 0 && a.offset < proc.frame
+		&& proc.types[a.offset] != NULL;
+}
+
+/*
+ * Returns index in the struct type of class of its scalar field at
+ * offset of kind k, counting padding as print_struct does, else -1.
+ */
+static int find_field(struct typeinfo *class, int offset, enum kind k)
+{
+	if (class == NULL)
+		return -1;
+	size_t count;
+	struct hasht_node **fields = typeinfo_fields(class, &count);
+	int index = -1;
+	int end = 0;
+	int i = 0;
+	for (size_t j = 0; j < count; ++j) {
+		struct typeinfo *t = fields[j]->value;
+		int at = t->place.offset;
+		if (at < end)
+			continue;
+		if (at > end)
+			++i;
+		if (at == offset && !typeinfo_by_reference(t) && kind(t) == k) {
+			index = i;
+			break;
+		}
+		end = at + (typeinfo_by_reference(t) ? (int)typeinfo_size(t)
+		            : scalar_size(kind(t)));
+		++i;
+	}
+	free(fields);
+	return index;
+}
+
+/* returns the class pointer points to, else NULL */
+static struct typeinfo *class_of(struct typeinfo *pointer)
+{
+	if (pointer == NULL || pointer->base != CLASS_T
+	    || pointer->class.type == NULL)
+		return NULL;
+	struct hasht *global = list_index(yyscopes, 1)->data;
+	struct typeinfo *class = hasht_search(global, pointer->class.type);
+	return (class && class->base == CLASS_T) ? class : NULL;
+}
+
+/* returns kind of values of type t */
+static enum kind kind(struct typeinfo *t)
+{
+	if (t == NULL)
+		return K_VOID;
+	if (t->pointer || typeinfo_by_reference(t))
+		return K_PTR;
+	switch (t->base) {
+	case INT_T:
+		return K_INT;
+	case CHAR_T:
+		return K_CHAR;
+	case BOOL_T:
+		return K_BOOL;
+	case FLOAT_T:
+		return K_FLOAT;
+	case VOID_T:
+		return K_VOID;
+	default:
+		return K_PTR;
+	}
+}
+
+/* returns kind of what pointer type t points to, void for aggregates */
+static enum kind pointee(struct typeinfo *t)
+{
+	struct typeinfo u = *t;
+	u.pointer = false;
+	return typeinfo_by_reference(&u) ? K_VOID : kind(&u);
+}
+
+static const char *llvm_t(enum kind k)
+{
+	switch (k) {
+	case K_VOID:
+		return "void";
+	case K_FLAG:
+		return "i1";
+	case K_BOOL:
+	case K_CHAR:
+		return "i8";
+	case K_INT:
+		return "i32";
+	case K_LONG:
+		return "i64";
+	case K_FLOAT:
+		return "double";
+	default:
+		return "i8*";
+	}
+}
+
+/* returns width of integer kind k */
+static int bits(enum kind k)
+{
+	switch (k) {
+	case K_FLAG:
+		return 1;
+	case K_BOOL:
+	case K_CHAR:
+		return 8;
+	case K_INT:
+		return 32;
+	default:
+		return 64;
+	}
+}
+
+/* returns bytes taken by a value of kind k in memory */
+static int scalar_size(enum kind k)
+{
+	return (k == K_FLAG) ? 1 : bits(k) / 8;
+}
+
+/* returns bytes pointer type t steps by, the size pointed to */
+static int step(struct typeinfo *t)
+{
+	if (t == NULL || !t->pointer)
+		return 1;
+	struct typeinfo u = *t;
+	u.pointer = false;
+	int size = typeinfo_size(&u);
+	return (size > 1) ? size : 1;
+}
+
+static bool has_name(struct list *names, const char *name)
+{
+	for (struct list_node *iter = list_head(names); !list_end(iter);
+	     iter = iter->next)
+		if (strcmp(iter->data, name) == 0)
+			return true;
+	return false;
+}
+
+#undef p
@@ -0,0 +1,18 @@
+/*
+ * llvm.h - Textual LLVM IR code generation.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef LLVM_H
+#define LLVM_H
+
+#include <stdio.h>
+
+struct list;
+
+void llvm_code(FILE *stream, struct list *code);
+
+#endif /* LLVM_H */
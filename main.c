@@ -24,7 +24,12 @@
 #include "node.h"
 #include "scope.h"
 #include "intermediate.h"
+#include "pass.h"
+#include "profile.h"
 #include "final.h"
+#include "native.h"
+#include "llvm.h"
+#include "interpret.h"
 
 #include "list.h"
 #include "tree.h"
@@ -45,10 +50,11 @@ static char doc[] = "Andrew Schwartzmeyer's 120++ compiler.\v"
 	"written in our CS 120 course, including basic classes. Notable "
 	"exceptions include exceptions, templates, virtual semantics, "
 	"namespaces, variadics, casting, conversions, typedefs, access and "
-	"storage qualifiers, operator overloading, and assembly code "
-	"generation. The final output is three-address C code, compilable by "
-	"GCC, which demonstrates the correctness of the lexer, parser, "
-	"semantic analysis, memory layout, and intermediate code generation. "
+	"storage qualifiers, and operator overloading. The default output is "
+	"three-address C code, compilable by GCC, which demonstrates the "
+	"correctness of the lexer, parser, semantic analysis, memory layout, "
+	"and intermediate code generation. Native x86-64 code and LLVM IR "
+	"may be generated instead, see --backend. "
 	"See the 'data/pass' folder for examples of valid code, and run "
 	"`make smoke` to see their output."
 	"\n\n"
@@ -72,6 +78,29 @@ static struct argp_option options[] = {
 	{ "assemble", 's', 0,      0, "Generate assembler code." },
 	{ "compile",  'c', 0,      0, "Generate object code." },
 	{ "output",   'o', "FILE", 0, "Name of generated executable." },
+	{ "run",      'x', 0,      0, "Run each program in memory as native "
+	  "code, exiting with its status; writes no files." },
+	{ "interpret", 'i', 0,     0, "Interpret each program's bytecode, "
+	  "exiting with its status; writes no files." },
+	{ "optimize", 'O', "LEVEL", 0, "Optimization level: 0 for none, 1 for "
+	  "local passes, 2 for all (default)." },
+	{ "time-passes", 'p', 0,   0, "Print the time and op count change of "
+	  "each optimization pass." },
+	{ "reorder-members", 'm', 0, 0, "Lay out class members by alignment "
+	  "to minimize padding." },
+	{ "register-stats", 'r', 0, 0, "Print the register pressure and spills "
+	  "of each procedure." },
+	{ "profile-generate", 'g', 0, 0, "Count the runs of each block and "
+	  "call, writing them to infile.profile when the program exits. "
+	  "Requires the C backend." },
+	{ "profile-use", 'u', 0, 0, "Optimize with the counts in "
+	  "infile.profile, written by a program built with --profile-generate." },
+	{ "profile",  'P', 0,      0, "Time each function, printing their "
+	  "calls and cycles, inclusive and exclusive of their callees, when "
+	  "the program exits. Requires the C backend." },
+	{ "backend",  'b', "NAME", 0, "Code generator: c for Three-Address C "
+	  "(default), x86-64 for native objects, or assembly with -s, llvm "
+	  "for LLVM IR compiled by opt and llc, or kept with -s." },
 	{ 0 }
 };
 
@@ -92,6 +121,9 @@ size_t offset;
 
 static void parse_program(char *filename);
 
+/* exit status of the last program run */
+static int run_status = EXIT_SUCCESS;
+
 /* from lexer */
 void free_typename(struct hasht_node *t);
 
@@ -107,11 +139,30 @@ int main(int argc, char **argv)
 	arguments.checks = false;
 	arguments.assemble = false;
 	arguments.compile = false;
+	arguments.run = false;
+	arguments.interpret = false;
 	arguments.output = "a.out";
+	arguments.time_passes = false;
+	arguments.reorder_members = false;
+	arguments.register_stats = false;
+	arguments.profile_generate = false;
+	arguments.profile_use = false;
+	arguments.profile = false;
+	arguments.level = OPT_LEVEL_MAX;
+	arguments.backend = BACKEND_C;
 	arguments.include = getcwd(NULL, 0);
 
 	argp_parse(&argp, argc, argv, 0, 0, &arguments);
 
+	if (arguments.profile_generate
+	    && (arguments.backend != BACKEND_C || arguments.run
+	        || arguments.interpret))
+		log_error("--profile-generate requires the C backend");
+	if (arguments.profile
+	    && (arguments.backend != BACKEND_C || arguments.run
+	        || arguments.interpret))
+		log_error("--profile requires the C backend");
+
 	char *objects = "";
 	/* parse each input file as a new 'program' */
 	for (int i = 0; arguments.input_files[i]; ++i) {
@@ -122,10 +173,10 @@ int main(int argc, char **argv)
 		/* copy because Wormulon's basename modifies */
 		char *copy = strdup(filename);
 		const char *base = basename(copy);
-		free(copy);
 		/* append object name to end of objects */
 		char *temp;
 		asprintf(&temp, "%s %s.o", objects, base);
+		free(copy);
 		/* free if previously allocated */
 		if (strcmp(objects, "") != 0)
 			free(objects);
@@ -134,9 +185,10 @@ int main(int argc, char **argv)
 	}
 
 	/* link object files */
-	if (!arguments.assemble && !arguments.compile) {
+	if (!arguments.assemble && !arguments.compile && !arguments.run
+	    && !arguments.interpret) {
 		char *command;
-		asprintf(&command, "gcc -o %s%s", arguments.output, objects);
+		asprintf(&command, "gcc -o %s%s -lm", arguments.output, objects);
 		int status = system(command);
 		if (status != 0)
 			log_error("command failed: %s", command);
@@ -149,12 +201,14 @@ int main(int argc, char **argv)
 		free(command);
 	}
 
-	return EXIT_SUCCESS;
+	return run_status;
 }
 
 void parse_program(char *filename)
 {
-	printf("parsing file: %s\n", filename);
+	/* output of a program run is its own */
+	if (!arguments.run && !arguments.interpret)
+		printf("parsing file: %s\n", filename);
 
 	yyfiles = list_new(NULL, &free);
 	log_assert(yyfiles);
@@ -230,16 +284,39 @@ void parse_program(char *filename)
 	code_generate(yyprogram);
 	struct list *code = ((struct node *)yyprogram->data)->code;
 
+	/* counters are numbered in the code as generated */
+	char *profile_file = NULL;
+	if (arguments.profile_generate || arguments.profile_use) {
+		char *name = strdup(filename);
+		asprintf(&profile_file, "%s.profile", basename(name));
+		free(name);
+	}
+	if (arguments.profile_generate) {
+		log_debug("instrumenting intermediate code");
+		profile_instrument(code);
+	} else if (arguments.profile_use) {
+		log_debug("reading profile %s", profile_file);
+		profile_read(code, profile_file);
+	}
+
+	log_debug("optimizing intermediate code");
+	pass_run(code, arguments.level);
+
 	/* iterate to get correct size of constant region */
 	size_t string_size = 0;
 	for (size_t i = 0; i < constant->size; ++i) {
 		struct hasht_node *slot = constant->table[i];
 		if (slot && !hasht_node_deleted(slot)) {
 			struct typeinfo *v = slot->value;
+			size_t end = v->place.offset;
 			if (v->base == FLOAT_T)
-				string_size += 8;
+				end += 8;
 			else if (v->base == CHAR_T && v->pointer)
-				string_size += v->token->ssize;
+				end += v->token->ssize;
+			else
+				continue;
+			if (end > string_size)
+				string_size = end;
 		}
 	}
 
@@ -289,12 +366,84 @@ void parse_program(char *filename)
 		free(output_file);
 	}
 
-	log_debug("generating final code");
-	/* copy because Wormulon */
+	/* copy because Wormulon, kept as base points into it */
 	char *copy = strdup(filename);
 	char *base = basename(copy);
-	free(copy);
 	char *output_file;
+
+	if (arguments.interpret) {
+		log_debug("interpreting bytecode");
+		run_status = interpret(code);
+		goto clean;
+	}
+
+	if (arguments.run) {
+		log_debug("running native code");
+		run_status = native_run(code);
+		goto clean;
+	}
+
+	if (arguments.backend == BACKEND_X86 && !arguments.assemble) {
+		log_debug("generating object code");
+		asprintf(&output_file, "%s.o", base);
+		FILE *fo = fopen(output_file, "wb");
+		if (fo == NULL)
+			log_error("could not save to output file: %s", output_file);
+		native_object(fo, code);
+		fclose(fo);
+		free(output_file);
+		goto clean;
+	}
+
+	if (arguments.backend == BACKEND_X86) {
+		log_debug("generating native code");
+		asprintf(&output_file, "%s.s", base);
+		FILE *fs = fopen(output_file, "w");
+		if (fs == NULL)
+			log_error("could not save to output file: %s", output_file);
+
+		fprintf(fs, "/*\n");
+		fprintf(fs, " * %s - 120++ x86-64 Assembly\n", output_file);
+		fprintf(fs, " *\n");
+		fprintf(fs, " * Created by Andrew Schwartzmeyer's 120++ Compiler\n");
+		fprintf(fs, " * Project located @ https://github.com/andschwa/uidaho-cs445\n");
+		fprintf(fs, " */\n\n");
+		native_code(fs, code);
+		fclose(fs);
+		free(output_file);
+		goto clean;
+	}
+
+	if (arguments.backend == BACKEND_LLVM) {
+		log_debug("generating LLVM IR");
+		asprintf(&output_file, "%s.ll", base);
+		FILE *fl = fopen(output_file, "w");
+		if (fl == NULL)
+			log_error("could not save to output file: %s", output_file);
+
+		fprintf(fl, "; %s - 120++ LLVM IR\n", output_file);
+		fprintf(fl, ";\n");
+		fprintf(fl, "; Created by Andrew Schwartzmeyer's 120++ Compiler\n");
+		fprintf(fl, "; Project located @ https://github.com/andschwa/uidaho-cs445\n\n");
+		llvm_code(fl, code);
+		fclose(fl);
+
+		/* optimized and compiled to an object by LLVM's tools */
+		if (!arguments.assemble) {
+			char *command;
+			asprintf(&command, "opt -O2 %s | llc -O2 -filetype=obj "
+			         "-relocation-model=pic -o %s.o", output_file, base);
+			int status = system(command);
+			if (status != 0)
+				log_error("command failed: %s", command);
+			free(command);
+			remove(output_file);
+		}
+		free(output_file);
+		goto clean;
+	}
+
+	log_debug("generating final code");
 	asprintf(&output_file, "%s.c", base);
 	FILE *fc = fopen(output_file, "w");
 	if (fc == NULL)
@@ -316,8 +465,11 @@ void parse_program(char *filename)
 	fprintf(fc, "#include <stdlib.h>\n");
 	fprintf(fc, "#include <stdbool.h>\n");
 	fprintf(fc, "#include <string.h>\n");
-	if (libs.usingstd && libs.iostream)
+	if ((libs.usingstd && libs.iostream) || arguments.profile_generate
+	    || arguments.profile)
 		fprintf(fc, "#include <stdio.h>\n");
+	if (arguments.profile)
+		fprintf(fc, "#include <time.h>\n");
 	fprintf(fc, "\n");
 
 	/* include passed-through C headers */
@@ -329,25 +481,25 @@ void parse_program(char *filename)
 	}
 	fprintf(fc, "\n");
 
-	/* get maximum param size for faux stack */
-	size_t max_param_size = 0;
-	iter = list_head(code);
-	while (!list_end(iter)) {
-		struct op *op = iter->data;
-		if (op->code == PROC_O) {
-			size_t param_size = op->address[0].offset;
-			if (param_size > max_param_size)
-				max_param_size = param_size;
-		}
-		iter = iter->next;
-	}
-
 	fprintf(fc, "/* Memory regions */\n");
-	fprintf(fc, "char constant[%zu];\n", string_size);
-	fprintf(fc, "char global[%zu];\n", global->size);
-	fprintf(fc, "char stack[%zu];\n", max_param_size);
+	final_constants(fc);
+	/* aligned for the largest type at aligned offsets within */
+	fprintf(fc, "char global[%zu] __attribute__((aligned(8)));\n",
+	        scope_size(global));
 	fprintf(fc, "\n");
 
+	if (arguments.profile_generate) {
+		fprintf(fc, "/* Profile counters */\n");
+		final_profile(fc, profile_file);
+		fprintf(fc, "\n");
+	}
+
+	if (arguments.profile) {
+		fprintf(fc, "/* Profiler */\n");
+		final_profiler(fc, code);
+		fprintf(fc, "\n");
+	}
+
 	fprintf(fc, "/* Final Three-Address C Generated Code */\n");
 	final_code(fc, code);
 	fclose(fc);
@@ -366,8 +518,11 @@ void parse_program(char *filename)
 
 	free(output_file);
 
+clean:
 	/* clean up */
 	log_debug("cleaning up");
+	free(copy);
+	free(profile_file);
 	tree_free(yyprogram);
 	yylex_destroy();
 	hasht_free(yytypes);
@@ -406,6 +561,45 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 	case 'o':
 		arguments->output = arg;
 		break;
+	case 'x':
+		arguments->run = true;
+		break;
+	case 'i':
+		arguments->interpret = true;
+		break;
+	case 'O':
+		if (arg[0] < '0' || arg[0] > '0' + OPT_LEVEL_MAX || arg[1])
+			argp_error(state, "invalid optimization level: %s", arg);
+		arguments->level = arg[0] - '0';
+		break;
+	case 'p':
+		arguments->time_passes = true;
+		break;
+	case 'm':
+		arguments->reorder_members = true;
+		break;
+	case 'r':
+		arguments->register_stats = true;
+		break;
+	case 'g':
+		arguments->profile_generate = true;
+		break;
+	case 'u':
+		arguments->profile_use = true;
+		break;
+	case 'P':
+		arguments->profile = true;
+		break;
+	case 'b':
+		if (strcmp(arg, "c") == 0)
+			arguments->backend = BACKEND_C;
+		else if (strcmp(arg, "x86-64") == 0)
+			arguments->backend = BACKEND_X86;
+		else if (strcmp(arg, "llvm") == 0)
+			arguments->backend = BACKEND_LLVM;
+		else
+			argp_error(state, "unknown backend: %s", arg);
+		break;
 
 	case ARGP_KEY_NO_ARGS:
 		argp_usage(state);
@@ -0,0 +1,1535 @@
+/*
+ * native.c - x86-64 System V assembly from intermediate code.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "native.h"
+#include "args.h"
+#include "intermediate.h"
+#include "x86.h"
+#include "object.h"
+#include "jit.h"
+#include "tile.h"
+#include "type.h"
+#include "token.h"
+#include "scope.h"
+
+#include "logger.h"
+#include "list.h"
+#include "hasht.h"
+
+#define p(...) fprintf(stream, __VA_ARGS__)
+
+extern struct list *yyscopes;
+extern size_t yylabels;
+extern struct typeinfo int_type;
+extern struct typeinfo float_type;
+extern struct typeinfo bool_type;
+extern struct typeinfo ptr_type;
+
+/* System V registers for integer arguments, and count of xmm ones */
+static const int int_args[] = { RDI, RSI, RDX, RCX, R8, R9 };
+#define INT_ARGS 6
+#define FLOAT_ARGS 8
+
+/*
+ * Values are loaded into registers by operand index i: %rax or
+ * %xmm0 for the first, %rcx or %xmm1 for the second. %r10 and %xmm15
+ * are scratch for conversions, and %r11 holds the instance pointer
+ * for class fields.
+ */
+static const int values[] = { RAX, RCX };
+#define SCRATCH R10
+#define INSTANCE R11
+#define XSCRATCH 15
+
+/*
+ * Registers a tile may take to evaluate its tree, all free between
+ * ops. A tree needs at most TILE_REGISTERS of them, so an operand
+ * may be evaluated while the first value register is held.
+ */
+static const int pool[] = { RAX, RCX, RDX, RSI, RDI, R8, R9 };
+#define POOL 7
+
+/* formats of printing ops, after the constant region */
+static const struct {
+	const char *name;
+	const char *format;
+} formats[] = {
+	{ ".Lprint_int", "%d" },
+	{ ".Lprint_char", "%c" },
+	{ ".Lprint_float", "%f" },
+	{ ".Lprint_str", "%s" },
+};
+#define FORMATS 4
+
+/* an argument evaluated by PARAM_O, waiting in a slot for its call */
+struct arg {
+	int slot;
+	struct typeinfo *type;
+};
+
+/* the procedure being lowered */
+static struct {
+	int frame;                /* bytes below %rbp */
+	int args;                 /* local offset of argument slots */
+	int saves;                /* local offset of by-reference pointers */
+	struct typeinfo *type;    /* returned */
+	struct arg *pending;      /* arguments of calls yet to be made */
+	int top;
+	int next;
+	struct tiling *tiling;    /* of its expression trees */
+	size_t position;          /* of the op being lowered */
+	struct expr *expr;        /* of the op being lowered */
+} proc;
+
+static struct list *lower_program(struct list *code, struct list *names);
+static void print_regions(FILE *stream);
+static void define_regions(struct object *o);
+static void noops(struct list *x, struct list *names, struct hasht *table,
+                  char *class);
+static void lower(struct list *x, struct list_node *iter);
+static void prologue(struct list *x, struct op *op, struct list_node *iter);
+static void epilogue(struct list *x);
+static struct typeinfo *call(struct list *x, struct op *op);
+static void jump_table(struct list *x, struct list_node *iter);
+static void lower_tiles(struct list *x, struct expr *e);
+static struct x86_operand reduce(struct list *x, struct expr *e,
+                                 enum nonterm nt, unsigned busy);
+static struct x86_operand indexed(struct list *x, struct x86_operand base,
+                                  struct x86_operand index, unsigned busy);
+static struct expr *tiled_operand(struct address a);
+static struct typeinfo *result_type(struct expr *e);
+static int take(unsigned busy);
+static int reuse(struct x86_operand o, unsigned busy);
+static unsigned held(struct x86_operand o);
+static int step(struct op *op);
+static enum x86_cc condition(enum opcode code);
+static enum x86_cc compare(struct list *x, enum opcode code,
+                           struct address a, struct address b,
+                           bool *floating);
+static void set_flag(struct list *x, enum x86_cc cc, bool floating);
+static void jump_flag(struct list *x, enum x86_cc cc, bool floating,
+                      int label);
+static struct x86_operand place(struct list *x, struct address a);
+static struct x86_operand local(int offset);
+static void load(struct list *x, struct address a, int i);
+static void store(struct list *x, struct address a, struct typeinfo *from,
+                  int i);
+static void load_mem(struct list *x, struct x86_operand m,
+                     struct typeinfo *t, int i);
+static void store_mem(struct list *x, struct x86_operand m,
+                      struct typeinfo *t, int i);
+static void load_reg(struct list *x, struct x86_operand m,
+                     struct typeinfo *t, int r);
+static void store_reg(struct list *x, struct x86_operand m,
+                      struct typeinfo *t, int r);
+static void convert(struct list *x, struct typeinfo *from,
+                    struct typeinfo *to, int i);
+static void extend(struct list *x, struct typeinfo *t, int i);
+static void extend_reg(struct list *x, struct typeinfo *t, int r);
+static void normalize(struct list *x, struct typeinfo *from,
+                      struct typeinfo *to, int r);
+static void narrow(struct list *x, struct typeinfo *from,
+                   struct typeinfo *to, int r);
+static void copy(struct list *x, struct x86_operand to,
+                 struct x86_operand from, int size);
+static int scalar_size(struct typeinfo *t);
+
+#define emit(c, s, d) x86_emit(x, c, s, d)
+#define reg(r) x86_reg(r)
+#define xmm(r) x86_xmm(r)
+#define imm(v) x86_imm(v)
+#define none x86_none
+
+/*
+ * Prints the assembly for a program: its regions, then each
+ * procedure lowered op by op.
+ */
+void native_code(FILE *stream, struct list *code)
+{
+	print_regions(stream);
+
+	p("\t.text\n");
+	struct list *names = list_new(NULL, &free);
+	log_assert(names);
+	struct list *x = lower_program(code, names);
+	x86_print(stream, x);
+	list_free(x);
+	list_free(names);
+
+	p("\n\t.section .note.GNU-stack,\"\",@progbits\n");
+}
+
+/*
+ * Writes the program as an ELF64 relocatable object, its procedures
+ * lowered as for assembly and then encoded.
+ */
+void native_object(FILE *stream, struct list *code)
+{
+	struct object *o = object_new();
+	define_regions(o);
+	struct list *names = list_new(NULL, &free);
+	log_assert(names);
+	struct list *x = lower_program(code, names);
+	x86_assemble(x, o);
+	object_write(stream, o);
+	list_free(x);
+	list_free(names);
+	object_free(o);
+}
+
+/*
+ * Runs the program in this process: its object is loaded into memory
+ * and its main called, returning its exit status.
+ */
+int native_run(struct list *code)
+{
+	struct object *o = object_new();
+	define_regions(o);
+	struct list *names = list_new(NULL, &free);
+	log_assert(names);
+	struct list *x = lower_program(code, names);
+	x86_assemble(x, o);
+	list_free(x);
+	list_free(names);
+
+	struct jit *j = jit_load(o);
+	int (*entry)() = (int (*)())jit_symbol(j, "main");
+	if (entry == NULL)
+		log_error("program has no main procedure");
+	fflush(stdout);
+	int status = entry();
+	fflush(stdout);
+
+	jit_free(j);
+	object_free(o);
+	return status;
+}
+
+/*
+ * Returns the instructions of each procedure lowered op by op, then
+ * of methods only declared, whose symbols are kept in names.
+ */
+static struct list *lower_program(struct list *code, struct list *names)
+{
+	struct list *x = list_new(NULL, &free);
+	log_assert(x);
+	for (struct list_node *iter = list_head(code); !list_end(iter);
+	     iter = iter->next) {
+		if (arguments.debug)
+			x86_emit(x, X_OP, none, none)->op = iter->data;
+		lower(x, iter);
+	}
+
+	struct hasht *global = list_index(yyscopes, 1)->data;
+	for (size_t i = 0; i < global->size; ++i) {
+		struct hasht_node *slot = global->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *value = slot->value;
+			if (value->base == CLASS_T) {
+				noops(x, names, value->class.public, slot->key);
+				noops(x, names, value->class.private, slot->key);
+			}
+		}
+	}
+
+	free(proc.pending);
+	proc.pending = NULL;
+	tile_free(proc.tiling);
+	proc.tiling = NULL;
+	return x;
+}
+
+/*
+ * Prints the constant region with its strings and floats at their
+ * offsets, formats used by printing ops, and the global region.
+ */
+static void print_regions(FILE *stream)
+{
+	struct hasht *constant = list_front(yyscopes);
+	size_t count = 0;
+	struct typeinfo **values_ = calloc(constant->size + 1, sizeof(*values_));
+	log_assert(values_);
+	for (size_t i = 0; i < constant->size; ++i) {
+		struct hasht_node *slot = constant->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *v = slot->value;
+			if ((v->base == FLOAT_T && !v->pointer)
+			    || (v->base == CHAR_T && v->pointer))
+				values_[count++] = v;
+		}
+	}
+
+	p("\t.section .rodata\n");
+	p("\t.p2align 3\n");
+	p("constant:\n");
+	int end = 0;
+	for (int offset = 0; count > 0;) {
+		/* next constant by offset */
+		size_t next = 0;
+		for (size_t i = 1; i < count; ++i)
+			if (values_[i]->place.offset < values_[next]->place.offset)
+				next = i;
+		struct typeinfo *v = values_[next];
+		values_[next] = values_[--count];
+
+		offset = v->place.offset;
+		if (offset > end)
+			p("\t.zero %d\n", offset - end);
+		if (v->base == FLOAT_T) {
+			uint64_t bits;
+			memcpy(&bits, &v->token->fval, sizeof(bits));
+			p("\t.quad %#llx /* %s */\n", (unsigned long long)bits,
+			  v->token->text);
+			end = offset + sizeof(bits);
+		} else {
+			p("\t.byte ");
+			for (size_t i = 0; i < v->token->ssize; ++i)
+				p("%s%d", i ? "," : "", (unsigned char)v->token->sval[i]);
+			p("\n");
+			end = offset + v->token->ssize;
+		}
+	}
+	free(values_);
+	for (size_t i = 0; i < FORMATS; ++i)
+		p("%s:\n\t.string \"%s\"\n", formats[i].name, formats[i].format);
+
+	struct hasht *global = list_index(yyscopes, 1)->data;
+	p("\t.bss\n");
+	p("\t.p2align 3\n");
+	p("global:\n");
+	if (scope_size(global) > 0)
+		p("\t.zero %zu\n", scope_size(global));
+}
+
+/*
+ * Defines the regions in o as print_regions lays them out: the
+ * constant region and formats as read-only data, the global region
+ * zeroed.
+ */
+static void define_regions(struct object *o)
+{
+	struct hasht *constant = list_front(yyscopes);
+	size_t size = 0;
+	for (size_t i = 0; i < constant->size; ++i) {
+		struct hasht_node *slot = constant->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *v = slot->value;
+			size_t end;
+			if (v->base == FLOAT_T && !v->pointer)
+				end = v->place.offset + sizeof(double);
+			else if (v->base == CHAR_T && v->pointer)
+				end = v->place.offset + v->token->ssize;
+			else
+				continue;
+			if (end > size)
+				size = end;
+		}
+	}
+	for (size_t i = 0; i < FORMATS; ++i)
+		size += strlen(formats[i].format) + 1;
+
+	o->rodata = calloc(size + 1, 1);
+	log_assert(o->rodata);
+	for (size_t i = 0; i < constant->size; ++i) {
+		struct hasht_node *slot = constant->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *v = slot->value;
+			unsigned char *at = o->rodata + v->place.offset;
+			if (v->base == FLOAT_T && !v->pointer)
+				memcpy(at, &v->token->fval, sizeof(double));
+			else if (v->base == CHAR_T && v->pointer)
+				memcpy(at, v->token->sval, v->token->ssize);
+		}
+	}
+	object_define(o, "constant", SECTION_RODATA, 0, false);
+
+	size_t offset = size;
+	for (size_t i = FORMATS; i-- > 0;) {
+		offset -= strlen(formats[i].format) + 1;
+		memcpy(o->rodata + offset, formats[i].format,
+		       strlen(formats[i].format) + 1);
+		object_define(o, formats[i].name, SECTION_RODATA, offset, false);
+	}
+	o->rodata_size = size;
+
+	object_define(o, "global", SECTION_BSS, 0, false);
+	o->bss_size = scope_size(list_index(yyscopes, 1)->data);
+}
+
+/* emits procedures that only return for methods declared in class */
+static void noops(struct list *x, struct list *names, struct hasht *table,
+                  char *class)
+{
+	if (table == NULL)
+		return;
+	for (size_t i = 0; i < table->size; ++i) {
+		struct hasht_node *slot = table->table[i];
+		if (slot && !hasht_node_deleted(slot)) {
+			struct typeinfo *value = slot->value;
+			if (value->base == FUNCTION_T && !value->function.symbols) {
+				char *name;
+				asprintf(&name, "%s__%s", class, (char *)slot->key);
+				list_push_back(names, name);
+				emit(X_PROC, none, x86_symbol(name));
+				emit(X_RET, none, none);
+			}
+		}
+	}
+}
+
+/* lowers the op at iter to instructions appended to x */
+static void lower(struct list *x, struct list_node *iter)
+{
+	struct op *op = iter->data;
+	struct address a = op->address[0];
+	struct address b = op->address[1];
+	struct address c = op->address[2];
+	bool floating;
+	enum x86_cc cc;
+
+	if (op->code == PROC_O) {
+		tile_free(proc.tiling);
+		proc.tiling = tile_new(iter);
+		proc.position = 0;
+	}
+	proc.expr = proc.tiling ? proc.tiling->exprs[proc.position++] : NULL;
+	if (proc.expr && proc.expr->folded)
+		return; /* computed by the op using it */
+	if (proc.expr && tile_root(proc.expr)) {
+		lower_tiles(x, proc.expr);
+		return;
+	}
+
+	switch (op->code) {
+	case PROC_O:
+		prologue(x, op, iter);
+		break;
+	case END_O:
+		/* falling off the end, main returns 0 */
+		emit(X_XORQ, reg(RAX), reg(RAX));
+		epilogue(x);
+		tile_free(proc.tiling);
+		proc.tiling = NULL;
+		proc.expr = NULL;
+		break;
+	case PARAM_O: {
+		/* evaluate argument now, as its operand may be reused */
+		struct arg arg = { proc.next++, a.type };
+		struct x86_operand slot = local(proc.args + 8 * arg.slot);
+		if (typeinfo_by_reference(a.type)) {
+			emit(X_LEAQ, place(x, a), reg(RAX));
+			emit(X_MOVQ, reg(RAX), slot);
+		} else {
+			load(x, a, 0);
+			if (typeinfo_double(a.type))
+				emit(X_MOVSD, xmm(0), slot);
+			else
+				emit(X_MOVQ, reg(RAX), slot);
+		}
+		proc.pending[proc.top++] = arg;
+		break;
+	}
+	case CALL_O:
+	case CALLC_O: {
+		struct typeinfo *t = call(x, op);
+		if (a.region != UNKNOWN_R)
+			store(x, a, t, 0);
+		break;
+	}
+	case TCALL_O: {
+		struct typeinfo *t = call(x, op);
+		if (a.region != UNKNOWN_R)
+			convert(x, t, proc.type, 0);
+		epilogue(x);
+		break;
+	}
+	case RET_O:
+		if (a.region != UNKNOWN_R
+		    && !(proc.type->base == VOID_T && !proc.type->pointer)) {
+			load(x, a, 0);
+			convert(x, a.type, proc.type, 0);
+		}
+		epilogue(x);
+		break;
+	case LABEL_O:
+		emit(X_LABEL, none, x86_label(a.offset));
+		break;
+	case GOTO_O:
+		emit(X_JMP, none, x86_label(a.offset));
+		break;
+	case TABLE_O:
+		jump_table(x, iter);
+		break;
+	case CASE_O:
+		/* lowered with preceding TABLE_O */
+		break;
+	case COUNT_O:
+		/* only the C backend is instrumented */
+		break;
+	case NEW_O:
+		emit(X_MOVQ, imm(1), reg(RDI));
+		emit(X_MOVQ, imm(b.offset), reg(RSI));
+		emit(X_CALL, none, x86_symbol("calloc"));
+		store(x, a, a.type, 0);
+		break;
+	case DEL_O:
+		load(x, a, 0);
+		emit(X_MOVQ, reg(RAX), reg(RDI));
+		emit(X_CALL, none, x86_symbol("free"));
+		break;
+	case PINT_O:
+	case PCHAR_O:
+	case PBOOL_O:
+	case PFLOAT_O:
+	case PSTR_O: {
+		const char *format = (op->code == PCHAR_O) ? ".Lprint_char"
+			: (op->code == PFLOAT_O) ? ".Lprint_float"
+			: (op->code == PSTR_O) ? ".Lprint_str"
+			: ".Lprint_int";
+		load(x, a, 0);
+		emit(X_LEAQ, x86_rip(format, 0), reg(RDI));
+		if (op->code == PFLOAT_O) {
+			convert(x, a.type, &float_type, 0);
+			emit(X_MOVQ, imm(1), reg(RAX));
+		} else {
+			emit(X_MOVQ, reg(RAX), reg(RSI));
+			emit(X_MOVQ, imm(0), reg(RAX));
+		}
+		emit(X_CALL, none, x86_symbol("printf"));
+		break;
+	}
+	case ADD_O:
+	case SUB_O:
+		load(x, b, 0);
+		load(x, c, 1);
+		if (step(op) > 1)
+			emit(X_IMULQ, imm(step(op)), reg(RCX));
+		emit(op->code == ADD_O ? X_ADDQ : X_SUBQ, reg(RCX), reg(RAX));
+		store(x, a, b.type->pointer ? b.type : &int_type, 0);
+		break;
+	case MUL_O:
+		load(x, b, 0);
+		load(x, c, 1);
+		emit(X_IMULQ, reg(RCX), reg(RAX));
+		store(x, a, &int_type, 0);
+		break;
+	case DIV_O:
+	case MOD_O:
+		load(x, b, 0);
+		load(x, c, 1);
+		emit(X_CQTO, none, none);
+		emit(X_IDIVQ, none, reg(RCX));
+		if (op->code == MOD_O)
+			emit(X_MOVQ, reg(RDX), reg(RAX));
+		store(x, a, &int_type, 0);
+		break;
+	case SHL_O:
+	case SHR_O:
+	case USHR_O:
+		/* in 32 bits, as the ints they shift */
+		load(x, b, 0);
+		load(x, c, 1);
+		emit(op->code == SHL_O ? X_SHLL : op->code == SHR_O ? X_SARL : X_SHRL,
+		     reg(RCX), reg(RAX));
+		emit(X_MOVSLQ, reg(RAX), reg(RAX));
+		store(x, a, &int_type, 0);
+		break;
+	case MULH_O:
+		load(x, b, 0);
+		load(x, c, 1);
+		emit(X_IMULQ, reg(RCX), reg(RAX));
+		emit(X_SARQ, imm(32), reg(RAX));
+		store(x, a, &int_type, 0);
+		break;
+	case INC_O:
+	case DEC_O:
+		load(x, a, 0);
+		if (typeinfo_double(a.type)) {
+			emit(X_MOVQ, imm(1), reg(SCRATCH));
+			emit(X_CVTSI2SDQ, reg(SCRATCH), xmm(XSCRATCH));
+			emit(op->code == INC_O ? X_ADDSD : X_SUBSD, xmm(XSCRATCH),
+			     xmm(0));
+		} else {
+			emit(op->code == INC_O ? X_ADDQ : X_SUBQ, imm(1), reg(RAX));
+		}
+		store(x, a, a.type, 0);
+		break;
+	case FADD_O:
+	case FSUB_O:
+	case FMUL_O:
+	case FDIV_O:
+		load(x, b, 0);
+		convert(x, b.type, &float_type, 0);
+		load(x, c, 1);
+		convert(x, c.type, &float_type, 1);
+		emit(op->code == FADD_O ? X_ADDSD : op->code == FSUB_O ? X_SUBSD
+		     : op->code == FMUL_O ? X_MULSD : X_DIVSD, xmm(1), xmm(0));
+		store(x, a, &float_type, 0);
+		break;
+	case LT_O:
+	case FLT_O:
+	case LE_O:
+	case FLE_O:
+	case GT_O:
+	case FGT_O:
+	case GE_O:
+	case FGE_O:
+	case EQ_O:
+	case FEQ_O:
+	case NE_O:
+	case FNE_O:
+		cc = compare(x, op->code, b, c, &floating);
+		set_flag(x, cc, floating);
+		store(x, a, &bool_type, 0);
+		break;
+	case OR_O:
+	case AND_O:
+		load(x, b, 0);
+		convert(x, b.type, &bool_type, 0);
+		load(x, c, 1);
+		convert(x, c.type, &bool_type, 1);
+		emit(op->code == OR_O ? X_ORQ : X_ANDQ, reg(RCX), reg(RAX));
+		store(x, a, &bool_type, 0);
+		break;
+	case NEG_O:
+	case FNEG_O:
+		load(x, b, 0);
+		if (typeinfo_double(b.type)) {
+			/* multiplying by -1 flips the sign of zeros too */
+			emit(X_MOVQ, imm(-1), reg(SCRATCH));
+			emit(X_CVTSI2SDQ, reg(SCRATCH), xmm(XSCRATCH));
+			emit(X_MULSD, xmm(XSCRATCH), xmm(0));
+		} else {
+			emit(X_NEGQ, none, reg(RAX));
+		}
+		store(x, a, b.type, 0);
+		break;
+	case NOT_O:
+		load(x, b, 0);
+		convert(x, b.type, &bool_type, 0);
+		emit(X_XORQ, imm(1), reg(RAX));
+		store(x, a, &bool_type, 0);
+		break;
+	case ASN_O:
+		if (typeinfo_by_reference(a.type)) {
+			emit(X_LEAQ, place(x, b), reg(RSI));
+			emit(X_LEAQ, place(x, a), reg(RDI));
+			copy(x, reg(RDI), reg(RSI), typeinfo_size(a.type));
+		} else {
+			load(x, b, 0);
+			store(x, a, b.type, 0);
+		}
+		break;
+	case RSTAR_O: {
+		struct typeinfo t = *b.type;
+		t.pointer = false;
+		load(x, b, 0);
+		load_mem(x, x86_mem(RAX, 0), &t, 0);
+		store(x, a, &t, 0);
+		break;
+	}
+	case LSTAR_O: {
+		struct typeinfo t = *a.type;
+		t.pointer = false;
+		load(x, b, 0);
+		convert(x, b.type, &t, 0);
+		load(x, a, 1);
+		store_mem(x, x86_mem(RCX, 0), &t, 0);
+		break;
+	}
+	case ADDR_O:
+		emit(X_LEAQ, place(x, b), reg(RAX));
+		store(x, a, a.type, 0);
+		break;
+	case LARR_O:
+	case RARR_O:
+		/* index c is already in bytes, an array parameter a pointer */
+		if (b.type->pointer)
+			load(x, b, 0);
+		else
+			emit(X_LEAQ, place(x, b), reg(RAX));
+		load(x, c, 1);
+		if (op->code == LARR_O)
+			emit(X_ADDQ, reg(RCX), reg(RAX));
+		else
+			load_mem(x, x86_index(RAX, RCX, 1, 0), a.type, 0);
+		store(x, a, a.type, 0);
+		break;
+	case LFIELD_O:
+	case RFIELD_O:
+		load(x, b, 0);
+		if (op->code == LFIELD_O)
+			emit(X_LEAQ, x86_mem(RAX, c.offset), reg(RAX));
+		else
+			load_mem(x, x86_mem(RAX, c.offset), a.type, 0);
+		store(x, a, a.type, 0);
+		break;
+	case IF_O:
+	case IFN_O:
+		load(x, a, 0);
+		convert(x, a.type, &bool_type, 0);
+		emit(X_TESTQ, reg(RAX), reg(RAX));
+		x86_emit_cc(x, X_JCC, op->code == IF_O ? CC_NE : CC_E,
+		            x86_label(b.offset));
+		break;
+	case IFLT_O:
+	case IFLE_O:
+	case IFGT_O:
+	case IFGE_O:
+	case IFEQ_O:
+	case IFNE_O:
+		cc = compare(x, op->code, a, b, &floating);
+		jump_flag(x, cc, floating, c.offset);
+		break;
+	case ERRC_O:
+		emit(X_MOVQ, imm(-1), reg(RDI));
+		emit(X_CALL, none, x86_symbol("exit"));
+		break;
+	}
+}
+
+/*
+ * Sets up the frame of the procedure at iter: the local region, a
+ * slot for each argument it passes, and a save for each by-reference
+ * parameter. Parameters are then stored into the local region as
+ * laid out for the procedure, copying by-reference ones in whole.
+ */
+static void prologue(struct list *x, struct op *op, struct list_node *iter)
+{
+	struct typeinfo *function = op->address[2].type;
+	proc.type = typeinfo_return(function);
+
+	int args = 0;
+	for (struct list_node *i = iter->next; ((struct op *)i->data)->code != END_O;
+	     i = i->next)
+		if (((struct op *)i->data)->code == PARAM_O)
+			++args;
+	proc.pending = realloc(proc.pending, (args + 1) * sizeof(*proc.pending));
+	log_assert(proc.pending);
+	proc.top = 0;
+	proc.next = 0;
+
+	int saves = 0;
+	struct list_node *param = list_head(function->function.parameters);
+	for (; !list_end(param); param = param->next)
+		if (typeinfo_by_reference(param->data))
+			++saves;
+	proc.args = (op->address[1].offset + 7) / 8 * 8;
+	proc.saves = proc.args + 8 * args;
+	proc.frame = (proc.saves + 8 * saves + 15) / 16 * 16;
+
+	emit(X_PROC, none, x86_symbol(op->name));
+	emit(X_PUSHQ, none, reg(RBP));
+	emit(X_MOVQ, reg(RSP), reg(RBP));
+	if (proc.frame > 0)
+		emit(X_SUBQ, imm(proc.frame), reg(RSP));
+
+	/* the instance pointer, then parameters, in registers or on stack */
+	int ints = 0;
+	int floats = 0;
+	int stack = 0;
+	int offset = 0;
+	if (strstr(op->name, "__")) {
+		emit(X_MOVQ, reg(int_args[ints++]), local(offset));
+		offset += 8;
+	}
+	saves = 0;
+	param = list_head(function->function.parameters);
+	for (; !list_end(param); param = param->next) {
+		struct typeinfo *t = param->data;
+		offset = typeinfo_aligned(offset, t);
+		bool reference = typeinfo_by_reference(t);
+		struct typeinfo *as = reference ? &ptr_type : t;
+		struct x86_operand to = reference
+			? local(proc.saves + 8 * saves++) : local(offset);
+		bool floating = typeinfo_double(t);
+		if (floating && floats < FLOAT_ARGS) {
+			emit(X_MOVSD, xmm(floats++), to);
+		} else if (!floating && ints < INT_ARGS) {
+			emit(X_MOVQ, reg(int_args[ints]), reg(RAX));
+			store_mem(x, to, as, 0);
+			++ints;
+		} else {
+			/* above the saved %rbp and return address */
+			struct x86_operand from = x86_mem(RBP, 16 + 8 * stack++);
+			load_mem(x, from, as, 0);
+			store_mem(x, to, as, 0);
+		}
+		offset += typeinfo_size(t);
+	}
+
+	/* by-reference copies, once argument registers are free */
+	offset = strstr(op->name, "__") ? 8 : 0;
+	saves = 0;
+	param = list_head(function->function.parameters);
+	for (; !list_end(param); param = param->next) {
+		struct typeinfo *t = param->data;
+		offset = typeinfo_aligned(offset, t);
+		if (typeinfo_by_reference(t)) {
+			int size = typeinfo_size(t);
+			if (size > 0) {
+				emit(X_MOVQ, local(proc.saves + 8 * saves), reg(RSI));
+				emit(X_LEAQ, local(offset), reg(RDI));
+				copy(x, reg(RDI), reg(RSI), size);
+			}
+			++saves;
+		}
+		offset += typeinfo_size(t);
+	}
+}
+
+/* returns from the procedure, the result already in place */
+static void epilogue(struct list *x)
+{
+	emit(X_LEAVE, none, none);
+	emit(X_RET, none, none);
+}
+
+/*
+ * Calls the procedure of op with its pending arguments, converted to
+ * the types of its parameters where known. Returns the type of the
+ * result, left in the first value register.
+ */
+static struct typeinfo *call(struct list *x, struct op *op)
+{
+	int n = op->address[1].offset;
+	log_assert(n <= proc.top);
+	struct arg *args = proc.pending + proc.top - n;
+	proc.top -= n;
+
+	struct typeinfo *f = scope_procedure(op->name);
+	struct list_node *param = f ? list_head(f->function.parameters) : NULL;
+	bool member = f && strstr(op->name, "__");
+
+	/* the type each argument is passed as, and where */
+	struct typeinfo **types = calloc(n + 1, sizeof(*types));
+	int *where = calloc(n + 1, sizeof(*where));
+	log_assert(types && where);
+	int ints = 0;
+	int floats = 0;
+	int stack = 0;
+	for (int i = 0; i < n; ++i) {
+		types[i] = args[i].type;
+		if (param && !(member && i == 0) && !list_end(param)) {
+			if (!typeinfo_by_reference(args[i].type))
+				types[i] = param->data;
+			param = param->next;
+		}
+		if (typeinfo_by_reference(args[i].type))
+			types[i] = &ptr_type;
+		if (typeinfo_double(types[i]))
+			where[i] = (floats < FLOAT_ARGS) ? floats++ : -1 - stack++;
+		else
+			where[i] = (ints < INT_ARGS) ? INT_ARGS + ints++ : -1 - stack++;
+	}
+
+	/* keep the stack aligned to 16 bytes, pushing last argument first */
+	if (stack % 2)
+		emit(X_SUBQ, imm(8), reg(RSP));
+	for (int i = n - 1; i >= 0; --i) {
+		if (where[i] >= 0)
+			continue;
+		struct typeinfo *from = typeinfo_by_reference(args[i].type)
+			? &ptr_type : args[i].type;
+		struct x86_operand slot = local(proc.args + 8 * args[i].slot);
+		emit(typeinfo_double(from) ? X_MOVSD : X_MOVQ, slot,
+		     typeinfo_double(from) ? xmm(0) : reg(RAX));
+		convert(x, from, types[i], 0);
+		if (typeinfo_double(types[i]))
+			emit(X_MOVQX, xmm(0), reg(RAX));
+		emit(X_PUSHQ, none, reg(RAX));
+	}
+
+	/* last first, so %xmm0 is free for conversions until its turn */
+	for (int i = n - 1; i >= 0; --i) {
+		if (where[i] < 0)
+			continue;
+		struct typeinfo *from = typeinfo_by_reference(args[i].type)
+			? &ptr_type : args[i].type;
+		struct x86_operand slot = local(proc.args + 8 * args[i].slot);
+		emit(typeinfo_double(from) ? X_MOVSD : X_MOVQ, slot,
+		     typeinfo_double(from) ? xmm(0) : reg(RAX));
+		convert(x, from, types[i], 0);
+		if (where[i] < INT_ARGS) {
+			if (where[i] != 0)
+				emit(X_MOVSD, xmm(0), xmm(where[i]));
+		} else {
+			emit(X_MOVQ, reg(RAX), reg(int_args[where[i] - INT_ARGS]));
+		}
+	}
+
+	/* variadic callees are told how many vector registers are used */
+	emit(X_MOVQ, imm(floats), reg(RAX));
+	emit(X_CALL, none, x86_symbol(op->name));
+	if (stack > 0)
+		emit(X_ADDQ, imm(8 * (stack + stack % 2)), reg(RSP));
+	free(types);
+	free(where);
+
+	struct typeinfo *t = f ? typeinfo_return(f) : op->address[0].type;
+	if (t == NULL || (t->base == VOID_T && !t->pointer))
+		return t;
+	extend(x, t, 0);
+	return t;
+}
+
+/*
+ * Lowers TABLE_O at iter and its CASE_O entries to an indirect jump
+ * through a table of offsets, relative so that it needs no
+ * relocation, with values outside it going to the default.
+ */
+static void jump_table(struct list *x, struct list_node *iter)
+{
+	struct op *op = iter->data;
+	int n = op->address[1].offset;
+	struct op **cases = calloc(n + 1, sizeof(*cases));
+	log_assert(cases);
+	int low = 0;
+	int high = 0;
+	for (int i = 0; i < n; ++i) {
+		iter = iter->next;
+		cases[i] = iter->data;
+		int v = cases[i]->address[0].offset;
+		if (i == 0 || v < low)
+			low = v;
+		if (i == 0 || v > high)
+			high = v;
+	}
+
+	int fallback = op->address[2].offset;
+	int table = yylabels++;
+	load(x, op->address[0], 0);
+	emit(X_SUBQ, imm(low), reg(RAX));
+	emit(X_CMPQ, imm((long)high - low), reg(RAX));
+	/* unsigned, so values below low wrap above */
+	x86_emit_cc(x, X_JCC, CC_A, x86_label(fallback));
+	emit(X_LEAQ, x86_rip(NULL, table), reg(RDX));
+	emit(X_MOVSLQ, x86_index(RDX, RAX, 4, 0), reg(RAX));
+	emit(X_ADDQ, reg(RDX), reg(RAX));
+	emit(X_JMPR, none, reg(RAX));
+	emit(X_LABEL, none, x86_label(table));
+	for (long v = low; n > 0 && v <= high; ++v) {
+		int target = fallback;
+		for (int i = 0; i < n; ++i)
+			if (cases[i]->address[0].offset == v)
+				target = cases[i]->address[1].offset;
+		emit(X_ENTRY, x86_label(table), x86_label(target));
+	}
+	free(cases);
+}
+
+/*
+ * Emits the tiles chosen for the root e: a value is reduced to a
+ * register and stored to its result, a branch or store for effect.
+ */
+static void lower_tiles(struct list *x, struct expr *e)
+{
+	if (tile_goal(e) == NT_STMT) {
+		reduce(x, e, NT_STMT, 0);
+		return;
+	}
+	struct x86_operand o = reduce(x, e, NT_REG, 0);
+	if (o.reg != values[0])
+		emit(X_MOVQ, o, reg(values[0]));
+	store(x, e->address, result_type(e), 0);
+}
+
+/*
+ * Emits the tile of the rule chosen to derive nonterminal nt for e,
+ * its kids first, returning where it leaves the value. Registers in
+ * busy are held by the caller. An index is left as a register with
+ * its scale, and flags as their condition code in the value of an
+ * empty operand.
+ */
+static struct x86_operand reduce(struct list *x, struct expr *e,
+                                 enum nonterm nt, unsigned busy)
+{
+	struct op *op = e->op;
+	struct address a = e->address;
+	struct expr **kids = e->kids;
+	struct x86_operand k;
+	struct x86_operand l;
+	struct x86_operand o = none;
+	struct typeinfo t;
+	enum x86_code code;
+
+	switch (e->rule[nt]) {
+	case R_IMM:
+		return imm(a.offset);
+	case R_MEM:
+	case R_MEM_CLASS:
+	case R_PLACE:
+	case R_PLACE_CLASS:
+		return place(x, a);
+	case R_STRING:
+		o = reg(take(busy));
+		emit(X_LEAQ, place(x, a), o);
+		return o;
+	case R_REG_IMM:
+		o = reg(take(busy));
+		emit(X_MOVQ, reduce(x, e, NT_IMM, busy), o);
+		return o;
+	case R_REG_MEM:
+		k = reduce(x, e, NT_MEM, busy);
+		o = reg(reuse(k, busy));
+		load_reg(x, k, a.type, o.reg);
+		return o;
+	case R_REG_ADDR:
+		k = reduce(x, e, NT_ADDR, busy);
+		o = reg(reuse(k, busy));
+		emit(X_LEAQ, k, o);
+		return o;
+	case R_REG_FLAGS:
+		k = reduce(x, e, NT_FLAGS, busy);
+		o = reg(take(busy));
+		x86_emit_cc(x, X_SETCC, k.value, o);
+		emit(X_MOVZBQ, o, o);
+		return o;
+	case R_ADDR_REG:
+		return x86_mem(reduce(x, e, NT_REG, busy).reg, 0);
+	case R_INDEX_REG:
+		return reduce(x, e, NT_REG, busy);
+
+	case R_ADD_RI:
+	case R_SUB_RI:
+	case R_MUL_RI:
+	case R_SHL_RI:
+		o = reduce(x, kids[0], NT_REG, busy);
+		l = reduce(x, kids[1], NT_IMM, busy | held(o));
+		if (e->kind == E_SHL) {
+			emit(X_SHLL, l, o);
+			emit(X_MOVSLQ, o, o);
+		} else {
+			if (e->kind != E_MUL)
+				l.value *= step(op);
+			code = (e->kind == E_ADD) ? X_ADDQ
+				: (e->kind == E_SUB) ? X_SUBQ : X_IMULQ;
+			emit(code, l, o);
+		}
+		break;
+	case R_ADD_RR:
+	case R_ADD_RR_SCALED:
+	case R_SUB_RR:
+	case R_SUB_RR_SCALED:
+	case R_MUL_RR:
+		o = reduce(x, kids[0], NT_REG, busy);
+		l = reduce(x, kids[1], NT_REG, busy | held(o));
+		if (e->kind != E_MUL && step(op) > 1)
+			emit(X_IMULQ, imm(step(op)), l);
+		code = (e->kind == E_ADD) ? X_ADDQ
+			: (e->kind == E_SUB) ? X_SUBQ : X_IMULQ;
+		emit(code, l, o);
+		break;
+	case R_ADD_ADDR:
+		o = reduce(x, kids[0], NT_ADDR, busy);
+		o.disp += reduce(x, kids[1], NT_IMM, busy).value * step(op);
+		return o;
+	case R_MUL_INDEX:
+		o = reduce(x, kids[0], NT_REG, busy);
+		o.scale = kids[1]->address.offset;
+		return o;
+	case R_SHL_INDEX:
+		o = reduce(x, kids[0], NT_REG, busy);
+		o.scale = 1 << kids[1]->address.offset;
+		return o;
+
+	case R_RARR_INDEX:
+	case R_LARR_INDEX:
+		k = reduce(x, kids[0], NT_ADDR, busy);
+		l = reduce(x, kids[1], NT_INDEX, busy | held(k));
+		return indexed(x, k, l, busy);
+	case R_RARR_DISP:
+	case R_LARR_DISP:
+		o = reduce(x, kids[0], NT_ADDR, busy);
+		o.disp += reduce(x, kids[1], NT_IMM, busy).value;
+		return o;
+	case R_RFIELD:
+	case R_LFIELD:
+		o = reduce(x, kids[0], NT_ADDR, busy);
+		o.disp += op->address[2].offset;
+		return o;
+	case R_RSTAR:
+	case R_ADDR:
+		return reduce(x, kids[0], NT_ADDR, busy);
+
+	case R_CMP_RI:
+	case R_CMP_RR:
+	case R_CMP_MI:
+	case R_CMP_MR:
+		k = reduce(x, kids[0], e->rule[nt] == R_CMP_MI
+		           || e->rule[nt] == R_CMP_MR ? NT_MEM : NT_REG, busy);
+		l = reduce(x, kids[1], e->rule[nt] == R_CMP_RI
+		           || e->rule[nt] == R_CMP_MI ? NT_IMM : NT_REG,
+		           busy | held(k));
+		/* ints in memory compare in 4 bytes */
+		code = (k.kind == X_REG || kids[0]->address.type->pointer)
+			? X_CMPQ : X_CMPL;
+		emit(code, l, k);
+		o.value = condition(op->code);
+		return o;
+	case R_CMP_IR:
+		k = reduce(x, kids[0], NT_IMM, busy);
+		l = reduce(x, kids[1], NT_REG, busy);
+		emit(X_CMPQ, k, l);
+		/* flags hold for the operands swapped */
+		o.value = condition(op->code);
+		if (o.value == CC_L || o.value == CC_G)
+			o.value = (o.value == CC_L) ? CC_G : CC_L;
+		else if (o.value == CC_LE || o.value == CC_GE)
+			o.value = (o.value == CC_LE) ? CC_GE : CC_LE;
+		return o;
+
+	case R_BRANCH_FLAGS:
+		k = reduce(x, kids[0], NT_FLAGS, busy);
+		/* conditions are encoded in pairs, the second its negation */
+		x86_emit_cc(x, X_JCC, (op->code == IFN_O) ? k.value ^ 1 : k.value,
+		            x86_label(op->address[op->code <= IFN_O ? 1 : 2].offset));
+		return none;
+	case R_BRANCH_REG:
+		k = reduce(x, kids[0], NT_REG, busy);
+		emit(X_TESTQ, k, k);
+		x86_emit_cc(x, X_JCC, (op->code == IFN_O) ? CC_E : CC_NE,
+		            x86_label(op->address[op->code <= IFN_O ? 1 : 2].offset));
+		return none;
+	case R_STORE_REG:
+	case R_STORE_IMM:
+		/* through a pointer, to what it points to */
+		t = *op->address[0].type;
+		if (op->code == LSTAR_O)
+			t.pointer = false;
+		k = reduce(x, kids[0], NT_ADDR, busy);
+		if (e->rule[nt] == R_STORE_REG) {
+			l = reduce(x, kids[1], NT_REG, busy | held(k));
+			normalize(x, op->address[1].type, &t, l.reg);
+			store_reg(x, k, &t, l.reg);
+			return none;
+		}
+		l = reduce(x, kids[1], NT_IMM, busy);
+		if (t.base == BOOL_T && !t.pointer)
+			l.value = l.value != 0;
+		code = (scalar_size(&t) == 1) ? X_MOVB
+			: (scalar_size(&t) == 4) ? X_MOVL : X_MOVQ;
+		l.value = (scalar_size(&t) == 1) ? (signed char)l.value
+			: (scalar_size(&t) == 4) ? (int)l.value : l.value;
+		emit(code, l, k);
+		return none;
+	default:
+		log_error("no tile for rule %d", e->rule[nt]);
+		return none;
+	}
+
+	/* kept as if stored to and loaded from its result */
+	if (e->folded)
+		narrow(x, result_type(e), a.type, o.reg);
+	return o;
+}
+
+/*
+ * Returns the memory operand of base indexed by a scaled register,
+ * first computing base into a register if it has no room.
+ */
+static struct x86_operand indexed(struct list *x, struct x86_operand base,
+                                  struct x86_operand index, unsigned busy)
+{
+	if (base.kind == X_RIP || base.index >= 0) {
+		int r = reuse(base, busy | held(index));
+		emit(X_LEAQ, base, reg(r));
+		base = x86_mem(r, 0);
+	}
+	return x86_index(base.reg, index.reg, index.scale, base.disp);
+}
+
+/* returns tree computing operand a of the op being lowered, if any */
+static struct expr *tiled_operand(struct address a)
+{
+	if (proc.expr == NULL)
+		return NULL;
+	for (int i = 0; i < 3; ++i) {
+		struct expr *e = proc.expr->operands[i];
+		if (e && e->op && e->address.region == a.region
+		    && e->address.offset == a.offset)
+			return e;
+	}
+	return NULL;
+}
+
+/* type of the value an op computes before it is stored */
+static struct typeinfo *result_type(struct expr *e)
+{
+	struct typeinfo *b = e->op->address[1].type;
+	switch (e->kind) {
+	case E_ADD:
+	case E_SUB:
+	case E_MUL:
+	case E_SHL:
+		return b->pointer ? b : &int_type;
+	case E_CMP:
+		return &bool_type;
+	default:
+		return e->address.type;
+	}
+}
+
+/* returns a register of the pool not in busy */
+static int take(unsigned busy)
+{
+	for (int i = 0; i < POOL; ++i)
+		if (!(busy & 1u << pool[i]))
+			return pool[i];
+	log_error("out of registers for tree");
+	return RAX;
+}
+
+/* returns a register of the pool that o holds, else one not in busy */
+static int reuse(struct x86_operand o, unsigned busy)
+{
+	unsigned h = held(o);
+	for (int i = 0; i < POOL; ++i)
+		if (h & 1u << pool[i])
+			return pool[i];
+	return take(busy);
+}
+
+/* registers of the pool that o holds */
+static unsigned held(struct x86_operand o)
+{
+	unsigned h = 0;
+	if (o.kind == X_REG || o.kind == X_MEM)
+		h |= 1u << o.reg;
+	if (o.kind == X_MEM && o.index >= 0)
+		h |= 1u << o.index;
+	return h & ~(1u << RBP | 1u << INSTANCE);
+}
+
+/* bytes pointer arithmetic of op steps by, the size pointed to */
+static int step(struct op *op)
+{
+	struct typeinfo *b = op->address[1].type;
+	if (!b->pointer || op->address[2].type->pointer)
+		return 1;
+	struct typeinfo t = *b;
+	t.pointer = false;
+	int size = typeinfo_size(&t);
+	return (size > 1) ? size : 1;
+}
+
+/* returns condition on which the integer relation of code holds */
+static enum x86_cc condition(enum opcode code)
+{
+	switch (code) {
+	case LT_O: case FLT_O: case IFLT_O: return CC_L;
+	case LE_O: case FLE_O: case IFLE_O: return CC_LE;
+	case GT_O: case FGT_O: case IFGT_O: return CC_G;
+	case GE_O: case FGE_O: case IFGE_O: return CC_GE;
+	case EQ_O: case FEQ_O: case IFEQ_O: return CC_E;
+	default: return CC_NE;
+	}
+}
+
+/*
+ * Compares a with b for the relation of code, returning the condition
+ * on which it holds. Doubles compare unordered, so a relation is set
+ * up as above or equal, false for NaN, and equality needs parity.
+ */
+static enum x86_cc compare(struct list *x, enum opcode code,
+                           struct address a, struct address b,
+                           bool *floating)
+{
+	*floating = typeinfo_double(a.type) || typeinfo_double(b.type);
+	load(x, a, 0);
+	load(x, b, 1);
+	if (!*floating) {
+		emit(X_CMPQ, reg(RCX), reg(RAX));
+		return condition(code);
+	}
+
+	convert(x, a.type, &float_type, 0);
+	convert(x, b.type, &float_type, 1);
+	switch (code) {
+	case LT_O: case FLT_O: case IFLT_O:
+		emit(X_UCOMISD, xmm(0), xmm(1));
+		return CC_A;
+	case LE_O: case FLE_O: case IFLE_O:
+		emit(X_UCOMISD, xmm(0), xmm(1));
+		return CC_AE;
+	case GT_O: case FGT_O: case IFGT_O:
+		emit(X_UCOMISD, xmm(1), xmm(0));
+		return CC_A;
+	case GE_O: case FGE_O: case IFGE_O:
+		emit(X_UCOMISD, xmm(1), xmm(0));
+		return CC_AE;
+	case EQ_O: case FEQ_O: case IFEQ_O:
+		emit(X_UCOMISD, xmm(1), xmm(0));
+		return CC_E;
+	default:
+		emit(X_UCOMISD, xmm(1), xmm(0));
+		return CC_NE;
+	}
+}
+
+/* sets the first value register to 1 if cc holds, else 0 */
+static void set_flag(struct list *x, enum x86_cc cc, bool floating)
+{
+	x86_emit_cc(x, X_SETCC, cc, reg(RAX));
+	emit(X_MOVZBQ, reg(RAX), reg(RAX));
+	if (floating && (cc == CC_E || cc == CC_NE)) {
+		/* unordered is not equal */
+		x86_emit_cc(x, X_SETCC, cc == CC_E ? CC_NP : CC_P, reg(SCRATCH));
+		emit(X_MOVZBQ, reg(SCRATCH), reg(SCRATCH));
+		emit(cc == CC_E ? X_ANDQ : X_ORQ, reg(SCRATCH), reg(RAX));
+	}
+}
+
+/* jumps to label if cc holds */
+static void jump_flag(struct list *x, enum x86_cc cc, bool floating,
+                      int label)
+{
+	if (floating && cc == CC_E) {
+		/* unordered is not equal */
+		int skip = yylabels++;
+		x86_emit_cc(x, X_JCC, CC_P, x86_label(skip));
+		x86_emit_cc(x, X_JCC, CC_E, x86_label(label));
+		emit(X_LABEL, none, x86_label(skip));
+		return;
+	}
+	x86_emit_cc(x, X_JCC, cc, x86_label(label));
+	if (floating && cc == CC_NE)
+		x86_emit_cc(x, X_JCC, CC_P, x86_label(label));
+}
+
+/*
+ * Returns memory operand for a in its region, loading the instance
+ * pointer for a class field.
+ */
+static struct x86_operand place(struct list *x, struct address a)
+{
+	switch (a.region) {
+	case LOCAL_R:
+	case PARAM_R:
+		return local(a.offset);
+	case GLOBE_R:
+		return x86_rip("global", a.offset);
+	case CONST_R:
+		return x86_rip("constant", a.offset);
+	case CLASS_R:
+		emit(X_MOVQ, local(0), reg(INSTANCE));
+		return x86_mem(INSTANCE, a.offset);
+	default:
+		log_error("no place for region %d", a.region);
+		return none;
+	}
+}
+
+/* memory operand at offset in local region */
+static struct x86_operand local(int offset)
+{
+	return x86_mem(RBP, offset - proc.frame);
+}
+
+/*
+ * Loads value of a into value register i, integers extended to 64
+ * bits and aggregates as their address.
+ */
+static void load(struct list *x, struct address a, int i)
+{
+	if (a.region == UNKNOWN_R)
+		return;
+	struct expr *e = tiled_operand(a);
+	if (e) {
+		/* the second is loaded with the first held */
+		struct x86_operand o = reduce(x, e, NT_REG,
+		                              i ? 1u << values[0] : 0);
+		if (o.reg != values[i])
+			emit(X_MOVQ, o, reg(values[i]));
+	} else if (a.region == CONST_R && !a.type->pointer
+	    && (a.type->base == INT_T
+	        || a.type->base == CHAR_T
+	        || a.type->base == BOOL_T)) {
+		emit(X_MOVQ, imm(a.offset), reg(values[i]));
+	} else if (a.region == CONST_R && a.type->base == CHAR_T) {
+		emit(X_LEAQ, place(x, a), reg(values[i]));
+	} else if (typeinfo_by_reference(a.type)) {
+		emit(X_LEAQ, place(x, a), reg(values[i]));
+	} else {
+		load_mem(x, place(x, a), a.type, i);
+	}
+}
+
+/* stores value register i holding a value of type from to a */
+static void store(struct list *x, struct address a, struct typeinfo *from,
+                  int i)
+{
+	if (a.region == UNKNOWN_R)
+		return;
+	convert(x, from, a.type, i);
+	store_mem(x, place(x, a), a.type, i);
+}
+
+/* loads type t from m into value register i */
+static void load_mem(struct list *x, struct x86_operand m,
+                     struct typeinfo *t, int i)
+{
+	if (typeinfo_double(t))
+		emit(X_MOVSD, m, xmm(i));
+	else
+		load_reg(x, m, t, values[i]);
+}
+
+/* stores value register i to m as type t */
+static void store_mem(struct list *x, struct x86_operand m,
+                      struct typeinfo *t, int i)
+{
+	if (typeinfo_double(t))
+		emit(X_MOVSD, xmm(i), m);
+	else
+		store_reg(x, m, t, values[i]);
+}
+
+/* loads integer type t from m into general register r, extended */
+static void load_reg(struct list *x, struct x86_operand m,
+                     struct typeinfo *t, int r)
+{
+	switch (scalar_size(t)) {
+	case 4:
+		emit(X_MOVSLQ, m, reg(r));
+		break;
+	case 1:
+		emit(t->base == BOOL_T ? X_MOVZBQ : X_MOVSBQ, m, reg(r));
+		break;
+	default:
+		emit(X_MOVQ, m, reg(r));
+	}
+}
+
+/* stores general register r to m as integer type t */
+static void store_reg(struct list *x, struct x86_operand m,
+                      struct typeinfo *t, int r)
+{
+	switch (scalar_size(t)) {
+	case 4:
+		emit(X_MOVL, reg(r), m);
+		break;
+	case 1:
+		emit(X_MOVB, reg(r), m);
+		break;
+	default:
+		emit(X_MOVQ, reg(r), m);
+	}
+}
+
+/*
+ * Converts the value in register i from one type to another, between
+ * integers and doubles, and to a bool of 0 or 1.
+ */
+static void convert(struct list *x, struct typeinfo *from,
+                    struct typeinfo *to, int i)
+{
+	if (from == NULL || to == NULL)
+		return;
+	bool from_bool = from->base == BOOL_T && !from->pointer;
+	bool to_bool = to->base == BOOL_T && !to->pointer;
+	if (typeinfo_double(from) && to_bool) {
+		emit(X_XORPD, xmm(XSCRATCH), xmm(XSCRATCH));
+		emit(X_UCOMISD, xmm(XSCRATCH), xmm(i));
+		x86_emit_cc(x, X_SETCC, CC_NE, reg(values[i]));
+		x86_emit_cc(x, X_SETCC, CC_P, reg(SCRATCH));
+		emit(X_MOVZBQ, reg(values[i]), reg(values[i]));
+		emit(X_MOVZBQ, reg(SCRATCH), reg(SCRATCH));
+		emit(X_ORQ, reg(SCRATCH), reg(values[i]));
+	} else if (typeinfo_double(from) && !typeinfo_double(to)) {
+		emit(X_CVTTSD2SIQ, xmm(i), reg(values[i]));
+	} else if (!typeinfo_double(from) && typeinfo_double(to)) {
+		emit(X_CVTSI2SDQ, reg(values[i]), xmm(i));
+	} else if (to_bool && !from_bool && !typeinfo_double(to)) {
+		emit(X_TESTQ, reg(values[i]), reg(values[i]));
+		x86_emit_cc(x, X_SETCC, CC_NE, reg(values[i]));
+		emit(X_MOVZBQ, reg(values[i]), reg(values[i]));
+	}
+}
+
+/* extends a result of type t returned in register i to 64 bits */
+static void extend(struct list *x, struct typeinfo *t, int i)
+{
+	if (!typeinfo_double(t))
+		extend_reg(x, t, values[i]);
+}
+
+/* extends integer type t in general register r to 64 bits */
+static void extend_reg(struct list *x, struct typeinfo *t, int r)
+{
+	switch (scalar_size(t)) {
+	case 4:
+		emit(X_MOVSLQ, reg(r), reg(r));
+		break;
+	case 1:
+		emit(t->base == BOOL_T ? X_MOVZBQ : X_MOVSBQ, reg(r), reg(r));
+		break;
+	}
+}
+
+/* makes integer value in general register r a bool of 0 or 1 for to */
+static void normalize(struct list *x, struct typeinfo *from,
+                      struct typeinfo *to, int r)
+{
+	if (to->base == BOOL_T && !to->pointer
+	    && !(from->base == BOOL_T && !from->pointer)) {
+		emit(X_TESTQ, reg(r), reg(r));
+		x86_emit_cc(x, X_SETCC, CC_NE, reg(r));
+		emit(X_MOVZBQ, reg(r), reg(r));
+	}
+}
+
+/*
+ * Leaves integer value in general register r as if stored from one
+ * type to another and loaded back.
+ */
+static void narrow(struct list *x, struct typeinfo *from,
+                   struct typeinfo *to, int r)
+{
+	normalize(x, from, to, r);
+	if (!(to->base == BOOL_T && !to->pointer))
+		extend_reg(x, to, r);
+}
+
+/* copies size bytes from the address in %rsi to the one in %rdi */
+static void copy(struct list *x, struct x86_operand to,
+                 struct x86_operand from, int size)
+{
+	log_assert(to.reg == RDI && from.reg == RSI);
+	emit(X_MOVQ, imm(size), reg(RCX));
+	emit(X_REP_MOVSB, none, none);
+}
+
+/* bytes of a scalar in memory, ints kept in 4 as in C */
+static int scalar_size(struct typeinfo *t)
+{
+	if (t->pointer)
+		return 8;
+	switch (t->base) {
+	case INT_T:
+		return 4;
+	case CHAR_T:
+	case BOOL_T:
+		return 1;
+	default:
+		return 8;
+	}
+}
+
+#undef emit
+#undef reg
+#undef xmm
+#undef imm
+#undef none
+#undef p
@@ -0,0 +1,20 @@
+/*
+ * native.h - x86-64 assembly and object code generation, or running.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <stdio.h>
+
+struct list;
+
+void native_code(FILE *stream, struct list *code);
+void native_object(FILE *stream, struct list *code);
+int native_run(struct list *code);
+
+#endif /* NATIVE_H */
@@ -21,7 +21,7 @@
  * Nodes hold semantic attributes, such as production rule, memory
  * address (place field), and non-NULL token pointers if a leaf.
  *
- * TODO: add first/follow/true/false attributes
+ * TODO: add first/follow attributes
  */
 struct node *node_new(enum rule r)
 {
@@ -33,6 +33,8 @@ struct node *node_new(enum rule r)
 	n->place.region = UNKNOWN_R;
 	n->place.offset = 0;
 	n->code = NULL;
+	n->truelist = NULL;
+	n->falselist = NULL;
 	n->token = NULL;
 
 	return n;
@@ -23,6 +23,8 @@ struct node {
 	enum rule rule;
 	struct address place;
 	struct list *code;
+	struct list *truelist; /* jumps taken when true (backpatched) */
+	struct list *falselist; /* jumps taken when false (backpatched) */
 	struct token *token;
 };
 
@@ -0,0 +1,334 @@
+/*
+ * object.c - Implementation of ELF64 relocatable object files.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <elf.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "object.h"
+
+#include "logger.h"
+#include "list.h"
+
+/* section headers, in order of their index */
+enum {
+	SH_NULL,
+	SH_TEXT,
+	SH_RODATA,
+	SH_BSS,
+	SH_STACK,
+	SH_RELA,
+	SH_SYMTAB,
+	SH_STRTAB,
+	SH_SHSTRTAB,
+	SH_COUNT
+};
+
+/* a growing string table */
+struct strtab {
+	char *bytes;
+	size_t size;
+};
+
+static void free_symbol(void *data);
+static void free_reloc(void *data);
+static size_t add_string(struct strtab *t, const char *s);
+static size_t section_index(enum object_section section);
+static void write_at(FILE *stream, size_t *offset, const void *data,
+                     size_t size, size_t align);
+
+struct object *object_new()
+{
+	struct object *o = calloc(1, sizeof(*o));
+	log_assert(o);
+	o->symbols = list_new(NULL, &free_symbol);
+	o->relocs = list_new(NULL, &free_reloc);
+	log_assert(o->symbols && o->relocs);
+	return o;
+}
+
+void object_free(struct object *o)
+{
+	if (o == NULL)
+		return;
+	free(o->text);
+	free(o->rodata);
+	list_free(o->symbols);
+	list_free(o->relocs);
+	free(o);
+}
+
+/*
+ * Defines name at value in section, global if it is a procedure
+ * other objects may call. Returns it so its size may be set.
+ */
+struct object_symbol *object_define(struct object *o, const char *name,
+                                    enum object_section section,
+                                    size_t value, bool global)
+{
+	struct object_symbol *s = calloc(1, sizeof(*s));
+	log_assert(s);
+	s->name = strdup(name);
+	log_assert(s->name);
+	s->section = section;
+	s->value = value;
+	s->global = global;
+	list_push_back(o->symbols, s);
+	return s;
+}
+
+/* patches text at offset with symbol + addend when linked */
+void object_relocate(struct object *o, size_t offset, unsigned type,
+                     const char *symbol, long addend)
+{
+	struct object_reloc *r = calloc(1, sizeof(*r));
+	log_assert(r);
+	r->offset = offset;
+	r->type = type;
+	r->symbol = strdup(symbol);
+	log_assert(r->symbol);
+	r->addend = addend;
+	list_push_back(o->relocs, r);
+}
+
+/* returns the symbol defined as name, else NULL */
+struct object_symbol *object_find(struct object *o, const char *name)
+{
+	struct list_node *iter = list_head(o->symbols);
+	for (; !list_end(iter); iter = iter->next) {
+		struct object_symbol *s = iter->data;
+		if (strcmp(s->name, name) == 0)
+			return s;
+	}
+	return NULL;
+}
+
+/*
+ * Writes o as an ELF64 relocatable object. Relocations against local
+ * symbols are made against their section, so only procedures and
+ * what they call are named in the symbol table, as the assembler
+ * does for local labels.
+ */
+void object_write(FILE *stream, struct object *o)
+{
+	struct strtab strings = { NULL, 0 };
+	struct strtab names = { NULL, 0 };
+	add_string(&strings, "");
+	add_string(&names, "");
+
+	/* section symbols, then globals, then undefined ones referenced */
+	size_t count = 1 + 3 + list_size(o->symbols) + list_size(o->relocs);
+	Elf64_Sym *syms = calloc(count, sizeof(*syms));
+	char **undefined = calloc(count, sizeof(*undefined));
+	size_t *indices = calloc(list_size(o->symbols) + 1, sizeof(*indices));
+	log_assert(syms && undefined && indices);
+	size_t n = 1;
+	for (size_t s = SH_TEXT; s <= SH_BSS; ++s, ++n) {
+		syms[n].st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+		syms[n].st_shndx = s;
+	}
+	size_t first_global = n;
+	size_t i = 0;
+	struct list_node *iter = list_head(o->symbols);
+	for (; !list_end(iter); iter = iter->next, ++i) {
+		struct object_symbol *s = iter->data;
+		if (!s->global)
+			continue;
+		indices[i] = n;
+		syms[n].st_name = add_string(&strings, s->name);
+		syms[n].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+		syms[n].st_shndx = section_index(s->section);
+		syms[n].st_value = s->value;
+		syms[n].st_size = s->size;
+		++n;
+	}
+
+	Elf64_Rela *relas = calloc(list_size(o->relocs) + 1, sizeof(*relas));
+	log_assert(relas);
+	size_t r = 0;
+	size_t first_undefined = n;
+	size_t undefined_count = 0;
+	iter = list_head(o->relocs);
+	for (; !list_end(iter); iter = iter->next, ++r) {
+		struct object_reloc *reloc = iter->data;
+		struct object_symbol *s = object_find(o, reloc->symbol);
+		size_t index;
+		long addend = reloc->addend;
+		if (s && !s->global) {
+			index = section_index(s->section);
+			addend += s->value;
+		} else if (s) {
+			size_t k = 0;
+			for (struct list_node *j = list_head(o->symbols); j->data != s;
+			     j = j->next)
+				++k;
+			index = indices[k];
+		} else {
+			size_t k = 0;
+			while (k < undefined_count && strcmp(undefined[k], reloc->symbol))
+				++k;
+			if (k == undefined_count) {
+				undefined[undefined_count++] = reloc->symbol;
+				syms[n].st_name = add_string(&strings, reloc->symbol);
+				syms[n].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+				syms[n].st_shndx = SHN_UNDEF;
+				++n;
+			}
+			index = first_undefined + k;
+		}
+		relas[r].r_offset = reloc->offset;
+		relas[r].r_info = ELF64_R_INFO(index, reloc->type);
+		relas[r].r_addend = addend;
+	}
+
+	/* section contents follow the header, their headers last */
+	Elf64_Shdr shdrs[SH_COUNT];
+	memset(shdrs, 0, sizeof(shdrs));
+	static const char *const section_names[SH_COUNT] = {
+		"", ".text", ".rodata", ".bss", ".note.GNU-stack", ".rela.text",
+		".symtab", ".strtab", ".shstrtab"
+	};
+	for (size_t s = 1; s < SH_COUNT; ++s)
+		shdrs[s].sh_name = add_string(&names, section_names[s]);
+
+	shdrs[SH_TEXT].sh_type = SHT_PROGBITS;
+	shdrs[SH_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+	shdrs[SH_TEXT].sh_addralign = 16;
+	shdrs[SH_RODATA].sh_type = SHT_PROGBITS;
+	shdrs[SH_RODATA].sh_flags = SHF_ALLOC;
+	shdrs[SH_RODATA].sh_addralign = 8;
+	shdrs[SH_BSS].sh_type = SHT_NOBITS;
+	shdrs[SH_BSS].sh_flags = SHF_ALLOC | SHF_WRITE;
+	shdrs[SH_BSS].sh_addralign = 8;
+	shdrs[SH_BSS].sh_size = o->bss_size;
+	/* without it, linkers assume an executable stack */
+	shdrs[SH_STACK].sh_type = SHT_PROGBITS;
+	shdrs[SH_STACK].sh_addralign = 1;
+	shdrs[SH_RELA].sh_type = SHT_RELA;
+	shdrs[SH_RELA].sh_flags = SHF_INFO_LINK;
+	shdrs[SH_RELA].sh_link = SH_SYMTAB;
+	shdrs[SH_RELA].sh_info = SH_TEXT;
+	shdrs[SH_RELA].sh_addralign = 8;
+	shdrs[SH_RELA].sh_entsize = sizeof(Elf64_Rela);
+	shdrs[SH_SYMTAB].sh_type = SHT_SYMTAB;
+	shdrs[SH_SYMTAB].sh_link = SH_STRTAB;
+	shdrs[SH_SYMTAB].sh_info = first_global;
+	shdrs[SH_SYMTAB].sh_addralign = 8;
+	shdrs[SH_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+	shdrs[SH_STRTAB].sh_type = SHT_STRTAB;
+	shdrs[SH_STRTAB].sh_addralign = 1;
+	shdrs[SH_SHSTRTAB].sh_type = SHT_STRTAB;
+	shdrs[SH_SHSTRTAB].sh_addralign = 1;
+
+	Elf64_Ehdr ehdr;
+	memset(&ehdr, 0, sizeof(ehdr));
+	memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+	ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+	ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+	ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+	ehdr.e_type = ET_REL;
+	ehdr.e_machine = EM_X86_64;
+	ehdr.e_version = EV_CURRENT;
+	ehdr.e_ehsize = sizeof(ehdr);
+	ehdr.e_shentsize = sizeof(Elf64_Shdr);
+	ehdr.e_shnum = SH_COUNT;
+	ehdr.e_shstrndx = SH_SHSTRTAB;
+
+	size_t offset = 0;
+	write_at(stream, &offset, &ehdr, sizeof(ehdr), 1);
+	write_at(stream, &offset, o->text, o->text_size, 16);
+	shdrs[SH_TEXT].sh_offset = offset - o->text_size;
+	shdrs[SH_TEXT].sh_size = o->text_size;
+	write_at(stream, &offset, o->rodata, o->rodata_size, 8);
+	shdrs[SH_RODATA].sh_offset = offset - o->rodata_size;
+	shdrs[SH_RODATA].sh_size = o->rodata_size;
+	shdrs[SH_BSS].sh_offset = offset;
+	shdrs[SH_STACK].sh_offset = offset;
+	write_at(stream, &offset, relas, r * sizeof(*relas), 8);
+	shdrs[SH_RELA].sh_offset = offset - r * sizeof(*relas);
+	shdrs[SH_RELA].sh_size = r * sizeof(*relas);
+	write_at(stream, &offset, syms, n * sizeof(*syms), 8);
+	shdrs[SH_SYMTAB].sh_offset = offset - n * sizeof(*syms);
+	shdrs[SH_SYMTAB].sh_size = n * sizeof(*syms);
+	write_at(stream, &offset, strings.bytes, strings.size, 1);
+	shdrs[SH_STRTAB].sh_offset = offset - strings.size;
+	shdrs[SH_STRTAB].sh_size = strings.size;
+	write_at(stream, &offset, names.bytes, names.size, 1);
+	shdrs[SH_SHSTRTAB].sh_offset = offset - names.size;
+	shdrs[SH_SHSTRTAB].sh_size = names.size;
+
+	/* now that the section headers are known, place them */
+	size_t shoff = (offset + 7) / 8 * 8;
+	write_at(stream, &offset, shdrs, sizeof(shdrs), 8);
+	ehdr.e_shoff = shoff;
+	fseek(stream, 0, SEEK_SET);
+	fwrite(&ehdr, sizeof(ehdr), 1, stream);
+	fseek(stream, 0, SEEK_END);
+
+	free(relas);
+	free(indices);
+	free(undefined);
+	free(syms);
+	free(names.bytes);
+	free(strings.bytes);
+}
+
+static void free_symbol(void *data)
+{
+	struct object_symbol *s = data;
+	free(s->name);
+	free(s);
+}
+
+static void free_reloc(void *data)
+{
+	struct object_reloc *r = data;
+	free(r->symbol);
+	free(r);
+}
+
+/* appends s to t, returning its offset */
+static size_t add_string(struct strtab *t, const char *s)
+{
+	size_t length = strlen(s) + 1;
+	t->bytes = realloc(t->bytes, t->size + length);
+	log_assert(t->bytes);
+	memcpy(t->bytes + t->size, s, length);
+	t->size += length;
+	return t->size - length;
+}
+
+static size_t section_index(enum object_section section)
+{
+	switch (section) {
+	case SECTION_TEXT:
+		return SH_TEXT;
+	case SECTION_RODATA:
+		return SH_RODATA;
+	case SECTION_BSS:
+		return SH_BSS;
+	default:
+		return SHN_UNDEF;
+	}
+}
+
+/* writes size bytes of data at offset, first padding to align */
+static void write_at(FILE *stream, size_t *offset, const void *data,
+                     size_t size, size_t align)
+{
+	while (*offset % align) {
+		fputc(0, stream);
+		++*offset;
+	}
+	if (size > 0)
+		fwrite(data, size, 1, stream);
+	*offset += size;
+}
@@ -0,0 +1,62 @@
+/*
+ * object.h - ELF64 relocatable object files for native code.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+struct list;
+
+/* sections a symbol may be defined in, else it is undefined */
+enum object_section {
+	SECTION_UNDEF,
+	SECTION_TEXT,
+	SECTION_RODATA,
+	SECTION_BSS
+};
+
+struct object_symbol {
+	char *name;
+	enum object_section section;
+	size_t value;           /* offset in its section */
+	size_t size;
+	bool global;            /* a procedure, else local to the object */
+};
+
+/* a field of text to patch with the address of a symbol when linked */
+struct object_reloc {
+	size_t offset;
+	unsigned type;          /* R_X86_64_* */
+	char *symbol;
+	long addend;
+};
+
+struct object {
+	unsigned char *text;
+	size_t text_size;
+	unsigned char *rodata;
+	size_t rodata_size;
+	size_t bss_size;
+	struct list *symbols;
+	struct list *relocs;
+};
+
+struct object *object_new();
+void object_free(struct object *o);
+struct object_symbol *object_define(struct object *o, const char *name,
+                                    enum object_section section,
+                                    size_t value, bool global);
+void object_relocate(struct object *o, size_t offset, unsigned type,
+                     const char *symbol, long addend);
+struct object_symbol *object_find(struct object *o, const char *name);
+void object_write(FILE *stream, struct object *o);
+
+#endif /* OBJECT_H */
@@ -0,0 +1,1886 @@
+/*
+ * optimize.c - Implementation of optimization passes.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "optimize.h"
+#include "intermediate.h"
+#include "flow.h"
+#include "ssa.h"
+
+#include "logger.h"
+#include "list.h"
+
+extern size_t yylabels;
+extern struct typeinfo int_type;
+extern struct typeinfo unknown_type;
+extern const struct address e;
+
+#define op_at(node) ((struct op *)(node)->data)
+
+/* a procedure in the call graph */
+struct procedure {
+	char *name;
+	struct list_node *proc; /* PROC_O */
+	bool recursive;
+};
+
+static struct list_node **find_labels(struct list *code);
+static struct list_node *skip_labels(struct list_node *iter);
+static bool falls_to(struct list_node *iter, int label);
+static int final_label(struct list_node **labels, int label);
+static struct list_node *delete_op(struct list *code, struct list_node *iter);
+
+static bool thread_jumps(struct list *code, struct list_node **labels);
+static bool simplify_jumps(struct list *code);
+static bool remove_unreachable(struct list *code);
+static bool remove_labels(struct list *code);
+
+static bool transform_loops(struct list *code, struct list_node *proc,
+                            bool (*transform)(struct list *, struct flow *,
+                                              struct loop *));
+static bool hoist_invariants(struct list *code, struct flow *f,
+                             struct loop *loop);
+static bool is_hoistable(struct op *op);
+static bool can_hoist(struct flow *f, struct loop *loop, struct list *hoisted,
+                      bool clobbers, size_t b, struct list_node *node);
+static bool is_invariant(struct flow *f, struct loop *loop,
+                         struct list *hoisted, bool clobbers,
+                         struct address a);
+static bool address_taken(struct flow *f, struct address a);
+static bool has_preheader(struct flow *f, struct loop *loop);
+static struct list_node *make_preheader(struct list *code, struct flow *f,
+                                        struct loop *loop);
+
+static bool reduce_induction(struct list *code, struct flow *f,
+                             struct loop *loop);
+static bool is_basic_induction(struct flow *f, struct loop *loop,
+                               struct address i);
+static bool is_scaled_index(struct flow *f, size_t b, struct list_node *node,
+                            struct address i);
+
+static bool is_int(struct address a);
+static bool is_const(struct address a);
+static int power_of_two(int c);
+static void magic(int d, int *m, int *s);
+static struct address int_const(int value);
+static struct address temp_alloc(struct op *proc, struct typeinfo *type);
+static void insert_op(struct list *code, struct list_node *before,
+                      enum opcode code_, struct address a, struct address b,
+                      struct address c);
+static void set_op(struct op *op, enum opcode code, struct address b,
+                   struct address c);
+static void reduce_mul(struct list *code, struct op *proc,
+                       struct list_node *iter);
+static struct address reduce_div(struct list *code, struct op *proc,
+                                 struct list_node *iter, int d);
+
+static struct procedure *find_procedures(struct list *code, size_t *count);
+static struct procedure *find_procedure(struct procedure *procs, size_t count,
+                                        char *name);
+static bool reaches(struct procedure *procs, size_t count,
+                    struct procedure *p, struct procedure *target, bool *seen);
+static void order_procedures(struct procedure *procs, size_t count,
+                             struct procedure *p, bool *seen,
+                             size_t *order, size_t *n);
+static bool can_inline(struct procedure *p, size_t budget);
+static bool copies_params(struct op *proc);
+static unsigned long hottest_call(struct list *code);
+static size_t call_budget(struct op *call, size_t budget, size_t hot_budget,
+                          unsigned long hottest);
+static bool inline_call(struct list *code, struct procedure *procs,
+                        size_t count, struct procedure *caller, size_t budget,
+                        size_t hot_budget, unsigned long hottest);
+static void splice(struct list *code, struct procedure *caller,
+                   struct procedure *callee, struct list_node *node,
+                   struct list *params, int n);
+
+static void eliminate_tail_calls(struct list *code, struct list_node *node,
+                                 struct list_node **labels, size_t size);
+static bool tail_position(struct list_node **labels, size_t size,
+                          struct list_node *iter, struct address *ret);
+static void reassign_params(struct list *code, struct op *proc,
+                            struct list_node *node, struct list *params,
+                            int n);
+
+static void propagate_copies(struct ssa *s);
+static bool accepts_const(struct use *u);
+static void remove_dead(struct ssa *s);
+
+static bool fuse_branch(struct list *code, struct flow *f, size_t b,
+                        struct list_node *node);
+static bool fold_copy(struct list *code, struct flow *f, size_t b,
+                      struct list_node *node);
+static bool collapse_increment(struct list *code, struct flow *f, size_t b,
+                               struct list_node *node);
+static void delete_next(struct list *code, struct block *block,
+                        struct list_node *node);
+static bool same_address(struct address a, struct address b);
+
+static void peel_case(struct list *code, struct list_node **labels,
+                      struct list_node *node);
+static void move_cold(struct list *code, struct list_node *proc);
+static struct list_node *label_before(struct list *code,
+                                      struct list_node *node);
+static bool falls_through(struct op *op);
+
+/* a peephole pattern rewriting the ops from node in block b */
+static bool (*const peepholes[])(struct list *, struct flow *, size_t,
+                                 struct list_node *) = {
+	fuse_branch,
+	fold_copy,
+	collapse_increment,
+};
+
+/*
+ * Procedure inlining. Replaces calls to small non-recursive
+ * procedures (of at most budget ops) with copies of their bodies,
+ * working from callees up to callers so each copy is already inlined.
+ * With a profile, hot calls may inline up to hot_budget ops, and
+ * calls never made are left alone.
+ */
+void optimize_inline(struct list *code, size_t budget, size_t hot_budget)
+{
+	size_t count;
+	struct procedure *procs = find_procedures(code, &count);
+
+	size_t *order = malloc(count * sizeof(*order));
+	bool *seen = calloc(count, sizeof(*seen));
+	log_assert(count == 0 || (order && seen));
+	size_t n = 0;
+	for (size_t i = 0; i < count; ++i)
+		if (!seen[i])
+			order_procedures(procs, count, &procs[i], seen, order, &n);
+
+	unsigned long hottest = hottest_call(code);
+	for (size_t i = 0; i < n; ++i)
+		while (inline_call(code, procs, count, &procs[order[i]], budget,
+		                   hot_budget, hottest))
+			;
+
+	free(seen);
+	free(order);
+	free(procs);
+}
+
+/*
+ * Tail call elimination. A call whose result is returned directly
+ * becomes a jump: to the top of the procedure with its parameters
+ * reassigned when it calls itself, and otherwise a tail call.
+ */
+void optimize_tail_calls(struct list *code)
+{
+	size_t size = yylabels;
+	struct list_node **labels = find_labels(code);
+
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		if (op_at(iter)->code == PROC_O)
+			eliminate_tail_calls(code, iter, labels, size);
+		iter = iter->next;
+	}
+
+	free(labels);
+}
+
+/*
+ * Jump threading and label cleanup. Retargets jumps to the end of
+ * chains of labels and unconditional jumps, inverts conditional jumps
+ * over unconditional ones, and removes jumps to the next op,
+ * unreachable ops, and unreferenced labels until nothing changes.
+ */
+void optimize_jumps(struct list *code)
+{
+	bool changed = true;
+	while (changed) {
+		struct list_node **labels = find_labels(code);
+		changed = thread_jumps(code, labels);
+		free(labels);
+
+		changed |= simplify_jumps(code);
+		changed |= remove_unreachable(code);
+		changed |= remove_labels(code);
+	}
+}
+
+/*
+ * Loop-invariant code motion. Moves side-effect free ops whose
+ * operands do not change within a natural loop into a preheader
+ * before the loop, innermost loops first, until nothing moves.
+ */
+void optimize_loops(struct list *code)
+{
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		if (op_at(iter)->code == PROC_O)
+			while (transform_loops(code, iter, hoist_invariants))
+				;
+		iter = iter->next;
+	}
+}
+
+/*
+ * Induction variable strength reduction. Where a loop scales a
+ * variable stepped by a constant (as array indexing does), the scaled
+ * value is computed once before the loop and then stepped along with
+ * the variable, replacing a multiply per iteration with an add.
+ */
+void optimize_induction(struct list *code)
+{
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		if (op_at(iter)->code == PROC_O)
+			while (transform_loops(code, iter, reduce_induction))
+				;
+		iter = iter->next;
+	}
+}
+
+/*
+ * Strength reduction of integer arithmetic by constants: folds
+ * constant operands, and replaces multiplication with shifts and adds,
+ * and division and modulus with shifts and multiply-high sequences.
+ */
+void optimize_strength(struct list *code)
+{
+	struct op *proc = NULL;
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		struct address b = op->address[1];
+		struct address c = op->address[2];
+		if (op->code == PROC_O)
+			proc = op;
+
+		if (op->code == MUL_O && is_int(op->address[0])) {
+			reduce_mul(code, proc, iter);
+		} else if ((op->code != DIV_O && op->code != MOD_O)
+		           || !is_int(op->address[0]) || !is_const(c)
+		           || c.offset == 0) {
+			/* nothing to reduce */
+		} else if (is_const(b)) {
+			if (!(b.offset == INT_MIN && c.offset == -1))
+				set_op(op, ASN_O, int_const((op->code == DIV_O)
+				                            ? b.offset / c.offset
+				                            : b.offset % c.offset), e);
+		} else if (op->code == DIV_O) {
+			if (c.offset == 1)
+				set_op(op, ASN_O, b, e);
+			else if (c.offset == -1)
+				set_op(op, NEG_O, b, e);
+			else if (c.offset != INT_MIN)
+				set_op(op, ASN_O, reduce_div(code, proc, iter, c.offset), e);
+		} else if (c.offset == 1 || c.offset == -1) {
+			set_op(op, ASN_O, int_const(0), e);
+		} else if (c.offset != INT_MIN) {
+			/* x % d == x - (x / d) * d, and x % -d == x % d */
+			int d = abs(c.offset);
+			struct address q = reduce_div(code, proc, iter, d);
+			struct address t = temp_alloc(proc, &int_type);
+			int k = power_of_two(d);
+			if (k > 0) {
+				insert_op(code, iter, SHL_O, t, q, int_const(k));
+			} else {
+				insert_op(code, iter, MUL_O, t, q, int_const(d));
+				reduce_mul(code, proc, iter->prev);
+			}
+			set_op(op, SUB_O, b, t);
+		}
+		iter = iter->next;
+	}
+}
+
+/*
+ * Copy propagation and dead code elimination in SSA form. Uses of a
+ * copy read its source instead, and definitions left without uses
+ * are removed, before values are coalesced back into shared slots.
+ */
+void optimize_copies(struct list *code)
+{
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		if (op_at(iter)->code == PROC_O) {
+			struct ssa *s = ssa_new(iter);
+			propagate_copies(s);
+			remove_dead(s);
+			ssa_destroy(code, s);
+		}
+		iter = iter->next;
+	}
+}
+
+/*
+ * Peephole optimization of adjacent ops: fuses a comparison into the
+ * conditional jump testing it, computes a value directly into the
+ * variable it is then copied to, and turns adding one into increment.
+ * Patterns are retried at each op until none applies.
+ */
+void optimize_peephole(struct list *code)
+{
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		if (op_at(iter)->code == PROC_O) {
+			struct flow *f = flow_new(iter);
+			for (size_t b = 0; b < f->count; ++b) {
+				struct block *block = &f->blocks[b];
+				for (struct list_node *node = block->first; node;
+				     node = block_next(block, node)) {
+					size_t i = 0;
+					while (i < sizeof(peepholes) / sizeof(*peepholes))
+						i = peepholes[i](code, f, b, node) ? 0 : i + 1;
+				}
+			}
+			flow_free(f);
+		}
+		iter = iter->next;
+	}
+}
+
+/*
+ * Profile-guided switch lowering. Where the profile shows one case of
+ * a jump table reached at least half as often as the table, that
+ * case is tested before the table, which dispatches the rest.
+ */
+void optimize_switches(struct list *code)
+{
+	struct list_node **labels = find_labels(code);
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		if (op->code == TABLE_O && op->count > 0)
+			peel_case(code, labels, iter);
+		iter = iter->next;
+	}
+	free(labels);
+}
+
+/*
+ * Profile-guided block layout. Runs of blocks the profile shows were
+ * never entered, in procedures which were, move to the end of their
+ * procedure so that hot code falls through to hot code. Jumps are
+ * added where control fell into or out of a run, which
+ * optimize_jumps() folds into the branches around them.
+ */
+void optimize_layout(struct list *code)
+{
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		if (op->code == PROC_O && op->count > 0)
+			move_cold(code, iter);
+		iter = iter->next;
+	}
+}
+
+/*
+ * Returns an array mapping each label number to its node in code.
+ */
+static struct list_node **find_labels(struct list *code)
+{
+	struct list_node **labels = calloc(yylabels, sizeof(*labels));
+	log_assert(labels);
+
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		if (op->code == LABEL_O)
+			labels[op->address[0].offset] = iter;
+		iter = iter->next;
+	}
+	return labels;
+}
+
+/*
+ * Returns the first node at or after iter which is not a label.
+ */
+static struct list_node *skip_labels(struct list_node *iter)
+{
+	while (!list_end(iter) && op_at(iter)->code == LABEL_O)
+		iter = iter->next;
+	return iter;
+}
+
+/*
+ * Returns true if the run of labels starting at iter includes label.
+ */
+static bool falls_to(struct list_node *iter, int label)
+{
+	while (!list_end(iter) && op_at(iter)->code == LABEL_O) {
+		if (op_at(iter)->address[0].offset == label)
+			return true;
+		iter = iter->next;
+	}
+	return false;
+}
+
+/*
+ * Follows label through unconditional jumps to the label where
+ * control actually continues, naming adjacent labels by the first.
+ */
+static int final_label(struct list_node **labels, int label)
+{
+	if (labels[label] == NULL)
+		return label;
+
+	/* bounded so that cycles of jumps terminate */
+	for (size_t hops = 0; hops < yylabels; ++hops) {
+		struct list_node *iter = skip_labels(labels[label]);
+		if (list_end(iter) || op_at(iter)->code != GOTO_O)
+			break;
+		int next = op_at(iter)->address[0].offset;
+		if (next == label || labels[next] == NULL)
+			break;
+		label = next;
+	}
+
+	struct list_node *iter = labels[label];
+	while (!list_end(iter->prev) && op_at(iter->prev)->code == LABEL_O)
+		iter = iter->prev;
+	return op_at(iter)->address[0].offset;
+}
+
+/*
+ * Unlinks and frees the op at iter, returning the following node.
+ */
+static struct list_node *delete_op(struct list *code, struct list_node *iter)
+{
+	struct list_node *next = iter->next;
+	free(list_node_unlink(code, iter));
+	return next;
+}
+
+/*
+ * Retargets every jump to its final label.
+ */
+static bool thread_jumps(struct list *code, struct list_node **labels)
+{
+	bool changed = false;
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct address *target = op_target(iter->data);
+		if (target) {
+			int label = final_label(labels, target->offset);
+			if (label != target->offset) {
+				target->offset = label;
+				changed = true;
+			}
+		}
+		iter = iter->next;
+	}
+	return changed;
+}
+
+/*
+ * Removes jumps to the immediately following label and rewrites
+ *     if x goto L1; goto L2; L1:
+ * as
+ *     ifn x goto L2; L1:
+ * (and vice versa for ifn).
+ */
+static bool simplify_jumps(struct list *code)
+{
+	bool changed = false;
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		if (op->code != GOTO_O && op->code != IF_O && op->code != IFN_O) {
+			iter = iter->next;
+			continue;
+		}
+
+		int label = op_target(op)->offset;
+		if (falls_to(iter->next, label)) {
+			iter = delete_op(code, iter);
+			changed = true;
+			continue;
+		}
+
+		struct list_node *next = iter->next;
+		if (op->code != GOTO_O && !list_end(next)
+		    && op_at(next)->code == GOTO_O
+		    && falls_to(next->next, label)) {
+			op->code = (op->code == IF_O) ? IFN_O : IF_O;
+			op->address[1] = op_at(next)->address[0];
+			delete_op(code, next);
+			changed = true;
+		}
+		iter = iter->next;
+	}
+	return changed;
+}
+
+/*
+ * Removes ops following an unconditional jump or return which no
+ * label can reach.
+ */
+static bool remove_unreachable(struct list *code)
+{
+	bool changed = false;
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		if (op->code == TABLE_O) {
+			/* skip jump table entries */
+			for (int i = 0; i < op->address[1].offset; ++i)
+				iter = iter->next;
+		} else if (!op_jumps(op)) {
+			iter = iter->next;
+			continue;
+		}
+
+		iter = iter->next;
+		while (!list_end(iter)) {
+			enum opcode code_ = op_at(iter)->code;
+			if (code_ == LABEL_O || code_ == END_O || code_ == PROC_O)
+				break;
+			iter = delete_op(code, iter);
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+/*
+ * Removes labels which no jump references.
+ */
+static bool remove_labels(struct list *code)
+{
+	bool changed = false;
+	int *refs = calloc(yylabels, sizeof(*refs));
+	log_assert(refs);
+
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct address *target = op_target(iter->data);
+		if (target)
+			++refs[target->offset];
+		iter = iter->next;
+	}
+
+	iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		if (op->code == LABEL_O && refs[op->address[0].offset] == 0) {
+			iter = delete_op(code, iter);
+			changed = true;
+		} else {
+			iter = iter->next;
+		}
+	}
+
+	free(refs);
+	return changed;
+}
+
+/*
+ * Applies transform to the loops of proc, innermost first, until one
+ * changes code (invalidating the flow graph). Returns true if any did.
+ */
+static bool transform_loops(struct list *code, struct list_node *proc,
+                            bool (*transform)(struct list *, struct flow *,
+                                              struct loop *))
+{
+	struct flow *f = flow_new(proc);
+	size_t count;
+	struct loop *loops = flow_loops(f, &count);
+
+	bool changed = false;
+	for (size_t i = 0; i < count && !changed; ++i)
+		changed = transform(code, f, &loops[i]);
+
+	flow_loops_free(loops, count);
+	flow_free(f);
+	return changed;
+}
+
+/*
+ * Moves the invariant ops of loop, in order, to just before its
+ * header. Returns false if there were none.
+ */
+static bool hoist_invariants(struct list *code, struct flow *f,
+                             struct loop *loop)
+{
+	if (!has_preheader(f, loop))
+		return false;
+
+	/* calls and stores through pointers may write escaped memory */
+	bool clobbers = false;
+	for (size_t b = 0; b < f->count; ++b) {
+		if (!loop->body[b])
+			continue;
+		struct block *block = &f->blocks[b];
+		for (struct list_node *iter = block->first; iter;
+		     iter = block_next(block, iter)) {
+			enum opcode code_ = op_at(iter)->code;
+			if (code_ == LSTAR_O || code_ == CALL_O || code_ == CALLC_O)
+				clobbers = true;
+		}
+	}
+
+	/* ops are visited in code order, so operands computed by
+	   hoisted ops are hoisted first */
+	struct list *hoisted = list_new(NULL, NULL);
+	log_assert(hoisted);
+	for (size_t b = 0; b < f->count; ++b) {
+		if (!loop->body[b])
+			continue;
+		struct block *block = &f->blocks[b];
+		for (struct list_node *iter = block->first; iter;
+		     iter = block_next(block, iter))
+			if (can_hoist(f, loop, hoisted, clobbers, b, iter))
+				list_push_back(hoisted, iter);
+	}
+
+	bool changed = !list_empty(hoisted);
+	if (changed) {
+		log_debug("hoisting %zu ops out of loop at block %zu",
+		          list_size(hoisted), loop->header);
+		struct list_node *entry = make_preheader(code, f, loop);
+		struct list_node *iter = list_head(hoisted);
+		while (!list_end(iter)) {
+			struct op *op = list_node_unlink(code, iter->data);
+			list_node_link(code, list_node_new(op), entry);
+			iter = iter->next;
+		}
+	}
+	list_free(hoisted);
+	return changed;
+}
+
+/*
+ * Returns true for ops which neither trap nor touch memory other
+ * than their operands and result.
+ */
+static bool is_hoistable(struct op *op)
+{
+	struct address c = op->address[2];
+	switch (op->code) {
+	case ADD_O:
+	case FADD_O:
+	case SUB_O:
+	case FSUB_O:
+	case MUL_O:
+	case FMUL_O:
+	case FDIV_O:
+	case SHL_O:
+	case SHR_O:
+	case USHR_O:
+	case MULH_O:
+	case LT_O:
+	case FLT_O:
+	case LE_O:
+	case FLE_O:
+	case GT_O:
+	case FGT_O:
+	case GE_O:
+	case FGE_O:
+	case EQ_O:
+	case FEQ_O:
+	case NE_O:
+	case FNE_O:
+	case OR_O:
+	case AND_O:
+	case NEG_O:
+	case FNEG_O:
+	case NOT_O:
+	case ASN_O:
+	case ADDR_O:
+	case LARR_O:
+	case LFIELD_O:
+		return true;
+	case DIV_O:
+	case MOD_O:
+		/* hoisting must not introduce a trap */
+		return c.region == CONST_R && c.offset != 0 && c.offset != -1;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Returns true if the op at node, in block b of loop, computes the
+ * same value on every iteration into a local which it alone defines
+ * and which is only read where it has already been computed.
+ */
+static bool can_hoist(struct flow *f, struct loop *loop, struct list *hoisted,
+                      bool clobbers, size_t b, struct list_node *node)
+{
+	struct op *op = node->data;
+	if (!is_hoistable(op))
+		return false;
+
+	struct address d = op->address[0];
+	if (d.region != LOCAL_R || op_reads(op, d) || address_taken(f, d))
+		return false;
+
+	for (size_t c = 0; c < f->count; ++c) {
+		struct block *block = &f->blocks[c];
+		bool after = false;
+		for (struct list_node *iter = block->first; iter;
+		     iter = block_next(block, iter)) {
+			if (iter == node) {
+				after = true;
+				continue;
+			}
+			struct address *def = op_def(iter->data);
+			if (def && address_overlaps(*def, d))
+				return false;
+			if (op_reads(iter->data, d)
+			    && (!flow_dominates(f, b, c) || (c == b && !after)))
+				return false;
+		}
+	}
+
+	switch (op->code) {
+	case ADDR_O:
+		return true;
+	case LARR_O:
+		if (!op->address[1].type->pointer)
+			return is_invariant(f, loop, hoisted, clobbers,
+			                    op->address[2]);
+		/* fall through, as the array is indexed through its value */
+	default:
+		return is_invariant(f, loop, hoisted, clobbers, op->address[1])
+			&& is_invariant(f, loop, hoisted, clobbers, op->address[2]);
+	}
+}
+
+/*
+ * Returns true if nothing in loop may change the value at a.
+ */
+static bool is_invariant(struct flow *f, struct loop *loop,
+                         struct list *hoisted, bool clobbers,
+                         struct address a)
+{
+	if (a.region == CONST_R || a.region == UNKNOWN_R)
+		return true;
+
+	struct list_node *iter = list_head(hoisted);
+	while (!list_end(iter)) {
+		struct op *op = op_at((struct list_node *)iter->data);
+		if (address_overlaps(op->address[0], a))
+			return true;
+		iter = iter->next;
+	}
+
+	if (clobbers && (a.region == GLOBE_R || a.region == CLASS_R
+	                 || address_taken(f, a)))
+		return false;
+
+	for (size_t b = 0; b < f->count; ++b) {
+		if (!loop->body[b])
+			continue;
+		struct block *block = &f->blocks[b];
+		for (iter = block->first; iter; iter = block_next(block, iter)) {
+			struct address *def = op_def(iter->data);
+			if (def && address_overlaps(*def, a))
+				return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Returns true if the procedure of f takes the address of any memory
+ * overlapping a, so it may be written through a pointer.
+ */
+static bool address_taken(struct flow *f, struct address a)
+{
+	struct list_node *iter = f->proc->next;
+	while (iter != f->end) {
+		struct op *op = iter->data;
+		if ((op->code == ADDR_O || op->code == LARR_O
+		     || op->code == RARR_O)
+		    && address_overlaps(op->address[1], a))
+			return true;
+		iter = iter->next;
+	}
+	return false;
+}
+
+/*
+ * Returns true if code placed in front of the loop header runs only
+ * on entry to the loop, since nothing in the loop falls through to it.
+ */
+static bool has_preheader(struct flow *f, struct loop *loop)
+{
+	size_t h = loop->header;
+	if (h == 0 || !loop->body[h - 1])
+		return true;
+
+	struct list_node *iter = f->blocks[h - 1].last;
+	while (op_at(iter)->code == CASE_O)
+		iter = iter->prev;
+	return op_jumps(iter->data);
+}
+
+/*
+ * Retargets jumps entering the loop from outside to a new preheader
+ * label in front of the header (if there are any), and returns the
+ * node before which preheader code belongs.
+ */
+static struct list_node *make_preheader(struct list *code, struct flow *f,
+                                        struct loop *loop)
+{
+	struct list_node *entry = f->blocks[loop->header].first;
+	log_assert(op_at(entry)->code == LABEL_O);
+
+	struct op *preheader = NULL;
+	for (size_t b = 0; b < f->count; ++b) {
+		if (loop->body[b])
+			continue;
+		struct block *block = &f->blocks[b];
+		for (struct list_node *iter = block->first; iter;
+		     iter = block_next(block, iter)) {
+			struct address *target = op_target(iter->data);
+			if (target == NULL || !falls_to(entry, target->offset))
+				continue;
+			if (preheader == NULL) {
+				preheader = calloc(1, sizeof(*preheader));
+				log_assert(preheader);
+				struct address label = { LABEL_R, yylabels++,
+				                         &unknown_type };
+				struct address e = { UNKNOWN_R, 0, &unknown_type };
+				preheader->code = LABEL_O;
+				preheader->address[0] = label;
+				preheader->address[1] = e;
+				preheader->address[2] = e;
+				preheader->count = op_at(entry)->count;
+			}
+			target->offset = preheader->address[0].offset;
+		}
+	}
+	if (preheader)
+		list_node_link(code, list_node_new(preheader), entry);
+	return entry;
+}
+
+/*
+ * Replaces one scaled basic induction variable in loop with an
+ * induction variable of its own, returning true if it found one.
+ */
+static bool reduce_induction(struct list *code, struct flow *f,
+                             struct loop *loop)
+{
+	if (!has_preheader(f, loop))
+		return false;
+
+	for (size_t b = 0; b < f->count; ++b) {
+		if (!loop->body[b])
+			continue;
+		struct block *block = &f->blocks[b];
+		for (struct list_node *node = block->first; node;
+		     node = block_next(block, node)) {
+			struct op *op = node->data;
+			if (op->code != MUL_O || !is_int(op->address[0]))
+				continue;
+
+			/* t := i * s, with s constant */
+			struct address i = op->address[1];
+			struct address s = op->address[2];
+			if (is_const(i)) {
+				i = op->address[2];
+				s = op->address[1];
+			}
+			if (!is_const(s) || !is_basic_induction(f, loop, i)
+			    || !is_scaled_index(f, b, node, i))
+				continue;
+
+			log_debug("reducing induction variable in block %zu", b);
+			struct address t = op->address[0];
+
+			/* step t along with every step of i */
+			for (size_t c = 0; c < f->count; ++c) {
+				if (!loop->body[c])
+					continue;
+				struct block *other = &f->blocks[c];
+				for (struct list_node *iter = other->first; iter;
+				     iter = block_next(other, iter)) {
+					struct op *step = iter->data;
+					struct address *def = op_def(step);
+					if (def == NULL || !address_overlaps(*def, i))
+						continue;
+					int delta = (int)((unsigned)step->address[2].offset
+					                  * (unsigned)s.offset);
+					insert_op(code, iter->next, step->code, t, t,
+					          int_const(delta));
+				}
+			}
+
+			/* compute t before the loop instead of in it */
+			struct list_node *entry = make_preheader(code, f, loop);
+			list_node_link(code, list_node_new(list_node_unlink(code, node)),
+			               entry);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Returns true if i is an unaliased integer local which loop changes
+ * only by adding or subtracting constants.
+ */
+static bool is_basic_induction(struct flow *f, struct loop *loop,
+                               struct address i)
+{
+	if ((i.region != LOCAL_R && i.region != PARAM_R) || !is_int(i)
+	    || address_taken(f, i))
+		return false;
+
+	bool stepped = false;
+	for (size_t b = 0; b < f->count; ++b) {
+		if (!loop->body[b])
+			continue;
+		struct block *block = &f->blocks[b];
+		for (struct list_node *iter = block->first; iter;
+		     iter = block_next(block, iter)) {
+			struct op *op = iter->data;
+			struct address *def = op_def(op);
+			if (def == NULL || !address_overlaps(*def, i))
+				continue;
+			if ((op->code != ADD_O && op->code != SUB_O)
+			    || def->region != i.region || def->offset != i.offset
+			    || op->address[1].region != i.region
+			    || op->address[1].offset != i.offset
+			    || !is_const(op->address[2]))
+				return false;
+			stepped = true;
+		}
+	}
+	return stepped;
+}
+
+/*
+ * Returns true if the multiply at node, in block b, defines a local
+ * which nothing else defines and which is read only later in block b,
+ * before i next changes (so stepping it with i preserves every read).
+ */
+static bool is_scaled_index(struct flow *f, size_t b, struct list_node *node,
+                            struct address i)
+{
+	struct address t = op_at(node)->address[0];
+	if (t.region != LOCAL_R || address_overlaps(t, i) || address_taken(f, t))
+		return false;
+
+	for (size_t c = 0; c < f->count; ++c) {
+		struct block *block = &f->blocks[c];
+		bool after = false;
+		bool stepped = false;
+		for (struct list_node *iter = block->first; iter;
+		     iter = block_next(block, iter)) {
+			if (iter == node) {
+				after = true;
+				continue;
+			}
+			struct address *def = op_def(iter->data);
+			if (def && address_overlaps(*def, t))
+				return false;
+			if (op_reads(iter->data, t) && (!after || stepped))
+				return false;
+			if (after && def && address_overlaps(*def, i))
+				stepped = true;
+		}
+	}
+	return true;
+}
+
+static bool is_int(struct address a)
+{
+	return a.type && a.type->base == INT_T && !a.type->pointer;
+}
+
+static bool is_const(struct address a)
+{
+	return a.region == CONST_R && is_int(a);
+}
+
+/*
+ * Returns k if c == 2^k for some k > 0, else 0.
+ */
+static int power_of_two(int c)
+{
+	if (c <= 1 || (c & (c - 1)) != 0)
+		return 0;
+	int k = 0;
+	while (c >>= 1)
+		++k;
+	return k;
+}
+
+/*
+ * Computes the magic multiplier m and shift s for signed 32-bit
+ * division by d, where 2 <= |d| < 2^31 (Hacker's Delight, 10-1).
+ */
+static void magic(int d, int *m, int *s)
+{
+	const unsigned two31 = 0x80000000u;
+	unsigned ad = (d < 0) ? -(unsigned)d : (unsigned)d;
+	unsigned t = two31 + ((unsigned)d >> 31);
+	unsigned anc = t - 1 - t % ad;
+	unsigned q1 = two31 / anc;
+	unsigned r1 = two31 - q1 * anc;
+	unsigned q2 = two31 / ad;
+	unsigned r2 = two31 - q2 * ad;
+	unsigned delta;
+	int p = 31;
+	do {
+		++p;
+		q1 *= 2;
+		r1 *= 2;
+		if (r1 >= anc) {
+			++q1;
+			r1 -= anc;
+		}
+		q2 *= 2;
+		r2 *= 2;
+		if (r2 >= ad) {
+			++q2;
+			r2 -= ad;
+		}
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+
+	*m = (int)(q2 + 1);
+	if (d < 0)
+		*m = -*m;
+	*s = p - 32;
+}
+
+static struct address int_const(int value)
+{
+	struct address a = { CONST_R, value, &int_type };
+	return a;
+}
+
+/*
+ * Returns a new temporary of the given type in the locals of proc.
+ */
+static struct address temp_alloc(struct op *proc, struct typeinfo *type)
+{
+	log_assert(proc && proc->code == PROC_O);
+	struct address a = { LOCAL_R,
+	                     typeinfo_aligned(proc->address[1].offset, type),
+	                     type };
+	proc->address[1].offset = a.offset + typeinfo_size(type);
+	return a;
+}
+
+/*
+ * Inserts a new op into code before the given node, run as often and
+ * from the same source line.
+ */
+static void insert_op(struct list *code, struct list_node *before,
+                      enum opcode code_, struct address a, struct address b,
+                      struct address c)
+{
+	struct op *op = calloc(1, sizeof(*op));
+	log_assert(op);
+	op->code = code_;
+	op->address[0] = a;
+	op->address[1] = b;
+	op->address[2] = c;
+	op->count = op_at(before)->count;
+	op->filename = op_at(before)->filename;
+	op->lineno = op_at(before)->lineno;
+	list_node_link(code, list_node_new(op), before);
+}
+
+/*
+ * Rewrites op in place, keeping its result address.
+ */
+static void set_op(struct op *op, enum opcode code, struct address b,
+                   struct address c)
+{
+	op->code = code;
+	op->address[1] = b;
+	op->address[2] = c;
+}
+
+/*
+ * Folds or reduces the integer multiply at iter.
+ */
+static void reduce_mul(struct list *code, struct op *proc,
+                       struct list_node *iter)
+{
+	struct op *op = iter->data;
+	struct address x = op->address[1];
+	struct address c = op->address[2];
+	if (is_const(x)) {
+		x = op->address[2];
+		c = op->address[1];
+	}
+	if (!is_const(c))
+		return;
+
+	int k;
+	if (is_const(x)) {
+		set_op(op, ASN_O, int_const((int)((unsigned)x.offset
+		                                  * (unsigned)c.offset)), e);
+	} else if (c.offset == 0) {
+		set_op(op, ASN_O, int_const(0), e);
+	} else if (c.offset == 1) {
+		set_op(op, ASN_O, x, e);
+	} else if (c.offset == -1) {
+		set_op(op, NEG_O, x, e);
+	} else if ((k = power_of_two(c.offset)) > 0) {
+		set_op(op, SHL_O, x, int_const(k));
+	} else if ((k = power_of_two(c.offset - 1)) > 0) {
+		/* x * (2^k + 1) */
+		struct address t = temp_alloc(proc, &int_type);
+		insert_op(code, iter, SHL_O, t, x, int_const(k));
+		set_op(op, ADD_O, t, x);
+	} else if (c.offset < INT_MAX && (k = power_of_two(c.offset + 1)) > 0) {
+		/* x * (2^k - 1) */
+		struct address t = temp_alloc(proc, &int_type);
+		insert_op(code, iter, SHL_O, t, x, int_const(k));
+		set_op(op, SUB_O, t, x);
+	}
+}
+
+/*
+ * Inserts before iter the ops dividing its first operand by the
+ * constant d, where |d| >= 2 and d != INT_MIN, and returns the
+ * address of the quotient.
+ */
+static struct address reduce_div(struct list *code, struct op *proc,
+                                 struct list_node *iter, int d)
+{
+	struct address x = op_at(iter)->address[1];
+	struct address q = temp_alloc(proc, &int_type);
+	struct address sign = temp_alloc(proc, &int_type);
+	int k = power_of_two(d);
+
+	if (k > 0) {
+		/* round toward zero by adding 2^k - 1 to negative x */
+		insert_op(code, iter, SHR_O, sign, x, int_const(31));
+		insert_op(code, iter, USHR_O, sign, sign, int_const(32 - k));
+		insert_op(code, iter, ADD_O, q, x, sign);
+		insert_op(code, iter, SHR_O, q, q, int_const(k));
+	} else {
+		int m, s;
+		magic(d, &m, &s);
+		insert_op(code, iter, MULH_O, q, x, int_const(m));
+		if (d > 0 && m < 0)
+			insert_op(code, iter, ADD_O, q, q, x);
+		else if (d < 0 && m > 0)
+			insert_op(code, iter, SUB_O, q, q, x);
+		if (s > 0)
+			insert_op(code, iter, SHR_O, q, q, int_const(s));
+		/* add one to negative quotients */
+		insert_op(code, iter, USHR_O, sign, q, int_const(31));
+		insert_op(code, iter, ADD_O, q, q, sign);
+	}
+	return q;
+}
+
+/*
+ * Returns the procedures of code, with their recursion marked.
+ */
+static struct procedure *find_procedures(struct list *code, size_t *count)
+{
+	struct procedure *procs = NULL;
+	*count = 0;
+
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		if (op->code == PROC_O) {
+			procs = realloc(procs, (*count + 1) * sizeof(*procs));
+			log_assert(procs);
+			struct procedure *p = &procs[(*count)++];
+			p->name = op->name;
+			p->proc = iter;
+			p->recursive = false;
+		}
+		iter = iter->next;
+	}
+
+	bool *seen = malloc(*count * sizeof(*seen));
+	log_assert(*count == 0 || seen);
+	for (size_t i = 0; i < *count; ++i) {
+		memset(seen, false, *count * sizeof(*seen));
+		procs[i].recursive = reaches(procs, *count, &procs[i], &procs[i],
+		                             seen);
+	}
+	free(seen);
+
+	return procs;
+}
+
+static struct procedure *find_procedure(struct procedure *procs, size_t count,
+                                        char *name)
+{
+	for (size_t i = 0; i < count; ++i)
+		if (strcmp(procs[i].name, name) == 0)
+			return &procs[i];
+	return NULL;
+}
+
+/*
+ * Returns true if a call chain leads from p to target.
+ */
+static bool reaches(struct procedure *procs, size_t count,
+                    struct procedure *p, struct procedure *target, bool *seen)
+{
+	struct list_node *iter = p->proc->next;
+	while (op_at(iter)->code != END_O) {
+		struct op *op = iter->data;
+		struct procedure *callee = (op->code == CALL_O
+		                             || op->code == TCALL_O)
+			? find_procedure(procs, count, op->name) : NULL;
+		iter = iter->next;
+		if (callee == NULL)
+			continue;
+		if (callee == target)
+			return true;
+		if (!seen[callee - procs]) {
+			seen[callee - procs] = true;
+			if (reaches(procs, count, callee, target, seen))
+				return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Appends the index of p to order after those of its callees.
+ */
+static void order_procedures(struct procedure *procs, size_t count,
+                             struct procedure *p, bool *seen,
+                             size_t *order, size_t *n)
+{
+	seen[p - procs] = true;
+	struct list_node *iter = p->proc->next;
+	while (op_at(iter)->code != END_O) {
+		struct op *op = iter->data;
+		struct procedure *callee = (op->code == CALL_O
+		                             || op->code == TCALL_O)
+			? find_procedure(procs, count, op->name) : NULL;
+		if (callee && !seen[callee - procs])
+			order_procedures(procs, count, callee, seen, order, n);
+		iter = iter->next;
+	}
+	order[(*n)++] = p - procs;
+}
+
+/*
+ * Returns true if calls to p may be replaced by its body: it is
+ * small, not recursive, makes no tail calls, and is not a class
+ * member (whose code refers to its own instance).
+ */
+static bool can_inline(struct procedure *p, size_t budget)
+{
+	if (p->recursive || strstr(p->name, "__") || copies_params(p->proc->data))
+		return false;
+
+	size_t size = 0;
+	struct list_node *iter = p->proc->next;
+	while (op_at(iter)->code != END_O) {
+		struct op *op = iter->data;
+		if (op->code == TCALL_O)
+			return false;
+		for (int i = 0; i < 3; ++i)
+			if (op->address[i].region == CLASS_R)
+				return false;
+		if (++size > budget)
+			return false;
+		iter = iter->next;
+	}
+	return true;
+}
+
+/*
+ * Returns true if proc takes a class by value, which is copied in
+ * whole on entry rather than assigned.
+ */
+static bool copies_params(struct op *proc)
+{
+	struct typeinfo *function = proc->address[2].type;
+	struct list_node *iter = list_head(function->function.parameters);
+	while (!list_end(iter)) {
+		struct typeinfo *t = iter->data;
+		if (!t->pointer && t->base == CLASS_T)
+			return true;
+		iter = iter->next;
+	}
+	return false;
+}
+
+/*
+ * Returns the most times any call was made in the profile, else 0
+ * if there is none.
+ */
+static unsigned long hottest_call(struct list *code)
+{
+	unsigned long hottest = 0;
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		if (op->code == CALL_O && op->count > hottest)
+			hottest = op->count;
+		iter = iter->next;
+	}
+	return hottest;
+}
+
+/*
+ * Returns the ops a procedure may have to be inlined at call: without
+ * a profile budget, else none if the call was never made, hot_budget
+ * if it was made at least 1/INLINE_HOT_RATIO as often as the hottest.
+ */
+static size_t call_budget(struct op *call, size_t budget, size_t hot_budget,
+                          unsigned long hottest)
+{
+	if (hottest == 0)
+		return budget;
+	if (call->count == 0)
+		return 0;
+	if (call->count * INLINE_HOT_RATIO >= hottest)
+		return hot_budget;
+	return budget;
+}
+
+/*
+ * Inlines the first call in caller which can be, returning true if
+ * there was one. Parameters are matched to calls as a stack, so
+ * calls nested in argument lists take their own.
+ */
+static bool inline_call(struct list *code, struct procedure *procs,
+                        size_t count, struct procedure *caller, size_t budget,
+                        size_t hot_budget, unsigned long hottest)
+{
+	bool changed = false;
+	struct list *params = list_new(NULL, NULL);
+	log_assert(params);
+
+	struct list_node *iter = caller->proc->next;
+	while (op_at(iter)->code != END_O) {
+		struct op *op = iter->data;
+		if (op->code == PARAM_O) {
+			list_push_back(params, iter);
+		} else if (op->code == CALL_O || op->code == CALLC_O) {
+			int n = op->address[1].offset;
+			struct procedure *callee = (op->code == CALL_O)
+				? find_procedure(procs, count, op->name) : NULL;
+			if (callee && (int)list_size(params) >= n
+			    && can_inline(callee, call_budget(op, budget, hot_budget,
+			                                      hottest))) {
+				log_debug("inlining %s into %s", callee->name,
+				          caller->name);
+				splice(code, caller, callee, iter, params, n);
+				changed = true;
+				break;
+			}
+			for (int i = 0; i < n && !list_empty(params); ++i)
+				list_pop_back(params);
+		}
+		iter = iter->next;
+	}
+
+	list_free(params);
+	return changed;
+}
+
+/*
+ * Replaces the call at node with a copy of callee's body in a new
+ * part of the caller's frame. The last n pending parameters become
+ * assignments to the copied parameters, and returns become
+ * assignments to the call's result and jumps past the body. Profile
+ * counts of the copy are the callee's share made by this call.
+ */
+static void splice(struct list *code, struct procedure *caller,
+                   struct procedure *callee, struct list_node *node,
+                   struct list *params, int n)
+{
+	struct op *proc = caller->proc->data;
+	struct op *call = node->data;
+	int base = typeinfo_aligned(proc->address[1].offset, &int_type);
+	proc->address[1].offset = base + op_at(callee->proc)->address[1].offset;
+
+	/* parameters are laid out in order from the front of the frame */
+	int offset = base;
+	struct list_node *iter = list_tail(params);
+	for (int i = 1; i < n; ++i)
+		iter = iter->prev;
+	for (int i = 0; i < n; ++i) {
+		struct op *param = op_at((struct list_node *)iter->data);
+		struct typeinfo *type = param->address[0].type;
+		offset = base + typeinfo_aligned(offset - base, type);
+		struct address slot = { LOCAL_R, offset, type };
+		offset += typeinfo_size(type);
+		set_op(param, ASN_O, param->address[0], e);
+		param->address[0] = slot;
+		iter = iter->next;
+	}
+
+	size_t labels_size = yylabels;
+	int *labels = malloc(labels_size * sizeof(*labels));
+	log_assert(labels_size == 0 || labels);
+	for (size_t i = 0; i < labels_size; ++i)
+		labels[i] = -1;
+	struct address exit = { LABEL_R, yylabels++, &unknown_type };
+	unsigned long entries = op_at(callee->proc)->count;
+
+	iter = callee->proc->next;
+	while (op_at(iter)->code != END_O) {
+		struct op *copy = malloc(sizeof(*copy));
+		log_assert(copy);
+		*copy = *op_at(iter);
+		if (entries > 0)
+			copy->count = (double)copy->count * call->count / entries;
+		for (int i = 0; i < 3; ++i) {
+			struct address *a = &copy->address[i];
+			if (a->region == LOCAL_R || a->region == PARAM_R) {
+				a->region = LOCAL_R;
+				a->offset += base;
+			} else if (a->region == LABEL_R) {
+				log_assert((size_t)a->offset < labels_size);
+				if (labels[a->offset] < 0)
+					labels[a->offset] = yylabels++;
+				a->offset = labels[a->offset];
+			}
+		}
+
+		if (copy->code == RET_O) {
+			if (call->address[0].region != UNKNOWN_R
+			    && copy->address[0].region != UNKNOWN_R)
+				insert_op(code, node, ASN_O, call->address[0],
+				          copy->address[0], e);
+			insert_op(code, node, GOTO_O, exit, e, e);
+			free(copy);
+		} else {
+			list_node_link(code, list_node_new(copy), node);
+		}
+		iter = iter->next;
+	}
+	insert_op(code, node, LABEL_O, exit, e, e);
+	delete_op(code, node);
+	free(labels);
+}
+
+/*
+ * Rewrites the calls in tail position of the procedure at node.
+ * Labels at or past size were made here and are not in labels.
+ */
+static void eliminate_tail_calls(struct list *code, struct list_node *node,
+                                 struct list_node **labels, size_t size)
+{
+	struct op *proc = node->data;
+	struct address entry = e;
+	struct list *params = list_new(NULL, NULL);
+	log_assert(params);
+
+	struct list_node *iter = node->next;
+	while (op_at(iter)->code != END_O) {
+		struct op *op = iter->data;
+		struct address ret;
+		if (op->code == PARAM_O) {
+			list_push_back(params, iter);
+		} else if (op->code == CALL_O || op->code == CALLC_O) {
+			int n = op->address[1].offset;
+			if (op->code == CALL_O && (int)list_size(params) >= n
+			    && tail_position(labels, size, iter, &ret)) {
+				/* a member's instance is its own, never reassigned */
+				if (strcmp(op->name, proc->name) == 0
+				    && !copies_params(proc)
+				    && strstr(proc->name, "__") == NULL) {
+					log_debug("eliminating tail recursion in %s",
+					          proc->name);
+					if (entry.region == UNKNOWN_R) {
+						entry.region = LABEL_R;
+						entry.offset = yylabels++;
+						entry.type = &unknown_type;
+						insert_op(code, node->next, LABEL_O,
+						          entry, e, e);
+					}
+					reassign_params(code, proc, iter, params, n);
+					op->code = GOTO_O;
+					op->name = NULL;
+					op->address[0] = entry;
+					op->address[1] = e;
+				} else {
+					log_debug("tail call to %s in %s", op->name,
+					          proc->name);
+					op->code = TCALL_O;
+					op->address[0] = ret;
+				}
+			}
+			for (int i = 0; i < n && !list_empty(params); ++i)
+				list_pop_back(params);
+		}
+		iter = iter->next;
+	}
+
+	list_free(params);
+}
+
+/*
+ * Returns true if control passes from the call at iter through only
+ * labels and jumps to a return of its result, or to a return of
+ * nothing, storing the returned address in ret.
+ */
+static bool tail_position(struct list_node **labels, size_t size,
+                          struct list_node *iter, struct address *ret)
+{
+	struct address result = op_at(iter)->address[0];
+
+	/* bounded so that cycles of jumps terminate */
+	for (size_t hops = 0; hops <= size; ++hops) {
+		iter = skip_labels(iter->next);
+		struct op *op = iter->data;
+		if (op->code == GOTO_O) {
+			int label = op->address[0].offset;
+			if ((size_t)label >= size || labels[label] == NULL)
+				return false;
+			iter = labels[label];
+		} else if (op->code == END_O) {
+			*ret = e;
+			return true;
+		} else if (op->code == RET_O) {
+			struct address a = op->address[0];
+			if (a.region != UNKNOWN_R
+			    && (a.region != result.region
+			        || a.offset != result.offset))
+				return false;
+			*ret = a;
+			return true;
+		} else {
+			return false;
+		}
+	}
+	return false;
+}
+
+/*
+ * Turns the last n pending parameters into copies to temporaries,
+ * then assigns those to proc's own parameters before the call at
+ * node, so that no argument reads a parameter already reassigned.
+ */
+static void reassign_params(struct list *code, struct op *proc,
+                            struct list_node *node, struct list *params,
+                            int n)
+{
+	struct list_node *iter = list_tail(params);
+	for (int i = 1; i < n; ++i)
+		iter = iter->prev;
+
+	int offset = 0;
+	for (int i = 0; i < n; ++i) {
+		struct op *param = op_at((struct list_node *)iter->data);
+		struct address arg = param->address[0];
+		struct address t = temp_alloc(proc, arg.type);
+		offset = typeinfo_aligned(offset, arg.type);
+		struct address slot = { LOCAL_R, offset, arg.type };
+		offset += typeinfo_size(arg.type);
+		set_op(param, ASN_O, arg, e);
+		param->address[0] = t;
+		insert_op(code, node, ASN_O, slot, t, e);
+		iter = iter->next;
+	}
+}
+
+/*
+ * Replaces the uses of each copy of a value or constant of the same
+ * type with its source, removing the copy.
+ */
+static void propagate_copies(struct ssa *s)
+{
+	for (size_t v = 0; v < s->count; ++v) {
+		struct value *value = &s->values[v];
+		if (value->def == NULL || op_at(value->def)->code != ASN_O)
+			continue;
+
+		struct address src = op_at(value->def)->address[1];
+		struct typeinfo *t = value->address.type;
+		if (src.type->base != t->base || src.type->pointer != t->pointer)
+			continue;
+		if (ssa_value(s, src) == NULL) {
+			if (src.region != CONST_R)
+				continue;
+			bool accepts = true;
+			for (size_t i = 0; i < value->use_count; ++i)
+				accepts &= accepts_const(&value->uses[i]);
+			if (!accepts)
+				continue;
+		}
+
+		ssa_replace(s, value, src);
+		ssa_remove(s, value);
+	}
+}
+
+/*
+ * Returns true if a constant may be used in place of the value at u.
+ * A pointer dereferenced in final code must be in memory, and a
+ * unary operator would run into a negative immediate.
+ */
+static bool accepts_const(struct use *u)
+{
+	if (u->op == NULL)
+		return true;
+	enum opcode code = op_at(u->op)->code;
+	if (code == NEG_O || code == FNEG_O || code == NOT_O)
+		return false;
+	if (code == LSTAR_O)
+		return u->i != 0;
+	if (code == LFIELD_O || code == RFIELD_O)
+		return u->i != 1;
+	return true;
+}
+
+/*
+ * Removes the phis and side-effect free ops defining values which
+ * are never used, until none are left.
+ */
+static void remove_dead(struct ssa *s)
+{
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t v = 0; v < s->count; ++v) {
+			struct value *value = &s->values[v];
+			if (value->use_count > 0 || value->entry)
+				continue;
+			if (value->def) {
+				enum opcode code = op_at(value->def)->code;
+				if (code == CALL_O || code == CALLC_O || code == NEW_O)
+					continue;
+			} else if (value->phi == NULL) {
+				continue;
+			}
+			ssa_remove(s, value);
+			changed = true;
+		}
+	}
+}
+
+/*
+ * Fuses a comparison into a conditional jump on its result, when the
+ * result is a temporary read nowhere else.
+ */
+static bool fuse_branch(struct list *code, struct flow *f, size_t b,
+                        struct list_node *node)
+{
+	/* relations in the order of the comparison opcodes, and inverses */
+	static const enum opcode branches[] = {
+		IFLT_O, IFLE_O, IFGT_O, IFGE_O, IFEQ_O, IFNE_O
+	};
+	static const enum opcode inverses[] = {
+		IFGE_O, IFGT_O, IFLE_O, IFLT_O, IFNE_O, IFEQ_O
+	};
+
+	struct block *block = &f->blocks[b];
+	struct op *op = node->data;
+	if (op->code < LT_O || op->code > FNE_O || node == block->last)
+		return false;
+
+	struct op *jump = node->next->data;
+	struct address t = op->address[0];
+	if ((jump->code != IF_O && jump->code != IFN_O)
+	    || t.region != LOCAL_R || !same_address(jump->address[0], t)
+	    || address_taken(f, t)
+	    || flow_live_after(f, b, node->next, t))
+		return false;
+
+	/* a false float comparison may be unordered, so only == and != invert */
+	int relation = (op->code - LT_O) / 2;
+	bool is_float = (op->code - LT_O) % 2 == 1;
+	if (jump->code == IFN_O && is_float && op->code != FEQ_O
+	    && op->code != FNE_O)
+		return false;
+
+	struct address label = jump->address[1];
+	op->code = (jump->code == IF_O) ? branches[relation] : inverses[relation];
+	op->address[0] = op->address[1];
+	op->address[1] = op->address[2];
+	op->address[2] = label;
+	delete_next(code, block, node);
+	return true;
+}
+
+/*
+ * Computes a value directly into the variable it is copied to next,
+ * when the temporary it was computed into is read nowhere else.
+ */
+static bool fold_copy(struct list *code, struct flow *f, size_t b,
+                      struct list_node *node)
+{
+	struct block *block = &f->blocks[b];
+	struct op *op = node->data;
+	if (op->code < ADD_O || op->code > RFIELD_O || op_def(op) == NULL
+	    || op_uses(op, 0) || node == block->last)
+		return false;
+
+	struct op *copy = node->next->data;
+	struct address t = op->address[0];
+	struct address x = copy->address[0];
+	if (copy->code != ASN_O || t.region != LOCAL_R
+	    || !same_address(copy->address[1], t) || address_overlaps(x, t)
+	    || x.type->base != t.type->base || x.type->pointer != t.type->pointer
+	    || address_taken(f, t)
+	    || flow_live_after(f, b, node->next, t))
+		return false;
+
+	op->address[0] = x;
+	delete_next(code, block, node);
+	return true;
+}
+
+/*
+ * Replaces adding or subtracting one from an integer in place with an
+ * increment or decrement.
+ */
+static bool collapse_increment(struct list *code, struct flow *f, size_t b,
+                               struct list_node *node)
+{
+	struct op *op = node->data;
+	struct address x = op->address[0];
+	struct address c = op->address[2];
+	if ((op->code != ADD_O && op->code != SUB_O) || !is_int(x)
+	    || !same_address(op->address[1], x) || !is_const(c)
+	    || (c.offset != 1 && c.offset != -1))
+		return false;
+
+	op->code = ((op->code == ADD_O) == (c.offset == 1)) ? INC_O : DEC_O;
+	op->address[1] = e;
+	op->address[2] = e;
+	return true;
+}
+
+/*
+ * Deletes the op after node, which ends block if it ended before.
+ */
+static void delete_next(struct list *code, struct block *block,
+                        struct list_node *node)
+{
+	if (node->next == block->last)
+		block->last = node;
+	delete_op(code, node->next);
+}
+
+/*
+ * Returns true if a and b are the same memory of the same type.
+ */
+static bool same_address(struct address a, struct address b)
+{
+	return a.region == b.region && a.offset == b.offset
+		&& a.type->base == b.type->base
+		&& a.type->pointer == b.type->pointer;
+}
+
+/*
+ * Tests the case of the table at node whose label was reached most
+ * before the table, if that was at least half as often as the table.
+ */
+static void peel_case(struct list *code, struct list_node **labels,
+                      struct list_node *node)
+{
+	struct op *table = node->data;
+	struct op *hot = NULL;
+	unsigned long most = 0;
+	struct list_node *iter = node;
+	for (int i = 0; i < table->address[1].offset; ++i) {
+		iter = iter->next;
+		struct op *entry = iter->data;
+		struct list_node *label = labels[entry->address[1].offset];
+		if (label && op_at(label)->count > most) {
+			most = op_at(label)->count;
+			hot = entry;
+		}
+	}
+	if (hot == NULL || most * 2 < table->count)
+		return;
+
+	log_debug("testing case %d before its table", hot->address[0].offset);
+	insert_op(code, node, IFEQ_O, table->address[0], hot->address[0],
+	          hot->address[1]);
+}
+
+/*
+ * Moves each run of blocks of the procedure at proc never entered in
+ * the profile, but the entry block, to the end of the procedure.
+ */
+static void move_cold(struct list *code, struct list_node *proc)
+{
+	struct flow *f = flow_new(proc);
+	struct list *cold = list_new(NULL, NULL);
+	log_assert(cold);
+
+	for (size_t b = 1; b < f->count; ++b) {
+		if (op_at(f->blocks[b].first)->count > 0)
+			continue;
+		size_t r = b;
+		while (r + 1 < f->count && op_at(f->blocks[r + 1].first)->count == 0)
+			++r;
+		struct list_node *first = f->blocks[b].first;
+		struct list_node *last = f->blocks[r].last;
+		b = r;
+
+		/* entered and left only by jumps */
+		first = label_before(code, first);
+		if (falls_through(op_at(first->prev)))
+			insert_op(code, first, GOTO_O, op_at(first)->address[0], e, e);
+		if (falls_through(op_at(last))) {
+			struct list_node *next = label_before(code, last->next);
+			insert_op(code, next, GOTO_O, op_at(next)->address[0], e, e);
+			last = next->prev;
+		}
+
+		log_debug("moving cold blocks of %s", op_at(proc)->name);
+		struct list_node *iter = first;
+		while (true) {
+			struct list_node *next = iter->next;
+			bool end = (iter == last);
+			list_push_back(cold, list_node_unlink(code, iter));
+			if (end)
+				break;
+			iter = next;
+		}
+	}
+
+	if (!list_empty(cold)) {
+		struct list_node *tail = f->end;
+		if (falls_through(op_at(tail->prev))) {
+			tail = label_before(code, tail);
+			insert_op(code, tail, GOTO_O, op_at(tail)->address[0], e, e);
+		}
+		while (!list_empty(cold))
+			list_node_link(code, list_node_new(list_pop_front(cold)), tail);
+	}
+
+	list_free(cold);
+	flow_free(f);
+}
+
+/*
+ * Returns node if it is a label, else a new label inserted before it.
+ */
+static struct list_node *label_before(struct list *code,
+                                      struct list_node *node)
+{
+	if (op_at(node)->code == LABEL_O)
+		return node;
+	struct address label = { LABEL_R, yylabels++, &unknown_type };
+	insert_op(code, node, LABEL_O, label, e, e);
+	return node->prev;
+}
+
+/*
+ * Returns true if control may continue from op to the op after it.
+ */
+static bool falls_through(struct op *op)
+{
+	return !op_jumps(op) && op->code != CASE_O;
+}
+
+#undef op_at
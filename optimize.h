@@ -0,0 +1,35 @@
+/*
+ * optimize.h - Optimization passes over intermediate code.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <stddef.h>
+
+struct list;
+
+/* largest procedure, in ops, to inline */
+#define INLINE_BUDGET 32
+
+/* with a profile, calls made at least 1/INLINE_HOT_RATIO as often as
+   the most frequent call inline procedures of up to INLINE_HOT_BUDGET */
+#define INLINE_HOT_BUDGET 128
+#define INLINE_HOT_RATIO 8
+
+void optimize_inline(struct list *code, size_t budget, size_t hot_budget);
+void optimize_tail_calls(struct list *code);
+void optimize_jumps(struct list *code);
+void optimize_loops(struct list *code);
+void optimize_induction(struct list *code);
+void optimize_strength(struct list *code);
+void optimize_copies(struct list *code);
+void optimize_peephole(struct list *code);
+void optimize_switches(struct list *code);
+void optimize_layout(struct list *code);
+
+#endif /* OPTIMIZE_H */
@@ -0,0 +1,201 @@
+/*
+ * pass.c - Runs the optimization passes selected by a level.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pass.h"
+#include "args.h"
+#include "intermediate.h"
+#include "flow.h"
+#include "optimize.h"
+
+#include "logger.h"
+#include "list.h"
+
+extern size_t yylabels;
+
+static void inline_small(struct list *code);
+static double elapsed(struct timespec *start);
+static void verify_code(struct list *code, const char *after);
+static void verify_proc(struct list_node *proc, bool *defined,
+                        const char *after);
+static void verify_address(struct op *op, struct address a, int frame,
+                           const char *after);
+
+/*
+ * In order; -O1 keeps the local passes, -O2 adds the global ones.
+ * Switches and layout only change code with a profile.
+ */
+static const struct pass passes[] = {
+	{ "inline",     2, inline_small },
+	{ "switches",   2, optimize_switches },
+	{ "tail-calls", 2, optimize_tail_calls },
+	{ "jumps",      1, optimize_jumps },
+	{ "loops",      2, optimize_loops },
+	{ "induction",  2, optimize_induction },
+	{ "strength",   1, optimize_strength },
+	{ "copies",     2, optimize_copies },
+	{ "layout",     2, optimize_layout },
+	{ "jumps",      1, optimize_jumps },
+	{ "peephole",   1, optimize_peephole },
+};
+
+/*
+ * Runs each pass enabled at level over code. In debug mode the code
+ * is verified after every pass, and with --time-passes the time taken
+ * and change in op count of each pass are printed.
+ */
+void pass_run(struct list *code, int level)
+{
+	if (arguments.debug)
+		verify_code(code, "code generation");
+	if (arguments.time_passes)
+		fprintf(stderr, "%-12s %10s %8s %8s\n",
+		        "pass", "ms", "ops", "change");
+
+	double total = 0;
+	size_t initial = list_size(code);
+	for (size_t i = 0; i < sizeof(passes) / sizeof(*passes); ++i) {
+		const struct pass *pass = &passes[i];
+		if (pass->level > level)
+			continue;
+
+		log_debug("running pass %s", pass->name);
+		size_t before = list_size(code);
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		pass->run(code);
+		double ms = elapsed(&start);
+		total += ms;
+
+		if (arguments.debug)
+			verify_code(code, pass->name);
+		if (arguments.time_passes) {
+			size_t after = list_size(code);
+			fprintf(stderr, "%-12s %10.3f %8zu %+8ld\n", pass->name,
+			        ms, after, (long)after - (long)before);
+		}
+	}
+
+	if (arguments.time_passes) {
+		size_t after = list_size(code);
+		fprintf(stderr, "%-12s %10.3f %8zu %+8ld\n", "total",
+		        total, after, (long)after - (long)initial);
+	}
+}
+
+static void inline_small(struct list *code)
+{
+	optimize_inline(code, INLINE_BUDGET, INLINE_HOT_BUDGET);
+}
+
+/*
+ * Returns the milliseconds since start.
+ */
+static double elapsed(struct timespec *start)
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1e3
+		+ (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/*
+ * Checks the invariants later passes and final code rely on: every
+ * procedure ends before the next begins, labels are defined once in
+ * and jumped to only within their procedure, and locals lie in the
+ * frame.
+ */
+static void verify_code(struct list *code, const char *after)
+{
+	bool *defined = calloc(yylabels, sizeof(*defined));
+	log_assert(yylabels == 0 || defined);
+
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *op = iter->data;
+		if (op->code == END_O)
+			log_error("after %s: end outside of a procedure", after);
+		if (op->code == PROC_O) {
+			verify_proc(iter, defined, after);
+			while (((struct op *)iter->data)->code != END_O)
+				iter = iter->next;
+		}
+		iter = iter->next;
+	}
+
+	free(defined);
+}
+
+static void verify_proc(struct list_node *proc, bool *defined,
+                        const char *after)
+{
+	struct op *op = proc->data;
+	char *name = op->name;
+	int frame = op->address[1].offset;
+	if (op->address[0].offset > frame)
+		log_error("after %s: %s has parameters outside its frame",
+		          after, name);
+
+	/* labels of this procedure */
+	struct list_node *iter = proc->next;
+	for (;; iter = iter->next) {
+		if (list_end(iter))
+			log_error("after %s: %s has no end", after, name);
+		op = iter->data;
+		if (op->code == END_O)
+			break;
+		if (op->code == PROC_O)
+			log_error("after %s: %s has no end", after, name);
+		if (op->code != LABEL_O)
+			continue;
+		size_t label = op->address[0].offset;
+		if (label >= yylabels || defined[label])
+			log_error("after %s: label %zu of %s defined twice or "
+			          "out of range", after, label, name);
+		defined[label] = true;
+	}
+
+	for (iter = proc->next; iter->data != op; iter = iter->next) {
+		struct op *o = iter->data;
+		struct address *target = op_target(o);
+		if (target) {
+			size_t label = target->offset;
+			if (target->region != LABEL_R || label >= yylabels
+			    || !defined[label])
+				log_error("after %s: %s jumps to a label "
+				          "outside of it", after, name);
+		}
+		for (int i = 0; i < 3; ++i)
+			verify_address(o, o->address[i], frame, after);
+	}
+
+	/* label numbers are global, so forget this procedure's */
+	for (iter = proc->next; iter->data != op; iter = iter->next) {
+		struct op *o = iter->data;
+		if (o->code == LABEL_O)
+			defined[o->address[0].offset] = false;
+	}
+}
+
+static void verify_address(struct op *op, struct address a, int frame,
+                           const char *after)
+{
+	if (a.region != LOCAL_R && a.region != PARAM_R)
+		return;
+	if (a.offset < 0 || a.offset + (int)typeinfo_size(a.type) > frame) {
+		fprintf(stderr, "in: ");
+		print_op(stderr, op);
+		log_error("after %s: local %d is outside a frame of %d",
+		          after, a.offset, frame);
+	}
+}
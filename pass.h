@@ -0,0 +1,26 @@
+/*
+ * pass.h - Pass manager over intermediate code.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef PASS_H
+#define PASS_H
+
+struct list;
+
+/* highest optimization level, and the default */
+#define OPT_LEVEL_MAX 2
+
+/* an optimization over the code of a whole program */
+struct pass {
+	const char *name;
+	int level;              /* lowest optimization level running it */
+	void (*run)(struct list *code);
+};
+
+void pass_run(struct list *code, int level);
+
+#endif /* PASS_H */
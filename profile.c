@@ -0,0 +1,211 @@
+/*
+ * profile.c - Implementation of profile instrumentation and feedback.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+#include "intermediate.h"
+#include "flow.h"
+
+#include "logger.h"
+#include "list.h"
+#include "hasht.h"
+
+extern struct typeinfo int_type;
+extern const struct address e;
+
+#define op_at(node) ((struct op *)(node)->data)
+
+/*
+ * Counters are numbered in the code as generated, before any pass:
+ * one per basic block of each procedure, and one per call from it to
+ * another procedure of the program. Instrumented programs write each
+ * as a line of their profile at exit:
+ *
+ *     block <procedure> <block> <count>
+ *     call <procedure> <call> <count> <callee>
+ */
+static struct {
+	struct profile_site *sites;
+	size_t count;
+} counters;
+
+static void count_before(struct list *code, struct list_node *node,
+                         char *proc, size_t index, char *callee);
+static void read_counts(struct list_node *proc, struct hasht *counts);
+static unsigned long find_count(struct hasht *counts, char *proc,
+                                size_t index, char *callee);
+
+/*
+ * Inserts a COUNT_O at the start of every basic block, after its
+ * labels, and before every call to a procedure of the program.
+ */
+void profile_instrument(struct list *code)
+{
+	free(counters.sites);
+	counters.sites = NULL;
+	counters.count = 0;
+
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		struct op *proc = iter->data;
+		if (proc->code != PROC_O) {
+			iter = iter->next;
+			continue;
+		}
+
+		struct flow *f = flow_new(iter);
+		for (size_t b = 0; b < f->count; ++b) {
+			struct block *block = &f->blocks[b];
+			struct list_node *node = block->first;
+			while (op_at(node)->code == LABEL_O && node != block->last)
+				node = node->next;
+			if (op_at(node)->code == LABEL_O)
+				node = node->next;
+			count_before(code, node, proc->name, b, NULL);
+		}
+
+		size_t calls = 0;
+		for (iter = iter->next; iter != f->end; iter = iter->next) {
+			struct op *op = iter->data;
+			if (op->code == CALL_O)
+				count_before(code, iter, proc->name, calls++, op->name);
+		}
+		flow_free(f);
+	}
+}
+
+/*
+ * Returns the counters of the code last instrumented.
+ */
+struct profile_site *profile_sites(size_t *count)
+{
+	*count = counters.count;
+	return counters.sites;
+}
+
+/*
+ * Sets the count of each op of code to the times it was run in the
+ * profile at filename: a procedure's to the times it was entered, a
+ * call's to the times it was made, and others' to the times their
+ * block was entered. Ops the profile does not count are left at 0.
+ */
+void profile_read(struct list *code, const char *filename)
+{
+	FILE *file = fopen(filename, "r");
+	if (file == NULL)
+		log_error("could not open profile: %s", filename);
+
+	struct hasht *counts = hasht_new(64, true, NULL, NULL, NULL);
+	log_assert(counts);
+
+	char kind[8], proc[256], callee[256];
+	size_t index;
+	unsigned long count;
+	int fields;
+	while ((fields = fscanf(file, "%7s %255s %zu %lu", kind, proc, &index,
+	                        &count)) == 4) {
+		bool call = (strcmp(kind, "call") == 0);
+		if (call && fscanf(file, "%255s", callee) != 1)
+			break;
+		char *key;
+		asprintf(&key, "%s %s %zu %s", kind, proc, index,
+		         call ? callee : "");
+		unsigned long *value = malloc(sizeof(*value));
+		log_assert(key && value);
+		*value = count;
+		if (hasht_insert(counts, key, value) == NULL) {
+			free(key);
+			free(value);
+		}
+	}
+	if (fields != EOF)
+		log_error("malformed profile: %s", filename);
+	fclose(file);
+
+	struct list_node *iter = list_head(code);
+	while (!list_end(iter)) {
+		if (op_at(iter)->code == PROC_O)
+			read_counts(iter, counts);
+		iter = iter->next;
+	}
+
+	hasht_free(counts);
+}
+
+/*
+ * Inserts a new counter before node.
+ */
+static void count_before(struct list *code, struct list_node *node,
+                         char *proc, size_t index, char *callee)
+{
+	counters.sites = realloc(counters.sites, (counters.count + 1)
+	                         * sizeof(*counters.sites));
+	log_assert(counters.sites);
+	struct profile_site *site = &counters.sites[counters.count];
+	site->proc = proc;
+	site->index = index;
+	site->callee = callee;
+
+	struct op *op = calloc(1, sizeof(*op));
+	log_assert(op);
+	struct address n = { CONST_R, counters.count++, &int_type };
+	op->code = COUNT_O;
+	op->address[0] = n;
+	op->address[1] = e;
+	op->address[2] = e;
+	list_node_link(code, list_node_new(op), node);
+}
+
+/*
+ * Counts the ops of the procedure at proc as they were instrumented.
+ */
+static void read_counts(struct list_node *proc, struct hasht *counts)
+{
+	struct op *op = proc->data;
+	struct flow *f = flow_new(proc);
+	for (size_t b = 0; b < f->count; ++b) {
+		struct block *block = &f->blocks[b];
+		unsigned long count = find_count(counts, op->name, b, NULL);
+		if (b == 0)
+			op->count = count;
+		for (struct list_node *iter = block->first; iter;
+		     iter = block_next(block, iter))
+			op_at(iter)->count = count;
+	}
+
+	size_t calls = 0;
+	for (struct list_node *iter = proc->next; iter != f->end;
+	     iter = iter->next) {
+		struct op *call = iter->data;
+		if (call->code == CALL_O)
+			call->count = find_count(counts, op->name, calls++,
+			                         call->name);
+	}
+	flow_free(f);
+}
+
+/*
+ * Returns the count of a block, or a call to callee, in the profile.
+ */
+static unsigned long find_count(struct hasht *counts, char *proc,
+                                size_t index, char *callee)
+{
+	char *key;
+	asprintf(&key, "%s %s %zu %s", callee ? "call" : "block", proc, index,
+	         callee ? callee : "");
+	log_assert(key);
+	unsigned long *count = hasht_search(counts, key);
+	free(key);
+	return count ? *count : 0;
+}
+
+#undef op_at
@@ -0,0 +1,27 @@
+/*
+ * profile.h - Profile instrumentation and feedback.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+
+struct list;
+
+/* what a profile counter counts, by its place in the generated code */
+struct profile_site {
+	char *proc;
+	size_t index;  /* of the block, or call, in proc */
+	char *callee;  /* of a call edge, else NULL for a block */
+};
+
+void profile_instrument(struct list *code);
+struct profile_site *profile_sites(size_t *count);
+void profile_read(struct list *code, const char *filename);
+
+#endif /* PROFILE_H */
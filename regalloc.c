@@ -0,0 +1,363 @@
+/*
+ * regalloc.c - Implementation of linear scan register allocation.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "regalloc.h"
+#include "flow.h"
+#include "intermediate.h"
+#include "type.h"
+
+#include "logger.h"
+#include "list.h"
+
+#define op_at(node) ((struct op *)(node)->data)
+
+static void find_intervals(struct regalloc *r, struct list_node *proc,
+                           regalloc_class class, size_t *vars);
+static void extend(struct interval *i, int position);
+static size_t find_var(struct regalloc *r, size_t *vars, struct address a);
+static void find_live_ranges(struct regalloc *r, struct list_node *proc,
+                             size_t *vars);
+static bool *find_liveness(struct regalloc *r, struct flow *f,
+                           size_t *vars, bool **live_in);
+static void find_pressure(struct regalloc *r);
+static void scan(struct regalloc *r);
+static int compare_starts(const void *a, const void *b);
+
+/*
+ * Builds the live interval of each local in the procedure at proc
+ * which class puts in a register class, then allocates registers
+ * to them, at most registers of each class. Intervals are scanned
+ * by start; when a class runs out, the interval ending last is
+ * spilled, staying at its offset in the frame.
+ */
+struct regalloc *regalloc_new(struct list_node *proc, int registers,
+                              regalloc_class class)
+{
+	log_assert(op_at(proc)->code == PROC_O);
+
+	struct regalloc *r = calloc(1, sizeof(*r));
+	log_assert(r);
+	r->frame = op_at(proc)->address[1].offset;
+	r->registers = registers;
+	r->regs = calloc(r->frame + 1, sizeof(*r->regs));
+	size_t *vars = calloc(r->frame + 1, sizeof(*vars));
+	log_assert(r->regs && vars);
+
+	find_intervals(r, proc, class, vars);
+	if (r->count > 0)
+		find_live_ranges(r, proc, vars);
+	free(vars);
+
+	find_pressure(r);
+	scan(r);
+
+	for (size_t i = 0; i < r->count; ++i) {
+		struct interval *v = &r->intervals[i];
+		r->regs[v->local.offset] = v->reg + 1;
+	}
+	return r;
+}
+
+void regalloc_free(struct regalloc *r)
+{
+	if (r == NULL)
+		return;
+	free(r->intervals);
+	free(r->regs);
+	free(r);
+}
+
+/*
+ * Returns the register of local a, else -1 if it is kept in memory.
+ */
+int regalloc_register(struct regalloc *r, struct address a)
+{
+	if (r == NULL || (a.region != LOCAL_R && a.region != PARAM_R)
+	    || a.offset < 0 || a.offset >= r->frame)
+		return -1;
+	return r->regs[a.offset] - 1;
+}
+
+/*
+ * Prints the statistics of allocation for the procedure name, or
+ * their header given no allocation.
+ */
+void regalloc_print(FILE *stream, const char *name, struct regalloc *r)
+{
+	if (r == NULL) {
+		fprintf(stream, "%-24s %9s %8s %9s %6s\n",
+		        "procedure", "intervals", "pressure", "registers",
+		        "spills");
+		return;
+	}
+	fprintf(stream, "%-24s %9zu %8d %9d %6zu\n",
+	        name, r->count, r->pressure, r->used, r->spills);
+}
+
+/*
+ * Gives each local in a register class an interval, covering every
+ * op accessing it. Parameters are stored on entry, so theirs start
+ * at the procedure.
+ */
+static void find_intervals(struct regalloc *r, struct list_node *proc,
+                           regalloc_class class, size_t *vars)
+{
+	int params = op_at(proc)->address[0].offset;
+	int position = 0;
+	for (struct list_node *iter = proc; ; iter = iter->next) {
+		struct op *op = iter->data;
+		for (int i = 0; i < 3; ++i) {
+			struct address a = op->address[i];
+			if ((a.region != LOCAL_R && a.region != PARAM_R)
+			    || a.offset < 0 || a.offset >= r->frame)
+				continue;
+			size_t v = vars[a.offset];
+			if (v == 0) {
+				int c = class(a);
+				if (c < 0)
+					continue;
+				r->intervals = realloc(r->intervals, (r->count + 1)
+				                       * sizeof(*r->intervals));
+				log_assert(r->intervals);
+				struct interval *n = &r->intervals[r->count];
+				n->local = a;
+				n->class = c;
+				n->start = (a.offset < params) ? 0 : INT_MAX;
+				n->end = -1;
+				n->reg = -1;
+				if (c >= r->classes)
+					r->classes = c + 1;
+				v = vars[a.offset] = ++r->count;
+			}
+			extend(&r->intervals[v - 1], position);
+		}
+		if (op->code == END_O)
+			break;
+		++position;
+	}
+}
+
+static void extend(struct interval *i, int position)
+{
+	if (position < i->start)
+		i->start = position;
+	if (position > i->end)
+		i->end = position;
+}
+
+/* returns the index + 1 of the interval of a, else 0 */
+static size_t find_var(struct regalloc *r, size_t *vars, struct address a)
+{
+	if ((a.region != LOCAL_R && a.region != PARAM_R)
+	    || a.offset < 0 || a.offset >= r->frame)
+		return 0;
+	return vars[a.offset];
+}
+
+/*
+ * Extends each interval over the blocks it is live into or out of,
+ * so that it covers every op between a definition and a use.
+ */
+static void find_live_ranges(struct regalloc *r, struct list_node *proc,
+                             size_t *vars)
+{
+	struct flow *f = flow_new(proc);
+	size_t n = f->count;
+	int *starts = calloc(n + 1, sizeof(*starts));
+	int *ends = calloc(n + 1, sizeof(*ends));
+	log_assert(starts && ends);
+
+	/* blocks are in code order, after the procedure */
+	size_t b = 0;
+	int position = 1;
+	for (struct list_node *iter = proc->next; b < n; iter = iter->next) {
+		if (iter == f->blocks[b].first)
+			starts[b] = position;
+		if (iter == f->blocks[b].last)
+			ends[b++] = position;
+		++position;
+	}
+
+	bool *live_in;
+	bool *live_out = find_liveness(r, f, vars, &live_in);
+	for (size_t x = 0; x < n; ++x) {
+		for (size_t v = 0; v < r->count; ++v) {
+			if (live_in[x * r->count + v])
+				extend(&r->intervals[v], starts[x]);
+			if (live_out[x * r->count + v])
+				extend(&r->intervals[v], ends[x]);
+		}
+	}
+
+	free(live_out);
+	free(live_in);
+	free(ends);
+	free(starts);
+	flow_free(f);
+}
+
+/*
+ * Returns the locals live out of each block, where
+ * live_out[x * count + v] iff v is live out of x, setting live_in
+ * likewise.
+ */
+static bool *find_liveness(struct regalloc *r, struct flow *f,
+                           size_t *vars, bool **live_in)
+{
+	size_t n = f->count;
+	size_t count = r->count;
+	bool *uses = calloc(n * count, sizeof(*uses));
+	bool *defs = calloc(n * count, sizeof(*defs));
+	bool *in = calloc(n * count, sizeof(*in));
+	bool *live_out = calloc(n * count, sizeof(*live_out));
+	log_assert(n * count == 0 || (uses && defs && in && live_out));
+
+	for (size_t x = 0; x < n; ++x) {
+		struct block *block = &f->blocks[x];
+		if (!block->reachable)
+			continue;
+		for (struct list_node *iter = block->first; iter;
+		     iter = block_next(block, iter)) {
+			struct op *op = iter->data;
+			for (int i = 0; i < 3; ++i) {
+				size_t v = op_uses(op, i)
+					? find_var(r, vars, op->address[i]) : 0;
+				if (v && !defs[x * count + v - 1])
+					uses[x * count + v - 1] = true;
+			}
+			struct address *def = op_def(op);
+			size_t v = def ? find_var(r, vars, *def) : 0;
+			if (v)
+				defs[x * count + v - 1] = true;
+		}
+	}
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t x = n; x-- > 0;) {
+			struct block *block = &f->blocks[x];
+			if (!block->reachable)
+				continue;
+			bool *out = &live_out[x * count];
+			for (size_t i = 0; i < block->succ_count; ++i) {
+				size_t y = block->succs[i];
+				for (size_t v = 0; v < count; ++v)
+					if (in[y * count + v] && !out[v])
+						out[v] = changed = true;
+			}
+			for (size_t v = 0; v < count; ++v) {
+				bool live = uses[x * count + v]
+					|| (out[v] && !defs[x * count + v]);
+				if (live && !in[x * count + v])
+					in[x * count + v] = changed = true;
+			}
+		}
+	}
+
+	free(defs);
+	free(uses);
+	*live_in = in;
+	return live_out;
+}
+
+/* finds the most intervals live at the start of any one */
+static void find_pressure(struct regalloc *r)
+{
+	r->pressure = 0;
+	for (size_t i = 0; i < r->count; ++i) {
+		int live = 0;
+		for (size_t j = 0; j < r->count; ++j)
+			if (r->intervals[j].start <= r->intervals[i].start
+			    && r->intervals[j].end >= r->intervals[i].start)
+				++live;
+		if (live > r->pressure)
+			r->pressure = live;
+	}
+}
+
+/*
+ * Allocates registers over the intervals in order of start. An
+ * active interval expires only once it ends before another starts,
+ * as an op may write its result before it has read all of its
+ * operands.
+ */
+static void scan(struct regalloc *r)
+{
+	if (r->count > 0)
+		qsort(r->intervals, r->count, sizeof(*r->intervals),
+		      &compare_starts);
+
+	int total = r->classes * r->registers;
+	bool *busy = calloc(total + 1, sizeof(*busy));
+	bool *used = calloc(total + 1, sizeof(*used));
+	struct interval **active = calloc(r->count + 1, sizeof(*active));
+	log_assert(busy && used && active);
+	size_t count = 0;
+
+	for (size_t i = 0; i < r->count; ++i) {
+		struct interval *v = &r->intervals[i];
+
+		/* expire old intervals */
+		size_t kept = 0;
+		for (size_t j = 0; j < count; ++j) {
+			if (active[j]->end < v->start)
+				busy[active[j]->reg] = false;
+			else
+				active[kept++] = active[j];
+		}
+		count = kept;
+
+		int base = v->class * r->registers;
+		for (int k = 0; k < r->registers && v->reg < 0; ++k)
+			if (!busy[base + k])
+				v->reg = base + k;
+
+		if (v->reg < 0) {
+			/* spill whichever of its class ends last */
+			size_t last = count;
+			for (size_t j = 0; j < count; ++j)
+				if (active[j]->class == v->class
+				    && (last == count || active[j]->end > active[last]->end))
+					last = j;
+			++r->spills;
+			if (last == count || active[last]->end <= v->end)
+				continue;
+			v->reg = active[last]->reg;
+			active[last]->reg = -1;
+			active[last] = active[--count];
+		}
+
+		busy[v->reg] = true;
+		used[v->reg] = true;
+		active[count++] = v;
+	}
+
+	r->used = 0;
+	for (int k = 0; k < total; ++k)
+		if (used[k])
+			++r->used;
+
+	free(active);
+	free(used);
+	free(busy);
+}
+
+static int compare_starts(const void *a, const void *b)
+{
+	const struct interval *x = a;
+	const struct interval *y = b;
+	if (x->start != y->start)
+		return (x->start < y->start) ? -1 : 1;
+	return x->local.offset - y->local.offset;
+}
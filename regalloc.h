@@ -0,0 +1,56 @@
+/*
+ * regalloc.h - Linear scan register allocation of locals.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "type.h"
+
+struct list_node;
+
+/* registers of each class available to a procedure */
+#define REGALLOC_REGISTERS 8
+
+/*
+ * Returns the register class of local a, such as its C type or its
+ * machine register file, else -1 if it cannot live in a register.
+ */
+typedef int (*regalloc_class)(struct address a);
+
+/* where a local is live, over ops numbered from PROC_O in code order */
+struct interval {
+	struct address local;
+	int class;
+	int start;
+	int end;
+	int reg;                /* class * registers + index, else -1 */
+};
+
+struct regalloc {
+	struct interval *intervals; /* by start */
+	size_t count;
+	int *regs;              /* register + 1 by local offset, else 0 */
+	int frame;
+	int registers;          /* of each class */
+	int classes;
+	int used;               /* registers given to any interval */
+	int pressure;           /* most intervals live at one op */
+	size_t spills;          /* intervals left in the frame */
+};
+
+struct regalloc *regalloc_new(struct list_node *proc, int registers,
+                              regalloc_class class);
+void regalloc_free(struct regalloc *r);
+int regalloc_register(struct regalloc *r, struct address a);
+void regalloc_print(FILE *stream, const char *name, struct regalloc *r);
+
+#endif /* REGALLOC_H */
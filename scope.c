@@ -7,12 +7,18 @@
  */
 
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "scope.h"
 #include "symbol.h"
+#include "logger.h"
 #include "list.h"
 #include "hasht.h"
 
+static bool takes_space(struct hasht_node *slot);
+
 /*
  * Search the stack of scopes for a given identifier.
  */
@@ -32,7 +38,34 @@ struct typeinfo *scope_search(char *k)
 }
 
 /*
- * Returns sum of sizes of symbols in scope.
+ * Returns the function type of the procedure named name in the
+ * global scope, Class__method for members, else NULL.
+ */
+struct typeinfo *scope_procedure(char *name)
+{
+	struct hasht *global = list_index(yyscopes, 1)->data;
+	struct typeinfo *t = NULL;
+	char *split = strstr(name, "__");
+	if (split == NULL) {
+		t = hasht_search(global, name);
+	} else {
+		char *class = strndup(name, split - name);
+		log_assert(class);
+		struct typeinfo *c = hasht_search(global, class);
+		free(class);
+		if (c && c->base == CLASS_T) {
+			if (c->class.public)
+				t = hasht_search(c->class.public, split + 2);
+			if (t == NULL && c->class.private)
+				t = hasht_search(c->class.private, split + 2);
+		}
+	}
+	return (t && t->base == FUNCTION_T) ? t : NULL;
+}
+
+/*
+ * Returns size of region spanned by the symbols in scope, from its
+ * start to the end of the last symbol.
  *
  * This is sadly highly coupled with my hash table implementation
  * since it does not (yet) have an iterable interface.
@@ -45,9 +78,43 @@ size_t scope_size(struct hasht *t)
 	size_t total = 0;
 	for (size_t i = 0; i < t->size; ++i) {
 		struct hasht_node *slot = t->table[i];
-		if (slot && !hasht_node_deleted(slot)) {
-			total += typeinfo_size(slot->value);
+		if (slot && !hasht_node_deleted(slot) && takes_space(slot)) {
+			struct typeinfo *v = slot->value;
+			size_t end = v->place.offset + typeinfo_size(v);
+			if (end > total)
+				total = end;
 		}
 	}
 	return total;
 }
+
+/*
+ * Returns largest alignment of symbols in scope, at least 1.
+ */
+size_t scope_align(struct hasht *t)
+{
+	size_t align = 1;
+	for (size_t i = 0; t && i < t->size; ++i) {
+		struct hasht_node *slot = t->table[i];
+		if (slot && !hasht_node_deleted(slot) && takes_space(slot)) {
+			size_t a = typeinfo_align(slot->value);
+			if (a > align)
+				align = a;
+		}
+	}
+	return align;
+}
+
+/*
+ * Functions and class definitions have no place in their region.
+ */
+static bool takes_space(struct hasht_node *slot)
+{
+	struct typeinfo *v = slot->value;
+	if (v->base == FUNCTION_T)
+		return false;
+	if (v->base == CLASS_T && !v->pointer && v->class.type
+	    && strcmp(v->class.type, slot->key) == 0)
+		return false;
+	return true;
+}
@@ -22,6 +22,8 @@ extern struct list *yyscopes;
 #define scope_pop() list_pop_back(yyscopes)
 
 struct typeinfo *scope_search(char *k);
+struct typeinfo *scope_procedure(char *name);
 size_t scope_size(struct hasht *t);
+size_t scope_align(struct hasht *t);
 
 #endif /* SCOPE_H */
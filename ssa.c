@@ -0,0 +1,1198 @@
+/*
+ * ssa.c - Implementation of static single assignment form.
+ *
+ * Locals whose every access is to the same bytes as the same type,
+ * and whose address is never taken, are renamed so that each
+ * definition writes a new slot of the frame. Phi functions are kept
+ * beside the code, and are replaced by copies on destruction, after
+ * the values which never interfere are coalesced back into shared
+ * slots.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ssa.h"
+#include "flow.h"
+#include "intermediate.h"
+#include "type.h"
+
+#include "logger.h"
+#include "list.h"
+
+extern size_t yylabels;
+extern struct typeinfo unknown_type;
+extern const struct address e;
+
+#define op_at(node) ((struct op *)(node)->data)
+
+#define NONE SIZE_MAX
+
+/* a local being renamed */
+struct var {
+	struct address local;
+	bool promoted;
+	bool global;        /* read in some block before written there */
+	size_t *stack;      /* current value last */
+	size_t top;
+};
+
+/* state of construction */
+struct builder {
+	struct ssa *s;
+	struct op *proc;
+	struct var *vars;
+	size_t var_count;
+	size_t *var_at;     /* var index + 1 by local offset */
+	size_t *idom;
+};
+
+/* state of destruction */
+struct coalescer {
+	struct ssa *s;
+	size_t count;
+	bool *interferes;   /* interferes[v * count + w] */
+	size_t *parent;     /* union-find of coalesced values */
+	size_t *next;       /* circular list of each class */
+	int *slot;          /* by class root */
+	int frame;          /* end of the slots in use */
+};
+
+/* a copy on an edge, part of a parallel assignment */
+struct move {
+	struct address dst;
+	struct address src;
+};
+
+static bool is_local(struct address a);
+static bool is_promotable(struct typeinfo *t);
+static bool same_type(struct typeinfo *a, struct typeinfo *b);
+static bool same_slot(struct address a, struct address b);
+static bool is_dead(struct ssa *s, struct list_node *node);
+
+static void find_vars(struct builder *b);
+static void add_access(struct builder *b, bool *taken, struct address a);
+static void mark_bytes(bool *bytes, int frame, int offset, size_t size);
+static struct var *find_var(struct builder *b, struct address a);
+static size_t new_value(struct builder *b, struct var *var);
+static void add_use(struct ssa *s, size_t v, struct list_node *op,
+                    struct phi *phi, int i);
+static void drop_use(struct ssa *s, struct address a, struct list_node *op,
+                     struct phi *phi, int i);
+static void find_idoms(struct builder *b);
+static bool *find_frontiers(struct builder *b);
+static void place_phis(struct builder *b, bool *frontiers);
+static void rename_block(struct builder *b, size_t x);
+
+static bool *find_liveness(struct ssa *s);
+static void find_interference(struct coalescer *c, bool *live_out);
+static void interfere(struct coalescer *c, size_t v, size_t w);
+static size_t find_class(struct coalescer *c, size_t v);
+static bool coalesce(struct coalescer *c, size_t v, size_t w);
+static bool classes_interfere(struct coalescer *c, size_t v, size_t w);
+static bool slot_free(struct coalescer *c, size_t root, int offset);
+static void assign_slots(struct coalescer *c);
+static void rewrite_values(struct coalescer *c);
+static void insert_copies(struct list *code, struct coalescer *c);
+static void emit_moves(struct list *code, struct coalescer *c,
+                       struct list_node *before, struct move *moves,
+                       size_t count);
+static void insert_op(struct list *code, struct list_node *before,
+                      enum opcode code_, struct address a, struct address b);
+
+/*
+ * Puts the procedure at proc into SSA form. The code is renamed in
+ * place, and stays valid for final code except for the phis.
+ */
+struct ssa *ssa_new(struct list_node *proc)
+{
+	struct ssa *s = calloc(1, sizeof(*s));
+	log_assert(s);
+	s->flow = flow_new(proc);
+	s->phis = calloc(s->flow->count, sizeof(*s->phis));
+	s->dead = list_new(NULL, NULL);
+	log_assert((s->flow->count == 0 || s->phis) && s->dead);
+
+	struct builder b = { s, proc->data, NULL, 0, NULL, NULL };
+	s->frame = b.proc->address[1].offset;
+	find_vars(&b);
+
+	/* every local first holds its value from entry */
+	for (size_t i = 0; i < b.var_count; ++i) {
+		struct var *var = &b.vars[i];
+		if (!var->promoted)
+			continue;
+		s->values = realloc(s->values, (s->count + 1) * sizeof(*s->values));
+		log_assert(s->values);
+		struct value *v = &s->values[s->count];
+		memset(v, 0, sizeof(*v));
+		v->address = var->local;
+		v->local = var->local;
+		v->entry = true;
+		var->stack = malloc(sizeof(*var->stack));
+		log_assert(var->stack);
+		var->stack[var->top++] = s->count++;
+	}
+
+	if (s->flow->count > 0) {
+		find_idoms(&b);
+		bool *frontiers = find_frontiers(&b);
+		place_phis(&b, frontiers);
+		free(frontiers);
+
+		struct block *entry = &s->flow->blocks[0];
+		for (struct phi *phi = s->phis[0]; phi; phi = phi->next) {
+			size_t v = find_var(&b, phi->local)->stack[0];
+			phi->args[entry->pred_count] = s->values[v].address;
+			add_use(s, v, NULL, phi, entry->pred_count);
+		}
+		rename_block(&b, 0);
+	}
+
+	s->size = b.proc->address[1].offset;
+	s->slots = calloc(s->size, sizeof(*s->slots));
+	log_assert(s->size == 0 || s->slots);
+	for (size_t i = 0; i < s->count; ++i)
+		s->slots[s->values[i].address.offset] = i + 1;
+
+	for (size_t i = 0; i < b.var_count; ++i)
+		free(b.vars[i].stack);
+	free(b.vars);
+	free(b.var_at);
+	free(b.idom);
+	return s;
+}
+
+/*
+ * Takes the procedure out of SSA form and frees s. Values which do
+ * not interfere share slots, preferring those of their locals, and
+ * each phi becomes copies on the edges into its block.
+ */
+void ssa_destroy(struct list *code, struct ssa *s)
+{
+	struct coalescer c = { s, s->count, NULL, NULL, NULL, NULL, s->frame };
+	c.interferes = calloc(c.count * c.count, sizeof(*c.interferes));
+	c.parent = malloc(c.count * sizeof(*c.parent));
+	c.next = malloc(c.count * sizeof(*c.next));
+	c.slot = malloc(c.count * sizeof(*c.slot));
+	log_assert(c.count == 0
+	           || (c.interferes && c.parent && c.next && c.slot));
+	for (size_t v = 0; v < c.count; ++v) {
+		c.parent[v] = v;
+		c.next[v] = v;
+		c.slot[v] = -1;
+	}
+
+	bool *live_out = find_liveness(s);
+	find_interference(&c, live_out);
+	free(live_out);
+
+	/* phis first, so that their copies are the ones removed */
+	for (size_t b = 0; b < s->flow->count; ++b)
+		for (struct phi *phi = s->phis[b]; phi; phi = phi->next) {
+			struct value *r = ssa_value(s, phi->result);
+			for (size_t j = 0; j < s->flow->blocks[b].pred_count + (b == 0);
+			     ++j) {
+				struct value *a = ssa_value(s, phi->args[j]);
+				if (a)
+					coalesce(&c, r - s->values, a - s->values);
+			}
+		}
+	for (size_t v = 0; v < c.count; ++v) {
+		struct list_node *def = s->values[v].def;
+		if (def && op_at(def)->code == ASN_O) {
+			struct value *a = ssa_value(s, op_at(def)->address[1]);
+			if (a)
+				coalesce(&c, v, a - s->values);
+		}
+	}
+
+	assign_slots(&c);
+	rewrite_values(&c);
+	insert_copies(code, &c);
+	op_at(s->flow->proc)->address[1].offset = c.frame;
+
+	while (!list_empty(s->dead))
+		free(list_node_unlink(code, list_pop_front(s->dead)));
+
+	/* copies between coalesced values are now to themselves */
+	struct list_node *iter = s->flow->proc->next;
+	while (op_at(iter)->code != END_O) {
+		struct op *op = iter->data;
+		struct list_node *next = iter->next;
+		if (op->code == ASN_O && same_slot(op->address[0], op->address[1])
+		    && same_type(op->address[0].type, op->address[1].type))
+			free(list_node_unlink(code, iter));
+		iter = next;
+	}
+
+	for (size_t b = 0; b < s->flow->count; ++b) {
+		struct phi *phi = s->phis[b];
+		while (phi) {
+			struct phi *next = phi->next;
+			free(phi->args);
+			free(phi);
+			phi = next;
+		}
+	}
+	for (size_t v = 0; v < s->count; ++v)
+		free(s->values[v].uses);
+	free(c.interferes);
+	free(c.parent);
+	free(c.next);
+	free(c.slot);
+	list_free(s->dead);
+	free(s->values);
+	free(s->slots);
+	free(s->phis);
+	flow_free(s->flow);
+	free(s);
+}
+
+/*
+ * Returns the value held at address a, else NULL if it is not one.
+ */
+struct value *ssa_value(struct ssa *s, struct address a)
+{
+	if (!is_local(a) || a.offset < 0 || a.offset >= s->size
+	    || s->slots[a.offset] == 0)
+		return NULL;
+	return &s->values[s->slots[a.offset] - 1];
+}
+
+/*
+ * Replaces every use of v with a, a value or constant of its type.
+ */
+void ssa_replace(struct ssa *s, struct value *v, struct address a)
+{
+	struct value *w = ssa_value(s, a);
+	log_assert(w != v);
+	size_t index = w ? (size_t)(w - s->values) : NONE;
+	for (size_t i = 0; i < v->use_count; ++i) {
+		struct use *u = &v->uses[i];
+		struct address *t = u->op ? &op_at(u->op)->address[u->i]
+			: &u->phi->args[u->i];
+		t->region = a.region;
+		t->offset = a.offset;
+		if (index != NONE)
+			add_use(s, index, u->op, u->phi, u->i);
+	}
+	v->use_count = 0;
+}
+
+/*
+ * Removes the definition of v, which must have no uses. Its op is
+ * kept in code until destruction, so that blocks keep their bounds.
+ */
+void ssa_remove(struct ssa *s, struct value *v)
+{
+	log_assert(v->use_count == 0 && !v->entry);
+	if (v->def) {
+		struct op *op = op_at(v->def);
+		for (int i = 0; i < 3; ++i)
+			if (op_uses(op, i))
+				drop_use(s, op->address[i], v->def, NULL, i);
+		list_push_back(s->dead, v->def);
+		v->def = NULL;
+	} else if (v->phi) {
+		struct phi *phi = v->phi;
+		struct block *block = &s->flow->blocks[phi->block];
+		for (size_t j = 0; j < block->pred_count + (phi->block == 0); ++j)
+			drop_use(s, phi->args[j], NULL, phi, j);
+
+		struct phi **link = &s->phis[phi->block];
+		while (*link != phi)
+			link = &(*link)->next;
+		*link = phi->next;
+		free(phi->args);
+		free(phi);
+		v->phi = NULL;
+	}
+}
+
+static bool is_local(struct address a)
+{
+	return a.region == LOCAL_R || a.region == PARAM_R;
+}
+
+/*
+ * Returns true if values of type t may be renamed. Character
+ * pointers are excluded, as returning one returns its slot.
+ */
+static bool is_promotable(struct typeinfo *t)
+{
+	if (t->pointer)
+		return t->base != CHAR_T;
+	return t->base == INT_T || t->base == FLOAT_T || t->base == CHAR_T
+		|| t->base == BOOL_T;
+}
+
+static bool same_type(struct typeinfo *a, struct typeinfo *b)
+{
+	return a->base == b->base && a->pointer == b->pointer;
+}
+
+static bool same_slot(struct address a, struct address b)
+{
+	return is_local(a) && is_local(b) && a.offset == b.offset;
+}
+
+/*
+ * Returns true if the op at node was removed.
+ */
+static bool is_dead(struct ssa *s, struct list_node *node)
+{
+	struct address *def = op_def(node->data);
+	if (def == NULL)
+		return false;
+	struct value *v = ssa_value(s, *def);
+	return v && v->def != node;
+}
+
+/*
+ * Finds the locals of the procedure, promoting those with a single
+ * type and extent which never overlap another or have their address
+ * taken.
+ */
+static void find_vars(struct builder *b)
+{
+	int frame = b->s->frame;
+	b->var_at = calloc(frame, sizeof(*b->var_at));
+	bool *taken = calloc(frame, sizeof(*taken));
+	log_assert(frame == 0 || (b->var_at && taken));
+
+	/* a member's instance is read through the slot at the front */
+	if (strstr(b->proc->name, "__"))
+		mark_bytes(taken, frame, 0, sizeof(void *));
+
+	struct list_node *iter = b->s->flow->proc->next;
+	while (op_at(iter)->code != END_O) {
+		struct op *op = iter->data;
+		struct address *def = op_def(op);
+		for (int i = 0; i < 3; ++i) {
+			struct address a = op->address[i];
+			if (!is_local(a))
+				continue;
+			if (op_uses(op, i) && def == &op->address[i])
+				/* updated in place, so it cannot be renamed */
+				mark_bytes(taken, frame, a.offset, typeinfo_size(a.type));
+			else if (op_uses(op, i) || def == &op->address[i])
+				add_access(b, taken, a);
+			else if (i == 1 && (op->code == ADDR_O || op->code == LARR_O
+			                    || op->code == RARR_O))
+				mark_bytes(taken, frame, a.offset, typeinfo_size(a.type));
+		}
+		iter = iter->next;
+	}
+
+	size_t *owner = calloc(frame, sizeof(*owner));
+	log_assert(frame == 0 || owner);
+	for (size_t i = 0; i < b->var_count; ++i) {
+		struct var *var = &b->vars[i];
+		size_t size = typeinfo_size(var->local.type);
+		for (size_t k = 0; k < size; ++k) {
+			int byte = var->local.offset + k;
+			if (owner[byte]) {
+				var->promoted = false;
+				b->vars[owner[byte] - 1].promoted = false;
+			} else {
+				owner[byte] = i + 1;
+			}
+			if (taken[byte])
+				var->promoted = false;
+		}
+	}
+	for (size_t i = 0; i < b->var_count; ++i)
+		if (!b->vars[i].promoted)
+			b->var_at[b->vars[i].local.offset] = 0;
+
+	free(owner);
+	free(taken);
+}
+
+/*
+ * Records an access of a, which disqualifies any local it does not
+ * match exactly.
+ */
+static void add_access(struct builder *b, bool *taken, struct address a)
+{
+	int frame = b->s->frame;
+	size_t size = typeinfo_size(a.type);
+	if (a.offset < 0 || size == 0 || a.offset + (int)size > frame) {
+		/* cannot be tracked, and neither can what it overlaps */
+		mark_bytes(taken, frame, a.offset, size);
+		return;
+	}
+
+	struct var *var = find_var(b, a);
+	if (var == NULL) {
+		b->vars = realloc(b->vars, (b->var_count + 1) * sizeof(*b->vars));
+		log_assert(b->vars);
+		var = &b->vars[b->var_count++];
+		memset(var, 0, sizeof(*var));
+		var->local = a;
+		var->local.region = LOCAL_R;
+		var->promoted = is_promotable(a.type);
+		b->var_at[a.offset] = b->var_count;
+	} else if (!same_type(var->local.type, a.type)
+	           || typeinfo_size(var->local.type) != size) {
+		var->promoted = false;
+	}
+}
+
+static void mark_bytes(bool *bytes, int frame, int offset, size_t size)
+{
+	if (size == 0)
+		size = 1;
+	for (size_t k = 0; k < size; ++k)
+		if (offset + (int)k >= 0 && offset + (int)k < frame)
+			bytes[offset + k] = true;
+}
+
+/*
+ * Returns the local at a, else NULL.
+ */
+static struct var *find_var(struct builder *b, struct address a)
+{
+	if (!is_local(a) || a.offset < 0 || a.offset >= b->s->frame
+	    || b->var_at[a.offset] == 0)
+		return NULL;
+	return &b->vars[b->var_at[a.offset] - 1];
+}
+
+/*
+ * Returns a new value of var in a new slot, made current.
+ */
+static size_t new_value(struct builder *b, struct var *var)
+{
+	struct ssa *s = b->s;
+	s->values = realloc(s->values, (s->count + 1) * sizeof(*s->values));
+	log_assert(s->values);
+	struct value *v = &s->values[s->count];
+	memset(v, 0, sizeof(*v));
+	v->local = var->local;
+	v->address = var->local;
+	v->address.offset = typeinfo_aligned(b->proc->address[1].offset,
+	                                     var->local.type);
+	b->proc->address[1].offset = v->address.offset
+		+ typeinfo_size(var->local.type);
+
+	var->stack = realloc(var->stack, (var->top + 1) * sizeof(*var->stack));
+	log_assert(var->stack);
+	var->stack[var->top++] = s->count;
+	return s->count++;
+}
+
+static void add_use(struct ssa *s, size_t v, struct list_node *op,
+                    struct phi *phi, int i)
+{
+	struct value *value = &s->values[v];
+	value->uses = realloc(value->uses,
+	                      (value->use_count + 1) * sizeof(*value->uses));
+	log_assert(value->uses);
+	struct use *u = &value->uses[value->use_count++];
+	u->op = op;
+	u->phi = phi;
+	u->i = i;
+}
+
+/*
+ * Removes the use at op or phi of the value at a, if it is one.
+ */
+static void drop_use(struct ssa *s, struct address a, struct list_node *op,
+                     struct phi *phi, int i)
+{
+	struct value *v = ssa_value(s, a);
+	if (v == NULL)
+		return;
+	for (size_t k = 0; k < v->use_count; ++k) {
+		struct use *u = &v->uses[k];
+		if (u->op == op && u->phi == phi && u->i == i) {
+			*u = v->uses[--v->use_count];
+			return;
+		}
+	}
+}
+
+/*
+ * Finds the immediate dominator of each reachable block: the one of
+ * its strict dominators which is dominated by all the others.
+ */
+static void find_idoms(struct builder *b)
+{
+	struct flow *f = b->s->flow;
+	size_t n = f->count;
+	size_t *depth = calloc(n, sizeof(*depth));
+	b->idom = malloc(n * sizeof(*b->idom));
+	log_assert(depth && b->idom);
+
+	for (size_t x = 0; x < n; ++x)
+		for (size_t d = 0; d < n; ++d)
+			if (flow_dominates(f, d, x))
+				++depth[x];
+
+	for (size_t x = 0; x < n; ++x) {
+		b->idom[x] = NONE;
+		if (x == 0 || !f->blocks[x].reachable)
+			continue;
+		for (size_t d = 0; d < n; ++d)
+			if (d != x && flow_dominates(f, d, x)
+			    && (b->idom[x] == NONE || depth[d] > depth[b->idom[x]]))
+				b->idom[x] = d;
+	}
+	free(depth);
+}
+
+/*
+ * Returns the dominance frontiers, where frontiers[x * n + y] iff y
+ * is in the frontier of x. The entry block joins its predecessors
+ * with entry itself.
+ */
+static bool *find_frontiers(struct builder *b)
+{
+	struct flow *f = b->s->flow;
+	size_t n = f->count;
+	bool *frontiers = calloc(n * n, sizeof(*frontiers));
+	log_assert(frontiers);
+
+	for (size_t y = 0; y < n; ++y) {
+		struct block *block = &f->blocks[y];
+		if (!block->reachable || block->pred_count + (y == 0) < 2)
+			continue;
+		for (size_t i = 0; i < block->pred_count; ++i) {
+			size_t runner = block->preds[i];
+			if (!f->blocks[runner].reachable)
+				continue;
+			while (runner != b->idom[y] && runner != NONE) {
+				frontiers[runner * n + y] = true;
+				runner = b->idom[runner];
+			}
+		}
+	}
+	return frontiers;
+}
+
+/*
+ * Places phis for each local live across blocks at the iterated
+ * dominance frontier of its definitions.
+ */
+static void place_phis(struct builder *b, bool *frontiers)
+{
+	struct ssa *s = b->s;
+	struct flow *f = s->flow;
+	size_t n = f->count;
+	bool *defs = calloc(b->var_count * n, sizeof(*defs));
+	bool *killed = malloc(b->var_count * sizeof(*killed));
+	bool *has_phi = malloc(n * sizeof(*has_phi));
+	bool *queued = malloc(n * sizeof(*queued));
+	size_t *work = malloc(n * sizeof(*work));
+	log_assert((b->var_count == 0 || (defs && killed))
+	           && has_phi && queued && work);
+
+	for (size_t x = 0; x < n; ++x) {
+		struct block *block = &f->blocks[x];
+		if (!block->reachable)
+			continue;
+		memset(killed, false, b->var_count * sizeof(*killed));
+		for (struct list_node *iter = block->first; iter;
+		     iter = block_next(block, iter)) {
+			struct op *op = iter->data;
+			for (int i = 0; i < 3; ++i) {
+				struct var *var = op_uses(op, i)
+					? find_var(b, op->address[i]) : NULL;
+				if (var && var->promoted && !killed[var - b->vars])
+					var->global = true;
+			}
+			struct address *def = op_def(op);
+			struct var *var = def ? find_var(b, *def) : NULL;
+			if (var && var->promoted) {
+				killed[var - b->vars] = true;
+				defs[(var - b->vars) * n + x] = true;
+			}
+		}
+	}
+
+	for (size_t v = 0; v < b->var_count; ++v) {
+		struct var *var = &b->vars[v];
+		if (!var->promoted || !var->global)
+			continue;
+
+		size_t top = 0;
+		memset(has_phi, false, n * sizeof(*has_phi));
+		memset(queued, false, n * sizeof(*queued));
+		for (size_t x = 0; x < n; ++x)
+			if (defs[v * n + x]) {
+				queued[x] = true;
+				work[top++] = x;
+			}
+
+		while (top > 0) {
+			size_t x = work[--top];
+			for (size_t y = 0; y < n; ++y) {
+				if (!frontiers[x * n + y] || has_phi[y])
+					continue;
+				has_phi[y] = true;
+				struct phi *phi = calloc(1, sizeof(*phi));
+				log_assert(phi);
+				phi->local = var->local;
+				phi->result = e;
+				phi->block = y;
+				size_t args = f->blocks[y].pred_count + (y == 0);
+				phi->args = malloc(args * sizeof(*phi->args));
+				log_assert(phi->args);
+				for (size_t j = 0; j < args; ++j)
+					phi->args[j] = e;
+				phi->next = s->phis[y];
+				s->phis[y] = phi;
+				if (!queued[y]) {
+					queued[y] = true;
+					work[top++] = y;
+				}
+			}
+		}
+	}
+
+	free(work);
+	free(queued);
+	free(has_phi);
+	free(killed);
+	free(defs);
+}
+
+/*
+ * Renames the locals of block and the blocks it dominates, reading
+ * the current value of each and giving each definition a new one.
+ */
+static void rename_block(struct builder *b, size_t x)
+{
+	struct ssa *s = b->s;
+	struct flow *f = s->flow;
+	struct block *block = &f->blocks[x];
+	size_t *tops = malloc((b->var_count + 1) * sizeof(*tops));
+	log_assert(tops);
+	for (size_t v = 0; v < b->var_count; ++v)
+		tops[v] = b->vars[v].top;
+
+	for (struct phi *phi = s->phis[x]; phi; phi = phi->next) {
+		size_t v = new_value(b, find_var(b, phi->local));
+		s->values[v].phi = phi;
+		phi->result = s->values[v].address;
+	}
+
+	for (struct list_node *iter = block->first; iter;
+	     iter = block_next(block, iter)) {
+		struct op *op = iter->data;
+		for (int i = 0; i < 3; ++i) {
+			struct var *var = op_uses(op, i)
+				? find_var(b, op->address[i]) : NULL;
+			if (var == NULL || !var->promoted)
+				continue;
+			size_t v = var->stack[var->top - 1];
+			op->address[i].region = LOCAL_R;
+			op->address[i].offset = s->values[v].address.offset;
+			add_use(s, v, iter, NULL, i);
+		}
+		struct address *def = op_def(op);
+		struct var *var = def ? find_var(b, *def) : NULL;
+		if (var && var->promoted) {
+			size_t v = new_value(b, var);
+			s->values[v].def = iter;
+			def->region = LOCAL_R;
+			def->offset = s->values[v].address.offset;
+		}
+	}
+
+	for (size_t i = 0; i < block->succ_count; ++i) {
+		size_t y = block->succs[i];
+		size_t j = 0;
+		while (f->blocks[y].preds[j] != x)
+			++j;
+		for (struct phi *phi = s->phis[y]; phi; phi = phi->next) {
+			struct var *var = find_var(b, phi->local);
+			size_t v = var->stack[var->top - 1];
+			phi->args[j] = s->values[v].address;
+			add_use(s, v, NULL, phi, j);
+		}
+	}
+
+	for (size_t y = 0; y < f->count; ++y)
+		if (b->idom[y] == x)
+			rename_block(b, y);
+
+	for (size_t v = 0; v < b->var_count; ++v)
+		b->vars[v].top = tops[v];
+	free(tops);
+}
+
+/*
+ * Returns the values live out of each block, where
+ * live_out[x * count + v] iff v is live out of x. A phi reads its
+ * argument at the end of the matching predecessor.
+ */
+static bool *find_liveness(struct ssa *s)
+{
+	struct flow *f = s->flow;
+	size_t n = f->count;
+	size_t count = s->count;
+	bool *uses = calloc(n * count, sizeof(*uses));
+	bool *defs = calloc(n * count, sizeof(*defs));
+	bool *live_in = calloc(n * count, sizeof(*live_in));
+	bool *live_out = calloc(n * count, sizeof(*live_out));
+	log_assert(n * count == 0 || (uses && defs && live_in && live_out));
+
+	for (size_t x = 0; x < n; ++x) {
+		struct block *block = &f->blocks[x];
+		if (!block->reachable)
+			continue;
+		for (struct phi *phi = s->phis[x]; phi; phi = phi->next)
+			defs[x * count + (ssa_value(s, phi->result) - s->values)] = true;
+		for (struct list_node *iter = block->first; iter;
+		     iter = block_next(block, iter)) {
+			struct op *op = iter->data;
+			if (is_dead(s, iter))
+				continue;
+			for (int i = 0; i < 3; ++i) {
+				struct value *v = op_uses(op, i)
+					? ssa_value(s, op->address[i]) : NULL;
+				if (v && !defs[x * count + (v - s->values)])
+					uses[x * count + (v - s->values)] = true;
+			}
+			struct address *def = op_def(op);
+			struct value *v = def ? ssa_value(s, *def) : NULL;
+			if (v)
+				defs[x * count + (v - s->values)] = true;
+		}
+	}
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t x = n; x-- > 0;) {
+			struct block *block = &f->blocks[x];
+			if (!block->reachable)
+				continue;
+			bool *out = &live_out[x * count];
+			for (size_t i = 0; i < block->succ_count; ++i) {
+				size_t y = block->succs[i];
+				for (size_t v = 0; v < count; ++v)
+					if (live_in[y * count + v] && !out[v])
+						out[v] = changed = true;
+				size_t j = 0;
+				while (f->blocks[y].preds[j] != x)
+					++j;
+				for (struct phi *phi = s->phis[y]; phi; phi = phi->next) {
+					struct value *v = ssa_value(s, phi->args[j]);
+					if (v && !out[v - s->values])
+						out[v - s->values] = changed = true;
+				}
+			}
+			for (size_t v = 0; v < count; ++v) {
+				bool in = uses[x * count + v]
+					|| (out[v] && !defs[x * count + v]);
+				if (in && !live_in[x * count + v])
+					live_in[x * count + v] = changed = true;
+			}
+		}
+	}
+
+	free(live_in);
+	free(defs);
+	free(uses);
+	return live_out;
+}
+
+/*
+ * Walks each block backwards from its live out values, making each
+ * definition interfere with the values live across it. A copy does
+ * not interfere with its source, as both hold the same value.
+ */
+static void find_interference(struct coalescer *c, bool *live_out)
+{
+	struct ssa *s = c->s;
+	struct flow *f = s->flow;
+	bool *live = malloc(c->count * sizeof(*live));
+	log_assert(c->count == 0 || live);
+
+	for (size_t x = 0; x < f->count; ++x) {
+		struct block *block = &f->blocks[x];
+		if (!block->reachable)
+			continue;
+		memcpy(live, &live_out[x * c->count], c->count * sizeof(*live));
+
+		struct list_node *iter = block->last;
+		while (true) {
+			struct op *op = iter->data;
+			struct address *def = op_def(op);
+			struct value *d = def ? ssa_value(s, *def) : NULL;
+			if (!is_dead(s, iter)) {
+				if (d) {
+					struct value *src = (op->code == ASN_O)
+						? ssa_value(s, op->address[1]) : NULL;
+					if (src && !same_type(d->address.type,
+					                      src->address.type))
+						src = NULL;
+					for (size_t w = 0; w < c->count; ++w)
+						if (live[w] && &s->values[w] != src)
+							interfere(c, d - s->values, w);
+					live[d - s->values] = false;
+				}
+				for (int i = 0; i < 3; ++i) {
+					struct value *v = op_uses(op, i)
+						? ssa_value(s, op->address[i]) : NULL;
+					if (v)
+						live[v - s->values] = true;
+				}
+			}
+			if (iter == block->first)
+				break;
+			iter = iter->prev;
+		}
+
+		for (struct phi *phi = s->phis[x]; phi; phi = phi->next) {
+			size_t r = ssa_value(s, phi->result) - s->values;
+			live[r] = false;
+			for (size_t w = 0; w < c->count; ++w)
+				if (live[w])
+					interfere(c, r, w);
+			for (struct phi *other = s->phis[x]; other; other = other->next)
+				if (other != phi)
+					interfere(c, r, ssa_value(s, other->result)
+					          - s->values);
+		}
+
+		if (x == 0) {
+			/* entry values are all defined before the first block */
+			for (struct phi *phi = s->phis[0]; phi; phi = phi->next) {
+				struct value *a = ssa_value(s, phi->args[block->pred_count]);
+				if (a)
+					live[a - s->values] = true;
+			}
+			for (size_t v = 0; v < c->count; ++v)
+				if (s->values[v].entry)
+					for (size_t w = 0; w < c->count; ++w)
+						if (live[w])
+							interfere(c, v, w);
+		}
+	}
+	free(live);
+}
+
+static void interfere(struct coalescer *c, size_t v, size_t w)
+{
+	if (v == w)
+		return;
+	c->interferes[v * c->count + w] = true;
+	c->interferes[w * c->count + v] = true;
+}
+
+static size_t find_class(struct coalescer *c, size_t v)
+{
+	while (c->parent[v] != v)
+		v = c->parent[v] = c->parent[c->parent[v]];
+	return v;
+}
+
+/*
+ * Merges the classes of v and w, if they are of one type, do not
+ * interfere, and do not hold two values needing their own slots.
+ */
+static bool coalesce(struct coalescer *c, size_t v, size_t w)
+{
+	struct ssa *s = c->s;
+	size_t x = find_class(c, v);
+	size_t y = find_class(c, w);
+	if (x == y)
+		return true;
+	if (!same_type(s->values[v].address.type, s->values[w].address.type)
+	    || classes_interfere(c, x, y))
+		return false;
+
+	bool entry = false;
+	size_t k = x;
+	do {
+		entry |= s->values[k].entry;
+		k = c->next[k];
+	} while (k != x);
+	k = y;
+	do {
+		if (entry && s->values[k].entry)
+			return false;
+		k = c->next[k];
+	} while (k != y);
+
+	c->parent[y] = x;
+	size_t t = c->next[x];
+	c->next[x] = c->next[y];
+	c->next[y] = t;
+	return true;
+}
+
+static bool classes_interfere(struct coalescer *c, size_t x, size_t y)
+{
+	size_t v = x;
+	do {
+		size_t w = y;
+		do {
+			if (c->interferes[v * c->count + w])
+				return true;
+			w = c->next[w];
+		} while (w != y);
+		v = c->next[v];
+	} while (v != x);
+	return false;
+}
+
+/*
+ * Returns true if no class already in the slot at offset interferes
+ * with the class of root.
+ */
+static bool slot_free(struct coalescer *c, size_t root, int offset)
+{
+	for (size_t v = 0; v < c->count; ++v)
+		if (c->slot[v] == offset && find_class(c, v) == v
+		    && classes_interfere(c, v, root))
+			return false;
+	return true;
+}
+
+/*
+ * Gives each class a slot: its entry value's, else that of one of
+ * its locals or any other of the same size which it does not
+ * interfere with, else a new one past the original locals.
+ */
+static void assign_slots(struct coalescer *c)
+{
+	struct ssa *s = c->s;
+	for (size_t v = 0; v < c->count; ++v)
+		if (s->values[v].entry)
+			c->slot[find_class(c, v)] = s->values[v].local.offset;
+
+	for (size_t root = 0; root < c->count; ++root) {
+		if (find_class(c, root) != root || c->slot[root] >= 0)
+			continue;
+		struct typeinfo *type = s->values[root].address.type;
+		size_t size = typeinfo_size(type);
+
+		size_t v = root;
+		do {
+			int offset = s->values[v].local.offset;
+			if (slot_free(c, root, offset)) {
+				c->slot[root] = offset;
+				break;
+			}
+			v = c->next[v];
+		} while (v != root);
+		if (c->slot[root] >= 0)
+			continue;
+
+		for (size_t w = 0; w < c->count && c->slot[root] < 0; ++w) {
+			int offset = c->slot[w];
+			if (offset >= 0 && find_class(c, w) == w
+			    && typeinfo_size(s->values[w].address.type) == size
+			    && typeinfo_aligned(offset, type) == (size_t)offset
+			    && slot_free(c, root, offset))
+				c->slot[root] = offset;
+		}
+		if (c->slot[root] >= 0)
+			continue;
+
+		c->frame = typeinfo_aligned(c->frame, type);
+		c->slot[root] = c->frame;
+		c->frame += size;
+	}
+}
+
+/*
+ * Moves every live value, and its uses, to the slot of its class.
+ */
+static void rewrite_values(struct coalescer *c)
+{
+	struct ssa *s = c->s;
+	for (size_t v = 0; v < c->count; ++v) {
+		struct value *value = &s->values[v];
+		int offset = c->slot[find_class(c, v)];
+		if (value->def) {
+			struct address *def = op_def(op_at(value->def));
+			def->region = LOCAL_R;
+			def->offset = offset;
+		} else if (value->phi) {
+			value->phi->result.offset = offset;
+		} else if (!value->entry) {
+			continue;
+		}
+		for (size_t i = 0; i < value->use_count; ++i) {
+			struct use *u = &value->uses[i];
+			struct address *a = u->op ? &op_at(u->op)->address[u->i]
+				: &u->phi->args[u->i];
+			a->region = LOCAL_R;
+			a->offset = offset;
+		}
+	}
+}
+
+/*
+ * Replaces the phis with copies along each edge into their blocks.
+ * Copies go at the end of a predecessor ending in a jump, or between
+ * a predecessor and the block it falls into; a branch gets a new
+ * block of its own.
+ */
+static void insert_copies(struct list *code, struct coalescer *c)
+{
+	struct ssa *s = c->s;
+	struct flow *f = s->flow;
+	size_t labels_size = yylabels;
+	size_t *labels = malloc(labels_size * sizeof(*labels));
+	log_assert(labels_size == 0 || labels);
+	for (size_t i = 0; i < labels_size; ++i)
+		labels[i] = f->count;
+	for (size_t x = 0; x < f->count; ++x) {
+		struct block *block = &f->blocks[x];
+		for (struct list_node *iter = block->first;
+		     iter && op_at(iter)->code == LABEL_O;
+		     iter = block_next(block, iter))
+			labels[op_at(iter)->address[0].offset] = x;
+	}
+
+	size_t phi_count = 0;
+	for (size_t x = 0; x < f->count; ++x)
+		for (struct phi *phi = s->phis[x]; phi; phi = phi->next)
+			++phi_count;
+	struct move *moves = malloc((phi_count + 1) * sizeof(*moves));
+	log_assert(moves);
+
+	for (size_t x = 0; x < f->count; ++x) {
+		struct block *block = &f->blocks[x];
+		if (s->phis[x] == NULL || !block->reachable)
+			continue;
+
+		/* copies on fall through precede any new blocks */
+		for (int pass = 0; pass < 2; ++pass) {
+		for (size_t j = 0; j < block->pred_count + (x == 0); ++j) {
+			size_t count = 0;
+			for (struct phi *phi = s->phis[x]; phi; phi = phi->next) {
+				if (phi->args[j].region == UNKNOWN_R)
+					continue;
+				moves[count].dst = phi->result;
+				moves[count].src = phi->args[j];
+				moves[count].src.type = phi->result.type;
+				if (!same_slot(moves[count].dst, moves[count].src))
+					++count;
+			}
+			if (count == 0)
+				continue;
+
+			if (j == block->pred_count) {
+				/* entry */
+				if (pass == 0)
+					emit_moves(code, c, block->first, moves, count);
+				continue;
+			}
+
+			size_t p = block->preds[j];
+			struct block *pred = &f->blocks[p];
+			if (!pred->reachable)
+				continue;
+			struct list_node *last = pred->last;
+			while (op_at(last)->code == CASE_O)
+				last = last->prev;
+
+			bool taken = false;
+			for (struct list_node *iter = pred->first; iter;
+			     iter = block_next(pred, iter)) {
+				struct address *t = op_target(iter->data);
+				if (t && (size_t)t->offset < labels_size
+				    && labels[t->offset] == x)
+					taken = true;
+			}
+			bool falls = !op_jumps(last->data) && p + 1 == x;
+
+			if (pass == 0 && falls) {
+				emit_moves(code, c, block->first, moves, count);
+			} else if (pass == 0 && taken && op_at(last)->code == GOTO_O) {
+				emit_moves(code, c, last, moves, count);
+			} else if (pass == 1 && taken
+			           && op_at(last)->code != GOTO_O) {
+				struct address target = op_at(block->first)->address[0];
+				struct address split = { LABEL_R, yylabels++,
+				                         &unknown_type };
+				for (struct list_node *iter = pred->first; iter;
+				     iter = block_next(pred, iter)) {
+					struct address *t = op_target(iter->data);
+					if (t && (size_t)t->offset < labels_size
+					    && labels[t->offset] == x)
+						t->offset = split.offset;
+				}
+				if (!op_jumps(op_at(block->first->prev)))
+					insert_op(code, block->first, GOTO_O, target, e);
+				insert_op(code, block->first, LABEL_O, split, e);
+				emit_moves(code, c, block->first, moves, count);
+				insert_op(code, block->first, GOTO_O, target, e);
+			}
+		}
+		}
+	}
+
+	free(moves);
+	free(labels);
+}
+
+/*
+ * Inserts the parallel assignment of moves before the given node,
+ * ordered so that no source is overwritten before it is read, and
+ * breaking cycles through a new temporary.
+ */
+static void emit_moves(struct list *code, struct coalescer *c,
+                       struct list_node *before, struct move *moves,
+                       size_t count)
+{
+	while (count > 0) {
+		size_t i = 0;
+		for (; i < count; ++i) {
+			bool read = false;
+			for (size_t k = 0; k < count; ++k)
+				if (k != i && same_slot(moves[k].src, moves[i].dst))
+					read = true;
+			if (!read)
+				break;
+		}
+
+		if (i == count) {
+			struct address t = moves[0].src;
+			t.region = LOCAL_R;
+			c->frame = typeinfo_aligned(c->frame, t.type);
+			t.offset = c->frame;
+			c->frame += typeinfo_size(t.type);
+			insert_op(code, before, ASN_O, t, moves[0].src);
+			moves[0].src = t;
+			continue;
+		}
+
+		insert_op(code, before, ASN_O, moves[i].dst, moves[i].src);
+		moves[i] = moves[--count];
+	}
+}
+
+static void insert_op(struct list *code, struct list_node *before,
+                      enum opcode code_, struct address a, struct address b)
+{
+	struct op *op = calloc(1, sizeof(*op));
+	log_assert(op);
+	op->code = code_;
+	op->address[0] = a;
+	op->address[1] = b;
+	op->address[2] = e;
+	op->count = op_at(before)->count;
+	op->filename = op_at(before)->filename;
+	op->lineno = op_at(before)->lineno;
+	list_node_link(code, list_node_new(op), before);
+}
+
+#undef NONE
+#undef op_at
@@ -0,0 +1,65 @@
+/*
+ * ssa.h - Static single assignment form of intermediate code.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef SSA_H
+#define SSA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "type.h"
+
+struct list;
+struct list_node;
+struct flow;
+
+/* a phi function at the head of a block, merging a local */
+struct phi {
+	struct address local;   /* the original local */
+	struct address result;
+	struct address *args;   /* by predecessor of block, then entry */
+	size_t block;
+	struct phi *next;
+};
+
+/* address i of op, or argument i of phi, reads a value */
+struct use {
+	struct list_node *op;
+	struct phi *phi;
+	int i;
+};
+
+/* one definition of a local, in a slot of its own */
+struct value {
+	struct address address;
+	struct address local;   /* the original local */
+	struct list_node *def;  /* defining op, else NULL */
+	struct phi *phi;        /* defining phi, else NULL */
+	bool entry;             /* defined on entry, in the original slot */
+	struct use *uses;
+	size_t use_count;
+};
+
+struct ssa {
+	struct flow *flow;
+	struct phi **phis;      /* by block */
+	struct value *values;
+	size_t count;
+	size_t *slots;          /* value index + 1 by local offset */
+	struct list *dead;      /* removed ops, unlinked on destruction */
+	int size;               /* bytes of locals with a value slot */
+	int frame;              /* bytes of locals before construction */
+};
+
+struct ssa *ssa_new(struct list_node *proc);
+void ssa_destroy(struct list *code, struct ssa *s);
+struct value *ssa_value(struct ssa *s, struct address a);
+void ssa_replace(struct ssa *s, struct value *v, struct address a);
+void ssa_remove(struct ssa *s, struct value *v);
+
+#endif /* SSA_H */
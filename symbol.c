@@ -58,6 +58,8 @@ static void handle_init(struct typeinfo *v, struct tree *n);
 static void handle_init_list(struct typeinfo *v, struct tree *n);
 static void handle_function(struct typeinfo *t, struct tree *n, char *k);
 static void handle_class(struct typeinfo *t, struct tree *n);
+static void reorder_members(struct typeinfo *class);
+static int compare_members(const void *a, const void *b);
 static void handle_param(struct typeinfo *v, struct tree *n, struct hasht *s, struct list *l);
 void handle_param_list(struct tree *n, struct hasht *s, struct list *l);
 
@@ -95,6 +97,10 @@ static void symbol_insert(char *k, struct typeinfo *v, struct tree *t,
 		e = hasht_search(list_tail(yyscopes)->data, k);
 
 	if (e == NULL) {
+		/* align all but constants kept elsewhere, floats are stored */
+		if (!constant || v->base == FLOAT_T)
+			offset = typeinfo_aligned(offset, v);
+
 		/* assign region and offset to node AND symbol */
 		struct node *n = t->data;
 		v->place.region = n->place.region = region;
@@ -1154,9 +1160,12 @@ static void handle_param(struct typeinfo *v, struct tree *n, struct hasht *s, st
 		struct tree *t = child(1);
 		enum rule r = get_rule(t);
 
-		/* array (with possible size) */
-		if (r == DIRECT_ABSTRACT_DECL4 || r == DIRECT_DECL6)
+		/* array (with possible size), passed as a pointer to
+		   its first element */
+		if (r == DIRECT_ABSTRACT_DECL4 || r == DIRECT_DECL6) {
 			v = typeinfo_new_array(t, v);
+			v->pointer = true;
+		}
 	}
 
 	/* insert into list when declaring */
@@ -1166,6 +1175,7 @@ static void handle_param(struct typeinfo *v, struct tree *n, struct hasht *s, st
 	/* insert into table when defining */
 	if (s && k && v) {
 		/* assign region and offset */
+		offset = typeinfo_aligned(offset, v);
 		struct node *node = n->data;
 		v->place.region = node->place.region = region;
 		v->place.offset = node->place.offset = offset;
@@ -1206,6 +1216,7 @@ static void handle_class(struct typeinfo *t, struct tree *n)
 {
 	char *k = get_identifier(n);
 	t->base = CLASS_T; /* class definition is still a class */
+	t->class.type = k;
 
 	symbol_insert(k, t, n, NULL, false);
 
@@ -1217,6 +1228,9 @@ static void handle_class(struct typeinfo *t, struct tree *n)
 
 	handle_init_list(t, child(1));
 
+	if (arguments.reorder_members)
+		reorder_members(t);
+
 	if (t->class.public == NULL) {
 		log_debug("creating default public scope for %s", k);
 		t->class.public = hasht_new(2, true, NULL, NULL, &symbol_free);
@@ -1238,4 +1252,50 @@ static void handle_class(struct typeinfo *t, struct tree *n)
 	offset = offset_;
 }
 
+/*
+ * Lays out the fields of a class by decreasing alignment, which
+ * leaves no padding between them, otherwise in declaration order.
+ */
+static void reorder_members(struct typeinfo *class)
+{
+	struct hasht *tables[] = { class->class.public, class->class.private };
+	size_t size = 0;
+	for (int i = 0; i < 2; ++i)
+		if (tables[i])
+			size += tables[i]->size;
+
+	struct typeinfo **fields = calloc(size + 1, sizeof(*fields));
+	log_assert(fields);
+	size_t count = 0;
+	for (int i = 0; i < 2; ++i) {
+		for (size_t j = 0; tables[i] && j < tables[i]->size; ++j) {
+			struct hasht_node *slot = tables[i]->table[j];
+			if (slot && !hasht_node_deleted(slot)
+			    && ((struct typeinfo *)slot->value)->base != FUNCTION_T)
+				fields[count++] = slot->value;
+		}
+	}
+	qsort(fields, count, sizeof(*fields), compare_members);
+
+	size_t offset_ = 0;
+	for (size_t i = 0; i < count; ++i) {
+		offset_ = typeinfo_aligned(offset_, fields[i]);
+		fields[i]->place.offset = offset_;
+		offset_ += typeinfo_size(fields[i]);
+	}
+	free(fields);
+}
+
+static int compare_members(const void *a, const void *b)
+{
+	struct typeinfo *s = *(struct typeinfo **)a;
+	struct typeinfo *t = *(struct typeinfo **)b;
+	size_t s_align = typeinfo_align(s);
+	size_t t_align = typeinfo_align(t);
+	if (s_align != t_align)
+		return (s_align < t_align) - (s_align > t_align);
+	return (s->place.offset > t->place.offset)
+		- (s->place.offset < t->place.offset);
+}
+
 #undef child
@@ -0,0 +1,669 @@
+/*
+ * tile.c - Implementation of tree pattern instruction selection.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "tile.h"
+#include "flow.h"
+#include "intermediate.h"
+#include "type.h"
+
+#include "logger.h"
+#include "list.h"
+
+extern struct typeinfo bool_type;
+
+#define op_at(node) ((struct op *)(node)->data)
+
+/* cost of a nonterminal no rule derives */
+#define INFINITE (INT_MAX / 4)
+
+/* kind of a chain rule, deriving one nonterminal from another */
+#define CHAIN E_OTHER
+
+static bool is_imm(struct expr *e);
+static bool is_mem(struct expr *e);
+static bool is_class_mem(struct expr *e);
+static bool is_string(struct expr *e);
+static bool is_direct(struct expr *e);
+static bool is_class(struct expr *e);
+static int pointee_size(struct expr *e);
+static bool is_unscaled(struct expr *e);
+static bool is_scaled(struct expr *e);
+static bool is_pointer_add(struct expr *e);
+static bool is_scale(struct expr *e);
+static bool is_shift_scale(struct expr *e);
+static bool is_wide_left(struct expr *e);
+
+/*
+ * Rules rewriting a node of a kind, whose kids derive the given
+ * nonterminals, to a nonterminal, at a cost in instructions emitted.
+ */
+static const struct pattern {
+	enum nonterm lhs;
+	enum expr_kind kind;
+	int arity;
+	enum nonterm kids[2];
+	int cost;
+	bool (*guard)(struct expr *e);
+} patterns[R_COUNT] = {
+	[R_IMM] = { NT_IMM, E_LEAF, 0, { 0 }, 0, &is_imm },
+	[R_MEM] = { NT_MEM, E_LEAF, 0, { 0 }, 0, &is_mem },
+	[R_MEM_CLASS] = { NT_MEM, E_LEAF, 0, { 0 }, 1, &is_class_mem },
+	[R_STRING] = { NT_REG, E_LEAF, 0, { 0 }, 1, &is_string },
+	[R_PLACE] = { NT_ADDR, E_PLACE, 0, { 0 }, 0, &is_direct },
+	[R_PLACE_CLASS] = { NT_ADDR, E_PLACE, 0, { 0 }, 1, &is_class },
+
+	[R_REG_IMM] = { NT_REG, CHAIN, 1, { NT_IMM }, 1, NULL },
+	[R_REG_MEM] = { NT_REG, CHAIN, 1, { NT_MEM }, 1, NULL },
+	[R_REG_ADDR] = { NT_REG, CHAIN, 1, { NT_ADDR }, 1, NULL },
+	[R_REG_FLAGS] = { NT_REG, CHAIN, 1, { NT_FLAGS }, 2, NULL },
+	[R_ADDR_REG] = { NT_ADDR, CHAIN, 1, { NT_REG }, 0, NULL },
+	[R_INDEX_REG] = { NT_INDEX, CHAIN, 1, { NT_REG }, 0, NULL },
+
+	[R_ADD_RI] = { NT_REG, E_ADD, 2, { NT_REG, NT_IMM }, 1, NULL },
+	[R_ADD_RR] = { NT_REG, E_ADD, 2, { NT_REG, NT_REG }, 1, &is_unscaled },
+	[R_ADD_RR_SCALED] = { NT_REG, E_ADD, 2, { NT_REG, NT_REG }, 2,
+	                      &is_scaled },
+	[R_ADD_ADDR] = { NT_ADDR, E_ADD, 2, { NT_ADDR, NT_IMM }, 0,
+	                 &is_pointer_add },
+	[R_SUB_RI] = { NT_REG, E_SUB, 2, { NT_REG, NT_IMM }, 1, NULL },
+	[R_SUB_RR] = { NT_REG, E_SUB, 2, { NT_REG, NT_REG }, 1, &is_unscaled },
+	[R_SUB_RR_SCALED] = { NT_REG, E_SUB, 2, { NT_REG, NT_REG }, 2,
+	                      &is_scaled },
+	[R_MUL_RI] = { NT_REG, E_MUL, 2, { NT_REG, NT_IMM }, 1, NULL },
+	[R_MUL_RR] = { NT_REG, E_MUL, 2, { NT_REG, NT_REG }, 1, NULL },
+	[R_MUL_INDEX] = { NT_INDEX, E_MUL, 2, { NT_REG, NT_IMM }, 0, &is_scale },
+	[R_SHL_RI] = { NT_REG, E_SHL, 2, { NT_REG, NT_IMM }, 2, NULL },
+	[R_SHL_INDEX] = { NT_INDEX, E_SHL, 2, { NT_REG, NT_IMM }, 0,
+	                  &is_shift_scale },
+
+	[R_RARR_INDEX] = { NT_MEM, E_RARR, 2, { NT_ADDR, NT_INDEX }, 0, NULL },
+	[R_RARR_DISP] = { NT_MEM, E_RARR, 2, { NT_ADDR, NT_IMM }, 0, NULL },
+	[R_LARR_INDEX] = { NT_ADDR, E_LARR, 2, { NT_ADDR, NT_INDEX }, 0, NULL },
+	[R_LARR_DISP] = { NT_ADDR, E_LARR, 2, { NT_ADDR, NT_IMM }, 0, NULL },
+	[R_RFIELD] = { NT_MEM, E_RFIELD, 1, { NT_ADDR }, 0, NULL },
+	[R_LFIELD] = { NT_ADDR, E_LFIELD, 1, { NT_ADDR }, 0, NULL },
+	[R_RSTAR] = { NT_MEM, E_RSTAR, 1, { NT_ADDR }, 0, NULL },
+	[R_ADDR] = { NT_ADDR, E_ADDR, 1, { NT_ADDR }, 0, NULL },
+
+	[R_CMP_RI] = { NT_FLAGS, E_CMP, 2, { NT_REG, NT_IMM }, 1, NULL },
+	[R_CMP_IR] = { NT_FLAGS, E_CMP, 2, { NT_IMM, NT_REG }, 1, NULL },
+	[R_CMP_RR] = { NT_FLAGS, E_CMP, 2, { NT_REG, NT_REG }, 1, NULL },
+	[R_CMP_MI] = { NT_FLAGS, E_CMP, 2, { NT_MEM, NT_IMM }, 1, &is_wide_left },
+	[R_CMP_MR] = { NT_FLAGS, E_CMP, 2, { NT_MEM, NT_REG }, 1, &is_wide_left },
+	[R_BRANCH_FLAGS] = { NT_STMT, E_BRANCH, 1, { NT_FLAGS }, 1, NULL },
+	[R_BRANCH_REG] = { NT_STMT, E_BRANCH, 1, { NT_REG }, 2, NULL },
+	[R_STORE_REG] = { NT_STMT, E_STORE, 2, { NT_ADDR, NT_REG }, 1, NULL },
+	[R_STORE_IMM] = { NT_STMT, E_STORE, 2, { NT_ADDR, NT_IMM }, 1, NULL },
+};
+
+static struct expr *build(struct tiling *t, struct op *op);
+static struct expr *new_leaf(struct tiling *t, enum expr_kind kind,
+                             struct address a);
+static void count_uses(struct list_node *proc, int frame, int *uses,
+                       bool *bad);
+static bool is_value(struct op *op, int i);
+static void fold(struct tiling *t, size_t p, int *uses, bool *bad,
+                 int frame);
+static bool foldable(struct expr *d, struct address a, int *uses, bool *bad,
+                     int frame);
+static size_t subtree_size(struct expr *e);
+static int need(struct expr *e);
+static void link(struct expr *e);
+static void label(struct expr *e);
+static bool check(struct tiling *t, size_t p);
+static void unfold(struct tiling *t, struct expr *e, int i);
+static bool is_scalar(struct typeinfo *t);
+static bool is_local(struct address a);
+
+/*
+ * Builds the expression trees of the procedure at proc and tiles
+ * them. An op is computed within its user when it is the one use of
+ * its result, and it and the ops between are pure and just before
+ * the user, so moving it there reads the same memory. Each tree is
+ * labeled bottom up with the cheapest rule deriving each
+ * nonterminal, leaving ops no tree covers to be lowered alone.
+ */
+struct tiling *tile_new(struct list_node *proc)
+{
+	struct tiling *t = calloc(1, sizeof(*t));
+	log_assert(t);
+
+	struct list_node *iter = proc;
+	for (t->count = 1; op_at(iter)->code != END_O; iter = iter->next)
+		++t->count;
+	t->exprs = calloc(t->count, sizeof(*t->exprs));
+	log_assert(t->exprs);
+	iter = proc;
+	for (size_t i = 0; i < t->count; ++i, iter = iter->next)
+		t->exprs[i] = build(t, iter->data);
+
+	int frame = op_at(proc)->address[1].offset;
+	int *uses = calloc(frame + 1, sizeof(*uses));
+	bool *bad = calloc(frame + 1, sizeof(*bad));
+	log_assert(uses && bad);
+	count_uses(proc, frame, uses, bad);
+	for (size_t p = 1; p < t->count; ++p)
+		fold(t, p, uses, bad, frame);
+	free(bad);
+	free(uses);
+
+	/* unfold what no rule covers until every tree is tiled */
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t p = 0; p < t->count; ++p)
+			t->exprs[p]->labeled = false;
+		for (size_t i = 0; i < t->leaf_count; ++i)
+			t->leaves[i]->labeled = false;
+		for (size_t p = 0; p < t->count; ++p)
+			if (!t->exprs[p]->folded && !check(t, p))
+				changed = true;
+	}
+	return t;
+}
+
+void tile_free(struct tiling *t)
+{
+	if (t == NULL)
+		return;
+	for (size_t i = 0; i < t->count; ++i)
+		free(t->exprs[i]);
+	for (size_t i = 0; i < t->leaf_count; ++i)
+		free(t->leaves[i]);
+	free(t->exprs);
+	free(t->leaves);
+	free(t);
+}
+
+/* the nonterminal a root is reduced to */
+enum nonterm tile_goal(struct expr *e)
+{
+	return (e->kind == E_BRANCH || e->kind == E_STORE) ? NT_STMT : NT_REG;
+}
+
+/*
+ * Returns true if e is emitted by its tiles, else it is lowered by
+ * its op, loading any operands computed in it.
+ */
+bool tile_root(struct expr *e)
+{
+	return !e->folded && e->kind != E_OTHER
+		&& e->cost[tile_goal(e)] < INFINITE;
+}
+
+/*
+ * Returns the expression of op, with a leaf for each operand it
+ * reads, and a kind for the rules if its types are all scalars
+ * other than doubles.
+ */
+static struct expr *build(struct tiling *t, struct op *op)
+{
+	struct expr *e = calloc(1, sizeof(*e));
+	log_assert(e);
+	e->kind = E_OTHER;
+	e->op = op;
+	e->address = op->address[0];
+	for (int i = 0; i < 3; ++i)
+		if (is_value(op, i))
+			e->operands[i] = new_leaf(t, E_LEAF, op->address[i]);
+
+	struct typeinfo *a = op->address[0].type;
+	struct typeinfo *b = op->address[1].type;
+	struct typeinfo *c = op->address[2].type;
+	switch (op->code) {
+	case ADD_O:
+	case SUB_O:
+	case MUL_O:
+	case SHL_O:
+	case LT_O:
+	case LE_O:
+	case GT_O:
+	case GE_O:
+	case EQ_O:
+	case NE_O:
+		if (is_scalar(a) && is_scalar(b) && is_scalar(c))
+			e->kind = (op->code == ADD_O) ? E_ADD
+				: (op->code == SUB_O) ? E_SUB
+				: (op->code == MUL_O) ? E_MUL
+				: (op->code == SHL_O) ? E_SHL : E_CMP;
+		break;
+	case RARR_O:
+	case LARR_O:
+		/* an array parameter is indexed through its value */
+		if (is_scalar(a) && is_scalar(c) && !b->pointer) {
+			e->kind = (op->code == RARR_O) ? E_RARR : E_LARR;
+			e->operands[1] = new_leaf(t, E_PLACE, op->address[1]);
+		}
+		break;
+	case RFIELD_O:
+	case LFIELD_O:
+		if (is_scalar(a) && b && b->pointer)
+			e->kind = (op->code == RFIELD_O) ? E_RFIELD : E_LFIELD;
+		break;
+	case RSTAR_O:
+		if (is_scalar(a) && !a->pointer && b && b->pointer
+		    && a->base == b->base)
+			e->kind = E_RSTAR;
+		break;
+	case ADDR_O:
+		if (is_scalar(a) && b && b->base != FUNCTION_T) {
+			e->kind = E_ADDR;
+			e->operands[1] = new_leaf(t, E_PLACE, op->address[1]);
+		}
+		break;
+	case IF_O:
+	case IFN_O:
+		if (is_scalar(a))
+			e->kind = E_BRANCH;
+		break;
+	case IFLT_O:
+	case IFLE_O:
+	case IFGT_O:
+	case IFGE_O:
+	case IFEQ_O:
+	case IFNE_O:
+		if (is_scalar(a) && is_scalar(b)) {
+			e->kind = E_BRANCH;
+			struct address flag = { UNKNOWN_R, 0, &bool_type };
+			e->kids[0] = new_leaf(t, E_CMP, flag);
+			e->kids[0]->op = op;
+		}
+		break;
+	case ASN_O:
+		if (is_scalar(a) && is_scalar(b)) {
+			e->kind = E_STORE;
+			e->operands[0] = new_leaf(t, E_PLACE, op->address[0]);
+		}
+		break;
+	case LSTAR_O:
+		if (a && a->pointer && is_scalar(a) && is_scalar(b)
+		    && a->base != VOID_T)
+			e->kind = E_STORE;
+		break;
+	default:
+		break;
+	}
+	return e;
+}
+
+/* returns a node not of an op, freed with the tiling */
+static struct expr *new_leaf(struct tiling *t, enum expr_kind kind,
+                             struct address a)
+{
+	struct expr *e = calloc(1, sizeof(*e));
+	t->leaves = realloc(t->leaves, (t->leaf_count + 1) * sizeof(*t->leaves));
+	log_assert(e && t->leaves);
+	e->kind = kind;
+	e->address = a;
+	t->leaves[t->leaf_count++] = e;
+	return e;
+}
+
+/*
+ * Counts the reads of each local, and marks as bad any local whose
+ * address is taken or whose bytes are accessed at another offset.
+ */
+static void count_uses(struct list_node *proc, int frame, int *uses,
+                       bool *bad)
+{
+	int *owner = calloc(frame + 1, sizeof(*owner));
+	log_assert(owner);
+	for (struct list_node *iter = proc; ; iter = iter->next) {
+		struct op *op = iter->data;
+		for (int i = 0; i < 3; ++i) {
+			struct address a = op->address[i];
+			if (!is_local(a) || a.offset >= frame)
+				continue;
+			int size = typeinfo_size(a.type);
+			if (!is_scalar(a.type) || size == 0
+			    || (i == 1 && (op->code == ADDR_O || op->code == RARR_O
+			                   || op->code == LARR_O)))
+				bad[a.offset] = true;
+			for (int j = a.offset; j < a.offset + size && j < frame; ++j) {
+				if (owner[j] && owner[j] != a.offset + 1)
+					bad[a.offset] = bad[owner[j] - 1] = true;
+				owner[j] = a.offset + 1;
+			}
+			if (op_def(op) != &op->address[i] || op_uses(op, i))
+				++uses[a.offset];
+		}
+		if (op->code == END_O)
+			break;
+	}
+	free(owner);
+}
+
+/* true if op loads the value of its address i */
+static bool is_value(struct op *op, int i)
+{
+	if (!op_uses(op, i) || !is_scalar(op->address[i].type))
+		return false;
+	switch (op->code) {
+	case RARR_O:
+	case LARR_O:
+	case ADDR_O:
+		return i != 1;
+	case RFIELD_O:
+	case LFIELD_O:
+		return i == 1;
+	default:
+		return true;
+	}
+}
+
+/*
+ * Folds into the op at p the ops just before it computing its
+ * operands, most recent first, while they can be.
+ */
+static void fold(struct tiling *t, size_t p, int *uses, bool *bad,
+                 int frame)
+{
+	struct expr *e = t->exprs[p];
+	size_t c = p - 1;
+	while (c > 0) {
+		struct expr *d = t->exprs[c];
+		int i = 0;
+		while (i < 3 && !(e->operands[i] && e->operands[i]->kind == E_LEAF
+		                  && foldable(d, e->operands[i]->address, uses, bad,
+		                              frame)))
+			++i;
+		if (i == 3)
+			return;
+
+		struct expr *leaf = e->operands[i];
+		e->operands[i] = d;
+		if (need(e) > TILE_REGISTERS) {
+			e->operands[i] = leaf;
+			return;
+		}
+		d->folded = true;
+		size_t size = subtree_size(d);
+		if (size > c)
+			return;
+		c -= size;
+	}
+}
+
+/* true if d computes the value of a for its one use */
+static bool foldable(struct expr *d, struct address a, int *uses, bool *bad,
+                     int frame)
+{
+	if (d->folded || d->kind == E_OTHER || d->kind == E_BRANCH
+	    || d->kind == E_STORE)
+		return false;
+	struct address r = d->address;
+	return is_local(r) && r.region == a.region && r.offset == a.offset
+		&& r.offset < frame && uses[r.offset] == 1 && !bad[r.offset]
+		&& r.type->base == a.type->base
+		&& r.type->pointer == a.type->pointer;
+}
+
+/* ops computed in e, including itself */
+static size_t subtree_size(struct expr *e)
+{
+	size_t size = 1;
+	for (int i = 0; i < 3; ++i)
+		if (e->operands[i] && e->operands[i]->op)
+			size += subtree_size(e->operands[i]);
+	return size;
+}
+
+/*
+ * Returns the registers to evaluate e, where an operand may hold
+ * two, a base and an index, while the next is evaluated.
+ */
+static int need(struct expr *e)
+{
+	int most = 1;
+	int held = 0;
+	for (int i = 0; i < 3; ++i) {
+		if (e->operands[i] == NULL)
+			continue;
+		int n = held + need(e->operands[i]);
+		if (n > most)
+			most = n;
+		held += 2;
+	}
+	return most;
+}
+
+/* sets the kids matched by rules from the operands of e */
+static void link(struct expr *e)
+{
+	switch (e->kind) {
+	case E_ADD:
+	case E_SUB:
+	case E_MUL:
+	case E_SHL:
+	case E_CMP:
+	case E_RARR:
+	case E_LARR:
+		if (e->op && e->op->code >= IFLT_O && e->op->code <= IFNE_O) {
+			/* compare of a branch */
+			e->kids[0] = e->operands[0];
+			e->kids[1] = e->operands[1];
+		} else {
+			e->kids[0] = e->operands[1];
+			e->kids[1] = e->operands[2];
+		}
+		break;
+	case E_RFIELD:
+	case E_LFIELD:
+	case E_RSTAR:
+	case E_ADDR:
+		e->kids[0] = e->operands[1];
+		break;
+	case E_BRANCH:
+		if (e->op->code == IF_O || e->op->code == IFN_O) {
+			e->kids[0] = e->operands[0];
+		} else {
+			e->kids[0]->operands[0] = e->operands[0];
+			e->kids[0]->operands[1] = e->operands[1];
+			link(e->kids[0]);
+		}
+		break;
+	case E_STORE:
+		e->kids[0] = e->operands[0];
+		e->kids[1] = e->operands[1];
+		break;
+	default:
+		break;
+	}
+	for (int i = 0; i < 3; ++i)
+		if (e->operands[i] && e->operands[i]->op)
+			link(e->operands[i]);
+}
+
+/*
+ * Finds the cheapest rule deriving each nonterminal for e, given
+ * those of its kids, then closes over the chain rules.
+ */
+static void label(struct expr *e)
+{
+	if (e->labeled)
+		return;
+	e->labeled = true;
+	for (int i = 0; i < 3; ++i)
+		if (e->operands[i])
+			label(e->operands[i]);
+	for (int i = 0; i < 2; ++i)
+		if (e->kids[i])
+			label(e->kids[i]);
+
+	for (int nt = 0; nt < NT_COUNT; ++nt)
+		e->cost[nt] = INFINITE;
+	if (e->kind == E_OTHER)
+		return;
+
+	for (int r = 0; r < R_COUNT; ++r) {
+		const struct pattern *rule = &patterns[r];
+		if (rule->kind != e->kind || (rule->guard && !rule->guard(e)))
+			continue;
+		int cost = rule->cost;
+		for (int k = 0; k < rule->arity; ++k)
+			cost += e->kids[k] ? e->kids[k]->cost[rule->kids[k]] : INFINITE;
+		if (cost < e->cost[rule->lhs]) {
+			e->cost[rule->lhs] = cost;
+			e->rule[rule->lhs] = r;
+		}
+	}
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int r = 0; r < R_COUNT; ++r) {
+			const struct pattern *rule = &patterns[r];
+			if (rule->kind != CHAIN)
+				continue;
+			int cost = rule->cost + e->cost[rule->kids[0]];
+			if (cost < e->cost[rule->lhs]) {
+				e->cost[rule->lhs] = cost;
+				e->rule[rule->lhs] = r;
+				changed = true;
+			}
+		}
+	}
+}
+
+/*
+ * Labels the root at p, returning false if an operand computed in it
+ * had to be unfolded as no rule covers it.
+ */
+static bool check(struct tiling *t, size_t p)
+{
+	struct expr *e = t->exprs[p];
+	link(e);
+	label(e);
+
+	bool tiled = e->kind != E_OTHER && e->cost[tile_goal(e)] < INFINITE;
+	bool ok = true;
+	for (int i = 0; i < 3; ++i) {
+		struct expr *d = e->operands[i];
+		if (d == NULL || d->op == NULL)
+			continue;
+		/* an op lowered alone loads operands into registers */
+		if (!tiled && d->cost[NT_REG] >= INFINITE) {
+			unfold(t, e, i);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+/* returns operand i of e to its op, a root of its own */
+static void unfold(struct tiling *t, struct expr *e, int i)
+{
+	struct expr *d = e->operands[i];
+	d->folded = false;
+	e->operands[i] = new_leaf(t, E_LEAF, e->op->address[i]);
+}
+
+static bool is_imm(struct expr *e)
+{
+	struct address a = e->address;
+	return a.region == CONST_R && !a.type->pointer
+		&& (a.type->base == INT_T
+		    || a.type->base == CHAR_T
+		    || a.type->base == BOOL_T);
+}
+
+static bool is_mem(struct expr *e)
+{
+	struct address a = e->address;
+	return is_scalar(a.type)
+		&& (is_local(a) || a.region == GLOBE_R);
+}
+
+static bool is_class_mem(struct expr *e)
+{
+	return is_scalar(e->address.type) && e->address.region == CLASS_R;
+}
+
+static bool is_string(struct expr *e)
+{
+	struct address a = e->address;
+	return a.region == CONST_R && a.type->pointer && a.type->base == CHAR_T;
+}
+
+static bool is_direct(struct expr *e)
+{
+	enum region r = e->address.region;
+	return r == LOCAL_R || r == PARAM_R || r == GLOBE_R || r == CONST_R;
+}
+
+static bool is_class(struct expr *e)
+{
+	return e->address.region == CLASS_R;
+}
+
+/* returns size of what a pointer operand of e points to, else 1 */
+static int pointee_size(struct expr *e)
+{
+	struct typeinfo *b = e->op->address[1].type;
+	struct typeinfo *c = e->op->address[2].type;
+	if (!b->pointer || c->pointer)
+		return 1;
+	struct typeinfo t = *b;
+	t.pointer = false;
+	return typeinfo_size(&t);
+}
+
+static bool is_unscaled(struct expr *e)
+{
+	return pointee_size(e) <= 1;
+}
+
+static bool is_scaled(struct expr *e)
+{
+	return pointee_size(e) > 1;
+}
+
+static bool is_pointer_add(struct expr *e)
+{
+	return e->op->address[1].type->pointer
+		&& !e->op->address[2].type->pointer;
+}
+
+static bool is_scale(struct expr *e)
+{
+	int s = e->kids[1]->address.offset;
+	return is_imm(e->kids[1]) && (s == 1 || s == 2 || s == 4 || s == 8);
+}
+
+static bool is_shift_scale(struct expr *e)
+{
+	int s = e->kids[1]->address.offset;
+	return is_imm(e->kids[1]) && s >= 0 && s <= 3;
+}
+
+/* true if left operand is compared whole in memory, int or pointer */
+static bool is_wide_left(struct expr *e)
+{
+	struct typeinfo *l = e->kids[0]->address.type;
+	struct typeinfo *r = e->kids[1]->address.type;
+	return l->pointer || (l->base == INT_T && !r->pointer);
+}
+
+/* true if values of t are held whole in a general register */
+static bool is_scalar(struct typeinfo *t)
+{
+	if (t == NULL)
+		return false;
+	if (t->pointer)
+		return true;
+	return t->base == INT_T || t->base == CHAR_T || t->base == BOOL_T;
+}
+
+static bool is_local(struct address a)
+{
+	return (a.region == LOCAL_R || a.region == PARAM_R) && a.offset >= 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * tile.h - Tree pattern instruction selection for native code.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef TILE_H
+#define TILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "type.h"
+
+struct list_node;
+struct op;
+
+/* what a tiled expression leaves its value as */
+enum nonterm {
+	NT_STMT,     /* nothing, done for effect */
+	NT_REG,      /* in a register */
+	NT_IMM,      /* an immediate */
+	NT_MEM,      /* in memory at an addressing mode */
+	NT_ADDR,     /* an address as an addressing mode */
+	NT_INDEX,    /* a register times a scale */
+	NT_FLAGS,    /* in the flags, holding if a condition code does */
+	NT_COUNT
+};
+
+enum expr_kind {
+	E_LEAF,      /* read of a value */
+	E_PLACE,     /* address of a region operand */
+	E_ADD,
+	E_SUB,
+	E_MUL,
+	E_SHL,
+	E_CMP,
+	E_RARR,
+	E_LARR,
+	E_RFIELD,
+	E_LFIELD,
+	E_RSTAR,
+	E_ADDR,
+	E_BRANCH,    /* IF_O, IFN_O, and IFxx_O over an E_CMP */
+	E_STORE,     /* ASN_O and LSTAR_O */
+	E_OTHER      /* lowered by op, its operands maybe tiled */
+};
+
+enum rule_id {
+	/* leaves */
+	R_IMM,
+	R_MEM,
+	R_MEM_CLASS,
+	R_STRING,
+	R_PLACE,
+	R_PLACE_CLASS,
+	/* chains */
+	R_REG_IMM,
+	R_REG_MEM,
+	R_REG_ADDR,
+	R_REG_FLAGS,
+	R_ADDR_REG,
+	R_INDEX_REG,
+	/* arithmetic */
+	R_ADD_RI,
+	R_ADD_RR,
+	R_ADD_RR_SCALED,
+	R_ADD_ADDR,
+	R_SUB_RI,
+	R_SUB_RR,
+	R_SUB_RR_SCALED,
+	R_MUL_RI,
+	R_MUL_RR,
+	R_MUL_INDEX,
+	R_SHL_RI,
+	R_SHL_INDEX,
+	/* addressing */
+	R_RARR_INDEX,
+	R_RARR_DISP,
+	R_LARR_INDEX,
+	R_LARR_DISP,
+	R_RFIELD,
+	R_LFIELD,
+	R_RSTAR,
+	R_ADDR,
+	/* comparison */
+	R_CMP_RI,
+	R_CMP_IR,
+	R_CMP_RR,
+	R_CMP_MI,
+	R_CMP_MR,
+	R_BRANCH_FLAGS,
+	R_BRANCH_REG,
+	R_STORE_REG,
+	R_STORE_IMM,
+	R_COUNT
+};
+
+/* an expression tree over the ops of a block */
+struct expr {
+	enum expr_kind kind;
+	struct op *op;              /* computing it, else NULL for a leaf */
+	struct address address;     /* of a leaf, else the result */
+	struct expr *kids[2];       /* operands matched by rules */
+	struct expr *operands[3];   /* by address of op, if computed in it */
+	bool folded;                /* computed within the op using it */
+	bool labeled;
+	int cost[NT_COUNT];
+	enum rule_id rule[NT_COUNT];
+};
+
+/* the expression trees of one procedure, by op from PROC_O */
+struct tiling {
+	struct expr **exprs;
+	size_t count;
+	struct expr **leaves;       /* and other nodes not of an op */
+	size_t leaf_count;
+};
+
+/* registers available to evaluate a tree */
+#define TILE_REGISTERS 6
+
+struct tiling *tile_new(struct list_node *proc);
+void tile_free(struct tiling *t);
+enum nonterm tile_goal(struct expr *e);
+bool tile_root(struct expr *e);
+
+#endif /* TILE_H */
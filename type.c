@@ -21,6 +21,8 @@
 #include "tree.h"
 #include "hasht.h"
 
+static int compare_fields(const void *a, const void *b);
+
 /* basic type comparators */
 struct typeinfo int_type;
 struct typeinfo float_type;
@@ -295,13 +297,106 @@ size_t typeinfo_size(struct typeinfo *t)
 		return t->array.size * typeinfo_size(t->array.type);
 	case FUNCTION_T:
 		return scope_size(t->function.symbols);
-	case CLASS_T:
-		return scope_size(t->class.public) + scope_size(t->class.private);
+	case CLASS_T: {
+		/* public and private share the class region */
+		size_t size = scope_size(t->class.public);
+		size_t private = scope_size(t->class.private);
+		if (private > size)
+			size = private;
+		/* padded so each element of an array is aligned */
+		return typeinfo_aligned(size, t);
+	}
 	default:
 		return 0;
 	}
 }
 
+/*
+ * Returns natural alignment for type, the largest alignment of its
+ * parts for arrays and classes.
+ */
+size_t typeinfo_align(struct typeinfo *t)
+{
+	if (t->pointer)
+		return 8;
+
+	switch (t->base) {
+	case INT_T:
+	case FLOAT_T:
+		return 8;
+	case ARRAY_T:
+		return typeinfo_align(t->array.type);
+	case CLASS_T: {
+		size_t align = scope_align(t->class.public);
+		size_t private = scope_align(t->class.private);
+		return (private > align) ? private : align;
+	}
+	default:
+		return 1;
+	}
+}
+
+/*
+ * Returns offset rounded up to the alignment of type.
+ */
+size_t typeinfo_aligned(size_t offset, struct typeinfo *t)
+{
+	size_t align = typeinfo_align(t);
+	return (offset + align - 1) / align * align;
+}
+
+/*
+ * Returns true if values of type t are doubles.
+ */
+bool typeinfo_double(struct typeinfo *t)
+{
+	return t && t->base == FLOAT_T && !t->pointer;
+}
+
+/*
+ * Returns true if values of type t are kept in memory and passed by
+ * address.
+ */
+bool typeinfo_by_reference(struct typeinfo *t)
+{
+	return !t->pointer && (t->base == ARRAY_T || t->base == CLASS_T);
+}
+
+/*
+ * Returns the fields of class, public and private, sorted by offset,
+ * setting count to how many. The caller frees the array.
+ */
+struct hasht_node **typeinfo_fields(struct typeinfo *class, size_t *count)
+{
+	struct hasht *tables[] = { class->class.public, class->class.private };
+	size_t size = 0;
+	for (int i = 0; i < 2; ++i)
+		if (tables[i])
+			size += tables[i]->size;
+
+	struct hasht_node **fields = calloc(size + 1, sizeof(*fields));
+	log_assert(fields);
+	*count = 0;
+	for (int i = 0; i < 2; ++i) {
+		for (size_t j = 0; tables[i] && j < tables[i]->size; ++j) {
+			struct hasht_node *slot = tables[i]->table[j];
+			if (slot && !hasht_node_deleted(slot)
+			    && ((struct typeinfo *)slot->value)->base != FUNCTION_T)
+				fields[(*count)++] = slot;
+		}
+	}
+	qsort(fields, *count, sizeof(*fields), compare_fields);
+	return fields;
+}
+
+static int compare_fields(const void *a, const void *b)
+{
+	struct typeinfo *s = (*(struct hasht_node **)a)->value;
+	struct typeinfo *t = (*(struct hasht_node **)b)->value;
+	return (s->place.offset > t->place.offset)
+		- (s->place.offset < t->place.offset);
+}
+
 /*
  * Recursively compares two typeinfos.
  */
@@ -319,8 +414,8 @@ bool typeinfo_compare(struct typeinfo *a, struct typeinfo *b)
 	if (a->base != b->base)
 		return false;
 
-	/* Both pointers (or not) */
-	if (a->pointer != b->pointer)
+	/* Both pointers (or not), but arrays decay to pointers */
+	if (a->pointer != b->pointer && a->base != ARRAY_T)
 		return false;
 
 	switch (a->base) {
@@ -19,6 +19,7 @@
 struct tree;
 struct list;
 struct hasht;
+struct hasht_node;
 
 /* the 120++ base types */
 enum type {
@@ -98,6 +99,11 @@ void typeinfo_delete(struct typeinfo *t);
 
 struct typeinfo *typeinfo_return(struct typeinfo *t);
 size_t typeinfo_size(struct typeinfo *t);
+size_t typeinfo_align(struct typeinfo *t);
+size_t typeinfo_aligned(size_t offset, struct typeinfo *t);
+bool typeinfo_double(struct typeinfo *t);
+bool typeinfo_by_reference(struct typeinfo *t);
+struct hasht_node **typeinfo_fields(struct typeinfo *class, size_t *count);
 
 bool typeinfo_compare(struct typeinfo *a, struct typeinfo *b);
 bool typeinfo_list_compare(struct list *a, struct list *b);
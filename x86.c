@@ -0,0 +1,692 @@
+/*
+ * x86.c - x86-64 instructions, their AT&T assembly and encoding.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#include <elf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "x86.h"
+#include "object.h"
+#include "intermediate.h"
+
+#include "logger.h"
+#include "list.h"
+
+#define p(...) fprintf(stream, __VA_ARGS__)
+
+static void print_operand(FILE *stream, struct x86_operand o, int size);
+
+/* a field of text to patch once the label it refers to is placed */
+struct fixup {
+	size_t at;          /* of the 4 byte field */
+	long label;
+	long from;          /* label the field is relative to, else -1 */
+	size_t end;         /* offset it is relative to, without one */
+};
+
+/* text being assembled into an object */
+struct assembler {
+	struct object *object;
+	unsigned char *bytes;
+	size_t size;
+	size_t capacity;
+	size_t *labels;     /* offset + 1 by label, else 0 */
+	size_t label_count;
+	struct fixup *fixups;
+	size_t fixup_count;
+	struct object_symbol *proc;
+};
+
+static void encode(struct assembler *a, struct x86_insn *insn);
+static void encode_rm(struct assembler *a, int prefix, bool w, int bytes,
+                      unsigned opcode, int reg, struct x86_operand o,
+                      int trailing);
+static void encode_mov(struct assembler *a, struct x86_insn *insn);
+static void encode_alu(struct assembler *a, struct x86_insn *insn, int n);
+static void encode_shift(struct assembler *a, struct x86_insn *insn,
+                         bool w, int n);
+static void encode_jump(struct assembler *a, unsigned opcode, long label);
+static void put(struct assembler *a, unsigned char byte);
+static void put_imm(struct assembler *a, long value, int size);
+static void place_label(struct assembler *a, long label);
+static void add_fixup(struct assembler *a, long label, long from, size_t end);
+static bool fits8(long value);
+static bool fits32(long value);
+
+/* mnemonic and register sizes of source and destination */
+static const struct {
+	const char *name;
+	int src;
+	int dst;
+} forms[] = {
+	[X_MOVQ] = { "movq", 8, 8 },
+	[X_MOVL] = { "movl", 4, 4 },
+	[X_MOVB] = { "movb", 1, 1 },
+	[X_MOVSLQ] = { "movslq", 4, 8 },
+	[X_MOVSBQ] = { "movsbq", 1, 8 },
+	[X_MOVZBQ] = { "movzbq", 1, 8 },
+	[X_LEAQ] = { "leaq", 8, 8 },
+	[X_ADDQ] = { "addq", 8, 8 },
+	[X_SUBQ] = { "subq", 8, 8 },
+	[X_IMULQ] = { "imulq", 8, 8 },
+	[X_ANDQ] = { "andq", 8, 8 },
+	[X_ORQ] = { "orq", 8, 8 },
+	[X_XORQ] = { "xorq", 8, 8 },
+	[X_CMPQ] = { "cmpq", 8, 8 },
+	[X_CMPL] = { "cmpl", 4, 4 },
+	[X_TESTQ] = { "testq", 8, 8 },
+	[X_NEGQ] = { "negq", 8, 8 },
+	[X_IDIVQ] = { "idivq", 8, 8 },
+	[X_CQTO] = { "cqto", 8, 8 },
+	[X_SARQ] = { "sarq", 8, 8 },
+	[X_SHLL] = { "shll", 1, 4 },
+	[X_SHRL] = { "shrl", 1, 4 },
+	[X_SARL] = { "sarl", 1, 4 },
+	[X_SETCC] = { "set", 1, 1 },
+	[X_JCC] = { "j", 8, 8 },
+	[X_JMP] = { "jmp", 8, 8 },
+	[X_JMPR] = { "jmp", 8, 8 },
+	[X_CALL] = { "call", 8, 8 },
+	[X_RET] = { "ret", 8, 8 },
+	[X_LEAVE] = { "leave", 8, 8 },
+	[X_PUSHQ] = { "pushq", 8, 8 },
+	[X_POPQ] = { "popq", 8, 8 },
+	[X_REP_MOVSB] = { "rep movsb", 8, 8 },
+	[X_MOVSD] = { "movsd", 8, 8 },
+	[X_ADDSD] = { "addsd", 8, 8 },
+	[X_SUBSD] = { "subsd", 8, 8 },
+	[X_MULSD] = { "mulsd", 8, 8 },
+	[X_DIVSD] = { "divsd", 8, 8 },
+	[X_UCOMISD] = { "ucomisd", 8, 8 },
+	[X_XORPD] = { "xorpd", 8, 8 },
+	[X_CVTSI2SDQ] = { "cvtsi2sdq", 8, 8 },
+	[X_CVTTSD2SIQ] = { "cvttsd2siq", 8, 8 },
+	[X_MOVQX] = { "movq", 8, 8 },
+};
+
+static const char *const cc_names[] = {
+	"o", "no", "b", "ae", "e", "ne", "be", "a",
+	"s", "ns", "p", "np", "l", "ge", "le", "g",
+};
+
+static const char *const reg_names[][16] = {
+	{ "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+	  "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" },
+	{ "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+	  "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" },
+	{ "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+	  "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" },
+};
+
+const struct x86_operand x86_none = { X_NONE, 0, -1, 1, 0, 0, NULL };
+
+struct x86_operand x86_reg(int reg)
+{
+	struct x86_operand o = x86_none;
+	o.kind = X_REG;
+	o.reg = reg;
+	return o;
+}
+
+struct x86_operand x86_xmm(int reg)
+{
+	struct x86_operand o = x86_none;
+	o.kind = X_XMM;
+	o.reg = reg;
+	return o;
+}
+
+struct x86_operand x86_imm(long value)
+{
+	struct x86_operand o = x86_none;
+	o.kind = X_IMM;
+	o.value = value;
+	return o;
+}
+
+struct x86_operand x86_mem(int base, long disp)
+{
+	return x86_index(base, -1, 1, disp);
+}
+
+struct x86_operand x86_index(int base, int index, int scale, long disp)
+{
+	struct x86_operand o = x86_none;
+	o.kind = X_MEM;
+	o.reg = base;
+	o.index = index;
+	o.scale = scale;
+	o.disp = disp;
+	return o;
+}
+
+/* symbol + disp, or with a NULL symbol, label disp */
+struct x86_operand x86_rip(const char *symbol, long disp)
+{
+	struct x86_operand o = x86_none;
+	o.kind = X_RIP;
+	o.symbol = symbol;
+	if (symbol)
+		o.disp = disp;
+	else
+		o.value = disp;
+	return o;
+}
+
+struct x86_operand x86_label(long label)
+{
+	struct x86_operand o = x86_none;
+	o.kind = X_TARGET;
+	o.value = label;
+	return o;
+}
+
+struct x86_operand x86_symbol(const char *symbol)
+{
+	struct x86_operand o = x86_none;
+	o.kind = X_SYMBOL;
+	o.symbol = symbol;
+	return o;
+}
+
+/*
+ * Appends an instruction to code, returning it.
+ */
+struct x86_insn *x86_emit(struct list *code, enum x86_code c,
+                          struct x86_operand src, struct x86_operand dst)
+{
+	struct x86_insn *insn = calloc(1, sizeof(*insn));
+	log_assert(insn);
+	insn->code = c;
+	insn->src = src;
+	insn->dst = dst;
+	list_push_back(code, insn);
+	return insn;
+}
+
+/* appends a conditional instruction, a set or a jump */
+struct x86_insn *x86_emit_cc(struct list *code, enum x86_code c,
+                             enum x86_cc cc, struct x86_operand dst)
+{
+	struct x86_insn *insn = x86_emit(code, c, x86_none, dst);
+	insn->cc = cc;
+	return insn;
+}
+
+/*
+ * Prints code as AT&T syntax assembly for the GNU assembler.
+ */
+void x86_print(FILE *stream, struct list *code)
+{
+	struct list_node *iter = list_head(code);
+	for (; !list_end(iter); iter = iter->next) {
+		struct x86_insn *insn = iter->data;
+		switch (insn->code) {
+		case X_OP:
+			p("/*\n");
+			print_op(stream, insn->op);
+			p("*/\n");
+			continue;
+		case X_PROC:
+			p("\n\t.globl %s\n", insn->dst.symbol);
+			p("\t.type %s, @function\n", insn->dst.symbol);
+			p("%s:\n", insn->dst.symbol);
+			continue;
+		case X_LABEL:
+			p(".L%ld:\n", insn->dst.value);
+			continue;
+		case X_ENTRY:
+			p("\t.long .L%ld-.L%ld\n", insn->dst.value, insn->src.value);
+			continue;
+		default:
+			break;
+		}
+
+		p("\t%s", forms[insn->code].name);
+		if (insn->code == X_SETCC || insn->code == X_JCC)
+			p("%s", cc_names[insn->cc]);
+		if (insn->src.kind != X_NONE) {
+			p(" ");
+			print_operand(stream, insn->src, forms[insn->code].src);
+			p(",");
+		}
+		if (insn->dst.kind != X_NONE) {
+			p(" ");
+			if (insn->code == X_JMPR)
+				p("*");
+			print_operand(stream, insn->dst, forms[insn->code].dst);
+		}
+		p("\n");
+	}
+}
+
+/* print operand, registers of the given byte size */
+static void print_operand(FILE *stream, struct x86_operand o, int size)
+{
+	switch (o.kind) {
+	case X_NONE:
+		break;
+	case X_REG:
+		p("%%%s", reg_names[size == 1 ? 0 : size == 4 ? 1 : 2][o.reg]);
+		break;
+	case X_XMM:
+		p("%%xmm%d", o.reg);
+		break;
+	case X_IMM:
+		p("$%ld", o.value);
+		break;
+	case X_MEM:
+		if (o.disp)
+			p("%ld", o.disp);
+		p("(%%%s", reg_names[2][o.reg]);
+		if (o.index >= 0)
+			p(",%%%s,%d", reg_names[2][o.index], o.scale);
+		p(")");
+		break;
+	case X_RIP:
+		if (o.symbol)
+			p("%s%+ld(%%rip)", o.symbol, o.disp);
+		else
+			p(".L%ld(%%rip)", o.value);
+		break;
+	case X_TARGET:
+		p(".L%ld", o.value);
+		break;
+	case X_SYMBOL:
+		p("%s@PLT", o.symbol);
+		break;
+	}
+}
+
+/*
+ * Encodes code into the text of object o, defining a global symbol
+ * for each procedure. Jumps within the text are resolved once every
+ * label is placed; calls and references to regions are left to the
+ * linker as relocations.
+ */
+void x86_assemble(struct list *code, struct object *o)
+{
+	struct assembler a;
+	memset(&a, 0, sizeof(a));
+	a.object = o;
+	struct list_node *iter = list_head(code);
+	for (; !list_end(iter); iter = iter->next)
+		encode(&a, iter->data);
+	if (a.proc)
+		a.proc->size = a.size - a.proc->value;
+
+	for (size_t i = 0; i < a.fixup_count; ++i) {
+		struct fixup *f = &a.fixups[i];
+		log_assert(f->label < (long)a.label_count && a.labels[f->label]);
+		long value = (long)a.labels[f->label] - 1;
+		if (f->from >= 0)
+			value -= (long)a.labels[f->from] - 1;
+		else
+			value -= (long)f->end;
+		for (int b = 0; b < 4; ++b)
+			a.bytes[f->at + b] = (unsigned long)value >> (8 * b);
+	}
+
+	free(o->text);
+	o->text = a.bytes;
+	o->text_size = a.size;
+	free(a.labels);
+	free(a.fixups);
+}
+
+/* encodes one instruction, in its form for its operands */
+static void encode(struct assembler *a, struct x86_insn *insn)
+{
+	struct x86_operand s = insn->src;
+	struct x86_operand d = insn->dst;
+	switch (insn->code) {
+	case X_OP:
+		break;
+	case X_PROC:
+		if (a->proc)
+			a->proc->size = a->size - a->proc->value;
+		a->proc = object_define(a->object, d.symbol, SECTION_TEXT, a->size,
+		                        true);
+		break;
+	case X_LABEL:
+		place_label(a, d.value);
+		break;
+	case X_ENTRY:
+		add_fixup(a, d.value, s.value, 0);
+		put_imm(a, 0, 4);
+		break;
+	case X_MOVQ:
+	case X_MOVL:
+	case X_MOVB:
+		encode_mov(a, insn);
+		break;
+	case X_MOVSLQ:
+		encode_rm(a, 0, true, 0, 0x63, d.reg, s, 0);
+		break;
+	case X_MOVSBQ:
+		encode_rm(a, 0, true, 2, 0x0fbe, d.reg, s, 0);
+		break;
+	case X_MOVZBQ:
+		encode_rm(a, 0, true, 2, 0x0fb6, d.reg, s, 0);
+		break;
+	case X_LEAQ:
+		encode_rm(a, 0, true, 0, 0x8d, d.reg, s, 0);
+		break;
+	case X_ADDQ:
+		encode_alu(a, insn, 0);
+		break;
+	case X_ORQ:
+		encode_alu(a, insn, 1);
+		break;
+	case X_ANDQ:
+		encode_alu(a, insn, 4);
+		break;
+	case X_SUBQ:
+		encode_alu(a, insn, 5);
+		break;
+	case X_XORQ:
+		encode_alu(a, insn, 6);
+		break;
+	case X_CMPQ:
+	case X_CMPL:
+		encode_alu(a, insn, 7);
+		break;
+	case X_TESTQ:
+		encode_rm(a, 0, true, 0, 0x85, s.reg, d, 0);
+		break;
+	case X_IMULQ:
+		if (s.kind == X_IMM) {
+			int size = fits8(s.value) ? 1 : 4;
+			encode_rm(a, 0, true, 0, size == 1 ? 0x6b : 0x69, d.reg, d, size);
+			put_imm(a, s.value, size);
+		} else {
+			encode_rm(a, 0, true, 0, 0x0faf, d.reg, s, 0);
+		}
+		break;
+	case X_NEGQ:
+		encode_rm(a, 0, true, 0, 0xf7, 3, d, 0);
+		break;
+	case X_IDIVQ:
+		encode_rm(a, 0, true, 0, 0xf7, 7, d, 0);
+		break;
+	case X_CQTO:
+		put(a, 0x48);
+		put(a, 0x99);
+		break;
+	case X_SARQ:
+		encode_shift(a, insn, true, 7);
+		break;
+	case X_SHLL:
+		encode_shift(a, insn, false, 4);
+		break;
+	case X_SHRL:
+		encode_shift(a, insn, false, 5);
+		break;
+	case X_SARL:
+		encode_shift(a, insn, false, 7);
+		break;
+	case X_SETCC:
+		encode_rm(a, 0, false, 2, 0x0f90 + insn->cc, 0, d, 0);
+		break;
+	case X_JCC:
+		encode_jump(a, 0x0f80 + insn->cc, d.value);
+		break;
+	case X_JMP:
+		encode_jump(a, 0xe9, d.value);
+		break;
+	case X_JMPR:
+		encode_rm(a, 0, false, 0, 0xff, 4, d, 0);
+		break;
+	case X_CALL:
+		put(a, 0xe8);
+		object_relocate(a->object, a->size, R_X86_64_PLT32, d.symbol, -4);
+		put_imm(a, 0, 4);
+		break;
+	case X_RET:
+		put(a, 0xc3);
+		break;
+	case X_LEAVE:
+		put(a, 0xc9);
+		break;
+	case X_PUSHQ:
+	case X_POPQ:
+		if (d.reg & 8)
+			put(a, 0x41);
+		put(a, (insn->code == X_PUSHQ ? 0x50 : 0x58) + (d.reg & 7));
+		break;
+	case X_REP_MOVSB:
+		put(a, 0xf3);
+		put(a, 0xa4);
+		break;
+	case X_MOVSD:
+		if (d.kind == X_XMM)
+			encode_rm(a, 0xf2, false, 0, 0x0f10, d.reg, s, 0);
+		else
+			encode_rm(a, 0xf2, false, 0, 0x0f11, s.reg, d, 0);
+		break;
+	case X_ADDSD:
+		encode_rm(a, 0xf2, false, 0, 0x0f58, d.reg, s, 0);
+		break;
+	case X_SUBSD:
+		encode_rm(a, 0xf2, false, 0, 0x0f5c, d.reg, s, 0);
+		break;
+	case X_MULSD:
+		encode_rm(a, 0xf2, false, 0, 0x0f59, d.reg, s, 0);
+		break;
+	case X_DIVSD:
+		encode_rm(a, 0xf2, false, 0, 0x0f5e, d.reg, s, 0);
+		break;
+	case X_UCOMISD:
+		encode_rm(a, 0x66, false, 0, 0x0f2e, d.reg, s, 0);
+		break;
+	case X_XORPD:
+		encode_rm(a, 0x66, false, 0, 0x0f57, d.reg, s, 0);
+		break;
+	case X_CVTSI2SDQ:
+		encode_rm(a, 0xf2, true, 0, 0x0f2a, d.reg, s, 0);
+		break;
+	case X_CVTTSD2SIQ:
+		encode_rm(a, 0xf2, true, 0, 0x0f2c, d.reg, s, 0);
+		break;
+	case X_MOVQX:
+		if (s.kind == X_XMM)
+			encode_rm(a, 0x66, true, 0, 0x0f7e, s.reg, d, 0);
+		else
+			encode_rm(a, 0x66, true, 0, 0x0f6e, d.reg, s, 0);
+		break;
+	}
+}
+
+/*
+ * Encodes an instruction of opcode, one or two bytes, after its
+ * mandatory prefix if any, with register or extension reg and
+ * register or memory operand o, to be followed by trailing bytes of
+ * immediate. Bit 1 of bytes marks reg a byte register, bit 2 marks
+ * o one, for which a REX prefix selects %sil and %dil over %dh and
+ * %bh.
+ */
+static void encode_rm(struct assembler *a, int prefix, bool w, int bytes,
+                      unsigned opcode, int reg, struct x86_operand o,
+                      int trailing)
+{
+	if (prefix)
+		put(a, prefix);
+	int rex = (w ? 8 : 0) | ((reg & 8) ? 4 : 0);
+	if (o.kind == X_MEM && o.index >= 0 && (o.index & 8))
+		rex |= 2;
+	if (o.kind != X_RIP && (o.reg & 8))
+		rex |= 1;
+	bool low = ((bytes & 1) && reg >= 4 && reg < 8)
+		|| ((bytes & 2) && o.kind == X_REG && o.reg >= 4 && o.reg < 8);
+	if (rex || low)
+		put(a, 0x40 | rex);
+	if (opcode > 0xff)
+		put(a, opcode >> 8);
+	put(a, opcode & 0xff);
+
+	switch (o.kind) {
+	case X_REG:
+	case X_XMM:
+		put(a, 0xc0 | (reg & 7) << 3 | (o.reg & 7));
+		break;
+	case X_RIP:
+		put(a, (reg & 7) << 3 | 5);
+		/* relative to the end of the instruction */
+		if (o.symbol)
+			object_relocate(a->object, a->size, R_X86_64_PC32, o.symbol,
+			                o.disp - 4 - trailing);
+		else
+			add_fixup(a, o.value, -1, a->size + 4 + trailing);
+		put_imm(a, 0, 4);
+		break;
+	case X_MEM: {
+		/* %rsp and %r12 need a SIB, %rbp and %r13 a displacement */
+		bool sib = o.index >= 0 || (o.reg & 7) == RSP;
+		int mod = (o.disp == 0 && (o.reg & 7) != RBP) ? 0
+			: fits8(o.disp) ? 1 : 2;
+		put(a, mod << 6 | (reg & 7) << 3 | (sib ? 4 : (o.reg & 7)));
+		if (sib) {
+			int scale = (o.scale == 8) ? 3 : (o.scale == 4) ? 2
+				: (o.scale == 2) ? 1 : 0;
+			int index = (o.index >= 0) ? o.index : RSP;
+			put(a, scale << 6 | (index & 7) << 3 | (o.reg & 7));
+		}
+		if (mod == 1)
+			put_imm(a, o.disp, 1);
+		else if (mod == 2)
+			put_imm(a, o.disp, 4);
+		break;
+	}
+	default:
+		log_error("operand kind %d not encodable", o.kind);
+	}
+}
+
+/* encodes a move of 8, 4, or 1 bytes, loads being of 8 or 4 */
+static void encode_mov(struct assembler *a, struct x86_insn *insn)
+{
+	struct x86_operand s = insn->src;
+	struct x86_operand d = insn->dst;
+	bool w = insn->code == X_MOVQ;
+	bool byte = insn->code == X_MOVB;
+	if (s.kind == X_IMM && d.kind == X_REG && w && !fits32(s.value)) {
+		put(a, 0x48 | ((d.reg & 8) ? 1 : 0));
+		put(a, 0xb8 + (d.reg & 7));
+		put_imm(a, s.value, 8);
+	} else if (s.kind == X_IMM) {
+		int size = byte ? 1 : 4;
+		encode_rm(a, 0, w, 0, byte ? 0xc6 : 0xc7, 0, d, size);
+		put_imm(a, s.value, size);
+	} else if (s.kind == X_REG) {
+		encode_rm(a, 0, w, byte ? 1 : 0, byte ? 0x88 : 0x89, s.reg, d, 0);
+	} else {
+		encode_rm(a, 0, w, 0, 0x8b, d.reg, s, 0);
+	}
+}
+
+/* encodes arithmetic of extension n: add, or, and, sub, xor, or cmp */
+static void encode_alu(struct assembler *a, struct x86_insn *insn, int n)
+{
+	struct x86_operand s = insn->src;
+	struct x86_operand d = insn->dst;
+	bool w = insn->code != X_CMPL;
+	if (s.kind == X_IMM && !fits8(s.value) && d.kind == X_REG
+	    && d.reg == RAX) {
+		/* short form for the accumulator */
+		if (w)
+			put(a, 0x48);
+		put(a, 8 * n + 5);
+		put_imm(a, s.value, 4);
+	} else if (s.kind == X_IMM) {
+		int size = fits8(s.value) ? 1 : 4;
+		encode_rm(a, 0, w, 0, size == 1 ? 0x83 : 0x81, n, d, size);
+		put_imm(a, s.value, size);
+	} else if (s.kind == X_REG) {
+		encode_rm(a, 0, w, 0, 8 * n + 1, s.reg, d, 0);
+	} else {
+		encode_rm(a, 0, w, 0, 8 * n + 3, d.reg, s, 0);
+	}
+}
+
+/* encodes a shift of extension n, by an immediate or by %cl */
+static void encode_shift(struct assembler *a, struct x86_insn *insn,
+                         bool w, int n)
+{
+	if (insn->src.kind == X_IMM && insn->src.value == 1) {
+		encode_rm(a, 0, w, 0, 0xd1, n, insn->dst, 0);
+	} else if (insn->src.kind == X_IMM) {
+		encode_rm(a, 0, w, 0, 0xc1, n, insn->dst, 1);
+		put_imm(a, insn->src.value, 1);
+	} else {
+		encode_rm(a, 0, w, 0, 0xd3, n, insn->dst, 0);
+	}
+}
+
+/* encodes a jump to label, always with a 4 byte displacement */
+static void encode_jump(struct assembler *a, unsigned opcode, long label)
+{
+	if (opcode > 0xff)
+		put(a, opcode >> 8);
+	put(a, opcode & 0xff);
+	add_fixup(a, label, -1, a->size + 4);
+	put_imm(a, 0, 4);
+}
+
+static void put(struct assembler *a, unsigned char byte)
+{
+	if (a->size == a->capacity) {
+		a->capacity = a->capacity ? 2 * a->capacity : 4096;
+		a->bytes = realloc(a->bytes, a->capacity);
+		log_assert(a->bytes);
+	}
+	a->bytes[a->size++] = byte;
+}
+
+/* puts value as size bytes, least significant first */
+static void put_imm(struct assembler *a, long value, int size)
+{
+	for (int b = 0; b < size; ++b)
+		put(a, (unsigned long)value >> (8 * b));
+}
+
+static void place_label(struct assembler *a, long label)
+{
+	if ((size_t)label >= a->label_count) {
+		size_t count = 2 * label + 16;
+		a->labels = realloc(a->labels, count * sizeof(*a->labels));
+		log_assert(a->labels);
+		memset(a->labels + a->label_count, 0,
+		       (count - a->label_count) * sizeof(*a->labels));
+		a->label_count = count;
+	}
+	a->labels[label] = a->size + 1;
+}
+
+/* patches the 4 bytes about to be put with label, less from or end */
+static void add_fixup(struct assembler *a, long label, long from, size_t end)
+{
+	a->fixups = realloc(a->fixups, (a->fixup_count + 1) * sizeof(*a->fixups));
+	log_assert(a->fixups);
+	struct fixup f = { a->size, label, from, end };
+	a->fixups[a->fixup_count++] = f;
+}
+
+static bool fits8(long value)
+{
+	return value >= -128 && value <= 127;
+}
+
+static bool fits32(long value)
+{
+	return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+#undef p
@@ -0,0 +1,134 @@
+/*
+ * x86.h - x86-64 instructions for native code generation.
+ *
+ * Copyright (C) 2014 Andrew Schwartzmeyer
+ *
+ * This file released under the AGPLv3 license.
+ */
+
+#ifndef X86_H
+#define X86_H
+
+#include <stdio.h>
+
+struct list;
+struct op;
+struct object;
+
+/* general purpose registers, numbered as encoded */
+enum x86_reg {
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+/* condition codes, numbered as encoded */
+enum x86_cc {
+	CC_O, CC_NO, CC_B, CC_AE, CC_E, CC_NE, CC_BE, CC_A,
+	CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_GE, CC_LE, CC_G,
+};
+
+enum x86_code {
+	/* pseudo instructions */
+	X_OP,        /* comment with the op being lowered */
+	X_PROC,      /* global function symbol */
+	X_LABEL,     /* local label */
+	X_ENTRY,     /* jump table entry, offset of label from table */
+	/* moves, suffixed by size of memory operand */
+	X_MOVQ,
+	X_MOVL,      /* store low 4 bytes */
+	X_MOVB,      /* store low byte */
+	X_MOVSLQ,    /* load 4 bytes, sign extended */
+	X_MOVSBQ,    /* load byte, sign extended */
+	X_MOVZBQ,    /* load byte, zero extended */
+	X_LEAQ,
+	/* integer arithmetic on whole registers */
+	X_ADDQ,
+	X_SUBQ,
+	X_IMULQ,
+	X_ANDQ,
+	X_ORQ,
+	X_XORQ,
+	X_CMPQ,
+	X_CMPL,      /* compare 4 bytes, as ints in memory */
+	X_TESTQ,
+	X_NEGQ,
+	X_IDIVQ,
+	X_CQTO,
+	X_SARQ,
+	/* 32 bit shifts by %cl */
+	X_SHLL,
+	X_SHRL,
+	X_SARL,
+	/* control */
+	X_SETCC,
+	X_JCC,
+	X_JMP,
+	X_JMPR,      /* indirect jump through register */
+	X_CALL,
+	X_RET,
+	X_LEAVE,
+	X_PUSHQ,
+	X_POPQ,
+	X_REP_MOVSB,
+	/* scalar doubles */
+	X_MOVSD,
+	X_ADDSD,
+	X_SUBSD,
+	X_MULSD,
+	X_DIVSD,
+	X_UCOMISD,
+	X_XORPD,
+	X_CVTSI2SDQ,
+	X_CVTTSD2SIQ,
+	X_MOVQX,     /* move bits between general and xmm registers */
+};
+
+enum x86_kind {
+	X_NONE,
+	X_REG,
+	X_XMM,
+	X_IMM,
+	X_MEM,       /* disp(base, index, scale) */
+	X_RIP,       /* symbol + disp, else label + disp, relative to %rip */
+	X_TARGET,    /* label jumped to */
+	X_SYMBOL,    /* procedure called */
+};
+
+struct x86_operand {
+	enum x86_kind kind;
+	int reg;            /* register, or base of memory */
+	int index;          /* index register of memory, else -1 */
+	int scale;
+	long disp;
+	long value;         /* immediate, or label */
+	const char *symbol;
+};
+
+/* an instruction in AT&T operand order, unary ones using dst */
+struct x86_insn {
+	enum x86_code code;
+	enum x86_cc cc;
+	struct x86_operand src;
+	struct x86_operand dst;
+	struct op *op;      /* of X_OP */
+};
+
+extern const struct x86_operand x86_none;
+
+struct x86_operand x86_reg(int reg);
+struct x86_operand x86_xmm(int reg);
+struct x86_operand x86_imm(long value);
+struct x86_operand x86_mem(int base, long disp);
+struct x86_operand x86_index(int base, int index, int scale, long disp);
+struct x86_operand x86_rip(const char *symbol, long disp);
+struct x86_operand x86_label(long label);
+struct x86_operand x86_symbol(const char *symbol);
+
+struct x86_insn *x86_emit(struct list *code, enum x86_code c,
+                          struct x86_operand src, struct x86_operand dst);
+struct x86_insn *x86_emit_cc(struct list *code, enum x86_code c,
+                             enum x86_cc cc, struct x86_operand dst);
+void x86_print(FILE *stream, struct list *code);
+void x86_assemble(struct list *code, struct object *o);
+
+#endif /* X86_H */